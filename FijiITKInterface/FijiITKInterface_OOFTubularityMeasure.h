@@ -15,6 +15,62 @@ extern "C" {
 JNIEXPORT jint JNICALL Java_FijiITKInterface_OOFTubularityMeasure_OrientedFlux
   (JNIEnv *, jobject, jbyteArray, jfloatArray, jint, jint, jint, jint, jdouble, jdouble, jdouble, jdouble, jdouble, jint, jstring);
 
+/*
+ * Class:     FijiITKInterface_OOFTubularityMeasure
+ * Method:    OrientedFluxGray16
+ * Signature: ([S[FIIIIDDDDDILjava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_FijiITKInterface_OOFTubularityMeasure_OrientedFluxGray16
+  (JNIEnv *, jobject, jshortArray, jfloatArray, jint, jint, jint, jint, jdouble, jdouble, jdouble, jdouble, jdouble, jint, jstring);
+
+/*
+ * Class:     FijiITKInterface_OOFTubularityMeasure
+ * Method:    OrientedFluxGray32
+ * Signature: ([F[FIIIIDDDDDILjava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_FijiITKInterface_OOFTubularityMeasure_OrientedFluxGray32
+  (JNIEnv *, jobject, jfloatArray, jfloatArray, jint, jint, jint, jint, jdouble, jdouble, jdouble, jdouble, jdouble, jint, jstring);
+
+/*
+ * Class:     FijiITKInterface_OOFTubularityMeasure
+ * Method:    setMetricsEnabled
+ * Signature: (Z)V
+ */
+JNIEXPORT void JNICALL Java_FijiITKInterface_OOFTubularityMeasure_setMetricsEnabled
+  (JNIEnv *, jobject, jboolean);
+
+/*
+ * Class:     FijiITKInterface_OOFTubularityMeasure
+ * Method:    getMetrics
+ * Signature: ()Ljava/lang/String;
+ */
+JNIEXPORT jstring JNICALL Java_FijiITKInterface_OOFTubularityMeasure_getMetrics
+  (JNIEnv *, jobject);
+
+/*
+ * Class:     FijiITKInterface_OOFTubularityMeasure
+ * Method:    resetMetrics
+ * Signature: ()V
+ */
+JNIEXPORT void JNICALL Java_FijiITKInterface_OOFTubularityMeasure_resetMetrics
+  (JNIEnv *, jobject);
+
+/*
+ * Class:     FijiITKInterface_OOFTubularityMeasure
+ * Method:    setTraceEventsEnabled
+ * Signature: (Z)V
+ */
+JNIEXPORT void JNICALL Java_FijiITKInterface_OOFTubularityMeasure_setTraceEventsEnabled
+  (JNIEnv *, jobject, jboolean);
+
+/*
+ * Class:     FijiITKInterface_OOFTubularityMeasure
+ * Method:    writeTraceEvents
+ * Signature: (Ljava/lang/String;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_FijiITKInterface_OOFTubularityMeasure_writeTraceEvents
+  (JNIEnv *, jobject, jstring);
+
 #ifdef __cplusplus
 }
 #endif
@@ -7,14 +7,6 @@
 #ifdef __cplusplus
 extern "C" {
 #endif
-/*
- * Class:     FijiITKInterface_TubularGeodesics
- * Method:    GetPath
- * Signature: ([F)I
- */
-JNIEXPORT jint JNICALL Java_FijiITKInterface_TubularGeodesics_GetPath
-  (JNIEnv *, jobject, jfloatArray);
-
 /*
  * Class:     FijiITKInterface_TubularGeodesics
  * Method:    FindPath
@@ -23,14 +15,6 @@ JNIEXPORT jint JNICALL Java_FijiITKInterface_TubularGeodesics_GetPath
 JNIEXPORT jint JNICALL Java_FijiITKInterface_TubularGeodesics_FindPath
   (JNIEnv *, jobject, jfloatArray, jintArray, jintArray, jfloatArray, jint, jint, jint, jint, jdouble, jdouble, jdouble);
 
-/*
- * Class:     FijiITKInterface_TubularGeodesics
- * Method:    OrientedFlux
- * Signature: ([B[FIIIIDDDDDI[F[F)I
- */
-JNIEXPORT jint JNICALL Java_FijiITKInterface_TubularGeodesics_OrientedFlux
-  (JNIEnv *, jobject, jbyteArray, jfloatArray, jint, jint, jint, jint, jdouble, jdouble, jdouble, jdouble, jdouble, jint, jfloatArray, jfloatArray);
-
 /*
  * Class:     FijiITKInterface_TubularGeodesics
  * Method:    startSearch
@@ -47,6 +31,206 @@ JNIEXPORT void JNICALL Java_FijiITKInterface_TubularGeodesics_startSearch
 JNIEXPORT void JNICALL Java_FijiITKInterface_TubularGeodesics_interruptSearch
   (JNIEnv *, jobject);
 
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    interruptSearchOf
+ * Signature: (Ltracing/TubularGeodesicsTracer;)V
+ */
+JNIEXPORT void JNICALL Java_FijiITKInterface_TubularGeodesics_interruptSearchOf
+  (JNIEnv *, jobject, jobject);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    setMaximumNumberOfSearchThreads
+ * Signature: (I)V
+ */
+JNIEXPORT void JNICALL Java_FijiITKInterface_TubularGeodesics_setMaximumNumberOfSearchThreads
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    openSession
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_FijiITKInterface_TubularGeodesics_openSession
+  (JNIEnv *, jobject);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    closeSession
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_FijiITKInterface_TubularGeodesics_closeSession
+  (JNIEnv *, jobject, jlong);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    loadScoreFromFile
+ * Signature: (JLjava/lang/String;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_FijiITKInterface_TubularGeodesics_loadScoreFromFile
+  (JNIEnv *, jobject, jlong, jstring);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    loadScoreFromBuffer
+ * Signature: (J[FIIIIDDDDD)Z
+ */
+JNIEXPORT jboolean JNICALL Java_FijiITKInterface_TubularGeodesics_loadScoreFromBuffer
+  (JNIEnv *, jobject, jlong, jfloatArray, jint, jint, jint, jint, jdouble, jdouble, jdouble, jdouble, jdouble);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    computeScore
+ * Signature: (J[BIIIDDDDDI)Z
+ */
+JNIEXPORT jboolean JNICALL Java_FijiITKInterface_TubularGeodesics_computeScore
+  (JNIEnv *, jobject, jlong, jbyteArray, jint, jint, jint, jdouble, jdouble, jdouble, jdouble, jdouble, jint);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    computeScoreGray16
+ * Signature: (J[SIIIDDDDDI)Z
+ */
+JNIEXPORT jboolean JNICALL Java_FijiITKInterface_TubularGeodesics_computeScoreGray16
+  (JNIEnv *, jobject, jlong, jshortArray, jint, jint, jint, jdouble, jdouble, jdouble, jdouble, jdouble, jint);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    computeScoreGray32
+ * Signature: (J[FIIIDDDDDI)Z
+ */
+JNIEXPORT jboolean JNICALL Java_FijiITKInterface_TubularGeodesics_computeScoreGray32
+  (JNIEnv *, jobject, jlong, jfloatArray, jint, jint, jint, jdouble, jdouble, jdouble, jdouble, jdouble, jint);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    getScore
+ * Signature: (J[F)Z
+ */
+JNIEXPORT jboolean JNICALL Java_FijiITKInterface_TubularGeodesics_getScore
+  (JNIEnv *, jobject, jlong, jfloatArray);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    tracePath
+ * Signature: (J[F[F)[F
+ */
+JNIEXPORT jfloatArray JNICALL Java_FijiITKInterface_TubularGeodesics_tracePath
+  (JNIEnv *, jobject, jlong, jfloatArray, jfloatArray);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    previewPath
+ * Signature: (J[F[F)[F
+ */
+JNIEXPORT jfloatArray JNICALL Java_FijiITKInterface_TubularGeodesics_previewPath
+  (JNIEnv *, jobject, jlong, jfloatArray, jfloatArray);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    tracePathThroughWaypoints
+ * Signature: (J[F)[F
+ */
+JNIEXPORT jfloatArray JNICALL Java_FijiITKInterface_TubularGeodesics_tracePathThroughWaypoints
+  (JNIEnv *, jobject, jlong, jfloatArray);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    addTracedPath
+ * Signature: (J[F)J
+ */
+JNIEXPORT jlong JNICALL Java_FijiITKInterface_TubularGeodesics_addTracedPath
+  (JNIEnv *, jobject, jlong, jfloatArray);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    removeTracedPath
+ * Signature: (JJ)Z
+ */
+JNIEXPORT jboolean JNICALL Java_FijiITKInterface_TubularGeodesics_removeTracedPath
+  (JNIEnv *, jobject, jlong, jlong);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    clearTracedPaths
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_FijiITKInterface_TubularGeodesics_clearTracedPaths
+  (JNIEnv *, jobject, jlong);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    snapToTracedPath
+ * Signature: (J[FD)[D
+ */
+JNIEXPORT jdoubleArray JNICALL Java_FijiITKInterface_TubularGeodesics_snapToTracedPath
+  (JNIEnv *, jobject, jlong, jfloatArray, jdouble);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    findTracedVerticesInRadius
+ * Signature: (J[FD)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_FijiITKInterface_TubularGeodesics_findTracedVerticesInRadius
+  (JNIEnv *, jobject, jlong, jfloatArray, jdouble);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    findOverlappingTracedPaths
+ * Signature: (J[FD)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_FijiITKInterface_TubularGeodesics_findOverlappingTracedPaths
+  (JNIEnv *, jobject, jlong, jfloatArray, jdouble);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    startSessionSearch
+ * Signature: (J[F[FLtracing/PathResult;Ltracing/TubularGeodesicsTracer;)V
+ */
+JNIEXPORT void JNICALL Java_FijiITKInterface_TubularGeodesics_startSessionSearch
+  (JNIEnv *, jobject, jlong, jfloatArray, jfloatArray, jobject, jobject);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    setMetricsEnabled
+ * Signature: (Z)V
+ */
+JNIEXPORT void JNICALL Java_FijiITKInterface_TubularGeodesics_setMetricsEnabled
+  (JNIEnv *, jobject, jboolean);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    getMetrics
+ * Signature: ()Ljava/lang/String;
+ */
+JNIEXPORT jstring JNICALL Java_FijiITKInterface_TubularGeodesics_getMetrics
+  (JNIEnv *, jobject);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    resetMetrics
+ * Signature: ()V
+ */
+JNIEXPORT void JNICALL Java_FijiITKInterface_TubularGeodesics_resetMetrics
+  (JNIEnv *, jobject);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    setTraceEventsEnabled
+ * Signature: (Z)V
+ */
+JNIEXPORT void JNICALL Java_FijiITKInterface_TubularGeodesics_setTraceEventsEnabled
+  (JNIEnv *, jobject, jboolean);
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    writeTraceEvents
+ * Signature: (Ljava/lang/String;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_FijiITKInterface_TubularGeodesics_writeTraceEvents
+  (JNIEnv *, jobject, jstring);
+
 #ifdef __cplusplus
 }
 #endif
@@ -5,5 +5,19 @@ import fiji.jni.LibraryLoader;
 public class OOFTubularityMeasure extends LibraryLoader {
 
     public native int OrientedFlux(byte [] imageIn,float [] imageOut, int type, int width, int height, int Nslice, double pixwidth, double pixheight, double pixdepth, double sigmaMin, double sigmaMax, int scales, String outputFilename);
+    public native int OrientedFluxGray16(short [] imageIn,float [] imageOut, int type, int width, int height, int Nslice, double pixwidth, double pixheight, double pixdepth, double sigmaMin, double sigmaMax, int scales, String outputFilename);
+    public native int OrientedFluxGray32(float [] imageIn,float [] imageOut, int type, int width, int height, int Nslice, double pixwidth, double pixheight, double pixdepth, double sigmaMin, double sigmaMax, int scales, String outputFilename);
+
+    /* Timers, counters and gauges of the oriented flux stages, as one
+       JSON object. Nothing is recorded until setMetricsEnabled(true) is
+       called. */
+    public native void setMetricsEnabled(boolean enabled);
+    public native String getMetrics();
+    public native void resetMetrics();
+
+    /* Timeline of the stages, one track per native thread, written as a
+       trace event file that chrome://tracing and Perfetto can open. */
+    public native void setTraceEventsEnabled(boolean enabled);
+    public native boolean writeTraceEvents(String filename);
 }
 
@@ -97,16 +97,13 @@ public class OOFTubularityMeasure_Plugin implements MouseListener, MouseMotionLi
             return;
         }
 
-		//TODO: possible types are : GRAY8 GRAY16 and GRAY32.
         int imageType = imagePlus.getType();
-        if( ! (imageType == ImagePlus.GRAY8 || imageType == ImagePlus.COLOR_256) ) {
-            IJ.error("Not an 8-bit image");
+        if( ! (imageType == ImagePlus.GRAY8 || imageType == ImagePlus.COLOR_256 ||
+               imageType == ImagePlus.GRAY16 || imageType == ImagePlus.GRAY32) ) {
+            IJ.error("Not an 8-bit, 16-bit or 32-bit grayscale image");
             return;
         }
 
-        ByteProcessor bp = (ByteProcessor)imagePlus.getProcessor();
-        byte [] pixelData = (byte [])bp.getPixels();
-
 		ROI_p1 = new Point(); ROI_p2 = new Point();
 		ROI_p1.x = 0; ROI_p1.y = 0; ROI_p2.x = imagePlus.getWidth(); ROI_p2.y = imagePlus.getHeight();
 		Slice1 = 1; Slice2 = stack.getSize();
@@ -118,20 +115,36 @@ public class OOFTubularityMeasure_Plugin implements MouseListener, MouseMotionLi
 		Calibration Calib = imagePlus.getCalibration();
 
 		int NSlices = stack.getSize(); int width = imagePlus.getWidth(); int height = imagePlus.getHeight(); 
-	
-		ByteProcessor bpStack;
-        byte [] SlicepixelData = new byte[width*height];
-		byte [] StackpixelData = new byte[width*height*NSlices];
 
+		// Java arrays are indexed with an int
+		if( (long)width * height * NSlices > Integer.MAX_VALUE ) {
+			IJ.error("The stack is too large, it has more than " + Integer.MAX_VALUE + " voxels");
+			return;
+		}
+	
 		float [] StackPixelDataOut = new float[width*height*NSlices];
 
 		///////////////////////////////////
 
-		for(int i=0;i<NSlices;i++){
-			bpStack = (ByteProcessor)stack.getProcessor(i+1);
-			SlicepixelData = (byte [])bpStack.getPixels();
-			for(int j=0;j<width*height;j++)
-				StackpixelData[width*height*i + j] = SlicepixelData[j];
+		// The stack is handed to the native side in its own pixel type,
+		// the conversion to float is done there while padding for the FFT.
+		byte [] BytepixelData = null;
+		short [] ShortpixelData = null;
+		float [] FloatpixelData = null;
+		if( imageType == ImagePlus.GRAY16 ) {
+			ShortpixelData = new short[width*height*NSlices];
+			for(int i=0;i<NSlices;i++)
+				System.arraycopy((short [])stack.getPixels(i+1), 0, ShortpixelData, width*height*i, width*height);
+		}
+		else if( imageType == ImagePlus.GRAY32 ) {
+			FloatpixelData = new float[width*height*NSlices];
+			for(int i=0;i<NSlices;i++)
+				System.arraycopy((float [])stack.getPixels(i+1), 0, FloatpixelData, width*height*i, width*height);
+		}
+		else {
+			BytepixelData = new byte[width*height*NSlices];
+			for(int i=0;i<NSlices;i++)
+				System.arraycopy((byte [])stack.getPixels(i+1), 0, BytepixelData, width*height*i, width*height);
 		}
 
 		//IDE 
@@ -172,7 +185,12 @@ public class OOFTubularityMeasure_Plugin implements MouseListener, MouseMotionLi
 	String outputFilename = getSavePath( Info );
 	System.out.println("writing to outputFilename:"+outputFilename);
 
-        ti.OrientedFlux(StackpixelData, StackPixelDataOut, imageType, width, height, NSlices, Calib.pixelWidth, Calib.pixelHeight, Calib.pixelDepth, minimumScale, maximumScale, scales, outputFilename);
+        if( imageType == ImagePlus.GRAY16 )
+            ti.OrientedFluxGray16(ShortpixelData, StackPixelDataOut, imageType, width, height, NSlices, Calib.pixelWidth, Calib.pixelHeight, Calib.pixelDepth, minimumScale, maximumScale, scales, outputFilename);
+        else if( imageType == ImagePlus.GRAY32 )
+            ti.OrientedFluxGray32(FloatpixelData, StackPixelDataOut, imageType, width, height, NSlices, Calib.pixelWidth, Calib.pixelHeight, Calib.pixelDepth, minimumScale, maximumScale, scales, outputFilename);
+        else
+            ti.OrientedFlux(BytepixelData, StackPixelDataOut, imageType, width, height, NSlices, Calib.pixelWidth, Calib.pixelHeight, Calib.pixelDepth, minimumScale, maximumScale, scales, outputFilename);
 
 		ImageStack newstack = new ImageStack(width, height);
 	
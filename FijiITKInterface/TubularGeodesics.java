@@ -6,9 +6,7 @@ import tracing.TubularGeodesicsTracer;
 
 public class TubularGeodesics extends LibraryLoader {
 
-    public native int GetPath(float [] jba);
     public native int FindPath(float [] Input, int [] pt1, int [] pt2 , float [] Path, int w, int h, int slices,int scales,  double pixw, double pixh, double pixd);
-    public native int OrientedFlux(byte [] imageIn,float [] imageOut, int type, int width, int height, int Nslice, double pixwidth, double pixheight, double pixdepth, double sigmaMin, double sigmaMax, int scales, float [] pt1, float[] pt2);
 
     public native void startSearch(String tubularityFilename,
                                    float [] p1,
@@ -16,6 +14,73 @@ public class TubularGeodesics extends LibraryLoader {
                                    PathResult result,
                                    TubularGeodesicsTracer javaSearchThread);
 
+    /* Searches are queued and run concurrently on a bounded pool of
+       native threads. interruptSearch cancels the ones started from
+       this object, interruptSearchOf only the ones reporting to
+       javaSearchThread. */
     public native void interruptSearch();
+    public native void interruptSearchOf(TubularGeodesicsTracer javaSearchThread);
+    public native void setMaximumNumberOfSearchThreads(int maximumNumberOfThreads);
+
+    /* Sessions keep a tubularity score loaded between searches. The
+       score can be given as a file or as the float array produced by
+       OOFTubularityMeasure (x fastest, scale slowest); a buffer that
+       cannot be loaded raises a RuntimeException. */
+    public native long openSession();
+    public native void closeSession(long session);
+    public native boolean loadScoreFromFile(long session, String tubularityFilename);
+    public native boolean loadScoreFromBuffer(long session, float [] score, int width, int height, int Nslice, int scales, double pixwidth, double pixheight, double pixdepth, double sigmaMin, double sigmaMax);
+
+    /* Computes the score of a stack once and keeps it in the session, a
+       failure, e.g. on a blank stack, being thrown as a RuntimeException;
+       getScore copies it out (x fastest, scale slowest) and tracePath
+       returns the path between two voxels, 4 floats (x, y, z, radius)
+       per vertex in physical coordinates, or null if it failed.
+       previewPath returns an approximate path in the same format within
+       milliseconds, e.g. while the end point is dragged, to be replaced by
+       the exact path of tracePath afterwards. tracePathThroughWaypoints
+       returns the path going through the waypoints in order, 3 floats
+       per waypoint in voxel coordinates, its segments being traced in
+       parallel. */
+    public native boolean computeScore(long session, byte [] image, int width, int height, int Nslice, double pixwidth, double pixheight, double pixdepth, double sigmaMin, double sigmaMax, int scales);
+    public native boolean computeScoreGray16(long session, short [] image, int width, int height, int Nslice, double pixwidth, double pixheight, double pixdepth, double sigmaMin, double sigmaMax, int scales);
+    public native boolean computeScoreGray32(long session, float [] image, int width, int height, int Nslice, double pixwidth, double pixheight, double pixdepth, double sigmaMin, double sigmaMax, int scales);
+    public native boolean getScore(long session, float [] score);
+    public native float [] tracePath(long session, float [] p1, float [] p2);
+    public native float [] previewPath(long session, float [] p1, float [] p2);
+    public native float [] tracePathThroughWaypoints(long session, float [] waypoints);
+
+    /* The paths kept by the user are stored in the session, in the
+       format of tracePath, and indexed for the queries: addTracedPath
+       returns the identifier of the path (0 if it failed), snapToTracedPath
+       the nearest traced vertex within maxDistance of a physical point as
+       {path, vertex number, x, y, z, radius, distance} or null,
+       findTracedVerticesInRadius the {path, vertex number} pairs within a
+       radius, and findOverlappingTracedPaths the traced paths coming within
+       a tolerance of a path. */
+    public native long addTracedPath(long session, float [] path);
+    public native boolean removeTracedPath(long session, long pathId);
+    public native void clearTracedPaths(long session);
+    public native double [] snapToTracedPath(long session, float [] point, double maxDistance);
+    public native long [] findTracedVerticesInRadius(long session, float [] point, double radius);
+    public native long [] findOverlappingTracedPaths(long session, float [] path, double tolerance);
+
+    public native void startSessionSearch(long session,
+                                          float [] p1,
+                                          float [] p2,
+                                          PathResult result,
+                                          TubularGeodesicsTracer javaSearchThread);
+
+    /* Timers, counters and gauges of the marching and of the path
+       extraction, as one JSON object. Nothing is recorded until
+       setMetricsEnabled(true) is called. */
+    public native void setMetricsEnabled(boolean enabled);
+    public native String getMetrics();
+    public native void resetMetrics();
+
+    /* Timeline of the stages, one track per native thread, written as a
+       trace event file that chrome://tracing and Perfetto can open. */
+    public native void setTraceEventsEnabled(boolean enabled);
+    public native boolean writeTraceEvents(String filename);
 
 }
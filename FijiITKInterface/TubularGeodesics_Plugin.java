@@ -45,10 +45,13 @@ public class TubularGeodesics_Plugin implements MouseListener, MouseMotionListen
     boolean ROIpt_1_2 = true;
     Point p, ROI_p1, ROI_p2;
 
-    float [] StackPixelDataOut;
     byte [] StackpixelData;
     Calibration Calib;
 
+    // Native session holding the tubularity score of the stack: it is
+    // computed once in run(), the clicks only trace paths on it.
+    long session = 0;
+
     Image3DUniverse univ;
 
 
@@ -92,6 +95,12 @@ public class TubularGeodesics_Plugin implements MouseListener, MouseMotionListen
 
 	NSlices = stack.getSize(); width = imagePlus.getWidth(); height = imagePlus.getHeight();
 	PxlDth = (float)Calib.pixelDepth; 
+
+	// Java arrays are indexed with an int
+	if( (long)width * height * NSlices > Integer.MAX_VALUE ) {
+		IJ.error("The stack is too large, it has more than " + Integer.MAX_VALUE + " voxels");
+		return;
+	}
 	
 	ByteProcessor bpStack;
     	byte [] SlicepixelData = new byte[width*height];
@@ -140,9 +149,24 @@ public class TubularGeodesics_Plugin implements MouseListener, MouseMotionListen
 	showFilteredImages = gd.getNextBoolean();
 	///////////////////////////////////////
 
-
-	//Create output image (need to know number of scales before)
-	StackPixelDataOut = new float[Nscales*width*height*NSlices];
+	//Compute the scale-space tubularity score once for the whole stack
+	if( session != 0 )
+		ti.closeSession(session);
+	session = ti.openSession();
+	IJ.showStatus("Computing the tubularity score...");
+	// A failure, e.g. a blank stack whose score is uniform, is raised as
+	// a RuntimeException by the native side
+	try {
+		ti.computeScore(session, StackpixelData, width, height, NSlices, Calib.pixelWidth, Calib.pixelHeight, Calib.pixelDepth, minimumScale, maximumScale, Nscales);
+	} catch( RuntimeException e ) {
+		IJ.showStatus("");
+		IJ.error("Computing the tubularity score failed: " + e.getMessage());
+		ti.closeSession(session);
+		session = 0;
+		return;
+	}
+	IJ.showStatus("");
+	showScore();
 
 	// Create a universe and show it
 	univ = new Image3DUniverse();
@@ -155,6 +179,33 @@ public class TubularGeodesics_Plugin implements MouseListener, MouseMotionListen
 
     }
 
+	//Display the score at the first scale, or at all the scales if asked
+	void showScore() {
+		int w = width; int h = height;
+		int scales;if(showFilteredImages) scales = Nscales; else scales = 1;
+		if( (long)scales * w * h * NSlices > Integer.MAX_VALUE ) {
+			IJ.error("The scale-space score is too large to be shown, only the first scale is");
+			scales = 1;
+		}
+		float [] score = new float[scales*w*h*NSlices];
+		if( !ti.getScore(session, score) )
+			return;
+
+		for(int k=0;k<scales;k++){
+			int offset = k*w*h*NSlices;
+			ImageStack newstack = new ImageStack(w,h);
+			for(int i=0;i<NSlices;i++){
+				float[] pix = new float[w*h];
+				System.arraycopy( score, offset + w*h*i, pix, 0, w*h );
+				FloatProcessor proc = new FloatProcessor(w, h, pix, null);
+				newstack.addSlice("", proc);
+			}
+			String nameout = "Tubularity" + k;
+			ImagePlus imp = new ImagePlus(nameout, newstack);
+			imp.show();
+		}
+	}
+
 	public void mouseClicked(MouseEvent me) {
   	}
 
@@ -185,50 +236,18 @@ public class TubularGeodesics_Plugin implements MouseListener, MouseMotionListen
 			float [] pt1 = {ROI_p1.x, ROI_p1.y, Slice1};
 			float [] pt2 = {ROI_p2.x, ROI_p2.y, Slice2}; 
 
-			ti.OrientedFlux(StackpixelData, StackPixelDataOut, imageType, width, height, NSlices, Calib.pixelWidth, Calib.pixelHeight, Calib.pixelDepth, minimumScale, maximumScale, Nscales, pt1, pt2);
-
-			//Print Output image(s)
-			int offset = 0;
-			int w = width; int h = height;
-
-			ImagePlus result_image = new ImagePlus();
-			ImageStack res_stack = new ImageStack(width,height);
-
-			for(int i=0;i<NSlices;i++){
-				float[] pix = new float[w*h]; // get your bytes somehow
-				for(int j=0;j<w*h;j++){
-					pix[j] = StackPixelDataOut[offset + w*h*i + j];
-				}
-				FloatProcessor proc = new FloatProcessor(w, h, pix, null);
-				res_stack.addSlice("", proc);
-			}	
-
-			result_image.setStack(res_stack);
-   			result_image.show();
-
-			//Display scale Images if users said
-			int scales;if(showFilteredImages) scales = Nscales; else scales = 1;
-			for(int k=1;k<scales;k++){
-				if(k>0){offset += w*h*NSlices;}
-				ImageStack newstack = new ImageStack(w,h);
-				for(int i=0;i<NSlices;i++){
-					float[] pix = new float[w*h];
-					for(int j=0;j<w*h;j++){
-						pix[j] = StackPixelDataOut[offset + w*h*i + j];
-					}
-					FloatProcessor proc = new FloatProcessor(w, h, pix, null);
-					newstack.addSlice("", proc);
-				}	
-				String nameout = "Tubularity" + k;
-				ImagePlus imp = new ImagePlus(nameout, newstack);
-				imp.show();
+			//Only the path is computed, on the score kept by the session
+			float [] Path = ti.tracePath(session, pt1, pt2);
+			if( Path == null ) {
+				IJ.error("No path was found between the two points");
+				position_checked = false;
+				return;
 			}
 
 	
 			////////Display all path using cylinders///////
 			float radius1, radius2;int ind =0;
-			float [] Path = new float[w*h*NSlices];
-			int size = ti.GetPath(Path);
+			int size = Path.length;
 
 			boolean resample = false;
 			Color3f realColor = new Color3f(Color.magenta);
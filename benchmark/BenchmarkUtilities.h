@@ -0,0 +1,245 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+// Helpers shared by the benchmarks: parameter lists, peak memory, hardware
+// event counters and the CSV / JSON result rows.
+
+#ifndef __BenchmarkUtilities_h
+#define __BenchmarkUtilities_h
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+/** Parses a comma separated list of numbers, e.g. "128,256,512". */
+template <class T>
+std::vector<T> ParseList(const char* text)
+{
+	std::vector<T> values;
+	std::stringstream stream(text);
+	std::string item;
+	while( std::getline(stream, item, ',') )
+	{
+		if( !item.empty() )
+		{
+			std::stringstream itemStream(item);
+			T value;
+			itemStream >> value;
+			values.push_back(value);
+		}
+	}
+	return values;
+}
+
+/** Peak resident set size of the process so far, in MB. */
+inline double PeakResidentSetSizeMB()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if( GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) )
+	{
+		return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+	}
+	return 0.0;
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return usage.ru_maxrss / (1024.0 * 1024.0); // bytes
+#else
+	return usage.ru_maxrss / 1024.0; // kilobytes
+#endif
+#endif
+}
+
+/** Counter of a hardware event of the process (threads created after
+ * Start() included), through perf_event_open on Linux. Read() returns -1
+ * where the counter is not available: other systems, no permission
+ * (kernel.perf_event_paranoid), or no performance counters in the
+ * virtual machine. */
+class HardwareEventCounter
+{
+public:
+	enum EventType { CacheMisses, DataTLBReadMisses };
+
+	explicit HardwareEventCounter(EventType event): m_FileDescriptor(-1)
+	{
+#ifdef __linux__
+		struct perf_event_attr attributes;
+		memset(&attributes, 0, sizeof(attributes));
+		attributes.size = sizeof(attributes);
+		if( event == CacheMisses )
+		{
+			attributes.type = PERF_TYPE_HARDWARE;
+			attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+		}
+		else
+		{
+			attributes.type = PERF_TYPE_HW_CACHE;
+			attributes.config = PERF_COUNT_HW_CACHE_DTLB |
+				(PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		}
+		attributes.disabled = 1;
+		attributes.inherit = 1;
+		attributes.exclude_kernel = 1;
+		attributes.exclude_hv = 1;
+		m_FileDescriptor = static_cast<int>( syscall(__NR_perf_event_open, &attributes, 0, -1, -1, 0) );
+#else
+		(void)event;
+#endif
+	}
+
+	~HardwareEventCounter()
+	{
+#ifdef __linux__
+		if( m_FileDescriptor >= 0 )
+		{
+			close(m_FileDescriptor);
+		}
+#endif
+	}
+
+	void Start()
+	{
+#ifdef __linux__
+		if( m_FileDescriptor >= 0 )
+		{
+			ioctl(m_FileDescriptor, PERF_EVENT_IOC_RESET, 0);
+			ioctl(m_FileDescriptor, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	void Stop()
+	{
+#ifdef __linux__
+		if( m_FileDescriptor >= 0 )
+		{
+			ioctl(m_FileDescriptor, PERF_EVENT_IOC_DISABLE, 0);
+		}
+#endif
+	}
+
+	/** Number of events between Start() and Stop(), -1 if not available. */
+	long long Read() const
+	{
+#ifdef __linux__
+		long long count = 0;
+		if( m_FileDescriptor >= 0 && read(m_FileDescriptor, &count, sizeof(count)) == sizeof(count) )
+		{
+			return count;
+		}
+#endif
+		return -1;
+	}
+
+private:
+	HardwareEventCounter(const HardwareEventCounter&); //purposely not implemented
+	void operator=(const HardwareEventCounter&); //purposely not implemented
+
+	int m_FileDescriptor;
+};
+
+/** Events per unit of work, -1 if the counter was not available. */
+inline double EventsPer(long long events, double work)
+{
+	return events >= 0 && work > 0.0 ? events / work : -1.0;
+}
+
+/** One row of results: named fields, written in insertion order. */
+class BenchmarkRecord
+{
+public:
+	template <class T>
+	void Add(const std::string& name, const T& value)
+	{
+		std::ostringstream stream;
+		stream << value;
+		m_Fields.push_back( std::make_pair(name, stream.str()) );
+	}
+
+	void AddString(const std::string& name, const std::string& value)
+	{
+		m_Fields.push_back( std::make_pair(name, "\"" + value + "\"") );
+	}
+
+	void WriteCSVHeader(std::ostream& os) const
+	{
+		for(unsigned int i = 0; i < m_Fields.size(); i++)
+		{
+			os << (i ? "," : "") << m_Fields[i].first;
+		}
+		os << std::endl;
+	}
+
+	void WriteCSV(std::ostream& os) const
+	{
+		for(unsigned int i = 0; i < m_Fields.size(); i++)
+		{
+			os << (i ? "," : "") << m_Fields[i].second;
+		}
+		os << std::endl;
+	}
+
+	void WriteJSON(std::ostream& os) const
+	{
+		os << "{";
+		for(unsigned int i = 0; i < m_Fields.size(); i++)
+		{
+			os << (i ? "," : "") << "\"" << m_Fields[i].first << "\":" << m_Fields[i].second;
+		}
+		os << "}" << std::endl;
+	}
+
+	/** Writes the row as CSV, preceded by the header if asked, or as one
+	 * JSON object per line. */
+	void Write(std::ostream& os, bool json, bool header) const
+	{
+		if( json )
+		{
+			this->WriteJSON(os);
+			return;
+		}
+		if( header )
+		{
+			this->WriteCSVHeader(os);
+		}
+		this->WriteCSV(os);
+	}
+
+private:
+	std::vector< std::pair<std::string, std::string> > m_Fields;
+};
+
+#endif
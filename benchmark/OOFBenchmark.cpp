@@ -0,0 +1,276 @@
+// Benchmark of the oriented flux engine on synthetic tube phantoms.
+//
+// Usage:
+//   OOFBenchmark [--sizes 128,256] [--scales 1,5,10,20] [--threads 1,2,4,8]
+//                [--sigma-min 1] [--sigma-max 8] [--repeat 1]
+//                [--format csv|json] [--output file] [--no-fork] [--component-images]
+//
+// Every combination of size (a size^3 phantom), number of scales and number
+// of threads is run. One row is written per run, with the per-stage times
+// of MultiScaleOrientedFluxBasedMeasureFFTImageFilter, the peak resident
+// memory and a nominal GFLOP/s.
+// On POSIX systems each run is done in a child process, so that the peak
+// memory is that of the run alone; --no-fork runs everything in this process.
+// --component-images passes the oriented flux to the measure as planar
+// component images instead of a tensor image.
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+#include "TubePhantom.h"
+#include "BenchmarkUtilities.h"
+#include "itkMultiScaleOrientedFluxBasedMeasureFFTImageFilter.h"
+#include "itkOrientedFluxCrossSectionTraceMeasure.h"
+#include "itkMultiThreader.h"
+#include "itkTimeProbe.h"
+#include <omp.h>
+
+const unsigned int Dimension = 3;
+typedef PhantomImageType																										InputImageType;
+typedef itk::Image<float, Dimension>																				OutputImageType;
+typedef itk::SymmetricSecondRankTensor<float, Dimension>										HessianPixelType;
+typedef itk::Image<HessianPixelType, Dimension>															HessianImageType;
+typedef itk::Image<float, Dimension>																				ScalesImageType;
+typedef itk::OrientedFluxCrossSectionTraceMeasureFilter<HessianImageType, OutputImageType>	MeasureFilterType;
+typedef itk::MultiScaleOrientedFluxBasedMeasureFFTImageFilter< InputImageType,
+	HessianImageType, ScalesImageType, MeasureFilterType, OutputImageType >		MultiScaleFilterType;
+
+struct BenchmarkOptions
+{
+	double SigmaMin;
+	double SigmaMax;
+	unsigned int Repeat;
+	bool JSON;
+	bool UseComponentImages;
+};
+
+void Usage(const char* name)
+{
+	std::cerr << "Usage: " << name << " [--sizes 128,256] [--scales 1,5,10,20] [--threads 1,2,4,8]" << std::endl;
+	std::cerr << "       [--sigma-min 1] [--sigma-max 8] [--repeat 1]" << std::endl;
+	std::cerr << "       [--format csv|json] [--output file] [--no-fork] [--component-images]" << std::endl;
+}
+
+// Nominal number of floating point operations of one scale: a real forward
+// transform and one real inverse transform per tensor component, counted as
+// 2.5 N log2(N) each, and the complex products on the half spectrum. The
+// padded size is computed as in FFTOrientedFluxMatrixImageFilter.
+double NominalFlops(unsigned int size, double radius)
+{
+	const unsigned int numberOfComponents = Dimension * (Dimension + 1) / 2;
+	unsigned int halfWindowSize = static_cast<unsigned int>( vnl_math_rnd(radius) ) + 1;
+	unsigned int padSize = size + 2 * halfWindowSize + 1;
+	while( !itk::VnlFFTCommon::IsDimensionSizeLegal( padSize ) )
+	{
+		padSize++;
+	}
+	double n = std::pow(static_cast<double>(padSize), static_cast<int>(Dimension));
+	double fft = 2.5 * n * std::log(n) / std::log(2.0);
+	double products = 6.0 * 0.5 * n * numberOfComponents;
+	return (1 + numberOfComponents) * fft + products;
+}
+
+BenchmarkRecord RunOnce(unsigned int size, unsigned int numberOfScales, unsigned int numberOfThreads,
+												unsigned int repetition, const BenchmarkOptions& options)
+{
+	itk::MultiThreader::SetGlobalMaximumNumberOfThreads( numberOfThreads );
+	itk::MultiThreader::SetGlobalDefaultNumberOfThreads( numberOfThreads );
+	omp_set_num_threads( numberOfThreads );
+
+	itk::TimeProbe phantomTime;
+	phantomTime.Start();
+	std::vector<TubeSegment> segments = StraightTubes(size, options.SigmaMin, options.SigmaMax);
+	std::vector<TubeSegment> helix = HelixTube(size, 0.5 * (options.SigmaMin + options.SigmaMax));
+	segments.insert(segments.end(), helix.begin(), helix.end());
+	InputImageType::Pointer phantom = MakeTubePhantom(size, segments);
+	phantomTime.Stop();
+
+	MultiScaleFilterType::Pointer filter = MultiScaleFilterType::New();
+	filter->SetInput( phantom );
+	filter->SetSigmaMinimum( options.SigmaMin );
+	filter->SetSigmaMaximum( options.SigmaMax );
+	filter->SetNumberOfSigmaSteps( numberOfScales );
+	filter->SetFixedSigmaForHessianImage( 1.5 );
+	filter->SetGenerateNPlus1DHessianMeasureOutput( true );
+	filter->SetGenerateHessianOutput( false );
+	filter->SetUseComponentImages( options.UseComponentImages );
+	filter->Update();
+
+	MultiScaleFilterType::StageTimesType stageTimes = filter->GetStageTimes();
+
+	double flops = 0.0;
+	for(unsigned int i = 0; i < numberOfScales; i++)
+	{
+		double sigma = options.SigmaMin;
+		if( numberOfScales > 1 )
+		{
+			sigma += i * (options.SigmaMax - options.SigmaMin) / (numberOfScales - 1);
+		}
+		flops += NominalFlops(size, std::sqrt(sigma * sigma + 1.5 * 1.5));
+	}
+
+	BenchmarkRecord record;
+	record.Add("size", size);
+	record.Add("scales", numberOfScales);
+	record.Add("threads", numberOfThreads);
+	record.Add("repetition", repetition);
+	record.Add("component_images", options.UseComponentImages ? 1 : 0);
+	record.Add("phantom_s", phantomTime.GetTotal());
+	const char* stages[] = { "pad", "forwardFFT", "kernel", "multiply", "inverseFFT",
+													 "crop", "copy", "measure", "reduction", "total" };
+	for(unsigned int s = 0; s < sizeof(stages) / sizeof(stages[0]); s++)
+	{
+		record.Add(std::string(stages[s]) + "_s", stageTimes[stages[s]]);
+	}
+	record.Add("peak_rss_mb", PeakResidentSetSizeMB());
+	record.Add("gflops", stageTimes["total"] > 0.0 ? flops / stageTimes["total"] * 1e-9 : 0.0);
+	return record;
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<unsigned int> sizes;
+	sizes.push_back(128);
+	sizes.push_back(256);
+	std::vector<unsigned int> scales;
+	scales.push_back(1);
+	scales.push_back(5);
+	scales.push_back(10);
+	scales.push_back(20);
+	std::vector<unsigned int> threads;
+	for(int t = 1; t <= omp_get_max_threads(); t *= 2)
+	{
+		threads.push_back(t);
+	}
+	BenchmarkOptions options;
+	options.SigmaMin = 1.0;
+	options.SigmaMax = 8.0;
+	options.Repeat = 1;
+	options.JSON = false;
+	options.UseComponentImages = false;
+	std::string outputFileName;
+	bool useFork = true;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if( !strcmp(argv[i], "--sizes") && i+1 < argc )
+		{
+			sizes = ParseList<unsigned int>(argv[++i]);
+		}
+		else if( !strcmp(argv[i], "--scales") && i+1 < argc )
+		{
+			scales = ParseList<unsigned int>(argv[++i]);
+		}
+		else if( !strcmp(argv[i], "--threads") && i+1 < argc )
+		{
+			threads = ParseList<unsigned int>(argv[++i]);
+		}
+		else if( !strcmp(argv[i], "--sigma-min") && i+1 < argc )
+		{
+			options.SigmaMin = atof(argv[++i]);
+		}
+		else if( !strcmp(argv[i], "--sigma-max") && i+1 < argc )
+		{
+			options.SigmaMax = atof(argv[++i]);
+		}
+		else if( !strcmp(argv[i], "--repeat") && i+1 < argc )
+		{
+			options.Repeat = atoi(argv[++i]);
+		}
+		else if( !strcmp(argv[i], "--format") && i+1 < argc )
+		{
+			options.JSON = !strcmp(argv[++i], "json");
+		}
+		else if( !strcmp(argv[i], "--output") && i+1 < argc )
+		{
+			outputFileName = argv[++i];
+		}
+		else if( !strcmp(argv[i], "--no-fork") )
+		{
+			useFork = false;
+		}
+		else if( !strcmp(argv[i], "--component-images") )
+		{
+			options.UseComponentImages = true;
+		}
+		else
+		{
+			Usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::ofstream outputFile;
+	if( !outputFileName.empty() )
+	{
+		outputFile.open( outputFileName.c_str() );
+	}
+	std::ostream& output = outputFileName.empty() ? std::cout : outputFile;
+
+	bool header = true;
+	for(unsigned int s = 0; s < sizes.size(); s++)
+	{
+		for(unsigned int n = 0; n < scales.size(); n++)
+		{
+			for(unsigned int t = 0; t < threads.size(); t++)
+			{
+				for(unsigned int r = 0; r < options.Repeat; r++)
+				{
+					output.flush();
+#ifndef _WIN32
+					pid_t pid = useFork ? fork() : -1;
+					if( pid >= 0 )
+					{
+						if( pid == 0 )
+						{
+							int status = EXIT_SUCCESS;
+							try
+							{
+								RunOnce(sizes[s], scales[n], threads[t], r, options).Write(output, options.JSON, header);
+							}
+							catch (itk::ExceptionObject &e)
+							{
+								std::cerr << e << std::endl;
+								status = EXIT_FAILURE;
+							}
+							output.flush();
+							_exit(status);
+						}
+						int status = 0;
+						waitpid(pid, &status, 0);
+						if( !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS )
+						{
+							std::cerr << "Run failed: size " << sizes[s] << ", " << scales[n] << " scales, "
+												<< threads[t] << " threads" << std::endl;
+							continue;
+						}
+						header = false;
+						continue;
+					}
+#endif
+					try
+					{
+						RunOnce(sizes[s], scales[n], threads[t], r, options).Write(output, options.JSON, header);
+						header = false;
+					}
+					catch (itk::ExceptionObject &e)
+					{
+						std::cerr << e << std::endl;
+					}
+				}
+			}
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,461 @@
+// Benchmark of the fast marching and of the path extraction on synthetic
+// scale-space tubularity scores.
+//
+// Usage:
+//   TracingBenchmark [--sizes 64,128,192] [--scales 8] [--cases straight,helix,branching,noise]
+//                    [--layouts scale-major,voxel-major,bricked] [--storages row-major,bricked]
+//                    [--path-extraction descent|predecessor] [--solver fast-marching|dijkstra]
+//                    [--connectivity 4] [--noise 0.3] [--repeat 1]
+//                    [--format csv|json] [--output file] [--no-fork]
+//
+// For every case, size (a size^3 x scales score) and number of scales, a
+// path is traced between the two ends of the tube with
+// TubularMetricToPathFilter, on the sub region the tracing session would use.
+// One row is written per run with the marching statistics (accepted voxels
+// per second, heap pushes, peak heap size, stale pops), the memory of the
+// gradient image, the back-tracing statistics and the end-to-end latency.
+// The cases are:
+//   straight   one straight tube,
+//   helix      a helical tube,
+//   branching  a branching tree, traced from the root to the last leaf,
+//   noise      the straight tube with uniform noise added to the response.
+// The layouts are those of the score read by the fast marching:
+//   scale-major  the Image<float,4>, the scales of a voxel a volume apart,
+//   voxel-major  VoxelMajorScoreImageFunction, the scales of a voxel contiguous,
+//   bricked      the same in bricks of 4^3 voxels.
+// The storages are those of the working images of the fast marching:
+//   row-major  the level set, label and gradient images,
+//   bricked    Z-order bricks of 8^3 voxels (UseBrickedStorage).
+// The paths are extracted by the Runge-Kutta descent along the
+// characteristic directions (descent, the default) or by walking the
+// predecessors recorded by the marching (predecessor), in which case the
+// gradient_mb column is the memory of the predecessor image.
+// With --solver dijkstra the fast marching is replaced by the approximate
+// Dijkstra solver, with the given connectivity (4 is the full 80 neighbors
+// of the 4D score), and the marching columns are those of the Dijkstra
+// propagation.
+// Where the hardware counters are available (Linux, perf_event_open
+// allowed) the cache misses and the data TLB read misses of the tracing are
+// reported per accepted voxel, -1 otherwise.
+// Besides the marching, each run times the search of the best scale of all
+// the voxels of the region (best_scale_s), as the session does for the ends
+// of a path.
+// On POSIX systems each run is done in a child process, so that the peak
+// memory is that of the run alone; --no-fork runs everything in this process.
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+#include "TubePhantom.h"
+#include "BenchmarkUtilities.h"
+#include "itkTubularMetricToPathFilter.h"
+#include "itkVoxelMajorScoreImageFunction.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkTimeProbe.h"
+
+const unsigned int Dimension = 3;
+typedef ScorePhantomImageType																		TubularityScoreImageType;
+typedef TubularityScoreImageType::IndexType											IndexType;
+typedef TubularityScoreImageType::SizeType											SizeType;
+typedef TubularityScoreImageType::RegionType										RegionType;
+typedef TubularityScoreImageType::IndexValueType								IndexValueType;
+typedef itk::TubularMetricToPathFilter< TubularityScoreImageType >	PathFilterType;
+typedef itk::VoxelMajorScoreImageFunction< TubularityScoreImageType >	VoxelMajorScoreType;
+
+struct BenchmarkOptions
+{
+	double SigmaMin;
+	double SigmaMax;
+	double NoiseLevel;
+	std::string PathExtraction;
+	std::string Solver;
+	unsigned int Connectivity;
+	unsigned int Repeat;
+	bool JSON;
+};
+
+void Usage(const char* name)
+{
+	std::cerr << "Usage: " << name << " [--sizes 64,128,192] [--scales 8]" << std::endl;
+	std::cerr << "       [--cases straight,helix,branching,noise] [--layouts scale-major,voxel-major,bricked]" << std::endl;
+	std::cerr << "       [--storages row-major,bricked] [--path-extraction descent|predecessor]" << std::endl;
+	std::cerr << "       [--solver fast-marching|dijkstra] [--connectivity 4]" << std::endl;
+	std::cerr << "       [--noise 0.3] [--repeat 1]" << std::endl;
+	std::cerr << "       [--format csv|json] [--output file] [--no-fork]" << std::endl;
+}
+
+// Tube of a case, and the two ends between which the path is traced.
+std::vector<TubeSegment> MakeCase(const std::string& name, unsigned int size, const BenchmarkOptions& options,
+																	const double*& start, const double*& end)
+{
+	std::vector<TubeSegment> segments;
+	const double radius = 0.5 * (options.SigmaMin + options.SigmaMax);
+	if( name == "helix" )
+	{
+		segments = HelixTube(size, radius);
+	}
+	else if( name == "branching" )
+	{
+		segments = BranchingTubes(size, options.SigmaMax);
+	}
+	else if( name == "straight" || name == "noise" )
+	{
+		segments.push_back( StraightTubes(size, radius, radius).front() );
+	}
+	else
+	{
+		itkGenericExceptionMacro(<< "Unknown case: " << name);
+	}
+	start = segments.front().Start;
+	end = segments.back().End;
+	return segments;
+}
+
+// Nearest score index of a point of the tube, with the scale of the radius.
+IndexType ToScoreIndex(const double* point, double radius, const TubularityScoreImageType* score)
+{
+	IndexType index;
+	for(unsigned int i = 0; i < Dimension; i++)
+	{
+		index[i] = static_cast<IndexValueType>( vnl_math_rnd( point[i] ) );
+	}
+	double scale = (radius - score->GetOrigin()[Dimension]) / score->GetSpacing()[Dimension];
+	IndexValueType maxScale = score->GetLargestPossibleRegion().GetSize()[Dimension] - 1;
+	index[Dimension] = vnl_math_max(IndexValueType(0), vnl_math_min(maxScale, IndexValueType( vnl_math_rnd(scale) )));
+	return index;
+}
+
+// Best scale of a voxel, read from the score image.
+IndexValueType BestScaleIndex(const TubularityScoreImageType* score, IndexType index)
+{
+	const RegionType& region = score->GetBufferedRegion();
+	IndexValueType bestScaleIndex = region.GetIndex()[Dimension];
+	float bestScore = itk::NumericTraits<float>::NonpositiveMin();
+	for(IndexValueType s = region.GetIndex()[Dimension];
+			s < region.GetIndex()[Dimension] + IndexValueType(region.GetSize()[Dimension]); s++)
+	{
+		index[Dimension] = s;
+		if( bestScore < score->GetPixel(index) )
+		{
+			bestScore = score->GetPixel(index);
+			bestScaleIndex = s;
+		}
+	}
+	return bestScaleIndex;
+}
+
+BenchmarkRecord RunOnce(const std::string& caseName, const std::string& layout, const std::string& storage,
+												unsigned int size, unsigned int numberOfScales, unsigned int repetition,
+												const BenchmarkOptions& options)
+{
+	if( storage != "row-major" && storage != "bricked" )
+	{
+		itkGenericExceptionMacro(<< "Unknown storage: " << storage);
+	}
+	if( options.PathExtraction != "descent" && options.PathExtraction != "predecessor" )
+	{
+		itkGenericExceptionMacro(<< "Unknown path extraction: " << options.PathExtraction);
+	}
+	if( options.Solver != "fast-marching" && options.Solver != "dijkstra" )
+	{
+		itkGenericExceptionMacro(<< "Unknown solver: " << options.Solver);
+	}
+
+	itk::TimeProbe phantomTime;
+	phantomTime.Start();
+	const double* startPoint = 0;
+	const double* endPoint = 0;
+	std::vector<TubeSegment> segments = MakeCase(caseName, size, options, startPoint, endPoint);
+	double noiseLevel = caseName == "noise" ? options.NoiseLevel : 0.0;
+	TubularityScoreImageType::Pointer score = MakeTubularityScorePhantom(size, numberOfScales,
+																																			 options.SigmaMin, options.SigmaMax,
+																																			 segments, noiseLevel, 1e5, repetition + 1);
+	phantomTime.Stop();
+
+	IndexType start = ToScoreIndex(startPoint, segments.front().Radius, score);
+	IndexType end = ToScoreIndex(endPoint, segments.back().Radius, score);
+
+	// Same sub region as TubularGeodesicsSession: the bounding box of the
+	// two points padded by 20 voxels, all the scales.
+	RegionType region = score->GetBufferedRegion();
+	IndexType subRegionStart;
+	SizeType subRegionSize;
+	subRegionStart[Dimension] = region.GetIndex()[Dimension];
+	subRegionSize[Dimension] = region.GetSize()[Dimension];
+	const IndexValueType subRegionPad = 20;
+	for(unsigned int i = 0; i < Dimension; i++)
+	{
+		IndexValueType minIndex = vnl_math_min( start[i], end[i] );
+		IndexValueType maxIndex = vnl_math_max( start[i], end[i] );
+		subRegionStart[i] = vnl_math_max( minIndex - subRegionPad, region.GetIndex()[i] );
+		IndexValueType maxSubRegionIndex = vnl_math_min( maxIndex + subRegionPad,
+																										 IndexValueType(region.GetIndex()[i] + region.GetSize()[i] - 1) );
+		subRegionSize[i] = maxSubRegionIndex - subRegionStart[i] + 1;
+	}
+	RegionType subRegion;
+	subRegion.SetIndex( subRegionStart );
+	subRegion.SetSize( subRegionSize );
+
+	// Copy the score in the layout of the run; the image is then only used
+	// for its geometry.
+	itk::TimeProbe layoutTime;
+	VoxelMajorScoreType::Pointer voxelMajorScore;
+	TubularityScoreImageType::Pointer scoreInput = score;
+	if( layout == "voxel-major" || layout == "bricked" )
+	{
+		layoutTime.Start();
+		voxelMajorScore = VoxelMajorScoreType::New();
+		voxelMajorScore->SetBrickSize( layout == "bricked" ? 4 : 1 );
+		voxelMajorScore->SetScore( score );
+		scoreInput = voxelMajorScore->GetScoreInformation();
+		layoutTime.Stop();
+	}
+	else if( layout != "scale-major" )
+	{
+		itkGenericExceptionMacro(<< "Unknown layout: " << layout);
+	}
+
+	RegionType spatialRegion = subRegion;
+	spatialRegion.SetSize(Dimension, 1);
+	itk::TimeProbe bestScaleTime;
+	bestScaleTime.Start();
+	double bestScaleSum = 0.0;
+	itk::ImageRegionConstIteratorWithIndex< TubularityScoreImageType > it( score, spatialRegion );
+	for(it.GoToBegin(); !it.IsAtEnd(); ++it)
+	{
+		bestScaleSum += voxelMajorScore ? voxelMajorScore->GetBestScaleIndex( it.GetIndex() )
+																		: BestScaleIndex( score, it.GetIndex() );
+	}
+	bestScaleTime.Stop();
+
+	HardwareEventCounter cacheMisses(HardwareEventCounter::CacheMisses);
+	HardwareEventCounter tlbMisses(HardwareEventCounter::DataTLBReadMisses);
+	itk::TimeProbe traceTime;
+	traceTime.Start();
+	PathFilterType::Pointer pathFilter = PathFilterType::New();
+	pathFilter->SetInput( scoreInput );
+	pathFilter->SetSpeedFunction( voxelMajorScore.GetPointer() );
+	pathFilter->SetUseBrickedStorage( storage == "bricked" );
+	pathFilter->SetPathExtractionMode( options.PathExtraction == "predecessor" ? PathFilterType::PredecessorWalk
+																																						 : PathFilterType::CharacteristicDescent );
+	pathFilter->SetGeodesicSolver( options.Solver == "dijkstra" ? PathFilterType::DijkstraSolver
+																														 : PathFilterType::FastMarchingSolver );
+	pathFilter->SetDijkstraConnectivity( options.Connectivity );
+	pathFilter->SetStartPoint( start );
+	pathFilter->AddPathEndPoint( end );
+	pathFilter->SetRegionToProcess( subRegion );
+	cacheMisses.Start();
+	tlbMisses.Start();
+	pathFilter->Update();
+	tlbMisses.Stop();
+	cacheMisses.Stop();
+	traceTime.Stop();
+
+	double marchingTime = pathFilter->GetFastMarchingTime();
+	BenchmarkRecord record;
+	record.AddString("case", caseName);
+	record.AddString("layout", layout);
+	record.AddString("storage", storage);
+	record.AddString("path_extraction", options.PathExtraction);
+	record.AddString("solver", options.Solver);
+	record.Add("connectivity", pathFilter->GetDijkstraConnectivity());
+	record.Add("size", size);
+	record.Add("scales", numberOfScales);
+	record.Add("repetition", repetition);
+	record.Add("region_voxels", subRegion.GetNumberOfPixels());
+	record.Add("phantom_s", phantomTime.GetTotal());
+	record.Add("layout_s", layoutTime.GetTotal());
+	record.Add("score_mb", (voxelMajorScore ? voxelMajorScore->GetMemorySize()
+													: score->GetBufferedRegion().GetNumberOfPixels() * sizeof(float)) / (1024.0 * 1024.0));
+	record.Add("best_scale_s", bestScaleTime.GetTotal());
+	record.Add("mean_best_scale", bestScaleSum / spatialRegion.GetNumberOfPixels());
+	record.Add("fast_marching_s", marchingTime);
+	record.Add("accepted", pathFilter->GetNumberOfAcceptedPoints());
+	record.Add("accepted_per_s", marchingTime > 0.0 ? pathFilter->GetNumberOfAcceptedPoints() / marchingTime : 0.0);
+	record.Add("heap_pushes", pathFilter->GetNumberOfHeapPushes());
+	record.Add("peak_heap", pathFilter->GetMaximumHeapSize());
+	record.Add("stale_pops", pathFilter->GetNumberOfStalePops());
+	const double accepted = static_cast<double>( pathFilter->GetNumberOfAcceptedPoints() );
+	record.Add("cache_misses_per_accepted", EventsPer(cacheMisses.Read(), accepted));
+	record.Add("dtlb_misses_per_accepted", EventsPer(tlbMisses.Read(), accepted));
+	record.Add("gradient_mb", pathFilter->GetGradientImageMemorySize() / (1024.0 * 1024.0));
+	record.Add("path_extraction_s", pathFilter->GetPathExtractionTime());
+	record.Add("descent_steps", pathFilter->GetNumberOfDescentSteps());
+	record.Add("oscillation_fallbacks", pathFilter->GetNumberOfOscillationFallbacks());
+	record.Add("zero_gradient_fallbacks", pathFilter->GetNumberOfZeroGradientFallbacks());
+	record.Add("vertices", pathFilter->GetPath(0)->GetVertexList()->Size());
+	record.Add("trace_s", traceTime.GetTotal());
+	record.Add("peak_rss_mb", PeakResidentSetSizeMB());
+	return record;
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<unsigned int> sizes;
+	sizes.push_back(64);
+	sizes.push_back(128);
+	sizes.push_back(192);
+	std::vector<unsigned int> scales;
+	scales.push_back(8);
+	std::vector<std::string> cases;
+	cases.push_back("straight");
+	cases.push_back("helix");
+	cases.push_back("branching");
+	cases.push_back("noise");
+	std::vector<std::string> layouts;
+	layouts.push_back("scale-major");
+	std::vector<std::string> storages;
+	storages.push_back("row-major");
+	BenchmarkOptions options;
+	options.SigmaMin = 1.0;
+	options.SigmaMax = 6.0;
+	options.NoiseLevel = 0.3;
+	options.PathExtraction = "descent";
+	options.Solver = "fast-marching";
+	options.Connectivity = Dimension + 1;
+	options.Repeat = 1;
+	options.JSON = false;
+	std::string outputFileName;
+	bool useFork = true;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if( !strcmp(argv[i], "--sizes") && i+1 < argc )
+		{
+			sizes = ParseList<unsigned int>(argv[++i]);
+		}
+		else if( !strcmp(argv[i], "--scales") && i+1 < argc )
+		{
+			scales = ParseList<unsigned int>(argv[++i]);
+		}
+		else if( !strcmp(argv[i], "--cases") && i+1 < argc )
+		{
+			cases = ParseList<std::string>(argv[++i]);
+		}
+		else if( !strcmp(argv[i], "--layouts") && i+1 < argc )
+		{
+			layouts = ParseList<std::string>(argv[++i]);
+		}
+		else if( !strcmp(argv[i], "--storages") && i+1 < argc )
+		{
+			storages = ParseList<std::string>(argv[++i]);
+		}
+		else if( !strcmp(argv[i], "--path-extraction") && i+1 < argc )
+		{
+			options.PathExtraction = argv[++i];
+		}
+		else if( !strcmp(argv[i], "--solver") && i+1 < argc )
+		{
+			options.Solver = argv[++i];
+		}
+		else if( !strcmp(argv[i], "--connectivity") && i+1 < argc )
+		{
+			options.Connectivity = atoi(argv[++i]);
+		}
+		else if( !strcmp(argv[i], "--noise") && i+1 < argc )
+		{
+			options.NoiseLevel = atof(argv[++i]);
+		}
+		else if( !strcmp(argv[i], "--repeat") && i+1 < argc )
+		{
+			options.Repeat = atoi(argv[++i]);
+		}
+		else if( !strcmp(argv[i], "--format") && i+1 < argc )
+		{
+			options.JSON = !strcmp(argv[++i], "json");
+		}
+		else if( !strcmp(argv[i], "--output") && i+1 < argc )
+		{
+			outputFileName = argv[++i];
+		}
+		else if( !strcmp(argv[i], "--no-fork") )
+		{
+			useFork = false;
+		}
+		else
+		{
+			Usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::ofstream outputFile;
+	if( !outputFileName.empty() )
+	{
+		outputFile.open( outputFileName.c_str() );
+	}
+	std::ostream& output = outputFileName.empty() ? std::cout : outputFile;
+
+	bool header = true;
+	for(unsigned int c = 0; c < cases.size(); c++)
+	{
+		for(unsigned int s = 0; s < sizes.size(); s++)
+		{
+			for(unsigned int n = 0; n < scales.size(); n++)
+			{
+				for(unsigned int l = 0; l < layouts.size(); l++)
+				{
+					for(unsigned int t = 0; t < storages.size(); t++)
+					{
+						for(unsigned int r = 0; r < options.Repeat; r++)
+						{
+							output.flush();
+#ifndef _WIN32
+							pid_t pid = useFork ? fork() : -1;
+							if( pid >= 0 )
+							{
+								if( pid == 0 )
+								{
+									int status = EXIT_SUCCESS;
+									try
+									{
+										RunOnce(cases[c], layouts[l], storages[t], sizes[s], scales[n], r, options).Write(output, options.JSON, header);
+									}
+									catch (itk::ExceptionObject &e)
+									{
+										std::cerr << e << std::endl;
+										status = EXIT_FAILURE;
+									}
+									output.flush();
+									_exit(status);
+								}
+								int status = 0;
+								waitpid(pid, &status, 0);
+								if( !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS )
+								{
+									std::cerr << "Run failed: " << cases[c] << ", " << layouts[l] << ", " << storages[t] << ", size " << sizes[s] << ", "
+														<< scales[n] << " scales" << std::endl;
+									continue;
+								}
+								header = false;
+								continue;
+							}
+#endif
+							try
+							{
+								RunOnce(cases[c], layouts[l], storages[t], sizes[s], scales[n], r, options).Write(output, options.JSON, header);
+								header = false;
+							}
+							catch (itk::ExceptionObject &e)
+							{
+								std::cerr << e << std::endl;
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,320 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+// Synthetic tube phantoms for the benchmarks: bright tubes with a Gaussian
+// cross section on a dark background, drawn from a list of segments so
+// that the centerlines are known.
+
+#ifndef __TubePhantom_h
+#define __TubePhantom_h
+
+#include <vector>
+#include <cmath>
+
+#include "itkImage.h"
+#include "itkImageRegionIterator.h"
+#include "itkMersenneTwisterRandomVariateGenerator.h"
+#include "vnl/vnl_math.h"
+
+typedef itk::Image<float, 3>			PhantomImageType;
+typedef itk::Image<float, 4>			ScorePhantomImageType;
+
+/** One straight piece of tube, in voxel coordinates. */
+struct TubeSegment
+{
+	double Start[3];
+	double End[3];
+	double Radius;
+};
+
+inline TubeSegment MakeTubeSegment(double x0, double y0, double z0,
+																	 double x1, double y1, double z1, double radius)
+{
+	TubeSegment segment;
+	segment.Start[0] = x0; segment.Start[1] = y0; segment.Start[2] = z0;
+	segment.End[0] = x1;   segment.End[1] = y1;   segment.End[2] = z1;
+	segment.Radius = radius;
+	return segment;
+}
+
+/** Straight tubes along the axes and the diagonal, with radii spread over
+ * [minRadius, maxRadius]. */
+inline std::vector<TubeSegment> StraightTubes(unsigned int size, double minRadius, double maxRadius)
+{
+	std::vector<TubeSegment> segments;
+	const double margin = 0.1 * size;
+	const double low = margin, high = size - 1 - margin, middle = 0.5 * (size - 1);
+	segments.push_back( MakeTubeSegment(low, middle, middle, high, middle, middle, minRadius) );
+	segments.push_back( MakeTubeSegment(middle, low, 0.25 * size, middle, high, 0.25 * size, 0.5 * (minRadius + maxRadius)) );
+	segments.push_back( MakeTubeSegment(0.25 * size, 0.75 * size, low, 0.25 * size, 0.75 * size, high, maxRadius) );
+	segments.push_back( MakeTubeSegment(low, low, low, high, high, high, 0.5 * (minRadius + maxRadius)) );
+	return segments;
+}
+
+/** A helix around the Z axis, approximated by numberOfSegments pieces. */
+inline std::vector<TubeSegment> HelixTube(unsigned int size, double radius,
+																					unsigned int numberOfTurns = 3, unsigned int numberOfSegments = 120)
+{
+	std::vector<TubeSegment> segments;
+	const double center = 0.5 * (size - 1);
+	const double helixRadius = 0.3 * size;
+	const double low = 0.1 * size, high = 0.9 * size;
+	double previous[3];
+	for(unsigned int k = 0; k <= numberOfSegments; k++)
+	{
+		double t = static_cast<double>(k) / numberOfSegments;
+		double angle = 2.0 * vnl_math::pi * numberOfTurns * t;
+		double current[3] = { center + helixRadius * std::cos(angle),
+													center + helixRadius * std::sin(angle),
+													low + t * (high - low) };
+		if( k > 0 )
+		{
+			segments.push_back( MakeTubeSegment(previous[0], previous[1], previous[2],
+																					current[0], current[1], current[2], radius) );
+		}
+		previous[0] = current[0]; previous[1] = current[1]; previous[2] = current[2];
+	}
+	return segments;
+}
+
+/** A binary tree with the given number of branching levels, the radius shrinking at each branching. */
+inline std::vector<TubeSegment> BranchingTubes(unsigned int size, double rootRadius, unsigned int levels = 3)
+{
+	std::vector<TubeSegment> segments;
+	std::vector<TubeSegment> current;
+	const double middle = 0.5 * (size - 1);
+	double length = 0.3 * size;
+	current.push_back( MakeTubeSegment(middle, middle, 0.05 * size, middle, middle, 0.05 * size + length, rootRadius) );
+	for(unsigned int level = 0; level < levels; level++)
+	{
+		std::vector<TubeSegment> next;
+		length *= 0.6;
+		for(unsigned int s = 0; s < current.size(); s++)
+		{
+			const TubeSegment& parent = current[s];
+			segments.push_back(parent);
+			double radius = vnl_math_max(1.0, 0.7 * parent.Radius);
+			double spread = 0.7 * length;
+			for(int side = -1; side <= 1; side += 2)
+			{
+				double dx = ( level % 2 ) ? 0.0 : side * spread;
+				double dy = ( level % 2 ) ? side * spread : 0.0;
+				next.push_back( MakeTubeSegment(parent.End[0], parent.End[1], parent.End[2],
+																				parent.End[0] + dx, parent.End[1] + dy, parent.End[2] + 0.7 * length,
+																				radius) );
+			}
+		}
+		current = next;
+	}
+	segments.insert(segments.end(), current.begin(), current.end());
+	return segments;
+}
+
+/** Calls visitor(index, profile) for each voxel of a size^3 grid within 3
+ * radii of the axis of the segment, profile being exp(-d^2 / (2 r^2)) with
+ * d the distance to the axis. */
+template <class TVisitor>
+void VisitTubeSegment(const TubeSegment& segment, unsigned int size, TVisitor& visitor)
+{
+	double axis[3], length2 = 0.0;
+	for(unsigned int i = 0; i < 3; i++)
+	{
+		axis[i] = segment.End[i] - segment.Start[i];
+		length2 += axis[i] * axis[i];
+	}
+	// Only the bounding box of the segment, enlarged by 3 radii, is visited
+	const double reach = 3.0 * segment.Radius;
+	PhantomImageType::IndexType start;
+	PhantomImageType::SizeType boxSize;
+	for(unsigned int i = 0; i < 3; i++)
+	{
+		long lo = static_cast<long>( std::floor( vnl_math_min(segment.Start[i], segment.End[i]) - reach ) );
+		long hi = static_cast<long>( std::ceil( vnl_math_max(segment.Start[i], segment.End[i]) + reach ) );
+		lo = vnl_math_max(lo, 0L);
+		hi = vnl_math_min(hi, static_cast<long>(size) - 1);
+		if( hi < lo )
+		{
+			return;
+		}
+		start[i] = lo;
+		boxSize[i] = hi - lo + 1;
+	}
+	const double twoRadius2 = 2.0 * segment.Radius * segment.Radius;
+	PhantomImageType::IndexType index;
+	for(index[2] = start[2]; index[2] < start[2] + static_cast<long>(boxSize[2]); index[2]++)
+	{
+		for(index[1] = start[1]; index[1] < start[1] + static_cast<long>(boxSize[1]); index[1]++)
+		{
+			for(index[0] = start[0]; index[0] < start[0] + static_cast<long>(boxSize[0]); index[0]++)
+			{
+				double t = 0.0;
+				if( length2 > 0.0 )
+				{
+					for(unsigned int i = 0; i < 3; i++)
+					{
+						t += (index[i] - segment.Start[i]) * axis[i];
+					}
+					t = vnl_math_max(0.0, vnl_math_min(1.0, t / length2));
+				}
+				double distance2 = 0.0;
+				for(unsigned int i = 0; i < 3; i++)
+				{
+					double d = index[i] - (segment.Start[i] + t * axis[i]);
+					distance2 += d * d;
+				}
+				if( distance2 <= reach * reach )
+				{
+					visitor(index, std::exp( -distance2 / twoRadius2 ));
+				}
+			}
+		}
+	}
+}
+
+/** Keeps, in each voxel, the largest intensity * profile. */
+class TubePhantomWriter
+{
+public:
+	TubePhantomWriter(PhantomImageType* image, float intensity): m_Image(image), m_Intensity(intensity) {}
+	void operator()(const PhantomImageType::IndexType& index, double profile)
+	{
+		float value = static_cast<float>( m_Intensity * profile );
+		if( value > m_Image->GetPixel(index) )
+		{
+			m_Image->SetPixel(index, value);
+		}
+	}
+private:
+	PhantomImageType*		m_Image;
+	float								m_Intensity;
+};
+
+/** Draws the segments in a size^3 image: each voxel takes the largest
+ * intensity * exp(-d^2 / (2 r^2)) over the segments, d being the distance
+ * to the segment axis. */
+inline PhantomImageType::Pointer MakeTubePhantom(unsigned int size,
+																								 const std::vector<TubeSegment>& segments,
+																								 float intensity = 255.0f)
+{
+	PhantomImageType::Pointer image = PhantomImageType::New();
+	PhantomImageType::SizeType imageSize;
+	imageSize.Fill(size);
+	PhantomImageType::RegionType region;
+	region.SetSize(imageSize);
+	image->SetRegions(region);
+	image->Allocate();
+	image->FillBuffer(0.0f);
+
+	TubePhantomWriter writer(image, intensity);
+	for(unsigned int s = 0; s < segments.size(); s++)
+	{
+		VisitTubeSegment(segments[s], size, writer);
+	}
+	return image;
+}
+
+/** Keeps, in each scale-space voxel, the largest profile * scale response. */
+class TubularityScorePhantomWriter
+{
+public:
+	TubularityScorePhantomWriter(ScorePhantomImageType* score, const std::vector<double>& scaleResponse):
+	m_Score(score), m_ScaleResponse(scaleResponse) {}
+	void operator()(const PhantomImageType::IndexType& spatialIndex, double profile)
+	{
+		ScorePhantomImageType::IndexType index;
+		for(unsigned int i = 0; i < 3; i++)
+		{
+			index[i] = spatialIndex[i];
+		}
+		for(unsigned int k = 0; k < m_ScaleResponse.size(); k++)
+		{
+			index[3] = k;
+			float response = static_cast<float>( profile * m_ScaleResponse[k] );
+			if( response > m_Score->GetPixel(index) )
+			{
+				m_Score->SetPixel(index, response);
+			}
+		}
+	}
+private:
+	ScorePhantomImageType*					m_Score;
+	const std::vector<double>&			m_ScaleResponse;
+};
+
+/** Builds a scale-space tubularity score like the one of the OOF plugin:
+ * scale k (the last axis) stands for sigmaMin + k * (sigmaMax - sigmaMin) /
+ * (numberOfScales - 1). The response of a voxel at a scale is the largest,
+ * over the segments, of exp(-d^2 / (2 r^2)) exp(-(sigma - r)^2 / 2), plus
+ * uniform noise in [0, noiseLevel). The score is exp(log(contrast) * response),
+ * strictly positive with the given contrast between background and tubes. */
+inline ScorePhantomImageType::Pointer MakeTubularityScorePhantom(unsigned int size,
+																																 unsigned int numberOfScales,
+																																 double sigmaMin, double sigmaMax,
+																																 const std::vector<TubeSegment>& segments,
+																																 double noiseLevel = 0.0,
+																																 double contrast = 1e5,
+																																 unsigned int seed = 1)
+{
+	ScorePhantomImageType::Pointer score = ScorePhantomImageType::New();
+	ScorePhantomImageType::SizeType scoreSize;
+	scoreSize.Fill(size);
+	scoreSize[3] = numberOfScales;
+	ScorePhantomImageType::RegionType scoreRegion;
+	scoreRegion.SetSize(scoreSize);
+	score->SetRegions(scoreRegion);
+	ScorePhantomImageType::SpacingType spacing;
+	spacing.Fill(1.0);
+	spacing[3] = numberOfScales > 1 ? vnl_math_max(1e-6, (sigmaMax - sigmaMin) / (numberOfScales - 1)) : 1.0;
+	ScorePhantomImageType::PointType origin;
+	origin.Fill(0.0);
+	origin[3] = sigmaMin;
+	score->SetSpacing(spacing);
+	score->SetOrigin(origin);
+	score->Allocate();
+	score->FillBuffer(0.0f);
+
+	// Responses first, then noise and the exponential mapping
+	for(unsigned int s = 0; s < segments.size(); s++)
+	{
+		const TubeSegment& segment = segments[s];
+		std::vector<double> scaleResponse(numberOfScales);
+		for(unsigned int k = 0; k < numberOfScales; k++)
+		{
+			double sigma = origin[3] + k * spacing[3];
+			scaleResponse[k] = std::exp( -0.5 * (sigma - segment.Radius) * (sigma - segment.Radius) );
+		}
+		TubularityScorePhantomWriter writer(score, scaleResponse);
+		VisitTubeSegment(segment, size, writer);
+	}
+
+	typedef itk::Statistics::MersenneTwisterRandomVariateGenerator GeneratorType;
+	GeneratorType::Pointer generator = GeneratorType::New();
+	generator->Initialize(seed);
+	const double logContrast = std::log(contrast);
+	itk::ImageRegionIterator<ScorePhantomImageType> sit(score, score->GetBufferedRegion());
+	for(sit.GoToBegin(); !sit.IsAtEnd(); ++sit)
+	{
+		double response = sit.Get();
+		if( noiseLevel > 0.0 )
+		{
+			response += noiseLevel * generator->GetUniformVariate(0.0, 1.0);
+		}
+		sit.Set( static_cast<float>( std::exp( logContrast * vnl_math_min(response, 1.0) ) ) );
+	}
+	return score;
+}
+
+#endif
@@ -0,0 +1,211 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+// Scale-space tubularity computation shared by the Fiji plugin and the
+// command line tools.
+
+#ifndef __OOFTubularityMeasure_h
+#define __OOFTubularityMeasure_h
+
+#include <iostream>
+
+#include "itkMultiScaleOrientedFluxBasedMeasureFFTImageFilter.h"
+#include "itkMinimumMaximumImageCalculator.h"
+#include "itkShiftScaleImageFilter.h"
+#include "itkOrientedFluxTraceMeasure.h"
+#include "itkOrientedFluxCrossSectionTraceMeasure.h"
+#include "itkNumericTraits.h"
+#include "itkExpImageFilter.h"
+#include "itkMetricsRegistry.h"
+
+#define SwitchCase(CaseValue, DerivedFilterType, BaseFilterObjectPtr, Call ) \
+case CaseValue: \
+{ \
+typedef DerivedFilterType FilterObjectType; \
+typename FilterObjectType::Pointer FilterObjectPtr = static_cast<FilterObjectType*>(BaseFilterObjectPtr.GetPointer()); \
+Call; \
+break; \
+} \
+
+#define MultiScaleEnhancementFilterSwitch3D(HessianFilterTypeValue, BaseFilterObjectPtr, Call)  \
+switch( HessianFilterTypeValue ) \
+{ \
+SwitchCase(OrientedFluxTrace, OrientedFluxTraceMultiScaleEnhancementFilterType, BaseFilterObjectPtr, Call ) \
+SwitchCase(OrientedFluxCrossSectionCurvature, OrientedFluxMainCurvatureMultiScaleEnhancementFilterType, BaseFilterObjectPtr, Call ) \
+}\
+
+#define MultiScaleEnhancementFilterSwitchND(HessianFilterTypeValue, BaseFilterObjectPtr, Call)  \
+switch( HessianFilterTypeValue ) \
+{ \
+SwitchCase(OrientedFluxTrace, OrientedFluxTraceMultiScaleEnhancementFilterType, BaseFilterObjectPtr, Call ) \
+SwitchCase(OrientedFluxCrossSectionCurvature, OrientedFluxMainCurvatureMultiScaleEnhancementFilterType, BaseFilterObjectPtr, Call ) \
+}\
+\
+
+// Computes the scale-space tubularity score of Input_Image: the oriented
+// flux cross section trace at each scale, mapped through an exponential so
+// that the score is positive with a contrast of 1e5 between the lowest and
+// the highest values.
+// Throws an itk::ExceptionObject if the computation fails or if the score
+// is uniform, e.g. on a blank stack; exiting is left to the callers.
+template<class TInputPixel, unsigned int VDimension> 
+typename itk::Image<float,VDimension+1>::Pointer
+Execute(typename itk::Image<TInputPixel,VDimension>::Pointer Input_Image, double sigmaMin, double sigmaMax, unsigned int numberOfScales, unsigned int numberOfParallelScales = 0)
+{	
+	// Define the dimension of the images
+	const unsigned int Dimension = VDimension;
+	
+	// Default hessian filter type
+	typedef enum
+	{
+		OrientedFluxTrace = 2,
+		OrientedFluxCrossSectionCurvature = 3
+	}HessianFilterTypeEnum;
+	HessianFilterTypeEnum HessianFilterTypeValue;
+	
+	
+	// Typedefs
+	typedef TInputPixel											InputPixelType;
+	typedef itk::Image<InputPixelType,Dimension>								InputImageType;
+	typedef typename InputImageType::SpacingType								SpacingType;
+	
+	
+	typedef float												OutputPixelType;
+	typedef itk::Image<OutputPixelType,Dimension>								OutputImageType;
+	typedef itk::Image<OutputPixelType,Dimension+1>								OutputScaleSpaceImageType;
+	
+	typedef itk::ExpImageFilter<OutputScaleSpaceImageType, OutputScaleSpaceImageType> ScaleSpaceExpFilterType;
+	
+	
+	typedef float												HessianPixelScalarType;
+	typedef itk::SymmetricSecondRankTensor< HessianPixelScalarType, Dimension > 				HessianPixelType;
+	typedef itk::Image< HessianPixelType, Dimension >							HessianImageType;
+	
+	typedef float												ScalesPixelType;
+	typedef itk::Image<ScalesPixelType, Dimension>								ScalesImageType;
+
+	
+	typedef itk::ShiftScaleImageFilter<OutputImageType, OutputImageType>					ShiftScaleFilterType;
+	typedef itk::MinimumMaximumImageCalculator<OutputImageType>						MinMaxCalculatorType;
+	typedef itk::ShiftScaleImageFilter<OutputScaleSpaceImageType, OutputScaleSpaceImageType>		ShiftScaleFilterForScaleSpaceImageType;
+	typedef itk::MinimumMaximumImageCalculator<OutputScaleSpaceImageType>					MinMaxCalculatorForScaleSpaceImageType;
+	
+	
+	// Declare the type of enhancement filter
+	typedef itk::ProcessObject ObjectnessBaseFilterType;
+	typedef itk::OrientedFluxTraceMeasureFilter<HessianImageType,OutputImageType> 		HessianToOrientedFluxTraceObjectnessFilterType;	
+	typedef itk::OrientedFluxCrossSectionTraceMeasureFilter<HessianImageType,OutputImageType> 	HessianToOrientedFluxMainCurvatureObjectnessFilterType;	
+	
+	// Declare the type of multiscale enhancement filter
+	typedef itk::ProcessObject 										MultiScaleEnhancementBaseFilterType;
+
+	typedef itk::MultiScaleOrientedFluxBasedMeasureFFTImageFilter< InputImageType, 
+								HessianImageType, 
+								ScalesImageType,
+								HessianToOrientedFluxTraceObjectnessFilterType, 
+								OutputImageType > 				OrientedFluxTraceMultiScaleEnhancementFilterType;
+	typedef itk::MultiScaleOrientedFluxBasedMeasureFFTImageFilter< InputImageType, 
+								HessianImageType, 
+								ScalesImageType,
+								HessianToOrientedFluxMainCurvatureObjectnessFilterType, 
+								OutputImageType > 				OrientedFluxMainCurvatureMultiScaleEnhancementFilterType;	
+
+
+	SpacingType spacing = Input_Image->GetSpacing();
+	double maxSpacing = spacing[0];
+	double minSpacing = spacing[0];
+	for(unsigned int i = 1; i < Dimension; i++)
+	{
+		maxSpacing = vnl_math_max(maxSpacing, spacing[i]);
+		minSpacing = vnl_math_min(minSpacing, spacing[i]);
+	}
+	// Parse the input arguments.
+
+	double fixedSigmaForHessianComputation = 1.5*minSpacing;//TODO : use the minimal ImageSpacing
+	
+	bool brightObject = true;
+	HessianFilterTypeValue =  OrientedFluxCrossSectionCurvature;//OrientedFluxCrossSectionCurvature;
+	bool useAFixedSigmaForComputingHessianImage = true;
+
+	bool generateScaleSpaceTubularityScoreImage = true;
+
+  ObjectnessBaseFilterType::Pointer objectnessFilter;
+	MultiScaleEnhancementBaseFilterType::Pointer multiScaleEnhancementFilter;
+	typename HessianToOrientedFluxMainCurvatureObjectnessFilterType::Pointer orientedFluxMainCurvatureObjectnessFilter = HessianToOrientedFluxMainCurvatureObjectnessFilterType::New();
+	orientedFluxMainCurvatureObjectnessFilter->SetBrightObject( brightObject );
+	objectnessFilter = orientedFluxMainCurvatureObjectnessFilter;
+	
+	typename OrientedFluxMainCurvatureMultiScaleEnhancementFilterType::Pointer orientedFluxMainCurvatureMultiScaleEnhancementFilter = OrientedFluxMainCurvatureMultiScaleEnhancementFilterType::New();
+	multiScaleEnhancementFilter = orientedFluxMainCurvatureMultiScaleEnhancementFilter;		
+	// main function
+	MultiScaleEnhancementFilterSwitchND(
+		HessianFilterTypeValue, multiScaleEnhancementFilter,FilterObjectPtr->SetInput(Input_Image);
+		FilterObjectPtr->SetSigmaMinimum( sigmaMin ); 
+		FilterObjectPtr->SetSigmaMaximum( sigmaMax );  
+		FilterObjectPtr->SetNumberOfSigmaSteps( numberOfScales );
+		FilterObjectPtr->SetNumberOfParallelScales( numberOfParallelScales );
+		FilterObjectPtr->SetGenerateNPlus1DHessianMeasureOutput(generateScaleSpaceTubularityScoreImage);
+  
+		if( useAFixedSigmaForComputingHessianImage )
+		{
+			FilterObjectPtr->SetFixedSigmaForHessianImage( fixedSigmaForHessianComputation );
+		}
+		FilterObjectPtr->SetGenerateHessianOutput( false );//false
+		// No Hessian output: the measures read the planar tensor components
+		FilterObjectPtr->SetUseComponentImages( true );
+		
+		FilterObjectPtr->Update();
+										
+		// Writing the output image.
+		typename OutputScaleSpaceImageType::Pointer tubularityScoreImage;
+		typename MinMaxCalculatorForScaleSpaceImageType::Pointer minMaxCalc = MinMaxCalculatorForScaleSpaceImageType::New();
+		minMaxCalc->SetImage( FilterObjectPtr->GetNPlus1DImageOutput() );
+		minMaxCalc->Compute();
+		double expFactor;
+	  if(vcl_fabs(minMaxCalc->GetMaximum() - minMaxCalc->GetMinimum()) < 
+				itk::NumericTraits<float>::epsilon())
+	  {
+			itkGenericExceptionMacro( << "Score image pixel values are all the same: "
+																<< minMaxCalc->GetMaximum() );
+	  }
+    double maxToMinContrastRatio = 1e5	;//TODO: should be fixed according to the precision
+		expFactor = vcl_log(maxToMinContrastRatio) / 
+		static_cast<double>(minMaxCalc->GetMaximum() - minMaxCalc->GetMinimum());																	
+		
+																			
+		itk::MetricsRegistry * metrics = itk::MetricsRegistry::GetInstance();
+		metrics->SetGauge("oof.minTubularityValue", minMaxCalc->GetMinimum());
+		metrics->SetGauge("oof.maxTubularityValue", minMaxCalc->GetMaximum());
+		metrics->SetGauge("oof.expFactor", expFactor);
+																			
+																			
+		typename ShiftScaleFilterForScaleSpaceImageType::Pointer shiftScaleFilter = ShiftScaleFilterForScaleSpaceImageType::New();
+		shiftScaleFilter->SetInput( FilterObjectPtr->GetNPlus1DImageOutput() );
+		shiftScaleFilter->SetShift( 0.0 );
+		shiftScaleFilter->SetScale( expFactor );
+																			
+		typename ScaleSpaceExpFilterType::Pointer expFilter = ScaleSpaceExpFilterType::New();
+		expFilter->SetInput( shiftScaleFilter->GetOutput() );
+		expFilter->Update();
+		tubularityScoreImage =  expFilter->GetOutput();
+		metrics->Publish();
+		return tubularityScoreImage;															
+	)		// end MultiScaleEnhancementFilterSwitchND
+	
+	return EXIT_SUCCESS;
+}
+
+#endif
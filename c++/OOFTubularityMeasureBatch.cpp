@@ -0,0 +1,276 @@
+// Computes the scale-space tubularity score of an image file, outside Fiji.
+//
+// Usage:
+//   OOFTubularityMeasureBatch input output sigmaMin sigmaMax numberOfScales
+//                             [--threads N] [--memory MB] [--sparse threshold]
+//                             [--timings file] [--metrics file] [--trace file]
+//
+// --sparse writes a block sparse score (see BlockSparseScoreImageFunction)
+// instead of an image: the blocks whose values are all below threshold times
+// the largest value are not written. TubularGeodesicsBatch and the tracing
+// plugin read both formats.
+// The timings are written as one JSON object per line, to the standard
+// output unless a file is given. --metrics writes the per-stage timers,
+// counters and gauges of the filters as one JSON object. --trace writes the
+// timeline of the stages, one track per thread, in the trace event format
+// read by chrome://tracing and Perfetto.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <complex>
+#include <algorithm>
+
+#include "OOFTubularityMeasure.h"
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+#include "itkBlockSparseScoreImageFunction.h"
+#include "itkMultiThreader.h"
+#include "itkTimeProbe.h"
+#include "itkMetricsRegistry.h"
+#include "itkTraceEventRecorder.h"
+#include <omp.h>
+
+const unsigned int Dimension = 3;
+typedef float                                     InputPixelType;
+typedef itk::Image<InputPixelType, Dimension>     InputImageType;
+typedef itk::Image<float, Dimension+1>            OutputImageType;
+typedef itk::ImageFileReader<InputImageType>      ReaderType;
+typedef itk::ImageFileWriter<OutputImageType>     WriterType;
+typedef itk::BlockSparseScoreImageFunction<OutputImageType> SparseScoreFunctionType;
+
+void Usage(const char* name)
+{
+	std::cerr << "Usage: " << name << " input output sigmaMin sigmaMax numberOfScales" << std::endl;
+	std::cerr << "       [--threads N]    number of threads (default: all the cores)" << std::endl;
+	std::cerr << "       [--memory MB]    memory budget, bounds the number of scales computed in parallel" << std::endl;
+	std::cerr << "       [--sparse t]     write a block sparse score, without the blocks below t times the largest value" << std::endl;
+	std::cerr << "       [--timings file] where to write the JSON timings (default: standard output)" << std::endl;
+	std::cerr << "       [--metrics file] where to write the JSON metrics of the filters" << std::endl;
+	std::cerr << "       [--trace file]   where to write the timeline, for chrome://tracing" << std::endl;
+}
+
+// Writes the metrics recorded by the filters to a file, as one JSON object.
+void WriteMetrics(const std::string& fileName)
+{
+	std::ofstream metricsFile( fileName.c_str() );
+	if( !metricsFile )
+	{
+		std::cerr << "Could not write the metrics to " << fileName << std::endl;
+		return;
+	}
+	itk::MetricsRegistry::GetInstance()->WriteJSON( metricsFile );
+	metricsFile << std::endl;
+}
+
+void WriteTiming(std::ostream& os, const std::string& input, const char* stage, double seconds)
+{
+	os << "{\"tool\":\"OOFTubularityMeasureBatch\",\"input\":\"" << input
+	   << "\",\"stage\":\"" << stage << "\",\"seconds\":" << seconds << "}" << std::endl;
+}
+
+// Rough peak memory of the multiscale filter, in bytes. What stays allocated
+// for the whole run: the input, the per-scale measures, the 4D score and its
+// exponential, and the update buffer. What each scale processed in parallel
+// adds: the padded input, its transform, the kernel and the product, the
+// inverse transform, the tensor image and the measure.
+void EstimateMemory(InputImageType::RegionType region, unsigned int numberOfScales,
+										double& residentBytes, double& perScaleBytes)
+{
+	const double numberOfVoxels = static_cast<double>( region.GetNumberOfPixels() );
+	residentBytes = numberOfVoxels * ( sizeof(InputPixelType) + sizeof(double) + sizeof(float)
+																		 + 3 * sizeof(float) * numberOfScales );
+	const double paddingFactor = 1.3;
+	perScaleBytes = numberOfVoxels * ( paddingFactor * ( 2 * sizeof(float) + 3 * sizeof(std::complex<float>) )
+																		 + 6 * sizeof(float) + sizeof(float) );
+}
+
+int main(int argc, char* argv[])
+{
+	if( argc < 6 )
+	{
+		Usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	std::string inputFileName  = argv[1];
+	std::string outputFileName = argv[2];
+	double sigmaMin = atof(argv[3]);
+	double sigmaMax = atof(argv[4]);
+	int numberOfScales = atoi(argv[5]);
+	int numberOfThreads = 0;
+	double memoryBudgetMB = 0.0;
+	double sparseThreshold = 0.0;
+	std::string timingsFileName;
+	std::string metricsFileName;
+	std::string traceFileName;
+
+	for(int i = 6; i < argc; i++)
+	{
+		if( !strcmp(argv[i], "--threads") && i+1 < argc )
+		{
+			numberOfThreads = atoi(argv[++i]);
+		}
+		else if( !strcmp(argv[i], "--memory") && i+1 < argc )
+		{
+			memoryBudgetMB = atof(argv[++i]);
+		}
+		else if( !strcmp(argv[i], "--sparse") && i+1 < argc )
+		{
+			sparseThreshold = atof(argv[++i]);
+		}
+		else if( !strcmp(argv[i], "--timings") && i+1 < argc )
+		{
+			timingsFileName = argv[++i];
+		}
+		else if( !strcmp(argv[i], "--metrics") && i+1 < argc )
+		{
+			metricsFileName = argv[++i];
+			itk::MetricsRegistry::GetInstance()->SetEnabled( true );
+		}
+		else if( !strcmp(argv[i], "--trace") && i+1 < argc )
+		{
+			traceFileName = argv[++i];
+			itk::TraceEventRecorder::GetInstance()->SetEnabled( true );
+		}
+		else
+		{
+			Usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if( numberOfScales < 1 || sigmaMax < sigmaMin )
+	{
+		std::cerr << "At least one scale is needed, and sigmaMax can not be less than sigmaMin" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::ofstream timingsFile;
+	if( !timingsFileName.empty() )
+	{
+		timingsFile.open( timingsFileName.c_str(), std::ios::app );
+	}
+	std::ostream& timings = timingsFileName.empty() ? std::cout : timingsFile;
+
+	if( numberOfThreads > 0 )
+	{
+		itk::MultiThreader::SetGlobalMaximumNumberOfThreads( numberOfThreads );
+		itk::MultiThreader::SetGlobalDefaultNumberOfThreads( numberOfThreads );
+		omp_set_num_threads( numberOfThreads );
+	}
+	else
+	{
+		numberOfThreads = omp_get_max_threads();
+	}
+
+	itk::TimeProbe totalTime;
+	totalTime.Start();
+
+	itk::TraceTimeProbe readTime("read", "io");
+	readTime.Start();
+	ReaderType::Pointer reader = ReaderType::New();
+	reader->SetFileName( inputFileName );
+	InputImageType::Pointer input;
+	try
+	{
+		reader->Update();
+		input = reader->GetOutput();
+		input->DisconnectPipeline();
+	}
+	catch (itk::ExceptionObject &e)
+	{
+		std::cerr << e << std::endl;
+		return EXIT_FAILURE;
+	}
+	readTime.Stop();
+	WriteTiming(timings, inputFileName, "read", readTime.GetTotal());
+
+	// Bound the number of scales computed at the same time by the memory budget
+	unsigned int numberOfParallelScales = 0;
+	if( memoryBudgetMB > 0.0 )
+	{
+		double residentBytes, perScaleBytes;
+		EstimateMemory( input->GetLargestPossibleRegion(), numberOfScales, residentBytes, perScaleBytes );
+		double budgetBytes = memoryBudgetMB * 1024.0 * 1024.0;
+		if( budgetBytes < residentBytes + perScaleBytes )
+		{
+			std::cerr << "Warning: about " << (residentBytes + perScaleBytes) / (1024.0 * 1024.0)
+								<< " MB are needed even with one scale at a time" << std::endl;
+			numberOfParallelScales = 1;
+		}
+		else
+		{
+			numberOfParallelScales = static_cast<unsigned int>( (budgetBytes - residentBytes) / perScaleBytes );
+			numberOfParallelScales = vnl_math_max( 1u, vnl_math_min( numberOfParallelScales, (unsigned int)numberOfThreads ) );
+		}
+	}
+
+	itk::TraceTimeProbe computeTime("oof", "batch");
+	computeTime.Start();
+	OutputImageType::Pointer output;
+	try
+	{
+		output = Execute<InputPixelType, Dimension>(input, sigmaMin, sigmaMax, numberOfScales, numberOfParallelScales);
+	}
+	catch (itk::ExceptionObject &e)
+	{
+		std::cerr << e << std::endl;
+		return EXIT_FAILURE;
+	}
+	computeTime.Stop();
+	WriteTiming(timings, inputFileName, "oof", computeTime.GetTotal());
+
+	itk::TraceTimeProbe writeTime("write", "io");
+	writeTime.Start();
+	try
+	{
+		if( sparseThreshold > 0.0 )
+		{
+			const float * buffer = output->GetBufferPointer();
+			const float maximum = *std::max_element( buffer, buffer + output->GetBufferedRegion().GetNumberOfPixels() );
+			SparseScoreFunctionType::Pointer sparseScore = SparseScoreFunctionType::New();
+			sparseScore->Build( output, sparseThreshold * maximum );
+			sparseScore->WriteFile( outputFileName );
+			itk::MetricsRegistry::GetInstance()->SetGauge("oof.sparseStoredBlockFraction",
+				double(sparseScore->GetNumberOfStoredBlocks()) / sparseScore->GetNumberOfBlocks());
+		}
+		else
+		{
+			WriterType::Pointer writer = WriterType::New();
+			writer->SetInput( output );
+			writer->SetFileName( outputFileName );
+			writer->Update();
+		}
+	}
+	catch (itk::ExceptionObject &e)
+	{
+		std::cerr << e << std::endl;
+		return EXIT_FAILURE;
+	}
+	writeTime.Stop();
+	WriteTiming(timings, inputFileName, "write", writeTime.GetTotal());
+
+	totalTime.Stop();
+	InputImageType::SizeType size = input->GetLargestPossibleRegion().GetSize();
+	timings << "{\"tool\":\"OOFTubularityMeasureBatch\",\"input\":\"" << inputFileName
+	        << "\",\"stage\":\"total\",\"seconds\":" << totalTime.GetTotal()
+	        << ",\"size\":[" << size[0] << "," << size[1] << "," << size[2] << "]"
+	        << ",\"scales\":" << numberOfScales
+	        << ",\"threads\":" << numberOfThreads
+	        << ",\"parallelScales\":" << numberOfParallelScales << "}" << std::endl;
+
+	if( !metricsFileName.empty() )
+	{
+		WriteMetrics( metricsFileName );
+	}
+	if( !traceFileName.empty() && !itk::TraceEventRecorder::GetInstance()->WriteFile( traceFileName ) )
+	{
+		std::cerr << "Could not write the trace events to " << traceFileName << std::endl;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -4,38 +4,11 @@
 
 #include "FijiITKInterface_OOFTubularityMeasure.h"
 #include "itkImageFileWriter.h"
-#include "itkMultiScaleOrientedFluxBasedMeasureFFTImageFilter.h"
-#include "itkMinimumMaximumImageCalculator.h"
-#include "itkShiftScaleImageFilter.h"
-#include "itkOrientedFluxTraceMeasure.h"
-#include "itkOrientedFluxCrossSectionTraceMeasure.h"
-#include "itkNumericTraits.h"
-#include "itkExpImageFilter.h"
-
-
-#define SwitchCase(CaseValue, DerivedFilterType, BaseFilterObjectPtr, Call ) \
-case CaseValue: \
-{ \
-typedef DerivedFilterType FilterObjectType; \
-typename FilterObjectType::Pointer FilterObjectPtr = static_cast<FilterObjectType*>(BaseFilterObjectPtr.GetPointer()); \
-Call; \
-break; \
-} \
-
-#define MultiScaleEnhancementFilterSwitch3D(HessianFilterTypeValue, BaseFilterObjectPtr, Call)  \
-switch( HessianFilterTypeValue ) \
-{ \
-SwitchCase(OrientedFluxTrace, OrientedFluxTraceMultiScaleEnhancementFilterType, BaseFilterObjectPtr, Call ) \
-SwitchCase(OrientedFluxCrossSectionCurvature, OrientedFluxMainCurvatureMultiScaleEnhancementFilterType, BaseFilterObjectPtr, Call ) \
-}\
-
-#define MultiScaleEnhancementFilterSwitchND(HessianFilterTypeValue, BaseFilterObjectPtr, Call)  \
-switch( HessianFilterTypeValue ) \
-{ \
-SwitchCase(OrientedFluxTrace, OrientedFluxTraceMultiScaleEnhancementFilterType, BaseFilterObjectPtr, Call ) \
-SwitchCase(OrientedFluxCrossSectionCurvature, OrientedFluxMainCurvatureMultiScaleEnhancementFilterType, BaseFilterObjectPtr, Call ) \
-}\
-\
+#include "itkImportImageFilter.h"
+#include "OOFTubularityMeasure.h"
+#include "itkMetricsRegistry.h"
+#include "itkTraceEventRecorder.h"
+
 
 #define GRAY8 0
 #define GRAY16 2
@@ -46,209 +19,63 @@ using std::endl;
 
 const unsigned int maxDimension = 3;
 
-// Main code goes here! 
-template<class TInputPixel, unsigned int VDimension> 
-typename itk::Image<float,VDimension+1>::Pointer
-Execute(typename itk::Image<TInputPixel,VDimension>::Pointer Input_Image, double sigmaMin, double sigmaMax, unsigned int numberOfScales)
-{	
-	// Define the dimension of the images
-	const unsigned int Dimension = VDimension;
-	
-	// Default hessian filter type
-	typedef enum
-	{
-		OrientedFluxTrace = 2,
-		OrientedFluxCrossSectionCurvature = 3
-	}HessianFilterTypeEnum;
-	HessianFilterTypeEnum HessianFilterTypeValue;
-	
-	
-	// Typedefs
-	typedef TInputPixel											InputPixelType;
-	typedef itk::Image<InputPixelType,Dimension>								InputImageType;
-	typedef typename InputImageType::SpacingType								SpacingType;
-	
-	
-	typedef float												OutputPixelType;
-	typedef itk::Image<OutputPixelType,Dimension>								OutputImageType;
-	typedef itk::Image<OutputPixelType,Dimension+1>								OutputScaleSpaceImageType;
-	
-	typedef itk::ExpImageFilter<OutputScaleSpaceImageType, OutputScaleSpaceImageType> ScaleSpaceExpFilterType;
-	
-	
-	typedef float												HessianPixelScalarType;
-	typedef itk::SymmetricSecondRankTensor< HessianPixelScalarType, Dimension > 				HessianPixelType;
-	typedef itk::Image< HessianPixelType, Dimension >							HessianImageType;
-	
-	typedef float												ScalesPixelType;
-	typedef itk::Image<ScalesPixelType, Dimension>								ScalesImageType;
-
-	
-	typedef itk::ShiftScaleImageFilter<OutputImageType, OutputImageType>					ShiftScaleFilterType;
-	typedef itk::MinimumMaximumImageCalculator<OutputImageType>						MinMaxCalculatorType;
-	typedef itk::ShiftScaleImageFilter<OutputScaleSpaceImageType, OutputScaleSpaceImageType>		ShiftScaleFilterForScaleSpaceImageType;
-	typedef itk::MinimumMaximumImageCalculator<OutputScaleSpaceImageType>					MinMaxCalculatorForScaleSpaceImageType;
-	
-	
-	// Declare the type of enhancement filter
-	typedef itk::ProcessObject ObjectnessBaseFilterType;
-	typedef itk::OrientedFluxTraceMeasureFilter<HessianImageType,OutputImageType> 		HessianToOrientedFluxTraceObjectnessFilterType;	
-	typedef itk::OrientedFluxCrossSectionTraceMeasureFilter<HessianImageType,OutputImageType> 	HessianToOrientedFluxMainCurvatureObjectnessFilterType;	
-	
-	// Declare the type of multiscale enhancement filter
-	typedef itk::ProcessObject 										MultiScaleEnhancementBaseFilterType;
-
-	typedef itk::MultiScaleOrientedFluxBasedMeasureFFTImageFilter< InputImageType, 
-								HessianImageType, 
-								ScalesImageType,
-								HessianToOrientedFluxTraceObjectnessFilterType, 
-								OutputImageType > 				OrientedFluxTraceMultiScaleEnhancementFilterType;
-	typedef itk::MultiScaleOrientedFluxBasedMeasureFFTImageFilter< InputImageType, 
-								HessianImageType, 
-								ScalesImageType,
-								HessianToOrientedFluxMainCurvatureObjectnessFilterType, 
-								OutputImageType > 				OrientedFluxMainCurvatureMultiScaleEnhancementFilterType;	
-
-
-	SpacingType spacing = Input_Image->GetSpacing();
-	double maxSpacing = spacing[0];
-	double minSpacing = spacing[0];
-	for(unsigned int i = 1; i < Dimension; i++)
-	{
-		maxSpacing = vnl_math_max(maxSpacing, spacing[i]);
-		minSpacing = vnl_math_min(minSpacing, spacing[i]);
-	}
-	// Parse the input arguments.
-
-	double fixedSigmaForHessianComputation = 1.5*minSpacing;//TODO : use the minimal ImageSpacing
-	
-	bool brightObject = true;
-	HessianFilterTypeValue =  OrientedFluxCrossSectionCurvature;//OrientedFluxCrossSectionCurvature;
-	bool useAFixedSigmaForComputingHessianImage = true;
-
-	bool generateScaleSpaceTubularityScoreImage = true;
-
-  ObjectnessBaseFilterType::Pointer objectnessFilter;
-	MultiScaleEnhancementBaseFilterType::Pointer multiScaleEnhancementFilter;
-	typename HessianToOrientedFluxMainCurvatureObjectnessFilterType::Pointer orientedFluxMainCurvatureObjectnessFilter = HessianToOrientedFluxMainCurvatureObjectnessFilterType::New();
-	orientedFluxMainCurvatureObjectnessFilter->SetBrightObject( brightObject );
-	objectnessFilter = orientedFluxMainCurvatureObjectnessFilter;
-	
-	typename OrientedFluxMainCurvatureMultiScaleEnhancementFilterType::Pointer orientedFluxMainCurvatureMultiScaleEnhancementFilter = OrientedFluxMainCurvatureMultiScaleEnhancementFilterType::New();
-	multiScaleEnhancementFilter = orientedFluxMainCurvatureMultiScaleEnhancementFilter;		
-	// main function
-	MultiScaleEnhancementFilterSwitchND(
-		HessianFilterTypeValue, multiScaleEnhancementFilter,FilterObjectPtr->SetInput(Input_Image);
-		FilterObjectPtr->SetSigmaMinimum( sigmaMin ); 
-		FilterObjectPtr->SetSigmaMaximum( sigmaMax );  
-		FilterObjectPtr->SetNumberOfSigmaSteps( numberOfScales );
-		FilterObjectPtr->SetGenerateNPlus1DHessianMeasureOutput(generateScaleSpaceTubularityScoreImage);
-  
-		if( useAFixedSigmaForComputingHessianImage )
-		{
-			FilterObjectPtr->SetFixedSigmaForHessianImage( fixedSigmaForHessianComputation );
-		}
-		FilterObjectPtr->SetGenerateHessianOutput( false );//false
-		
-		try
-		{
-			FilterObjectPtr->Update();
-		}
-		catch (itk::ExceptionObject &e)
-		{
-			std::cerr << e << std::endl;
-		}
-										
-		// Writing the output image.
-		typename OutputScaleSpaceImageType::Pointer tubularityScoreImage;
-		typename MinMaxCalculatorForScaleSpaceImageType::Pointer minMaxCalc = MinMaxCalculatorForScaleSpaceImageType::New();
-		minMaxCalc->SetImage( FilterObjectPtr->GetNPlus1DImageOutput() );
-		minMaxCalc->Compute();
-		double expFactor;
-	  if(vcl_fabs(minMaxCalc->GetMaximum() - minMaxCalc->GetMinimum()) < 
-				itk::NumericTraits<float>::epsilon())
-	  {
-			std::cerr << "Score image pixel values are all the same: ";
-			std::cerr <<  minMaxCalc->GetMaximum() << std::endl;
-			exit(1);
-	  }
-    double maxToMinContrastRatio = 1e5	;//TODO: should be fixed according to the precision
-		expFactor = vcl_log(maxToMinContrastRatio) / 
-		static_cast<double>(minMaxCalc->GetMaximum() - minMaxCalc->GetMinimum());																	
-		
-																			
-		std::cout << "minTubularityValue " << minMaxCalc->GetMinimum() << std::endl;
-		std::cout << "maxTubularityValue " << minMaxCalc->GetMaximum() << std::endl;
-		std::cout << "expFactor " << expFactor << std::endl;
-																			
-																			
-		typename ShiftScaleFilterForScaleSpaceImageType::Pointer shiftScaleFilter = ShiftScaleFilterForScaleSpaceImageType::New();
-		shiftScaleFilter->SetInput( FilterObjectPtr->GetNPlus1DImageOutput() );
-		shiftScaleFilter->SetShift( 0.0 );
-		shiftScaleFilter->SetScale( expFactor );
-																			
-		typename ScaleSpaceExpFilterType::Pointer expFilter = ScaleSpaceExpFilterType::New();
-		expFilter->SetInput( shiftScaleFilter->GetOutput() );
-		expFilter->Update();
-		tubularityScoreImage =  expFilter->GetOutput();
-		return tubularityScoreImage;															
-	)		// end MultiScaleEnhancementFilterSwitchND
-	
-	return EXIT_SUCCESS;
-}
-
-
-JNIEXPORT jint JNICALL Java_FijiITKInterface_OOFTubularityMeasure_OrientedFlux(JNIEnv *env, jobject ignored, jbyteArray jba, jfloatArray jbOut, jint type, jint width, jint height, jint NSlice, jdouble widthpix, jdouble heightpix, jdouble depthpix, jdouble sigmaMin, jdouble sigmaMax, jint numberOfScales, jstring outputFileName)
+// Runs the scale-space measure on a pixel buffer handed over by Java.
+// The buffer is wrapped as an itk image without any copy: the only cast
+// of the input happens when it is padded for the FFT.
+template<class TInputPixel>
+jint
+OrientedFluxOnBuffer(JNIEnv *env, TInputPixel * InputImageData, jfloatArray jbOut, jint width, jint height, jint NSlice, jdouble widthpix, jdouble heightpix, jdouble depthpix, jdouble sigmaMin, jdouble sigmaMax, jint numberOfScales, jstring outputFileName)
 {
-    jboolean isCopy;
-    jbyte * jbs   = env->GetByteArrayElements(jba,&isCopy);
-    jfloat * jbOutS = env->GetFloatArrayElements(jbOut,&isCopy);
-
-    if( ! jbs )
-        return -1;
+	itk::TraceEventRecorder::ScopedEvent jniEvent("OrientedFluxOnBuffer", "jni");
+	jboolean isCopy;
+	jfloat * jbOutS = env->GetFloatArrayElements(jbOut,&isCopy);
+	if( ! jbOutS )
+		return -1;
 
 	double spacing[3], origin[3]; 
 
-	unsigned char * InputImageData = (unsigned char *) jbs;
-	//Allocates an itk image with the 2D buffered data
-   	typedef itk::Image<unsigned char, 3>  ImageType;
-	typedef itk::Image<float, 4> 	      OutputImageType;
+	typedef itk::ImportImageFilter<TInputPixel, 3> ImportFilterType;
+	typedef itk::Image<TInputPixel, 3>             ImageType;
+	typedef itk::Image<float, 4>                   OutputImageType;
 
-	ImageType::Pointer itkImageP = ImageType::New();
-
-	ImageType::SizeType size;
+	typename ImageType::SizeType size;
 	size[0] = width;size[1] = height;size[2] = NSlice;
 
-	ImageType::IndexType start;
+	typename ImageType::IndexType start;
 	start[0] = 0;start[1] = 0;start[2] = 0;
 	
-	ImageType::RegionType region;
+	typename ImageType::RegionType region;
 	region.SetSize( size );
 	region.SetIndex( start );
-	itkImageP->SetRegions( region);
-	itkImageP->Allocate();
 
 	spacing[0] = widthpix;spacing[1] = heightpix;spacing[2] = depthpix;
-	itkImageP->SetSpacing( spacing );
-
 	origin[0] = 0;origin[1] = 0;origin[2] = 0;
-	itkImageP->SetOrigin( origin );
 
-	//Copies the data from the image buffer to the itkImage
-	typedef itk::ImageRegionIterator< ImageType> IteratorType;
+	//Wraps the Java buffer, the memory is still owned by the JVM
+	typename ImportFilterType::Pointer importFilter = ImportFilterType::New();
+	importFilter->SetRegion( region );
+	importFilter->SetSpacing( spacing );
+	importFilter->SetOrigin( origin );
+	const bool importFilterWillOwnTheBuffer = false;
+	importFilter->SetImportPointer( InputImageData, region.GetNumberOfPixels(), importFilterWillOwnTheBuffer );
+	importFilter->Update();
+
+	typename ImageType::Pointer itkImageP = importFilter->GetOutput();
+	itkImageP->DisconnectPipeline();
+
 	typedef itk::ImageRegionIterator< OutputImageType> OutputIteratorType;
-	IteratorType it( itkImageP, region);
 
-	it.GoToBegin();
-	unsigned char * dataPointer = InputImageData;
-	while( ! it.IsAtEnd() )
+	OutputImageType::Pointer outputImage;
+	try
 	{
-		it.Set( *dataPointer);
-		++it;
-		++dataPointer;
-	 }
-
-	OutputImageType::Pointer outputImage = Execute<unsigned char, 3>(itkImageP, sigmaMin, sigmaMax, numberOfScales);
+		outputImage = Execute<TInputPixel, 3>(itkImageP, sigmaMin, sigmaMax, numberOfScales);
+	}
+	catch (itk::ExceptionObject &e)
+	{
+		std::cerr << e << std::endl;
+		env->ReleaseFloatArrayElements(jbOut, jbOutS, JNI_ABORT);
+		return -1;
+	}
 
 	OutputImageType::RegionType Outputregion;
 	OutputImageType::SizeType Outputsize;
@@ -261,8 +88,23 @@ JNIEXPORT jint JNICALL Java_FijiITKInterface_OOFTubularityMeasure_OrientedFlux(J
 	float* outputImageData = (float*) jbOutS;
 	OutputIteratorType outit( outputImage, Outputregion);
 	outit.GoToBegin();
-	unsigned long int length = width * height * NSlice;
-	for(unsigned int i = 0; i < length; ++i ) {
+	// The whole scale-space score is copied when the Java array can hold it,
+	// so that it can be handed to a tracing session without going to disk.
+	// Otherwise only the first scale is copied.
+	// The sizes are computed in 64 bits, a stack larger than 2^31 voxels
+	// cannot be held by a Java array anyway.
+	typedef OutputImageType::SizeValueType SizeValueType;
+	const SizeValueType arrayLength = static_cast<SizeValueType>( env->GetArrayLength(jbOut) );
+	SizeValueType length = static_cast<SizeValueType>( width ) * static_cast<SizeValueType>( height ) * static_cast<SizeValueType>( NSlice );
+	if( length > arrayLength )
+	{
+		std::cerr << "The output array is too small for the stack" << std::endl;
+		env->ReleaseFloatArrayElements(jbOut, jbOutS, JNI_ABORT);
+		return -1;
+	}
+	if( arrayLength >= length * static_cast<SizeValueType>( numberOfScales ) )
+		length *= numberOfScales;
+	for(SizeValueType i = 0; i < length; ++i ) {
 	  	outputImageData[i] = outit.Get();
 	  	++outit;
 	}
@@ -283,9 +125,81 @@ JNIEXPORT jint JNICALL Java_FijiITKInterface_OOFTubularityMeasure_OrientedFlux(J
 		std::cerr << e << std::endl;
 	}
 
-	env->ReleaseByteArrayElements(jba,jbs,0);
   env->ReleaseFloatArrayElements(jbOut, jbOutS,0);
 	env->ReleaseStringUTFChars( outputFileName, s );
     return 0;
 }
 
+JNIEXPORT jint JNICALL Java_FijiITKInterface_OOFTubularityMeasure_OrientedFlux(JNIEnv *env, jobject ignored, jbyteArray jba, jfloatArray jbOut, jint type, jint width, jint height, jint NSlice, jdouble widthpix, jdouble heightpix, jdouble depthpix, jdouble sigmaMin, jdouble sigmaMax, jint numberOfScales, jstring outputFileName)
+{
+    jboolean isCopy;
+    jbyte * jbs   = env->GetByteArrayElements(jba,&isCopy);
+
+    if( ! jbs )
+        return -1;
+
+	jint result = OrientedFluxOnBuffer<unsigned char>(env, (unsigned char *) jbs, jbOut, width, height, NSlice, widthpix, heightpix, depthpix, sigmaMin, sigmaMax, numberOfScales, outputFileName);
+
+	// The input is only read, no need to copy it back to the Java array
+	env->ReleaseByteArrayElements(jba,jbs,JNI_ABORT);
+    return result;
+}
+
+JNIEXPORT jint JNICALL Java_FijiITKInterface_OOFTubularityMeasure_OrientedFluxGray16(JNIEnv *env, jobject ignored, jshortArray jsa, jfloatArray jbOut, jint type, jint width, jint height, jint NSlice, jdouble widthpix, jdouble heightpix, jdouble depthpix, jdouble sigmaMin, jdouble sigmaMax, jint numberOfScales, jstring outputFileName)
+{
+    jboolean isCopy;
+    jshort * jss   = env->GetShortArrayElements(jsa,&isCopy);
+
+    if( ! jss )
+        return -1;
+
+	// ImageJ stores 16-bit images as unsigned values in Java shorts
+	jint result = OrientedFluxOnBuffer<unsigned short>(env, (unsigned short *) jss, jbOut, width, height, NSlice, widthpix, heightpix, depthpix, sigmaMin, sigmaMax, numberOfScales, outputFileName);
+
+	env->ReleaseShortArrayElements(jsa,jss,JNI_ABORT);
+    return result;
+}
+
+JNIEXPORT jint JNICALL Java_FijiITKInterface_OOFTubularityMeasure_OrientedFluxGray32(JNIEnv *env, jobject ignored, jfloatArray jfa, jfloatArray jbOut, jint type, jint width, jint height, jint NSlice, jdouble widthpix, jdouble heightpix, jdouble depthpix, jdouble sigmaMin, jdouble sigmaMax, jint numberOfScales, jstring outputFileName)
+{
+    jboolean isCopy;
+    jfloat * jfs   = env->GetFloatArrayElements(jfa,&isCopy);
+
+    if( ! jfs )
+        return -1;
+
+	jint result = OrientedFluxOnBuffer<float>(env, (float *) jfs, jbOut, width, height, NSlice, widthpix, heightpix, depthpix, sigmaMin, sigmaMax, numberOfScales, outputFileName);
+
+	env->ReleaseFloatArrayElements(jfa,jfs,JNI_ABORT);
+    return result;
+}
+
+JNIEXPORT void JNICALL Java_FijiITKInterface_OOFTubularityMeasure_setMetricsEnabled(JNIEnv *env, jobject ignored, jboolean enabled)
+{
+	itk::MetricsRegistry::GetInstance()->SetEnabled( enabled == JNI_TRUE );
+}
+
+JNIEXPORT jstring JNICALL Java_FijiITKInterface_OOFTubularityMeasure_getMetrics(JNIEnv *env, jobject ignored)
+{
+	return env->NewStringUTF( itk::MetricsRegistry::GetInstance()->GetJSON().c_str() );
+}
+
+JNIEXPORT void JNICALL Java_FijiITKInterface_OOFTubularityMeasure_resetMetrics(JNIEnv *env, jobject ignored)
+{
+	itk::MetricsRegistry::GetInstance()->Reset();
+}
+
+JNIEXPORT void JNICALL Java_FijiITKInterface_OOFTubularityMeasure_setTraceEventsEnabled(JNIEnv *env, jobject ignored, jboolean enabled)
+{
+	itk::TraceEventRecorder::GetInstance()->SetEnabled( enabled == JNI_TRUE );
+}
+
+JNIEXPORT jboolean JNICALL Java_FijiITKInterface_OOFTubularityMeasure_writeTraceEvents(JNIEnv *env, jobject ignored, jstring jFilename)
+{
+	const char * filename = env->GetStringUTFChars( jFilename, NULL );
+	if( ! filename )
+		return JNI_FALSE;
+	bool written = itk::TraceEventRecorder::GetInstance()->WriteFile( filename );
+	env->ReleaseStringUTFChars( jFilename, filename );
+	return written ? JNI_TRUE : JNI_FALSE;
+}
@@ -0,0 +1,320 @@
+// Traces the minimal paths between a list of point pairs on a precomputed
+// tubularity score, outside Fiji.
+//
+// Usage:
+//   TubularGeodesicsBatch score pairs.csv output.csv
+//                         [--threads N] [--memory MB] [--no-mmap] [--compress]
+//                         [--sparse threshold] [--timings file] [--metrics file]
+//                         [--trace file]
+//
+// Each line of pairs.csv holds one pair, x1,y1,z1,x2,y2,z2, in voxel
+// coordinates; empty lines and lines starting with '#' are skipped.
+// output.csv receives one line per path vertex: pair,vertex,x,y,z,radius in
+// physical coordinates.
+// The timings are written as one JSON object per line, to the standard
+// output unless a file is given. --metrics writes the timers, counters and
+// gauges of the marching and of the path extraction as one JSON object.
+// --compress replaces the score by its parametric scale profiles once it is
+// loaded, which divides its memory by a quarter of the number of scales.
+// --sparse drops the blocks of the score whose values are all below threshold
+// times the largest value; block sparse score files are recognized as such.
+// --trace writes the timeline of the stages, one track per thread, in the
+// trace event format read by chrome://tracing and Perfetto.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "TubularGeodesicsSession.h"
+#include "itkMultiThreader.h"
+#include "itkTimeProbe.h"
+#include "itkMetricsRegistry.h"
+#include "itkTraceEventRecorder.h"
+#include <omp.h>
+
+struct PointPair
+{
+	float Start[Dimension];
+	float End[Dimension];
+};
+
+void Usage(const char* name)
+{
+	std::cerr << "Usage: " << name << " score pairs.csv output.csv" << std::endl;
+	std::cerr << "       [--threads N]    number of pairs traced at the same time (default: all the cores)" << std::endl;
+	std::cerr << "       [--memory MB]    memory budget of the searches, bounds the number of pairs traced at the same time" << std::endl;
+	std::cerr << "       [--no-mmap]      read the score in memory instead of mapping it" << std::endl;
+	std::cerr << "       [--compress]     keep the parametric scale profiles of the score instead of the score" << std::endl;
+	std::cerr << "       [--sparse t]     keep only the blocks of the score above t times its largest value" << std::endl;
+	std::cerr << "       [--timings file] where to write the JSON timings (default: standard output)" << std::endl;
+	std::cerr << "       [--metrics file] where to write the JSON metrics of the filters" << std::endl;
+	std::cerr << "       [--trace file]   where to write the timeline, for chrome://tracing" << std::endl;
+}
+
+// Writes the metrics recorded by the filters to a file, as one JSON object.
+void WriteMetrics(const std::string& fileName)
+{
+	std::ofstream metricsFile( fileName.c_str() );
+	if( !metricsFile )
+	{
+		std::cerr << "Could not write the metrics to " << fileName << std::endl;
+		return;
+	}
+	itk::MetricsRegistry::GetInstance()->WriteJSON( metricsFile );
+	metricsFile << std::endl;
+}
+
+bool ReadPairs(const char* fileName, std::vector<PointPair>& pairs)
+{
+	std::ifstream file(fileName);
+	if( !file )
+	{
+		return false;
+	}
+	std::string line;
+	unsigned int lineNumber = 0;
+	while( std::getline(file, line) )
+	{
+		lineNumber++;
+		if( line.empty() || line[0] == '#' || line.find_first_not_of(" \t\r") == std::string::npos )
+		{
+			continue;
+		}
+		PointPair pair;
+		if( sscanf(line.c_str(), "%f,%f,%f,%f,%f,%f",
+							 &pair.Start[0], &pair.Start[1], &pair.Start[2],
+							 &pair.End[0], &pair.End[1], &pair.End[2]) != 6 )
+		{
+			std::cerr << fileName << ":" << lineNumber << ": expected x1,y1,z1,x2,y2,z2" << std::endl;
+			return false;
+		}
+		pairs.push_back(pair);
+	}
+	return true;
+}
+
+// Rough memory used by the fast marching of one pair, in bytes: the
+// distance, label and gradient images over the sub region the session
+// processes, i.e. the bounding box of the pair padded by 20 voxels.
+double EstimateSearchMemory(const PointPair& pair, const SizeType& scoreSize)
+{
+	const int subRegionPad = 20;
+	double numberOfVoxels = scoreSize[Dimension];
+	for(unsigned int i = 0; i < Dimension; i++)
+	{
+		double extent = vnl_math_abs(pair.End[i] - pair.Start[i]) + 2 * subRegionPad + 1;
+		numberOfVoxels *= vnl_math_min(extent, double(scoreSize[i]));
+	}
+	return numberOfVoxels * ( sizeof(float) + sizeof(unsigned char) + SSDimension * sizeof(float) );
+}
+
+int main(int argc, char* argv[])
+{
+	if( argc < 4 )
+	{
+		Usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	std::string scoreFileName  = argv[1];
+	const char* pairsFileName  = argv[2];
+	const char* outputFileName = argv[3];
+	int numberOfThreads = 0;
+	double memoryBudgetMB = 0.0;
+	bool useMemoryMapping = true;
+	bool compressScore = false;
+	double sparseThreshold = 0.0;
+	std::string timingsFileName;
+	std::string metricsFileName;
+	std::string traceFileName;
+
+	for(int i = 4; i < argc; i++)
+	{
+		if( !strcmp(argv[i], "--threads") && i+1 < argc )
+		{
+			numberOfThreads = atoi(argv[++i]);
+		}
+		else if( !strcmp(argv[i], "--memory") && i+1 < argc )
+		{
+			memoryBudgetMB = atof(argv[++i]);
+		}
+		else if( !strcmp(argv[i], "--no-mmap") )
+		{
+			useMemoryMapping = false;
+		}
+		else if( !strcmp(argv[i], "--compress") )
+		{
+			compressScore = true;
+		}
+		else if( !strcmp(argv[i], "--sparse") && i+1 < argc )
+		{
+			sparseThreshold = atof(argv[++i]);
+		}
+		else if( !strcmp(argv[i], "--timings") && i+1 < argc )
+		{
+			timingsFileName = argv[++i];
+		}
+		else if( !strcmp(argv[i], "--metrics") && i+1 < argc )
+		{
+			metricsFileName = argv[++i];
+			itk::MetricsRegistry::GetInstance()->SetEnabled( true );
+		}
+		else if( !strcmp(argv[i], "--trace") && i+1 < argc )
+		{
+			traceFileName = argv[++i];
+			itk::TraceEventRecorder::GetInstance()->SetEnabled( true );
+		}
+		else
+		{
+			Usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::vector<PointPair> pairs;
+	if( !ReadPairs(pairsFileName, pairs) )
+	{
+		std::cerr << "Could not read the point pairs from " << pairsFileName << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::ofstream timingsFile;
+	if( !timingsFileName.empty() )
+	{
+		timingsFile.open( timingsFileName.c_str(), std::ios::app );
+	}
+	std::ostream& timings = timingsFileName.empty() ? std::cout : timingsFile;
+
+	if( numberOfThreads > 0 )
+	{
+		itk::MultiThreader::SetGlobalMaximumNumberOfThreads( numberOfThreads );
+		itk::MultiThreader::SetGlobalDefaultNumberOfThreads( numberOfThreads );
+	}
+	else
+	{
+		numberOfThreads = omp_get_max_threads();
+	}
+
+	itk::TimeProbe totalTime;
+	totalTime.Start();
+
+	itk::TraceTimeProbe loadTime("load", "io");
+	loadTime.Start();
+	TubularGeodesicsSession::Pointer session = TubularGeodesicsSession::New();
+	session->SetUseMemoryMapping( useMemoryMapping );
+	session->SetCompressScore( compressScore );
+	session->SetSparseThreshold( sparseThreshold );
+	try
+	{
+		session->LoadFromFile( scoreFileName.c_str() );
+	}
+	catch (itk::ExceptionObject &e)
+	{
+		std::cerr << e << std::endl;
+		return EXIT_FAILURE;
+	}
+	loadTime.Stop();
+	timings << "{\"tool\":\"TubularGeodesicsBatch\",\"input\":\"" << scoreFileName
+	        << "\",\"stage\":\"load\",\"seconds\":" << loadTime.GetTotal()
+	        << ",\"mmap\":" << (useMemoryMapping ? "true" : "false")
+	        << ",\"compressed\":" << (compressScore ? "true" : "false") << "}" << std::endl;
+
+	// Bound the number of searches running at the same time by the memory budget
+	int numberOfParallelSearches = numberOfThreads;
+	if( memoryBudgetMB > 0.0 && !pairs.empty() )
+	{
+		SizeType scoreSize = session->GetTubularityScore()->GetLargestPossibleRegion().GetSize();
+		double largestSearchBytes = 0.0;
+		for(unsigned int p = 0; p < pairs.size(); p++)
+		{
+			largestSearchBytes = vnl_math_max( largestSearchBytes, EstimateSearchMemory(pairs[p], scoreSize) );
+		}
+		double budgetBytes = memoryBudgetMB * 1024.0 * 1024.0;
+		numberOfParallelSearches = vnl_math_max( 1, vnl_math_min( numberOfThreads, int(budgetBytes / largestSearchBytes) ) );
+		if( budgetBytes < largestSearchBytes )
+		{
+			std::cerr << "Warning: the largest search needs about " << largestSearchBytes / (1024.0 * 1024.0)
+								<< " MB" << std::endl;
+		}
+	}
+
+	std::vector< std::vector<float> > paths( pairs.size() );
+	std::vector< int > results( pairs.size(), eFailed );
+	std::vector< double > seconds( pairs.size(), 0.0 );
+
+	// The session grafts the score for each search, so that the pairs can be
+	// traced concurrently.
+	#pragma omp parallel for schedule(dynamic) num_threads(numberOfParallelSearches)
+	for(int p = 0; p < int(pairs.size()); p++)
+	{
+		itk::TraceEventRecorder::GetInstance()->SetCurrentThreadName("tracing thread");
+		itk::TimeProbe pairTime;
+		pairTime.Start();
+		try
+		{
+			results[p] = session->Execute( pairs[p].Start, pairs[p].End, paths[p] );
+		}
+		catch (itk::ExceptionObject &e)
+		{
+			#pragma omp critical
+			std::cerr << "Pair " << p << ": " << e << std::endl;
+			results[p] = eFailed;
+		}
+		pairTime.Stop();
+		seconds[p] = pairTime.GetTotal();
+	}
+
+	std::ofstream output( outputFileName );
+	if( !output )
+	{
+		std::cerr << "Could not write " << outputFileName << std::endl;
+		return EXIT_FAILURE;
+	}
+	output << "pair,vertex,x,y,z,radius" << std::endl;
+	unsigned int numberOfFailures = 0;
+	for(unsigned int p = 0; p < pairs.size(); p++)
+	{
+		if( results[p] != eSuccess )
+		{
+			numberOfFailures++;
+		}
+		for(unsigned int k = 0; k + SSDimension <= paths[p].size(); k += SSDimension)
+		{
+			output << p << "," << k / SSDimension;
+			for(unsigned int i = 0; i < SSDimension; i++)
+			{
+				output << "," << paths[p][k+i];
+			}
+			output << std::endl;
+		}
+		timings << "{\"tool\":\"TubularGeodesicsBatch\",\"input\":\"" << scoreFileName
+		        << "\",\"stage\":\"trace\",\"pair\":" << p
+		        << ",\"seconds\":" << seconds[p]
+		        << ",\"vertices\":" << paths[p].size() / SSDimension
+		        << ",\"success\":" << (results[p] == eSuccess ? "true" : "false") << "}" << std::endl;
+	}
+
+	totalTime.Stop();
+	timings << "{\"tool\":\"TubularGeodesicsBatch\",\"input\":\"" << scoreFileName
+	        << "\",\"stage\":\"total\",\"seconds\":" << totalTime.GetTotal()
+	        << ",\"pairs\":" << pairs.size()
+	        << ",\"failures\":" << numberOfFailures
+	        << ",\"threads\":" << numberOfThreads
+	        << ",\"parallelSearches\":" << numberOfParallelSearches << "}" << std::endl;
+
+	if( !metricsFileName.empty() )
+	{
+		WriteMetrics( metricsFileName );
+	}
+	if( !traceFileName.empty() && !itk::TraceEventRecorder::GetInstance()->WriteFile( traceFileName ) )
+	{
+		std::cerr << "Could not write the trace events to " << traceFileName << std::endl;
+	}
+
+	return numberOfFailures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
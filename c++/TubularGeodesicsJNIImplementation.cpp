@@ -3,58 +3,132 @@
 #include <iostream>
 
 #include "FijiITKInterface_TubularGeodesics.h"
-#include "itkImage.h"
-#include "itkNumericTraits.h"
-#include "itkImageFileReader.h"
-#include "itkTubularMetricToPathFilter.h"
+#include "TubularGeodesicsSession.h"
+#include "OOFTubularityMeasure.h"
+#include "itkImportImageFilter.h"
+#include "itkMetricsRegistry.h"
+#include "itkTraceEventRecorder.h"
 #include <itkMultiThreader.h>
-#include <itkSemaphore.h>
 #include <itkFastMutexLock.h>
-#include "vnl/vnl_math.h"
+#include <itkMutexLock.h>
+#include <itkConditionVariable.h>
 #include <jni.h>
-
-#ifndef _WIN32
-	#include <unistd.h>
+#include <map>
+#include <limits>
+#include <exception>
+#include <deque>
+#include <list>
+
+#ifndef _WIN32
+	#include <unistd.h>
 #endif
 
 using std::cout;
 using std::endl;
 using std::flush;
 
-// Consts and typedefs
-const unsigned int Dimension = 3;
-const unsigned int SSDimension = Dimension+1;
-typedef float																												 TubularityScorePixelType;
-typedef itk::Image<TubularityScorePixelType,4>	                     TubularityScoreImageType;
-typedef TubularityScoreImageType::RegionType                         RegionType;
-typedef TubularityScoreImageType::SizeType                           SizeType;
+// Global variables
 
-typedef TubularityScoreImageType::IndexValueType                     IndexValueType;
-typedef TubularityScoreImageType::IndexType                          IndexType;
-typedef TubularityScoreImageType::PointType                          OriginType;
-typedef TubularityScoreImageType::SpacingType                        SpacingType;
+// Sessions opened from Java, indexed by the handle returned to Java.
+// The session used by startSearch (score given by filename) is not in the map.
+typedef std::map< jlong, TubularGeodesicsSession::Pointer > SessionMapType;
+SessionMapType openSessions;
+jlong nextSessionHandle = 1;
+itk::FastMutexLock::Pointer sessionsMutex = itk::FastMutexLock::New();
+TubularGeodesicsSession::Pointer defaultSession = TubularGeodesicsSession::New();
 
-typedef itk::TubularMetricToPathFilter< TubularityScoreImageType >  PathFilterType;
-typedef PathFilterType::VertexType			             VertexType;
+JavaVM * globalJVM = NULL;
 
-typedef itk::ImageFileReader< TubularityScoreImageType >             ImageReaderType;
+/**
+ * One search, from the JNI call that submits it to the report of its
+ * result. Everything a worker needs is copied in the request, so that
+ * concurrent searches do not share any mutable state.
+ */
+class TracingRequest {
 
-// Global variables
-TubularityScoreImageType::Pointer tubularityScore;
-bool isTubularityScoreLoaded = false;
-std::vector< float > Outputpath;
+public:
+    // Either a filename to load in the session, or empty if the
+    // search runs on an already loaded session
+    std::string tubularityFilename;
+    TubularGeodesicsSession::Pointer session;
+    float pt1[3];
+    float pt2[3];
+    // Global references, deleted once the result has been reported
+    jobject pathResultObject;
+    jobject javaSearchThread;
+    // The TubularGeodesics object the search was started from
+    jobject submitter;
+    itk::CancellationToken::Pointer cancellationToken;
+    std::vector< float > outputPath;
+};
 
-JavaVM * globalJVM = NULL;
-jobject pathResultObject;
-jobject javaSearchThread;
-itk::FastMutexLock::Pointer globalMutex = itk::FastMutexLock::New();
-bool pleaseStop;
+// Bounded pool of worker threads running the submitted requests.
+// Workers are spawned on demand, up to maximumNumberOfWorkers, and stay
+// attached to the JVM waiting for new requests.
+std::deque< TracingRequest * > pendingRequests;
+std::list< TracingRequest * > submittedRequests;
+itk::SimpleMutexLock requestsMutex;
+itk::ConditionVariable::Pointer requestsAvailable = itk::ConditionVariable::New();
+itk::MultiThreader::Pointer workersThreader = itk::MultiThreader::New();
+unsigned int numberOfWorkers = 0;
+unsigned int numberOfIdleWorkers = 0;
+unsigned int maximumNumberOfWorkers = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+
+// Searches given a score file all run on defaultSession. Searches on the
+// same file run concurrently; another file is only loaded once no search
+// runs on the previous one, so that the score cannot be replaced between
+// the load and the search.
+itk::SimpleMutexLock defaultScoreMutex;
+itk::ConditionVariable::Pointer defaultScoreReleased = itk::ConditionVariable::New();
+std::string defaultScoreFilename;
+unsigned int numberOfDefaultScoreSearches = 0;
+
+/**
+ * Holds the score file of defaultSession for the lifetime of a search.
+ * Nothing is held for an empty filename, i.e. a search on a session
+ * that is already loaded.
+ */
+class DefaultScoreUse {
+
+public:
+    DefaultScoreUse(const std::string & filename): m_Active(!filename.empty())
+    {
+        if (!m_Active) {
+            return;
+        }
+        defaultScoreMutex.Lock();
+        while (numberOfDefaultScoreSearches > 0 && defaultScoreFilename != filename) {
+            defaultScoreReleased->Wait(&defaultScoreMutex);
+        }
+        defaultScoreFilename = filename;
+        ++numberOfDefaultScoreSearches;
+        defaultScoreMutex.Unlock();
+    }
+
+    ~DefaultScoreUse()
+    {
+        if (!m_Active) {
+            return;
+        }
+        defaultScoreMutex.Lock();
+        if (--numberOfDefaultScoreSearches == 0) {
+            defaultScoreReleased->Broadcast();
+        }
+        defaultScoreMutex.Unlock();
+    }
+
+private:
+    bool m_Active;
+};
 
 JNIEXPORT void JNICALL
 reportProgress(JNIEnv *env, jobject obj, jfloat proportionDone)
 {
+  // Workers never return to Java, their local references have to be
+  // deleted explicitly
   jclass cls = env->GetObjectClass(obj);
   jmethodID mid = env->GetMethodID(cls, "reportProgress", "(F)V");
+  env->DeleteLocalRef(cls);
   if (! mid) {
       cout << "Failed to find the reportProgress method" << endl;
       return;
@@ -67,6 +141,7 @@ reportFinished(JNIEnv *env, jobject obj, jboolean success)
 {
   jclass cls = env->GetObjectClass(obj);
   jmethodID mid = env->GetMethodID(cls, "reportFinished", "(Z)V");
+  env->DeleteLocalRef(cls);
   if (! mid) {
       cout << "Failed to find the reportFinished method" << endl;
       return;
@@ -74,128 +149,66 @@ reportFinished(JNIEnv *env, jobject obj, jboolean success)
   env->CallVoidMethod(obj, mid, success);
 }
 
-// For a Given Location, Get the Optimal scale, 
 /**
- * ITK related methods: 
- * 
+ * Forwards the progress events of a search to the Java tracer. It is
+ * called from the worker thread running the search.
  */
-void GetOptimalScale(IndexType *point)
-{
-  TubularityScorePixelType bestScore    =  itk::NumericTraits< TubularityScorePixelType >::min();
-  IndexType scaleSpaceSourceVertexIndex = *point;
-  RegionType region                     = tubularityScore->GetBufferedRegion();
-  IndexValueType noOfScales             = region.GetSize()[Dimension];	       
-  IndexValueType scaleStartIndex        = region.GetIndex()[Dimension];	       
-  IndexValueType scaleEndIndex          = scaleStartIndex + noOfScales - 1; 
-  IndexValueType bestScaleIndex         = 0;
-  for(IndexValueType sourceScaleIndex   = scaleStartIndex;
-     sourceScaleIndex  <= scaleEndIndex;       			      
-     sourceScaleIndex++)
+class ReportProgressCommand : public itk::Command
+{
+public:
+    typedef ReportProgressCommand   Self;
+    typedef itk::Command            Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+    itkNewMacro(Self);
+
+    void SetJavaSearchThread(JNIEnv * env, jobject javaSearchThread)
     {
-      scaleSpaceSourceVertexIndex[Dimension] = sourceScaleIndex;
-      if( bestScore < tubularityScore->GetPixel( scaleSpaceSourceVertexIndex ) )
-	{
-	  bestScore = tubularityScore->GetPixel( scaleSpaceSourceVertexIndex );				       
-	  bestScaleIndex = sourceScaleIndex;
-	}
+        m_Env = env;
+        m_JavaSearchThread = javaSearchThread;
+    }
+
+    void Execute(itk::Object * caller, const itk::EventObject & event)
+    {
+        this->Execute( (const itk::Object *) caller, event );
     }
-  
-  (*point)[Dimension] = bestScaleIndex;  
-}
 
-enum ExecuteReturnValues {
-    eSuccess = 0,
-    eInterrupted = 1,
-    eFailed = 2
+    void Execute(const itk::Object * caller, const itk::EventObject & event)
+    {
+        const itk::ProcessObject * filter = dynamic_cast< const itk::ProcessObject * >( caller );
+        if ( !filter || !itk::ProgressEvent().CheckEvent( &event ) ) {
+            return;
+        }
+        reportProgress(m_Env, m_JavaSearchThread, filter->GetProgress());
+    }
+
+protected:
+    ReportProgressCommand(): m_Env(NULL), m_JavaSearchThread(NULL) {}
+
+private:
+    JNIEnv * m_Env;
+    jobject  m_JavaSearchThread;
 };
 
-// Computes the minimal path between 2 provided points
-/**
- * ITK related methods: 
- * 
- */
-int
-Execute( float* pt1, float* pt2)
+TubularGeodesicsSession::Pointer GetSession(jlong handle)
 {
+    TubularGeodesicsSession::Pointer session;
+    sessionsMutex->Lock();
+    SessionMapType::iterator it = openSessions.find(handle);
+    if (it != openSessions.end()) {
+        session = it->second;
+    }
+    sessionsMutex->Unlock();
+    return session;
+}
 
-  // Instantiate the path filter
-  PathFilterType::Pointer pathFilter = PathFilterType::New();
-  
-  // Set the tubularity score
-  pathFilter->SetInput( tubularityScore );
-
-  // Get the start and end points and give them to the path filter
-  IndexType startPoint;
-  IndexType endPoint;
-  for(unsigned int i = 0; i < Dimension; i++)
-    {
-      startPoint[i] = pt1[i];
-      endPoint[i]   = pt2[i];
-    }
-  // Get and assign to them the optimal scale
-  GetOptimalScale( &startPoint );
-  GetOptimalScale( &endPoint );
-  pathFilter->SetStartPoint( startPoint );
-  pathFilter->AddPathEndPoint( endPoint );
-  
-  // Get the sub region to be processed
-  // Warning a padding parameter is hardcoded
-  RegionType region = tubularityScore->GetBufferedRegion();
-   
-  RegionType subRegionToProcess;
-  IndexType startSubRegion;
-  SizeType  sizeSubRegion;
-  
-  // No Padding or sub-selcetion on the scale dimension
-  startSubRegion[Dimension] = region.GetIndex()[Dimension];
-  sizeSubRegion[Dimension]  = region.GetSize()[Dimension];
-  // extract sub region and pad it in the spatial domain
-  //TODO: This shouldn't be hardcoded
-  int subRegionPad    = 20;
-  //TODO: This shouldn't be hardcoded
-  // Anyways, we'll get rid of it soon ;-)
-  for(unsigned int i = 0; i < Dimension; i++)
-    {
-      IndexValueType minIndex = vnl_math_min( startPoint[i], endPoint[i] );
-      IndexValueType maxIndex = vnl_math_max( startPoint[i], endPoint[i] );
-      startSubRegion[i] = vnl_math_max( minIndex - subRegionPad, region.GetIndex()[i] );
-      IndexValueType maxSubRegionIndex = vnl_math_min( int(maxIndex + subRegionPad), int(region.GetIndex()[i] + region.GetSize()[i] -1) );
-      sizeSubRegion[i]  = maxSubRegionIndex - startSubRegion[i] + 1;
-    }
-  subRegionToProcess.SetIndex( startSubRegion );
-  subRegionToProcess.SetSize( sizeSubRegion );
-
-  pathFilter->SetRegionToProcess(subRegionToProcess);
-  try {
-      pathFilter->Update();
-  } catch (itk::ProcessAborted &e) {
-      return eInterrupted;
-  }
-  
-	SpacingType spacing = tubularityScore->GetSpacing();
-  OriginType  origin = tubularityScore->GetOrigin();
-	
-	// Get the minimum spacing among all the spatial dimensions.
-	double minSpacing = spacing[0];
-	for(unsigned int i = 1; i < Dimension-1; i++)
-	{
-		minSpacing = vnl_math_min(minSpacing, spacing[i]);
-	}
-	
-	// Downsample the path and smooth it slightly.
-	pathFilter->GetPath(0)->Resample(0.5 * minSpacing, tubularityScore.GetPointer());
-	pathFilter->GetPath(0)->SmoothVertexLocationsAndRadii(minSpacing, tubularityScore.GetPointer());
-
-  Outputpath.clear();
-  for(unsigned int k = 0; k < pathFilter->GetPath(0)->GetVertexList()->Size(); k++)
-	{
-		VertexType vertex = pathFilter->GetPath(0)->GetVertexList()->GetElement(k);
-		for (unsigned int i = 0; i < Dimension+1; i++) 
-	  {
-	    Outputpath.push_back(vertex[i]*spacing[i]+origin[i]);
-	  }
-	}
-  return eSuccess;
+// Raises a java.lang.RuntimeException in the calling Java thread; it is
+// thrown once the native method returns.
+void ThrowJavaException(JNIEnv * env, const char * message)
+{
+    jclass exceptionClass = env->FindClass("java/lang/RuntimeException");
+    if (exceptionClass) {
+        env->ThrowNew(exceptionClass, message);
+    }
 }
 
 /**
@@ -253,197 +266,98 @@ void setErrorMessage(JNIEnv * env,
                pathResultClass);
 }
 
-class UserData {
-
-public:
-    jstring jTubularityFilename;
-    jfloatArray jPoint1;
-    jfloatArray jPoint2;
-    itk::Semaphore * semaphoreUserDataCopied;
-};
-
-void releaseJVM(UserData * userData) {
-    delete userData;
-    globalJVM->DetachCurrentThread();
-    globalMutex->Lock();
-    globalJVM = NULL;
-    globalMutex->Unlock();
+/**
+ * Reports a search that failed with the given message as finished, so
+ * that the Java tracer does not keep waiting for it.
+ */
+void reportFailure(JNIEnv * env,
+                   TracingRequest * request,
+                   jclass pathResultClass,
+                   const char * message)
+{
+    setErrorMessage(env,
+                    message,
+                    request->pathResultObject,
+                    pathResultClass);
+    reportFinished(env,
+                   request->javaSearchThread,
+                   false);
 }
 
-ITK_THREAD_RETURN_TYPE ThreadedFunction(void* param) {
-
-    JNIEnv * env;
-    UserData * userData = NULL;
-	// From: http://www.adamish.com/blog/archives/327
-
-    int getEnvStat = globalJVM->GetEnv((void **)&env, JNI_VERSION_1_6);
-    if (getEnvStat == JNI_EDETACHED) {
-        if (globalJVM->AttachCurrentThread((void **)&env, NULL) != 0) {
-            cout << "Failed to attach to JVM" << endl;
-            return ITK_THREAD_RETURN_VALUE;
-        }
-    } else if (getEnvStat == JNI_OK) {
-    } else if (getEnvStat == JNI_EVERSION) {
-        cout << "Failed to attach to JVM with GetEnv: version not supported" << endl;
-    }
-	itk::MultiThreader::ThreadInfoStruct* threadInfo = static_cast<itk::MultiThreader::ThreadInfoStruct*>(param);
-
-    if (!threadInfo)  {
-        cout << "Failed to get the thread info" << endl;
-        releaseJVM(userData);
-        return ITK_THREAD_RETURN_VALUE;
-    }
-	userData = static_cast<UserData*>(threadInfo->UserData);
-
-    // Generate global references for the two objects that were passed in:
-
-    jclass pathResultClass = env->GetObjectClass(pathResultObject);
-
-    // Check that the float arrays are of the right length:
-	int pt1Length = env->GetArrayLength(userData->jPoint1);
-    int pt2Length = env->GetArrayLength(userData->jPoint2);
-
-    if (pt1Length != 3) {
-        cout << "wrong length of pt1" << endl;
-
-        setErrorMessage(env,
-                        "pt1 was not of length 3",
-                        pathResultObject,
-                        pathResultClass);
-        releaseJVM(userData);
-        return ITK_THREAD_RETURN_VALUE;
-    }
-	if (pt2Length != 3) {
-        cout << "wrong length of pt2" << endl;
-        setErrorMessage(env,
-                        "pt2 was not of length 3",
-                        pathResultObject,
-                        pathResultClass);
-        releaseJVM(userData);
-        return ITK_THREAD_RETURN_VALUE;
-    }
-
-    // And convert them to C types:
-	jboolean isPoint1Copy, isPoint2Copy;
-    jfloat * pt1 = env->GetFloatArrayElements(userData->jPoint1, &isPoint1Copy);
-    jfloat * pt2 = env->GetFloatArrayElements(userData->jPoint2, &isPoint2Copy);
-
-    float copiedPt1[3], copiedPt2[3];
-
-    for(int i = 0; i < 3; ++i ) {
-        copiedPt1[i] = pt1[i];
-        copiedPt2[i] = pt2[i];
-    }
-
-    env->ReleaseFloatArrayElements(userData->jPoint1, pt1, 0);
-    env->ReleaseFloatArrayElements(userData->jPoint2, pt2, 0);
-
-    // Now get the filename:
-
-    const char * filename = env->GetStringUTFChars(userData->jTubularityFilename, NULL);
-
-    if (!filename) {
-        setErrorMessage(env,
-                        "Failed to convert the filename",
-                        pathResultObject,
-                        pathResultClass);
-
-        releaseJVM(userData);
-        return ITK_THREAD_RETURN_VALUE;
-    }
-
-    // Now we can safely allow the function that spawned this thread
-    // to return:
-	userData->semaphoreUserDataCopied->Up();
-
-    // ------------------------------------------------------------------------
+/**
+ * Runs one search on a worker thread and reports its result to Java.
+ */
+void runRequest(JNIEnv * env, TracingRequest * request)
+{
+    itk::TraceEventRecorder::ScopedEvent requestEvent("runRequest", "jni");
+    jclass pathResultClass = env->GetObjectClass(request->pathResultObject);
 
     /**
      * Fethallah 
      * First, check if the tubularity score image is loaded.
-     * If not, load it
+     * If not, load it. The session only reads the file again when the
+     * filename changed, and keeps it until the search is done.
      */
-	std::cout << filename << std::endl;
-    if( !isTubularityScoreLoaded )
-      {
-	ImageReaderType::Pointer reader = ImageReaderType::New();
-	reader->SetFileName( filename );
-	try
-	  {
-	    reader->Update();
-	  }
-	catch(itk::ExceptionObject &e)   
-	  {      
-          std::cerr << e << endl;
-          env->ReleaseStringUTFChars(userData->jTubularityFilename, filename);
-          setErrorMessage(env,
-                          e.GetDescription(),
-                          pathResultObject,
-                          pathResultClass);
-
-          releaseJVM(userData);
-          return ITK_THREAD_RETURN_VALUE;
-	  }
-	
-	tubularityScore = reader->GetOutput();
-	tubularityScore->DisconnectPipeline();
-	isTubularityScoreLoaded = true;
-      }
+    DefaultScoreUse scoreUse(request->tubularityFilename);
+    if (!request->tubularityFilename.empty()) {
+        try {
+            request->session->LoadFromFile( request->tubularityFilename.c_str() );
+        } catch(itk::ExceptionObject &e) {
+            std::cerr << e << endl;
+            reportFailure(env, request, pathResultClass, e.GetDescription());
+            return;
+        } catch(std::exception &e) {
+            // e.g. std::bad_alloc when the score is read
+            std::cerr << e.what() << endl;
+            reportFailure(env, request, pathResultClass, e.what());
+            return;
+        }
+    }
     /**
      * Fethallah 
      * At this point, the tubularity score is supposed to be loaded and
      * the start and end points are given
      * One just needs to call the Execute method and convert the output
      */
+    ReportProgressCommand::Pointer progressCommand = ReportProgressCommand::New();
+    progressCommand->SetJavaSearchThread(env, request->javaSearchThread);
     try {
-        int executeResult = Execute( copiedPt1, copiedPt2 );
+        int executeResult = request->session->Execute( request->pt1,
+                                                       request->pt2,
+                                                       request->outputPath,
+                                                       request->cancellationToken,
+                                                       progressCommand );
         if (eInterrupted == executeResult) {
-            // ... then interrupt
-
-            /*
-            setSuccess(env,
-                       true,
-                       pathResultObject,
-                       pathResultClass);
-            */
-
             reportFinished(env,
-                           javaSearchThread,
+                           request->javaSearchThread,
                            false);
-            releaseJVM(userData);
-            return ITK_THREAD_RETURN_VALUE;
+            return;
         }
     } catch(itk::ExceptionObject &e) {
-        env->ReleaseStringUTFChars(userData->jTubularityFilename, filename);
-        setErrorMessage(env,
-                        e.GetDescription(),
-                        pathResultObject,
-                        pathResultClass);
-        releaseJVM(userData);
-        return ITK_THREAD_RETURN_VALUE;
+        reportFailure(env, request, pathResultClass, e.GetDescription());
+        return;
+    } catch(std::exception &e) {
+        // e.g. std::bad_alloc when the fast marching buffers are allocated
+        reportFailure(env, request, pathResultClass, e.what());
+        return;
     }
 
-    long nb_points  = Outputpath.size() / 4;
-    float * pathPoints = new float[nb_points*4];
-    for(int i = 0; i < 4*nb_points; ++i ) 
-      {
-	pathPoints[i] = Outputpath[i];
-      }
-
     // Now convert that to a Java float array:
 
-    jfloatArray jResultArray = env->NewFloatArray(nb_points * 4);
+    itk::TraceEventRecorder::ScopedEvent copyEvent("copyPathToJava", "jni");
+    jsize nb_values = request->outputPath.size();
+    jfloatArray jResultArray = env->NewFloatArray(nb_values);
     if (!jResultArray) {
         cout << "Failed to allocate a new Java float array" << endl;
-        env->ReleaseStringUTFChars(userData->jTubularityFilename, filename);
-        releaseJVM(userData);
-        return ITK_THREAD_RETURN_VALUE;
+        return;
     }
 
-    env->SetFloatArrayRegion(jResultArray,
-                             0,
-                             nb_points * 4,
-                             (jfloat *)pathPoints);
+    if (nb_values > 0) {
+        env->SetFloatArrayRegion(jResultArray,
+                                 0,
+                                 nb_values,
+                                 (jfloat *)&request->outputPath[0]);
+    }
 
     {
         jmethodID mid = env->GetMethodID(pathResultClass,
@@ -451,42 +365,152 @@ ITK_THREAD_RETURN_TYPE ThreadedFunction(void* param) {
                                          "([F)V");
         if (!mid) {
             cout << "Failed to find the setPath method" << endl;
-            env->ReleaseStringUTFChars(userData->jTubularityFilename, filename);
-            releaseJVM(userData);
-            return ITK_THREAD_RETURN_VALUE;
+            return;
         }
 
-        env->CallVoidMethod(pathResultObject,
+        env->CallVoidMethod(request->pathResultObject,
                             mid,
                             jResultArray);
     }
 
     env->DeleteLocalRef(jResultArray);
 
-    delete [] pathPoints;
-
     // ------------------------------------------------------------------------
 
     setSuccess(env,
                true,
-               pathResultObject,
+               request->pathResultObject,
                pathResultClass);
 
     reportFinished(env,
-                   javaSearchThread,
+                   request->javaSearchThread,
                    true);
+}
 
-    env->ReleaseStringUTFChars(userData->jTubularityFilename, filename);
+ITK_THREAD_RETURN_TYPE WorkerFunction(void *) {
 
-    /* Now we can delete the global references to the two objects that
-       were passed in: */
-    env->DeleteGlobalRef(pathResultObject);
-    env->DeleteGlobalRef(javaSearchThread);
+    JNIEnv * env;
+	// From: http://www.adamish.com/blog/archives/327
+    // Workers are daemon threads, they must not prevent the JVM from exiting.
+    if (globalJVM->AttachCurrentThreadAsDaemon((void **)&env, NULL) != 0) {
+        cout << "Failed to attach to JVM" << endl;
+        requestsMutex.Lock();
+        --numberOfWorkers;
+        requestsMutex.Unlock();
+        return ITK_THREAD_RETURN_VALUE;
+    }
+
+    while (true) {
+        requestsMutex.Lock();
+        ++numberOfIdleWorkers;
+        while (pendingRequests.empty()) {
+            requestsAvailable->Wait(&requestsMutex);
+        }
+        --numberOfIdleWorkers;
+        TracingRequest * request = pendingRequests.front();
+        pendingRequests.pop_front();
+        requestsMutex.Unlock();
+
+        itk::TraceEventRecorder::GetInstance()->SetCurrentThreadName("tracing worker");
+        // The worker stays attached to the JVM: the local references made
+        // by a request are freed with its own frame.
+        if (env->PushLocalFrame(16) == 0) {
+            runRequest(env, request);
+            env->PopLocalFrame(NULL);
+        } else {
+            cout << "Failed to allocate the local references of a search" << endl;
+            env->ExceptionClear();
+            reportFinished(env, request->javaSearchThread, false);
+        }
+
+        requestsMutex.Lock();
+        submittedRequests.remove(request);
+        requestsMutex.Unlock();
 
-    releaseJVM(userData);
+        /* Now we can delete the global references to the two objects that
+           were passed in: */
+        env->DeleteGlobalRef(request->pathResultObject);
+        env->DeleteGlobalRef(request->javaSearchThread);
+        env->DeleteGlobalRef(request->submitter);
+        delete request;
+    }
     return ITK_THREAD_RETURN_VALUE;
 }
 
+/**
+ * Queues a search on the given session. If jTubularityFilename is not
+ * NULL, the score is first loaded from that file into the session.
+ * The points and the filename are copied before returning, the search
+ * itself runs on one of the workers.
+ */
+void submitSearch(JNIEnv * env,
+                  jobject submitter,
+                  TubularGeodesicsSession * session,
+                  jstring jTubularityFilename,
+                  jfloatArray jPoint1,
+                  jfloatArray jPoint2,
+                  jobject passedPathResultObject,
+                  jobject passedJavaSearchThread)
+{
+    jclass pathResultClass = env->GetObjectClass(passedPathResultObject);
+
+    // Check that the float arrays are of the right length:
+    if (env->GetArrayLength(jPoint1) != 3) {
+        cout << "wrong length of pt1" << endl;
+        setErrorMessage(env,
+                        "pt1 was not of length 3",
+                        passedPathResultObject,
+                        pathResultClass);
+        return;
+    }
+    if (env->GetArrayLength(jPoint2) != 3) {
+        cout << "wrong length of pt2" << endl;
+        setErrorMessage(env,
+                        "pt2 was not of length 3",
+                        passedPathResultObject,
+                        pathResultClass);
+        return;
+    }
+
+    TracingRequest * request = new TracingRequest();
+    request->session = session;
+    env->GetFloatArrayRegion(jPoint1, 0, 3, request->pt1);
+    env->GetFloatArrayRegion(jPoint2, 0, 3, request->pt2);
+
+    // Now get the filename, if any:
+    if (jTubularityFilename) {
+        const char * filename = env->GetStringUTFChars(jTubularityFilename, NULL);
+        if (!filename) {
+            setErrorMessage(env,
+                            "Failed to convert the filename",
+                            passedPathResultObject,
+                            pathResultClass);
+            delete request;
+            return;
+        }
+        request->tubularityFilename = filename;
+        env->ReleaseStringUTFChars(jTubularityFilename, filename);
+    }
+
+    request->pathResultObject = env->NewGlobalRef(passedPathResultObject);
+    request->javaSearchThread = env->NewGlobalRef(passedJavaSearchThread);
+    request->submitter = env->NewGlobalRef(submitter);
+    request->cancellationToken = itk::CancellationToken::New();
+
+    requestsMutex.Lock();
+    if (!globalJVM) {
+        env->GetJavaVM(&globalJVM);
+    }
+    pendingRequests.push_back(request);
+    submittedRequests.push_back(request);
+    if (numberOfIdleWorkers < pendingRequests.size() &&
+        numberOfWorkers < maximumNumberOfWorkers) {
+        ++numberOfWorkers;
+        workersThreader->SpawnThread( &WorkerFunction, NULL );
+    }
+    requestsAvailable->Signal();
+    requestsMutex.Unlock();
+}
 
 /*
  * Class:     FijiITKInterface_TubularGeodesics
@@ -494,11 +518,50 @@ ITK_THREAD_RETURN_TYPE ThreadedFunction(void* param) {
  * Signature: ()V
  */
 JNIEXPORT void JNICALL Java_FijiITKInterface_TubularGeodesics_interruptSearch
-  (JNIEnv *, jobject)
+  (JNIEnv * env, jobject submitter)
+{
+    // Only the searches started from this object: other tracers sharing
+    // the worker pool keep running.
+    requestsMutex.Lock();
+    for (std::list< TracingRequest * >::iterator it = submittedRequests.begin();
+         it != submittedRequests.end(); ++it) {
+        if (env->IsSameObject((*it)->submitter, submitter)) {
+            (*it)->cancellationToken->Cancel();
+        }
+    }
+    requestsMutex.Unlock();
+}
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    interruptSearchOf
+ * Signature: (Ltracing/TubularGeodesicsTracer;)V
+ */
+JNIEXPORT void JNICALL Java_FijiITKInterface_TubularGeodesics_interruptSearchOf
+  (JNIEnv * env, jobject, jobject passedJavaSearchThread)
+{
+    requestsMutex.Lock();
+    for (std::list< TracingRequest * >::iterator it = submittedRequests.begin();
+         it != submittedRequests.end(); ++it) {
+        if (env->IsSameObject((*it)->javaSearchThread, passedJavaSearchThread)) {
+            (*it)->cancellationToken->Cancel();
+        }
+    }
+    requestsMutex.Unlock();
+}
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    setMaximumNumberOfSearchThreads
+ * Signature: (I)V
+ */
+JNIEXPORT void JNICALL Java_FijiITKInterface_TubularGeodesics_setMaximumNumberOfSearchThreads
+  (JNIEnv *, jobject, jint maximumNumberOfThreads)
 {
-    globalMutex->Lock();
-    pleaseStop = true;
-    globalMutex->Unlock();
+    // Workers already running are kept, the bound applies to new ones.
+    requestsMutex.Lock();
+    maximumNumberOfWorkers = vnl_math_max(1, int(maximumNumberOfThreads));
+    requestsMutex.Unlock();
 }
 
 /*
@@ -508,55 +571,650 @@ JNIEXPORT void JNICALL Java_FijiITKInterface_TubularGeodesics_interruptSearch
  */
 JNIEXPORT void JNICALL Java_FijiITKInterface_TubularGeodesics_startSearch
  (JNIEnv * env,
-  jobject ignored,
+  jobject submitter,
   jstring jTubularityFilename,
   jfloatArray jPoint1,
   jfloatArray jPoint2,
   jobject passedPathResultObject,
   jobject passedJavaSearchThread)
 {
-    globalMutex->Lock();
-    if (globalJVM) {
-        reportFinished(env, passedJavaSearchThread, false);
-        globalMutex->Unlock();
-        env->DeleteGlobalRef(pathResultObject);
-        env->DeleteGlobalRef(javaSearchThread);
-        return;
-    } else {
-        env->GetJavaVM(&globalJVM);
-        globalMutex->Unlock();
+    submitSearch(env,
+                 submitter,
+                 defaultSession,
+                 jTubularityFilename,
+                 jPoint1,
+                 jPoint2,
+                 passedPathResultObject,
+                 passedJavaSearchThread);
+}
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    openSession
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_FijiITKInterface_TubularGeodesics_openSession
+  (JNIEnv *, jobject)
+{
+    sessionsMutex->Lock();
+    jlong handle = nextSessionHandle++;
+    openSessions[handle] = TubularGeodesicsSession::New();
+    sessionsMutex->Unlock();
+    return handle;
+}
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    closeSession
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_FijiITKInterface_TubularGeodesics_closeSession
+  (JNIEnv *, jobject, jlong handle)
+{
+    TubularGeodesicsSession::Pointer session;
+    sessionsMutex->Lock();
+    SessionMapType::iterator it = openSessions.find(handle);
+    if (it != openSessions.end()) {
+        session = it->second;
+        openSessions.erase(it);
+    }
+    sessionsMutex->Unlock();
+
+    // A search still running on this session holds its own reference,
+    // the score is released when that search is done.
+    if (session) {
+        session->Close();
+    }
+}
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    loadScoreFromFile
+ * Signature: (JLjava/lang/String;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_FijiITKInterface_TubularGeodesics_loadScoreFromFile
+  (JNIEnv * env, jobject, jlong handle, jstring jTubularityFilename)
+{
+    TubularGeodesicsSession::Pointer session = GetSession(handle);
+    if (!session) {
+        cout << "No session with handle " << handle << endl;
+        return JNI_FALSE;
+    }
+
+    const char * filename = env->GetStringUTFChars(jTubularityFilename, NULL);
+    if (!filename) {
+        return JNI_FALSE;
+    }
+
+    jboolean loaded = JNI_TRUE;
+    try {
+        session->LoadFromFile( filename );
+    } catch(itk::ExceptionObject &e) {
+        std::cerr << e << endl;
+        loaded = JNI_FALSE;
+    }
+    env->ReleaseStringUTFChars(jTubularityFilename, filename);
+    return loaded;
+}
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    loadScoreFromBuffer
+ * Signature: (J[FIIIIDDDDD)Z
+ */
+JNIEXPORT jboolean JNICALL Java_FijiITKInterface_TubularGeodesics_loadScoreFromBuffer
+  (JNIEnv * env, jobject, jlong handle, jfloatArray jScore, jint width, jint height, jint NSlice, jint numberOfScales, jdouble widthpix, jdouble heightpix, jdouble depthpix, jdouble sigmaMin, jdouble sigmaMax)
+{
+    TubularGeodesicsSession::Pointer session = GetSession(handle);
+    if (!session) {
+        cout << "No session with handle " << handle << endl;
+        return JNI_FALSE;
+    }
+
+    if (width < 1 || height < 1 || NSlice < 1 || numberOfScales < 1) {
+        cout << "The dimensions of the score buffer must be positive" << endl;
+        return JNI_FALSE;
+    }
+    unsigned int size[SSDimension];
+    size[0] = width; size[1] = height; size[2] = NSlice; size[3] = numberOfScales;
+    // The number of voxels is computed in 64 bits, so that it cannot wrap
+    // around and pass for a smaller buffer.
+    const jlong numberOfPixels = jlong(width) * jlong(height) * jlong(NSlice) * jlong(numberOfScales);
+    if (jlong(env->GetArrayLength(jScore)) < numberOfPixels) {
+        cout << "The score buffer is smaller than the given dimensions" << endl;
+        return JNI_FALSE;
+    }
+
+    // Same geometry as the output of the multiscale oriented flux filter:
+    // the scale axis starts at sigmaMin with a regular step.
+    double spacing[SSDimension], origin[SSDimension];
+    spacing[0] = widthpix; spacing[1] = heightpix; spacing[2] = depthpix;
+    spacing[3] = itk::NumericTraits<double>::epsilon();
+    if (numberOfScales > 1) {
+        spacing[3] = vnl_math_max(spacing[3], (sigmaMax - sigmaMin) / (numberOfScales - 1));
+    }
+    origin[0] = 0; origin[1] = 0; origin[2] = 0; origin[3] = sigmaMin;
+
+    jfloat * score = env->GetFloatArrayElements(jScore, NULL);
+    if (!score) {
+        return JNI_FALSE;
     }
+    try {
+        session->LoadFromBuffer((const float *) score, size, spacing, origin);
+    } catch(itk::ExceptionObject &e) {
+        env->ReleaseFloatArrayElements(jScore, score, JNI_ABORT);
+        ThrowJavaException(env, e.GetDescription());
+        return JNI_FALSE;
+    } catch(std::exception &e) {
+        // e.g. std::bad_alloc when the copy of the score is allocated
+        env->ReleaseFloatArrayElements(jScore, score, JNI_ABORT);
+        ThrowJavaException(env, e.what());
+        return JNI_FALSE;
+    }
+    env->ReleaseFloatArrayElements(jScore, score, JNI_ABORT);
+    return JNI_TRUE;
+}
 
-    /* Keep these two in global variables, now that we know we're the
-       only thread running (due to checking jvm under a mutex): */
-    pathResultObject = env->NewGlobalRef(passedPathResultObject);
-    javaSearchThread = env->NewGlobalRef(passedJavaSearchThread);
+/**
+ * Computes the scale-space tubularity score of a stack handed over by Java
+ * and keeps it in the session, so that the following searches on that
+ * stack do not compute it again. The stack is wrapped without any copy.
+ */
+template<class TInputPixel>
+jboolean computeScoreOnBuffer(JNIEnv * env, jlong handle, TInputPixel * pixels,
+                              jint width, jint height, jint NSlice,
+                              jdouble widthpix, jdouble heightpix, jdouble depthpix,
+                              jdouble sigmaMin, jdouble sigmaMax, jint numberOfScales)
+{
+    TubularGeodesicsSession::Pointer session = GetSession(handle);
+    if (!session) {
+        cout << "No session with handle " << handle << endl;
+        return JNI_FALSE;
+    }
+    if (numberOfScales < 1 || sigmaMax < sigmaMin) {
+        cout << "At least one scale is needed, and sigmaMax can not be less than sigmaMin" << endl;
+        return JNI_FALSE;
+    }
 
-    globalMutex->Lock();
-    pleaseStop = false;
-    globalMutex->Unlock();
+    typedef itk::Image<TInputPixel, Dimension>             InputImageType;
+    typedef itk::ImportImageFilter<TInputPixel, Dimension> ImportFilterType;
+
+    typename InputImageType::SizeType size;
+    size[0] = width; size[1] = height; size[2] = NSlice;
+    typename InputImageType::IndexType start;
+    start.Fill(0);
+    typename InputImageType::RegionType region;
+    region.SetSize(size);
+    region.SetIndex(start);
+    double spacing[Dimension] = { widthpix, heightpix, depthpix };
+    double origin[Dimension] = { 0, 0, 0 };
+
+    typename ImportFilterType::Pointer importFilter = ImportFilterType::New();
+    importFilter->SetRegion(region);
+    importFilter->SetSpacing(spacing);
+    importFilter->SetOrigin(origin);
+    const bool importFilterWillOwnTheBuffer = false;
+    importFilter->SetImportPointer(pixels, region.GetNumberOfPixels(), importFilterWillOwnTheBuffer);
 
-    /* The code here that spawns this as a separate thread is based on
-       the example here:
-       http://docs.mitk.org/nightly-qt4/mitkITKThreadingTest_8cpp_source.html
-    */
+    try {
+        itk::TraceEventRecorder::ScopedEvent computeEvent("computeScore", "jni");
+        importFilter->Update();
+        typename InputImageType::Pointer image = importFilter->GetOutput();
+        image->DisconnectPipeline();
+        TubularityScoreImageType::Pointer score =
+            Execute<TInputPixel, Dimension>(image, sigmaMin, sigmaMax, numberOfScales);
+        session->LoadFromImage(score);
+    } catch(itk::ExceptionObject &e) {
+        // e.g. a blank stack, whose score is uniform
+        ThrowJavaException(env, e.GetDescription());
+        return JNI_FALSE;
+    }
+    return JNI_TRUE;
+}
 
-    itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
-    itk::Semaphore::Pointer semaphorePointer = itk::Semaphore::New();
-    semaphorePointer->Initialize(0);
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    computeScore
+ * Signature: (J[BIIIDDDDDI)Z
+ */
+JNIEXPORT jboolean JNICALL Java_FijiITKInterface_TubularGeodesics_computeScore
+  (JNIEnv * env, jobject, jlong handle, jbyteArray jImage, jint width, jint height, jint NSlice, jdouble widthpix, jdouble heightpix, jdouble depthpix, jdouble sigmaMin, jdouble sigmaMax, jint numberOfScales)
+{
+    jbyte * pixels = env->GetByteArrayElements(jImage, NULL);
+    if (!pixels) {
+        return JNI_FALSE;
+    }
+    jboolean computed = computeScoreOnBuffer<unsigned char>(env, handle, (unsigned char *) pixels,
+                                                            width, height, NSlice, widthpix, heightpix, depthpix,
+                                                            sigmaMin, sigmaMax, numberOfScales);
+    // The stack is only read, no need to copy it back to the Java array
+    env->ReleaseByteArrayElements(jImage, pixels, JNI_ABORT);
+    return computed;
+}
 
-    UserData * userData = new UserData();
-    userData->jTubularityFilename = jTubularityFilename;
-    userData->jPoint1 = jPoint1;
-    userData->jPoint2 = jPoint2;
-    userData->semaphoreUserDataCopied = semaphorePointer.GetPointer();
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    computeScoreGray16
+ * Signature: (J[SIIIDDDDDI)Z
+ */
+JNIEXPORT jboolean JNICALL Java_FijiITKInterface_TubularGeodesics_computeScoreGray16
+  (JNIEnv * env, jobject, jlong handle, jshortArray jImage, jint width, jint height, jint NSlice, jdouble widthpix, jdouble heightpix, jdouble depthpix, jdouble sigmaMin, jdouble sigmaMax, jint numberOfScales)
+{
+    jshort * pixels = env->GetShortArrayElements(jImage, NULL);
+    if (!pixels) {
+        return JNI_FALSE;
+    }
+    // ImageJ stores 16-bit images as unsigned values in Java shorts
+    jboolean computed = computeScoreOnBuffer<unsigned short>(env, handle, (unsigned short *) pixels,
+                                                             width, height, NSlice, widthpix, heightpix, depthpix,
+                                                             sigmaMin, sigmaMax, numberOfScales);
+    env->ReleaseShortArrayElements(jImage, pixels, JNI_ABORT);
+    return computed;
+}
 
-    itk::ThreadFunctionType functionPointer = &ThreadedFunction;
-    threader->SpawnThread( functionPointer, userData );
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    computeScoreGray32
+ * Signature: (J[FIIIDDDDDI)Z
+ */
+JNIEXPORT jboolean JNICALL Java_FijiITKInterface_TubularGeodesics_computeScoreGray32
+  (JNIEnv * env, jobject, jlong handle, jfloatArray jImage, jint width, jint height, jint NSlice, jdouble widthpix, jdouble heightpix, jdouble depthpix, jdouble sigmaMin, jdouble sigmaMax, jint numberOfScales)
+{
+    jfloat * pixels = env->GetFloatArrayElements(jImage, NULL);
+    if (!pixels) {
+        return JNI_FALSE;
+    }
+    jboolean computed = computeScoreOnBuffer<float>(env, handle, (float *) pixels,
+                                                    width, height, NSlice, widthpix, heightpix, depthpix,
+                                                    sigmaMin, sigmaMax, numberOfScales);
+    env->ReleaseFloatArrayElements(jImage, pixels, JNI_ABORT);
+    return computed;
+}
 
-    // Wait until the userData has been copied by the other thread:
-    semaphorePointer->Down();
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    getScore
+ * Signature: (J[F)Z
+ */
+JNIEXPORT jboolean JNICALL Java_FijiITKInterface_TubularGeodesics_getScore
+  (JNIEnv * env, jobject, jlong handle, jfloatArray jScore)
+{
+    TubularGeodesicsSession::Pointer session = GetSession(handle);
+    TubularityScoreImageType::Pointer score;
+    if (session) {
+        score = session->GetTubularityScore();
+    }
+    if (!score) {
+        cout << "No loaded session with handle " << handle << endl;
+        return JNI_FALSE;
+    }
+    if (score->GetBufferedRegion().GetNumberOfPixels() == 0) {
+        cout << "The score of the session with handle " << handle << " is not held as an image" << endl;
+        return JNI_FALSE;
+    }
 
-    /* Now we know that the userData has been copied, and the thread
-       is running, so we can leave the function. */
+    // x fastest, scale slowest: as many scales as the array can hold
+    const itk::SizeValueType numberOfPixels = score->GetBufferedRegion().GetNumberOfPixels();
+    if (numberOfPixels > static_cast<itk::SizeValueType>(std::numeric_limits<jsize>::max())) {
+        ThrowJavaException(env, "The score has too many voxels for a Java array");
+        return JNI_FALSE;
+    }
+    jsize length = static_cast<jsize>(numberOfPixels);
+    length = vnl_math_min(length, env->GetArrayLength(jScore));
+    env->SetFloatArrayRegion(jScore, 0, length, (const jfloat *) score->GetBufferPointer());
+    return JNI_TRUE;
+}
+
+// Path between two voxels of a session, exact or previewed, as a Java
+// array of 4 floats per vertex, or NULL if it failed.
+jfloatArray TraceSessionPath(JNIEnv * env, jlong handle, jfloatArray jPoint1, jfloatArray jPoint2,
+                             bool preview)
+{
+    TubularGeodesicsSession::Pointer session = GetSession(handle);
+    if (!session || !session->IsLoaded()) {
+        cout << "No loaded session with handle " << handle << endl;
+        return NULL;
+    }
+    if (env->GetArrayLength(jPoint1) != 3 || env->GetArrayLength(jPoint2) != 3) {
+        cout << "The points must be of length 3" << endl;
+        return NULL;
+    }
+
+    float pt1[3], pt2[3];
+    env->GetFloatArrayRegion(jPoint1, 0, 3, pt1);
+    env->GetFloatArrayRegion(jPoint2, 0, 3, pt2);
+
+    std::vector<float> path;
+    try {
+        itk::TraceEventRecorder::ScopedEvent traceEvent(preview ? "previewPath" : "tracePath", "jni");
+        if (session->Execute(pt1, pt2, path, NULL, NULL, preview) != eSuccess) {
+            return NULL;
+        }
+    } catch(itk::ExceptionObject &e) {
+        std::cerr << e << endl;
+        return NULL;
+    }
+
+    jfloatArray jPath = env->NewFloatArray(path.size());
+    if (!jPath) {
+        return NULL;
+    }
+    if (!path.empty()) {
+        env->SetFloatArrayRegion(jPath, 0, path.size(), &path[0]);
+    }
+    return jPath;
+}
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    tracePath
+ * Signature: (J[F[F)[F
+ */
+JNIEXPORT jfloatArray JNICALL Java_FijiITKInterface_TubularGeodesics_tracePath
+  (JNIEnv * env, jobject, jlong handle, jfloatArray jPoint1, jfloatArray jPoint2)
+{
+    return TraceSessionPath(env, handle, jPoint1, jPoint2, false);
+}
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    previewPath
+ * Signature: (J[F[F)[F
+ */
+JNIEXPORT jfloatArray JNICALL Java_FijiITKInterface_TubularGeodesics_previewPath
+  (JNIEnv * env, jobject, jlong handle, jfloatArray jPoint1, jfloatArray jPoint2)
+{
+    return TraceSessionPath(env, handle, jPoint1, jPoint2, true);
+}
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    tracePathThroughWaypoints
+ * Signature: (J[F)[F
+ */
+JNIEXPORT jfloatArray JNICALL Java_FijiITKInterface_TubularGeodesics_tracePathThroughWaypoints
+  (JNIEnv * env, jobject, jlong handle, jfloatArray jWaypoints)
+{
+    TubularGeodesicsSession::Pointer session = GetSession(handle);
+    if (!session || !session->IsLoaded()) {
+        cout << "No loaded session with handle " << handle << endl;
+        return NULL;
+    }
+    jsize length = env->GetArrayLength(jWaypoints);
+    if (length < 6 || length % 3 != 0) {
+        cout << "The waypoints must be at least 2 points of length 3" << endl;
+        return NULL;
+    }
+
+    std::vector<float> waypoints(length);
+    env->GetFloatArrayRegion(jWaypoints, 0, length, &waypoints[0]);
+
+    std::vector<float> path;
+    try {
+        itk::TraceEventRecorder::ScopedEvent traceEvent("tracePathThroughWaypoints", "jni");
+        if (session->ExecuteWaypoints(waypoints, path) != eSuccess) {
+            return NULL;
+        }
+    } catch(itk::ExceptionObject &e) {
+        std::cerr << e << endl;
+        return NULL;
+    }
+
+    jfloatArray jPath = env->NewFloatArray(path.size());
+    if (!jPath) {
+        return NULL;
+    }
+    if (!path.empty()) {
+        env->SetFloatArrayRegion(jPath, 0, path.size(), &path[0]);
+    }
+    return jPath;
+}
+
+// Copy of a Java path, 4 floats per vertex, or false if it is malformed.
+bool GetJavaPath(JNIEnv * env, jfloatArray jPath, std::vector<float> & path)
+{
+    jsize length = env->GetArrayLength(jPath);
+    if (length == 0 || length % 4 != 0) {
+        cout << "The path must be given as 4 floats per vertex" << endl;
+        return false;
+    }
+    path.resize(length);
+    env->GetFloatArrayRegion(jPath, 0, length, &path[0]);
+    return true;
+}
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    addTracedPath
+ * Signature: (J[F)J
+ */
+JNIEXPORT jlong JNICALL Java_FijiITKInterface_TubularGeodesics_addTracedPath
+  (JNIEnv * env, jobject, jlong handle, jfloatArray jPath)
+{
+    TubularGeodesicsSession::Pointer session = GetSession(handle);
+    std::vector<float> path;
+    if (!session || !GetJavaPath(env, jPath, path)) {
+        return 0;
+    }
+    try {
+        return session->AddTracedPath(path);
+    } catch(itk::ExceptionObject &e) {
+        std::cerr << e << endl;
+        return 0;
+    }
+}
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    removeTracedPath
+ * Signature: (JJ)Z
+ */
+JNIEXPORT jboolean JNICALL Java_FijiITKInterface_TubularGeodesics_removeTracedPath
+  (JNIEnv *, jobject, jlong handle, jlong pathId)
+{
+    TubularGeodesicsSession::Pointer session = GetSession(handle);
+    if (!session || pathId <= 0) {
+        return JNI_FALSE;
+    }
+    return session->RemoveTracedPath(pathId) ? JNI_TRUE : JNI_FALSE;
+}
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    clearTracedPaths
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_FijiITKInterface_TubularGeodesics_clearTracedPaths
+  (JNIEnv *, jobject, jlong handle)
+{
+    TubularGeodesicsSession::Pointer session = GetSession(handle);
+    if (session) {
+        session->ClearTracedPaths();
+    }
+}
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    snapToTracedPath
+ * Signature: (J[FD)[D
+ */
+JNIEXPORT jdoubleArray JNICALL Java_FijiITKInterface_TubularGeodesics_snapToTracedPath
+  (JNIEnv * env, jobject, jlong handle, jfloatArray jPoint, jdouble maxDistance)
+{
+    TubularGeodesicsSession::Pointer session = GetSession(handle);
+    if (!session || env->GetArrayLength(jPoint) != 3) {
+        return NULL;
+    }
+    float point[3];
+    env->GetFloatArrayRegion(jPoint, 0, 3, point);
+
+    PathIndexType::VertexHit hit;
+    float vertex[4];
+    if (!session->SnapToTracedPath(point, maxDistance, hit, vertex)) {
+        return NULL;
+    }
+
+    // path, vertex number, x, y, z, radius, distance
+    jdouble result[7] = { jdouble(hit.PathId), jdouble(hit.VertexIndex),
+                          vertex[0], vertex[1], vertex[2], vertex[3], hit.Distance };
+    jdoubleArray jResult = env->NewDoubleArray(7);
+    if (!jResult) {
+        return NULL;
+    }
+    env->SetDoubleArrayRegion(jResult, 0, 7, result);
+    return jResult;
+}
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    findTracedVerticesInRadius
+ * Signature: (J[FD)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_FijiITKInterface_TubularGeodesics_findTracedVerticesInRadius
+  (JNIEnv * env, jobject, jlong handle, jfloatArray jPoint, jdouble radius)
+{
+    TubularGeodesicsSession::Pointer session = GetSession(handle);
+    if (!session || env->GetArrayLength(jPoint) != 3) {
+        return NULL;
+    }
+    float point[3];
+    env->GetFloatArrayRegion(jPoint, 0, 3, point);
+
+    std::vector<PathIndexType::VertexHit> hits;
+    session->FindTracedVerticesInRadius(point, radius, hits);
+
+    // path and vertex number of each vertex
+    std::vector<jlong> result(2 * hits.size());
+    for (unsigned int h = 0; h < hits.size(); h++) {
+        result[2 * h] = hits[h].PathId;
+        result[2 * h + 1] = hits[h].VertexIndex;
+    }
+    jlongArray jResult = env->NewLongArray(result.size());
+    if (!jResult) {
+        return NULL;
+    }
+    if (!result.empty()) {
+        env->SetLongArrayRegion(jResult, 0, result.size(), &result[0]);
+    }
+    return jResult;
+}
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    findOverlappingTracedPaths
+ * Signature: (J[FD)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_FijiITKInterface_TubularGeodesics_findOverlappingTracedPaths
+  (JNIEnv * env, jobject, jlong handle, jfloatArray jPath, jdouble tolerance)
+{
+    TubularGeodesicsSession::Pointer session = GetSession(handle);
+    std::vector<float> path;
+    if (!session || !GetJavaPath(env, jPath, path)) {
+        return NULL;
+    }
+
+    std::vector<PathIdentifierType> pathIds;
+    session->FindOverlappingTracedPaths(path, tolerance, pathIds);
+
+    std::vector<jlong> result(pathIds.begin(), pathIds.end());
+    jlongArray jResult = env->NewLongArray(result.size());
+    if (!jResult) {
+        return NULL;
+    }
+    if (!result.empty()) {
+        env->SetLongArrayRegion(jResult, 0, result.size(), &result[0]);
+    }
+    return jResult;
+}
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    startSessionSearch
+ * Signature: (J[F[FLtracing/PathResult;Ltracing/TubularGeodesicsTracer;)V
+ */
+JNIEXPORT void JNICALL Java_FijiITKInterface_TubularGeodesics_startSessionSearch
+ (JNIEnv * env,
+  jobject submitter,
+  jlong handle,
+  jfloatArray jPoint1,
+  jfloatArray jPoint2,
+  jobject passedPathResultObject,
+  jobject passedJavaSearchThread)
+{
+    TubularGeodesicsSession::Pointer session = GetSession(handle);
+    if (!session || !session->IsLoaded()) {
+        cout << "No loaded session with handle " << handle << endl;
+        reportFinished(env, passedJavaSearchThread, false);
+        return;
+    }
+
+    submitSearch(env,
+                 submitter,
+                 session,
+                 NULL,
+                 jPoint1,
+                 jPoint2,
+                 passedPathResultObject,
+                 passedJavaSearchThread);
+}
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    setMetricsEnabled
+ * Signature: (Z)V
+ */
+JNIEXPORT void JNICALL Java_FijiITKInterface_TubularGeodesics_setMetricsEnabled
+ (JNIEnv * env, jobject ignored, jboolean enabled)
+{
+    itk::MetricsRegistry::GetInstance()->SetEnabled(enabled == JNI_TRUE);
+}
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    getMetrics
+ * Signature: ()Ljava/lang/String;
+ */
+JNIEXPORT jstring JNICALL Java_FijiITKInterface_TubularGeodesics_getMetrics
+ (JNIEnv * env, jobject ignored)
+{
+    return env->NewStringUTF(itk::MetricsRegistry::GetInstance()->GetJSON().c_str());
+}
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    resetMetrics
+ * Signature: ()V
+ */
+JNIEXPORT void JNICALL Java_FijiITKInterface_TubularGeodesics_resetMetrics
+ (JNIEnv * env, jobject ignored)
+{
+    itk::MetricsRegistry::GetInstance()->Reset();
+}
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    setTraceEventsEnabled
+ * Signature: (Z)V
+ */
+JNIEXPORT void JNICALL Java_FijiITKInterface_TubularGeodesics_setTraceEventsEnabled
+ (JNIEnv * env, jobject ignored, jboolean enabled)
+{
+    itk::TraceEventRecorder::GetInstance()->SetEnabled(enabled == JNI_TRUE);
+}
+
+/*
+ * Class:     FijiITKInterface_TubularGeodesics
+ * Method:    writeTraceEvents
+ * Signature: (Ljava/lang/String;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_FijiITKInterface_TubularGeodesics_writeTraceEvents
+ (JNIEnv * env, jobject ignored, jstring jFilename)
+{
+    const char * filename = env->GetStringUTFChars(jFilename, NULL);
+    if (!filename) {
+        return JNI_FALSE;
+    }
+    bool written = itk::TraceEventRecorder::GetInstance()->WriteFile(filename);
+    env->ReleaseStringUTFChars(jFilename, filename);
+    return written ? JNI_TRUE : JNI_FALSE;
 }
@@ -0,0 +1,769 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+#ifndef __TubularGeodesicsSession_h
+#define __TubularGeodesicsSession_h
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "itkImage.h"
+#include "itkNumericTraits.h"
+#include "itkImageFileReader.h"
+#include "itkMemoryMappedImageFileReader.h"
+#include "itkTubularMetricToPathFilter.h"
+#include "itkWaypointTubularMetricToPathFilter.h"
+#include "itkTubularPathSpatialIndex.h"
+#include "itkParametricScaleProfileImageFunction.h"
+#include "itkBlockSparseScoreImageFunction.h"
+#include "itkCancellationToken.h"
+#include "itkMetricsRegistry.h"
+#include "itkTraceEventRecorder.h"
+#include "itkCommand.h"
+#include <itkFastMutexLock.h>
+#include "vnl/vnl_math.h"
+
+// Consts and typedefs
+const unsigned int Dimension = 3;
+const unsigned int SSDimension = Dimension+1;
+typedef float																												 TubularityScorePixelType;
+typedef itk::Image<TubularityScorePixelType,SSDimension>            TubularityScoreImageType;
+typedef TubularityScoreImageType::RegionType                         RegionType;
+typedef TubularityScoreImageType::SizeType                           SizeType;
+
+typedef TubularityScoreImageType::IndexValueType                     IndexValueType;
+typedef TubularityScoreImageType::IndexType                          IndexType;
+typedef TubularityScoreImageType::PointType                          OriginType;
+typedef TubularityScoreImageType::SpacingType                        SpacingType;
+
+typedef itk::TubularMetricToPathFilter< TubularityScoreImageType >  PathFilterType;
+typedef PathFilterType::VertexType			             VertexType;
+typedef itk::WaypointTubularMetricToPathFilter< TubularityScoreImageType > WaypointPathFilterType;
+typedef itk::TubularPathSpatialIndex< SSDimension >                  PathIndexType;
+typedef PathIndexType::PathIdentifierType                            PathIdentifierType;
+
+typedef itk::ImageFileReader< TubularityScoreImageType >             ImageReaderType;
+typedef itk::MemoryMappedImageFileReader< TubularityScoreImageType > MappedImageReaderType;
+typedef itk::ParametricScaleProfileImageFunction< TubularityScoreImageType > ScaleProfileFunctionType;
+typedef itk::BlockSparseScoreImageFunction< TubularityScoreImageType > SparseScoreFunctionType;
+
+enum ExecuteReturnValues {
+    eSuccess = 0,
+    eInterrupted = 1,
+    eFailed = 2
+};
+
+/** \class TubularGeodesicsSession
+ * \brief Holds a 4D tubularity score image and computes minimal paths on it.
+ *
+ * A session is opened once per stack. The score is either read from a file
+ * or handed over from memory (e.g. the output of the OOF plugin), and stays
+ * loaded until the session is closed, so that successive path queries do
+ * not reload it.
+ * Sessions are reference counted: a search that is running keeps the
+ * session alive even if it has been closed in the meantime. Execute() can be
+ * called from several threads at once.
+ * With SetCompressScore(true), the loaded score is replaced by its
+ * parametric scale profiles (see ParametricScaleProfileImageFunction),
+ * which the searches evaluate on the fly: the session then holds 16 bytes
+ * per voxel instead of 4 bytes per voxel and per scale.
+ * With SetSparseThreshold(), or when the file is a block sparse score, only
+ * the blocks of the score above a threshold are kept (see
+ * BlockSparseScoreImageFunction), the others being a slow background.
+ * The paths accepted by the user can be stored in the session with
+ * AddTracedPath(), in a spatial index (see TubularPathSpatialIndex) that
+ * snaps a click to the nearest traced vertex, or tells whether a new path
+ * overlaps the traced ones, without going through all their vertices.
+ */
+class TubularGeodesicsSession : public itk::LightObject
+{
+public:
+	typedef TubularGeodesicsSession					Self;
+	typedef itk::LightObject								Superclass;
+	typedef itk::SmartPointer<Self>					Pointer;
+	typedef itk::SmartPointer<const Self>		ConstPointer;
+
+	itkNewMacro(Self);
+	itkTypeMacro(TubularGeodesicsSession, LightObject);
+
+	/** Load the score from a file, an image or a block sparse score written
+	 * by BlockSparseScoreImageFunction::WriteFile(). Nothing is read if that
+	 * file is already the one loaded. Throws an itk::ExceptionObject if the
+	 * file can not be read.
+	 * Concurrent loads are serialized: a second call with the same file
+	 * waits for the first one and finds the score loaded. */
+	void LoadFromFile(const char * filename)
+	{
+		m_LoadMutex->Lock();
+		try
+		{
+			m_Mutex->Lock();
+			bool alreadyLoaded = m_TubularityScore.IsNotNull() && m_FileName == filename;
+			m_Mutex->Unlock();
+			if( !alreadyLoaded )
+			{
+				this->ReadScoreFile( filename );
+			}
+		}
+		catch( ... )
+		{
+			m_LoadMutex->Unlock();
+			throw;
+		}
+		m_LoadMutex->Unlock();
+	}
+
+	/** Load the score from memory. The buffer is x-fastest, scale-slowest,
+	 * as produced by the multiscale oriented flux filter. It is copied, so the
+	 * caller can release it as soon as this method returns. */
+	void LoadFromBuffer(const float * buffer, const unsigned int size[SSDimension],
+											const double spacing[SSDimension], const double origin[SSDimension])
+	{
+		RegionType region;
+		IndexType start;
+		SizeType  regionSize;
+		for(unsigned int i = 0; i < SSDimension; i++)
+		{
+			start[i] = 0;
+			regionSize[i] = size[i];
+		}
+		region.SetIndex( start );
+		region.SetSize( regionSize );
+
+		TubularityScoreImageType::Pointer tubularityScore = TubularityScoreImageType::New();
+		tubularityScore->SetRegions( region );
+		tubularityScore->SetSpacing( spacing );
+		tubularityScore->SetOrigin( origin );
+		tubularityScore->Allocate();
+		std::copy(buffer, buffer + region.GetNumberOfPixels(), tubularityScore->GetBufferPointer());
+		this->LoadScore( tubularityScore );
+	}
+
+	/** Load a score image computed in this process, e.g. by the multiscale
+	 * oriented flux filter. The image is kept as is, without any copy, and
+	 * must not be modified afterwards. */
+	void LoadFromImage(TubularityScoreImageType * tubularityScore)
+	{
+		if( !tubularityScore )
+		{
+			itkGenericExceptionMacro( << "No tubularity score image given" );
+		}
+		tubularityScore->DisconnectPipeline();
+		this->LoadScore( tubularityScore );
+	}
+
+	/** Whether LoadFromFile maps the file in memory when it can. On by default.
+	 * A mapped score is read-only. */
+	void SetUseMemoryMapping(bool useMemoryMapping)
+	{
+		m_Mutex->Lock();
+		m_UseMemoryMapping = useMemoryMapping;
+		m_Mutex->Unlock();
+	}
+
+	bool GetUseMemoryMapping() const
+	{
+		m_Mutex->Lock();
+		bool useMemoryMapping = m_UseMemoryMapping;
+		m_Mutex->Unlock();
+		return useMemoryMapping;
+	}
+
+	/** Whether the next loaded scores are compressed. Off by default.
+	 * The compression reads the whole score once, and the searches are
+	 * slightly slower since each speed is evaluated from its profile. */
+	void SetCompressScore(bool compressScore)
+	{
+		m_Mutex->Lock();
+		m_CompressScore = compressScore;
+		m_Mutex->Unlock();
+	}
+
+	bool GetCompressScore() const
+	{
+		m_Mutex->Lock();
+		bool compressScore = m_CompressScore;
+		m_Mutex->Unlock();
+		return compressScore;
+	}
+
+	/** Threshold under which the blocks of the next loaded scores are
+	 * dropped, relative to the largest value of the score, e.g. 1e-3. 0, the
+	 * default, keeps the whole score. Ignored when the score is compressed. */
+	void SetSparseThreshold(double sparseThreshold)
+	{
+		m_Mutex->Lock();
+		m_SparseThreshold = sparseThreshold;
+		m_Mutex->Unlock();
+	}
+
+	double GetSparseThreshold() const
+	{
+		m_Mutex->Lock();
+		double sparseThreshold = m_SparseThreshold;
+		m_Mutex->Unlock();
+		return sparseThreshold;
+	}
+
+	/** Release the score image. */
+	void Close()
+	{
+		m_Mutex->Lock();
+		m_TubularityScore = NULL;
+		m_ScaleProfile = NULL;
+		m_SparseScore = NULL;
+		m_FileName.clear();
+		m_PathIndex->Clear();
+		m_Mutex->Unlock();
+	}
+
+	bool IsLoaded() const
+	{
+		m_Mutex->Lock();
+		bool isLoaded = m_TubularityScore.IsNotNull();
+		m_Mutex->Unlock();
+		return isLoaded;
+	}
+
+	/** Name of the file the score was read from, empty if it was loaded from memory. */
+	std::string GetFileName() const
+	{
+		m_Mutex->Lock();
+		std::string filename = m_FileName;
+		m_Mutex->Unlock();
+		return filename;
+	}
+
+	/** The score image. When the score is compressed or sparse, it only
+	 * holds the geometry of the score and has no pixel buffer. */
+	TubularityScoreImageType::Pointer GetTubularityScore() const
+	{
+		m_Mutex->Lock();
+		TubularityScoreImageType::Pointer tubularityScore = m_TubularityScore;
+		m_Mutex->Unlock();
+		return tubularityScore;
+	}
+
+	/** The scale profiles of the score, NULL if it is not compressed. */
+	ScaleProfileFunctionType::ConstPointer GetScaleProfile() const
+	{
+		m_Mutex->Lock();
+		ScaleProfileFunctionType::ConstPointer scaleProfile = m_ScaleProfile.GetPointer();
+		m_Mutex->Unlock();
+		return scaleProfile;
+	}
+
+	/** The blocks of the score, NULL if it is not sparse. */
+	SparseScoreFunctionType::ConstPointer GetSparseScore() const
+	{
+		m_Mutex->Lock();
+		SparseScoreFunctionType::ConstPointer sparseScore = m_SparseScore.GetPointer();
+		m_Mutex->Unlock();
+		return sparseScore;
+	}
+
+	/** For a given location, get the optimal scale. */
+	static void GetOptimalScale(const TubularityScoreImageType * tubularityScore, IndexType *point)
+	{
+		TubularityScorePixelType bestScore    =  itk::NumericTraits< TubularityScorePixelType >::min();
+		IndexType scaleSpaceSourceVertexIndex = *point;
+		RegionType region                     = tubularityScore->GetBufferedRegion();
+		IndexValueType noOfScales             = region.GetSize()[Dimension];
+		IndexValueType scaleStartIndex        = region.GetIndex()[Dimension];
+		IndexValueType scaleEndIndex          = scaleStartIndex + noOfScales - 1;
+		IndexValueType bestScaleIndex         = 0;
+		for(IndexValueType sourceScaleIndex   = scaleStartIndex;
+				sourceScaleIndex  <= scaleEndIndex;
+				sourceScaleIndex++)
+		{
+			scaleSpaceSourceVertexIndex[Dimension] = sourceScaleIndex;
+			if( bestScore < tubularityScore->GetPixel( scaleSpaceSourceVertexIndex ) )
+			{
+				bestScore = tubularityScore->GetPixel( scaleSpaceSourceVertexIndex );
+				bestScaleIndex = sourceScaleIndex;
+			}
+		}
+
+		(*point)[Dimension] = bestScaleIndex;
+	}
+
+	/** Computes the minimal path between 2 provided points, given in voxel
+	 * coordinates. The path is returned in physical coordinates, 4 floats
+	 * (x, y, z, radius) per vertex. The search stops with eInterrupted when
+	 * the cancellation token is cancelled, the progress command, if any,
+	 * observes the progress events of the path filter.
+	 * With preview on, the path is the approximate one given by Dijkstra's
+	 * algorithm on the voxels (see TubularMetricToPathFilter::SetGeodesicSolverToDijkstra()),
+	 * fast enough to follow the mouse; the exact path is computed by a call
+	 * without preview. */
+	int Execute(const float* pt1, const float* pt2, std::vector< float > & outputPath,
+							itk::CancellationToken * cancellationToken = NULL,
+							itk::Command * progressCommand = NULL,
+							bool preview = false)
+	{
+		itk::TraceEventRecorder::ScopedEvent executeEvent("Execute", "session");
+		TubularityScoreImageType::Pointer tubularityScore;
+		ScaleProfileFunctionType::ConstPointer scaleProfile;
+		SparseScoreFunctionType::ConstPointer sparseScore;
+		this->GetSearchScore( tubularityScore, scaleProfile, sparseScore );
+
+		// Instantiate the path filter
+		PathFilterType::Pointer pathFilter = PathFilterType::New();
+
+		// Set the tubularity score
+		pathFilter->SetInput( tubularityScore );
+		if( scaleProfile )
+		{
+			pathFilter->SetSpeedFunction( scaleProfile );
+		}
+		else if( sparseScore )
+		{
+			pathFilter->SetSpeedFunction( sparseScore );
+		}
+
+		// Get the start and end points, at their optimal scale, and give them
+		// to the path filter
+		IndexType startPoint = ToScoreIndex( pt1, tubularityScore, scaleProfile, sparseScore );
+		IndexType endPoint = ToScoreIndex( pt2, tubularityScore, scaleProfile, sparseScore );
+		pathFilter->SetStartPoint( startPoint );
+		pathFilter->AddPathEndPoint( endPoint );
+
+		// Get the sub region to be processed
+		// Warning a padding parameter is hardcoded
+		RegionType region = tubularityScore->GetLargestPossibleRegion();
+
+		RegionType subRegionToProcess;
+		IndexType startSubRegion;
+		SizeType  sizeSubRegion;
+
+		// No Padding or sub-selcetion on the scale dimension
+		startSubRegion[Dimension] = region.GetIndex()[Dimension];
+		sizeSubRegion[Dimension]  = region.GetSize()[Dimension];
+		// extract sub region and pad it in the spatial domain
+		//TODO: This shouldn't be hardcoded
+		int subRegionPad    = 20;
+		for(unsigned int i = 0; i < Dimension; i++)
+		{
+			IndexValueType minIndex = vnl_math_min( startPoint[i], endPoint[i] );
+			IndexValueType maxIndex = vnl_math_max( startPoint[i], endPoint[i] );
+			startSubRegion[i] = vnl_math_max( minIndex - subRegionPad, region.GetIndex()[i] );
+			IndexValueType maxSubRegionIndex = vnl_math_min( int(maxIndex + subRegionPad), int(region.GetIndex()[i] + region.GetSize()[i] -1) );
+			sizeSubRegion[i]  = maxSubRegionIndex - startSubRegion[i] + 1;
+		}
+		subRegionToProcess.SetIndex( startSubRegion );
+		subRegionToProcess.SetSize( sizeSubRegion );
+
+		pathFilter->SetRegionToProcess(subRegionToProcess);
+		pathFilter->SetCancellationToken(cancellationToken);
+		if( preview )
+		{
+			pathFilter->SetGeodesicSolverToDijkstra();
+		}
+		if( progressCommand )
+		{
+			pathFilter->AddObserver(itk::ProgressEvent(), progressCommand);
+		}
+		try {
+			pathFilter->Update();
+		} catch (itk::ProcessAborted &) {
+			return eInterrupted;
+		}
+
+		ToPhysicalPath( pathFilter->GetPath(0), tubularityScore, outputPath );
+		itk::MetricsRegistry::GetInstance()->Publish();
+		return eSuccess;
+	}
+
+	/** Computes the minimal path going through the given waypoints in order,
+	 * 3 floats per waypoint in voxel coordinates, as Execute() does for two
+	 * points. The segments between consecutive waypoints are solved
+	 * concurrently, each on the padded bounding box of its two waypoints
+	 * (see WaypointTubularMetricToPathFilter), and each waypoint keeps one
+	 * scale, its optimal one, for the two segments it joins. */
+	int ExecuteWaypoints(const std::vector< float > & waypoints, std::vector< float > & outputPath,
+											 itk::CancellationToken * cancellationToken = NULL,
+											 itk::Command * progressCommand = NULL,
+											 bool preview = false)
+	{
+		itk::TraceEventRecorder::ScopedEvent executeEvent("ExecuteWaypoints", "session");
+		if( waypoints.size() < 2 * Dimension || waypoints.size() % Dimension != 0 )
+		{
+			itkGenericExceptionMacro( << "At least two waypoints of " << Dimension << " coordinates must be given" );
+		}
+		TubularityScoreImageType::Pointer tubularityScore;
+		ScaleProfileFunctionType::ConstPointer scaleProfile;
+		SparseScoreFunctionType::ConstPointer sparseScore;
+		this->GetSearchScore( tubularityScore, scaleProfile, sparseScore );
+
+		WaypointPathFilterType::Pointer pathFilter = WaypointPathFilterType::New();
+		pathFilter->SetInput( tubularityScore );
+		if( scaleProfile )
+		{
+			pathFilter->SetSpeedFunction( scaleProfile );
+		}
+		else if( sparseScore )
+		{
+			pathFilter->SetSpeedFunction( sparseScore );
+		}
+		for(unsigned int w = 0; w < waypoints.size(); w += Dimension)
+		{
+			pathFilter->AddWaypoint( ToScoreIndex( &waypoints[w], tubularityScore, scaleProfile, sparseScore ) );
+		}
+		pathFilter->SetCancellationToken(cancellationToken);
+		if( preview )
+		{
+			pathFilter->SetGeodesicSolver( PathFilterType::DijkstraSolver );
+		}
+		if( progressCommand )
+		{
+			pathFilter->AddObserver(itk::ProgressEvent(), progressCommand);
+		}
+		try {
+			pathFilter->Update();
+		} catch (itk::ProcessAborted &) {
+			return eInterrupted;
+		}
+
+		ToPhysicalPath( pathFilter->GetPath(), tubularityScore, outputPath );
+		itk::MetricsRegistry::GetInstance()->Publish();
+		return eSuccess;
+	}
+
+	/** Store a traced path, 4 floats (x, y, z, radius) per vertex in
+	 * physical coordinates as returned by Execute(). Returns the identifier
+	 * of the path, the vertices keeping their order and numbers. */
+	PathIdentifierType AddTracedPath(const std::vector< float > & path)
+	{
+		if( path.empty() || path.size() % SSDimension != 0 )
+		{
+			itkGenericExceptionMacro( << "A path must be given as " << SSDimension << " floats per vertex" );
+		}
+		PathIndexType::PathType::Pointer indexedPath = PathIndexType::PathType::New();
+		// Keep all the vertices, even repeated ones
+		indexedPath->SetEpsilon( 0.0 );
+		for(unsigned int k = 0; k < path.size(); k += SSDimension)
+		{
+			PathIndexType::VertexType vertex;
+			for(unsigned int i = 0; i < SSDimension; i++)
+			{
+				vertex[i] = path[k + i];
+			}
+			indexedPath->AddVertex( vertex, path[k + Dimension] );
+		}
+		m_Mutex->Lock();
+		PathIdentifierType pathId = m_PathIndex->AddPath( indexedPath );
+		itk::MetricsRegistry::GetInstance()->SetGauge("session.tracedPathVertices", m_PathIndex->GetNumberOfVertices());
+		m_Mutex->Unlock();
+		return pathId;
+	}
+
+	/** Remove a traced path. Returns false if there is no such path. */
+	bool RemoveTracedPath(PathIdentifierType pathId)
+	{
+		m_Mutex->Lock();
+		bool removed = m_PathIndex->RemovePath( pathId );
+		m_Mutex->Unlock();
+		return removed;
+	}
+
+	/** Remove all the traced paths. */
+	void ClearTracedPaths()
+	{
+		m_Mutex->Lock();
+		m_PathIndex->Clear();
+		m_Mutex->Unlock();
+	}
+
+	/** The traced vertex nearest to a point in physical coordinates, if one
+	 * is within maxDistance, and its 4 coordinates. */
+	bool SnapToTracedPath(const float * point, double maxDistance, PathIndexType::VertexHit & hit,
+												float vertex[SSDimension]) const
+	{
+		m_Mutex->Lock();
+		bool found = m_PathIndex->FindNearestVertex( ToIndexedVertex( point ), maxDistance, hit );
+		if( found )
+		{
+			const PathIndexType::VertexType & snapped = m_PathIndex->GetPathVertices( hit.PathId )[hit.VertexIndex];
+			for(unsigned int i = 0; i < SSDimension; i++)
+			{
+				vertex[i] = snapped[i];
+			}
+		}
+		m_Mutex->Unlock();
+		return found;
+	}
+
+	/** The traced vertices within a radius of a point in physical coordinates. */
+	void FindTracedVerticesInRadius(const float * point, double radius,
+																	std::vector< PathIndexType::VertexHit > & hits) const
+	{
+		m_Mutex->Lock();
+		m_PathIndex->FindVerticesInRadius( ToIndexedVertex( point ), radius, hits );
+		m_Mutex->Unlock();
+	}
+
+	/** The traced paths coming within a tolerance of a path given as by
+	 * AddTracedPath(), each one once. */
+	void FindOverlappingTracedPaths(const std::vector< float > & path, double tolerance,
+																	std::vector< PathIdentifierType > & pathIds) const
+	{
+		PathIndexType::PathType::Pointer queryPath = PathIndexType::PathType::New();
+		queryPath->SetEpsilon( 0.0 );
+		for(unsigned int k = 0; k + SSDimension <= path.size(); k += SSDimension)
+		{
+			PathIndexType::VertexType vertex;
+			for(unsigned int i = 0; i < SSDimension; i++)
+			{
+				vertex[i] = path[k + i];
+			}
+			queryPath->AddVertex( vertex );
+		}
+		std::vector< PathIndexType::SegmentHit > hits;
+		m_Mutex->Lock();
+		m_PathIndex->FindIntersectingSegments( queryPath, tolerance, hits );
+		m_Mutex->Unlock();
+
+		pathIds.clear();
+		for(unsigned int h = 0; h < hits.size(); h++)
+		{
+			pathIds.push_back( hits[h].PathId );
+		}
+		std::sort( pathIds.begin(), pathIds.end() );
+		pathIds.erase( std::unique( pathIds.begin(), pathIds.end() ), pathIds.end() );
+	}
+
+	/** Number of traced paths stored. */
+	itk::SizeValueType GetNumberOfTracedPaths() const
+	{
+		m_Mutex->Lock();
+		itk::SizeValueType numberOfPaths = m_PathIndex->GetNumberOfPaths();
+		m_Mutex->Unlock();
+		return numberOfPaths;
+	}
+
+protected:
+	TubularGeodesicsSession()
+	{
+		m_Mutex = itk::FastMutexLock::New();
+		m_LoadMutex = itk::FastMutexLock::New();
+		m_PathIndex = PathIndexType::New();
+		m_UseMemoryMapping = true;
+		m_CompressScore = false;
+		m_SparseThreshold = 0.0;
+	}
+	virtual ~TubularGeodesicsSession() {};
+
+private:
+	TubularGeodesicsSession(const Self&); //purposely not implemented
+	void operator=(const Self&); //purposely not implemented
+
+	/** The score for a search, and its scale profiles or blocks if it is
+	 * compressed or sparse. Several searches may run concurrently on the
+	 * same score: each one works on its own image object sharing the
+	 * read-only pixel buffer, so that the pipelines do not step on each
+	 * other's regions. */
+	void GetSearchScore(TubularityScoreImageType::Pointer & tubularityScore,
+											ScaleProfileFunctionType::ConstPointer & scaleProfile,
+											SparseScoreFunctionType::ConstPointer & sparseScore) const
+	{
+		m_Mutex->Lock();
+		TubularityScoreImageType::Pointer sharedTubularityScore = m_TubularityScore;
+		scaleProfile = m_ScaleProfile.GetPointer();
+		sparseScore = m_SparseScore.GetPointer();
+		m_Mutex->Unlock();
+		if( sharedTubularityScore.IsNull() )
+		{
+			itkGenericExceptionMacro( << "No tubularity score is loaded in this session" );
+		}
+		tubularityScore = TubularityScoreImageType::New();
+		tubularityScore->Graft( sharedTubularityScore );
+	}
+
+	/** The score index of a voxel, at its optimal scale. */
+	static IndexType ToScoreIndex(const float * point, const TubularityScoreImageType * tubularityScore,
+																const ScaleProfileFunctionType * scaleProfile,
+																const SparseScoreFunctionType * sparseScore)
+	{
+		IndexType index;
+		for(unsigned int i = 0; i < Dimension; i++)
+		{
+			index[i] = point[i];
+		}
+		if( scaleProfile )
+		{
+			index[Dimension] = scaleProfile->GetBestScaleIndex( index );
+		}
+		else if( sparseScore )
+		{
+			index[Dimension] = sparseScore->GetBestScaleIndex( index );
+		}
+		else
+		{
+			GetOptimalScale( tubularityScore, &index );
+		}
+		return index;
+	}
+
+	/** Resample and smooth a path slightly, and write it in physical
+	 * coordinates, 4 floats (x, y, z, radius) per vertex. */
+	static void ToPhysicalPath(PathFilterType::PathType * path, const TubularityScoreImageType * tubularityScore,
+														 std::vector< float > & outputPath)
+	{
+		SpacingType spacing = tubularityScore->GetSpacing();
+		OriginType  origin = tubularityScore->GetOrigin();
+
+		// Get the minimum spacing among all the spatial dimensions.
+		double minSpacing = spacing[0];
+		for(unsigned int i = 1; i < Dimension-1; i++)
+		{
+			minSpacing = vnl_math_min(minSpacing, spacing[i]);
+		}
+
+		// Downsample the path and smooth it slightly.
+		path->Resample(0.5 * minSpacing, tubularityScore);
+		path->SmoothVertexLocationsAndRadii(minSpacing, tubularityScore);
+
+		outputPath.clear();
+		for(unsigned int k = 0; k < path->GetVertexList()->Size(); k++)
+		{
+			VertexType vertex = path->GetVertexList()->GetElement(k);
+			for (unsigned int i = 0; i < Dimension+1; i++)
+			{
+				outputPath.push_back(vertex[i]*spacing[i]+origin[i]);
+			}
+		}
+	}
+
+	/** A point in physical coordinates as a vertex of the path index, whose
+	 * scale coordinate is ignored. */
+	static PathIndexType::VertexType ToIndexedVertex(const float * point)
+	{
+		PathIndexType::VertexType vertex;
+		for(unsigned int i = 0; i < Dimension; i++)
+		{
+			vertex[i] = point[i];
+		}
+		vertex[Dimension] = 0.0;
+		return vertex;
+	}
+
+	/** Read a score file and make it the score of the session. */
+	void ReadScoreFile(const char * filename)
+	{
+		// Uncompressed MetaImage files are mapped rather than read: the
+		// pages are loaded when the front reaches them and are shared with
+		// the other processes working on the same file.
+		itk::TraceEventRecorder::ScopedEvent readEvent("readScore", "io");
+		if( SparseScoreFunctionType::CanReadFile( filename ) )
+		{
+			SparseScoreFunctionType::Pointer sparseScore = SparseScoreFunctionType::New();
+			sparseScore->ReadFile( filename );
+			this->StoreScore( sparseScore->GetScoreInformation(), NULL, sparseScore, filename );
+			return;
+		}
+		TubularityScoreImageType::Pointer tubularityScore;
+		if( this->GetUseMemoryMapping() && MappedImageReaderType::CanReadFile( filename ) )
+		{
+			MappedImageReaderType::Pointer reader = MappedImageReaderType::New();
+			reader->SetFileName( filename );
+			reader->Update();
+			tubularityScore = reader->GetOutput();
+		}
+		else
+		{
+			ImageReaderType::Pointer reader = ImageReaderType::New();
+			reader->SetFileName( filename );
+			reader->Update();
+			tubularityScore = reader->GetOutput();
+		}
+		tubularityScore->DisconnectPipeline();
+		this->SetScore( tubularityScore, filename );
+	}
+
+	/** Make a score given from memory the score of the session, after the
+	 * file loads in progress. */
+	void LoadScore(TubularityScoreImageType * tubularityScore)
+	{
+		m_LoadMutex->Lock();
+		try
+		{
+			this->SetScore( tubularityScore, std::string() );
+		}
+		catch( ... )
+		{
+			m_LoadMutex->Unlock();
+			throw;
+		}
+		m_LoadMutex->Unlock();
+	}
+
+	/** Make a loaded score the score of the session, compressing it or
+	 * dropping its background blocks first if asked to. */
+	void SetScore(TubularityScoreImageType * tubularityScore, const std::string & filename)
+	{
+		if( this->GetCompressScore() )
+		{
+			itk::TraceEventRecorder::ScopedEvent compressEvent("compressScore", "io");
+			ScaleProfileFunctionType::Pointer scaleProfile = ScaleProfileFunctionType::New();
+			scaleProfile->Compress( tubularityScore );
+			itk::MetricsRegistry::GetInstance()->SetGauge("session.scaleProfileBytes", scaleProfile->GetMemorySize());
+			itk::MetricsRegistry::GetInstance()->SetGauge("session.scaleProfileMaximumFitError", scaleProfile->GetMaximumFitError());
+			this->StoreScore( scaleProfile->GetScoreInformation(), scaleProfile, NULL, filename );
+			return;
+		}
+		double sparseThreshold = this->GetSparseThreshold();
+		if( sparseThreshold > 0.0 )
+		{
+			itk::TraceEventRecorder::ScopedEvent sparseEvent("sparseScore", "io");
+			const TubularityScorePixelType * buffer = tubularityScore->GetBufferPointer();
+			const TubularityScorePixelType maximum = *std::max_element( buffer, buffer + tubularityScore->GetBufferedRegion().GetNumberOfPixels() );
+			SparseScoreFunctionType::Pointer sparseScore = SparseScoreFunctionType::New();
+			sparseScore->Build( tubularityScore, sparseThreshold * maximum );
+			itk::MetricsRegistry::GetInstance()->SetGauge("session.sparseScoreBytes", sparseScore->GetMemorySize());
+			itk::MetricsRegistry::GetInstance()->SetGauge("session.sparseScoreStoredBlocks", sparseScore->GetNumberOfStoredBlocks());
+			this->StoreScore( sparseScore->GetScoreInformation(), NULL, sparseScore, filename );
+			return;
+		}
+		this->StoreScore( tubularityScore, NULL, NULL, filename );
+	}
+
+	void StoreScore(TubularityScoreImageType * tubularityScore, ScaleProfileFunctionType * scaleProfile,
+									SparseScoreFunctionType * sparseScore, const std::string & filename)
+	{
+		m_Mutex->Lock();
+		m_TubularityScore = tubularityScore;
+		m_ScaleProfile = scaleProfile;
+		m_SparseScore = sparseScore;
+		m_FileName = filename;
+		m_Mutex->Unlock();
+	}
+
+	TubularityScoreImageType::Pointer		m_TubularityScore;
+	ScaleProfileFunctionType::Pointer		m_ScaleProfile;
+	SparseScoreFunctionType::Pointer		m_SparseScore;
+	std::string													m_FileName;
+	bool																m_UseMemoryMapping;
+	bool																m_CompressScore;
+	double															m_SparseThreshold;
+	PathIndexType::Pointer							m_PathIndex;
+	itk::FastMutexLock::Pointer					m_Mutex;
+	/** Held across the loads, from the check of the loaded file to the
+	 * store of the new score. */
+	itk::FastMutexLock::Pointer					m_LoadMutex;
+};
+
+#endif
@@ -0,0 +1,180 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+#ifndef __itkBlockSparseScoreImageFunction_h
+#define __itkBlockSparseScoreImageFunction_h
+
+#include <string>
+#include <vector>
+
+#include <itkFunctionBase.h>
+#include <itkObjectFactory.h>
+#include <itkImageRegion.h>
+
+namespace itk
+{
+
+	/** \class BlockSparseScoreImageFunction
+	 * \brief Tubularity score stored by blocks, the background blocks being
+	 * implicit.
+	 *
+	 * Build() cuts a score image in blocks of BlockSize voxels (the scale
+	 * axis included) and stores only the blocks holding at least one value
+	 * above a threshold. The other blocks read as a constant, the
+	 * BackgroundValue, which defaults to the smallest value of the dropped
+	 * blocks: the fast marching crosses them as a uniform slow medium,
+	 * hence no path takes a shortcut through the background. Once the
+	 * blocks are built the score image can be released; the memory, and
+	 * the size of the files written by WriteFile(), is that of the
+	 * foreground blocks plus one integer per block.
+	 *
+	 * Evaluate() reads the score at an index of the score image, so that
+	 * the function can replace the score as the speed of
+	 * FastMarchingImageFilter2 (see SetSpeedFunction()).
+	 *
+	 * The file format is a small header (geometry, block size, threshold
+	 * and background value), the block table and the stored blocks, in the
+	 * byte order of the machine that wrote it.
+	 *
+	 * \author : Fethallah Benmansour
+	 */
+	template <class TScoreImage>
+	class ITK_EXPORT BlockSparseScoreImageFunction:
+	public FunctionBase<typename TScoreImage::IndexType, double>
+	{
+	public:
+		/** Standard class typedefs. */
+		typedef BlockSparseScoreImageFunction																Self;
+		typedef FunctionBase<typename TScoreImage::IndexType, double>				Superclass;
+		typedef SmartPointer<Self>																					Pointer;
+		typedef SmartPointer<const Self>																		ConstPointer;
+
+		/** Method for creation through the object factory. */
+		itkNewMacro(Self);
+
+		/** Run-time type information (and related methods). */
+		itkTypeMacro(BlockSparseScoreImageFunction, FunctionBase);
+
+		/** Dimension of the score, the last axis being the scale. */
+		itkStaticConstMacro(ImageDimension, unsigned int, TScoreImage::ImageDimension);
+
+		typedef TScoreImage																									ScoreImageType;
+		typedef typename ScoreImageType::PixelType													ScorePixelType;
+		typedef typename ScoreImageType::IndexType													IndexType;
+		typedef typename ScoreImageType::IndexValueType											IndexValueType;
+		typedef typename ScoreImageType::SizeType														SizeType;
+		typedef typename ScoreImageType::RegionType													RegionType;
+		typedef typename ScoreImageType::SpacingType												SpacingType;
+		typedef typename ScoreImageType::PointType													PointType;
+		typedef typename ScoreImageType::DirectionType											DirectionType;
+
+		/** Size of the blocks, 8 voxels along each axis by default. It is
+		 * used by the next call to Build(). */
+		itkSetMacro(BlockSize, SizeType);
+		itkGetConstReferenceMacro(BlockSize, SizeType);
+
+		/** Store the blocks of the buffered region of a score image that
+		 * hold a value above the threshold. The image can be released
+		 * afterwards. */
+		void Build(const ScoreImageType * score, double threshold);
+
+		/** Score at an index of the score image. The index must be inside
+		 * the region of the score. */
+		double Evaluate(const IndexType & index) const;
+
+		/** Index of the scale of strongest response at a spatial location;
+		 * the scale coordinate of the given index is ignored. */
+		IndexValueType GetBestScaleIndex(const IndexType & index) const;
+
+		/** Value of the voxels of the dropped blocks. */
+		itkSetMacro(BackgroundValue, double);
+		itkGetConstMacro(BackgroundValue, double);
+
+		itkGetConstMacro(Threshold, double);
+
+		/** Number of blocks of the score and number of stored blocks. */
+		SizeValueType GetNumberOfBlocks() const
+		{
+			return static_cast<SizeValueType>( m_BlockTable.size() );
+		}
+		itkGetConstMacro(NumberOfStoredBlocks, SizeValueType);
+
+		/** Size in bytes of the block table and of the stored blocks. */
+		SizeValueType GetMemorySize() const
+		{
+			return static_cast<SizeValueType>( m_BlockTable.size() * sizeof(int) +
+																				 m_Blocks.size() * sizeof(ScorePixelType) );
+		}
+
+		/** Geometry of the score. */
+		itkGetConstReferenceMacro(Region, RegionType);
+		itkGetConstReferenceMacro(Spacing, SpacingType);
+		itkGetConstReferenceMacro(Origin, PointType);
+		itkGetConstReferenceMacro(Direction, DirectionType);
+
+		/** An image with the geometry of the score and no pixel buffer, to
+		 * stand for the score where only its geometry is used (e.g. as the
+		 * input of TubularMetricToPathFilter). */
+		typename ScoreImageType::Pointer GetScoreInformation() const;
+
+		/** Write the blocks to a file, and read them back. Both throw an
+		 * exception if the file can not be written or read. */
+		void WriteFile(const std::string & fileName) const;
+		void ReadFile(const std::string & fileName);
+
+		/** Whether a file was written by WriteFile(), from its header. */
+		static bool CanReadFile(const std::string & fileName);
+
+	protected:
+		BlockSparseScoreImageFunction();
+		virtual ~BlockSparseScoreImageFunction() {}
+		void PrintSelf(std::ostream& os, Indent indent) const;
+
+	private:
+		BlockSparseScoreImageFunction(const Self&); //purposely not implemented
+		void operator=(const Self&); //purposely not implemented
+
+		/** Block sizes, numbers of blocks and strides, from m_Region and
+		 * m_BlockSize. */
+		void ComputeBlockLayout();
+
+		SizeType													m_BlockSize;
+		RegionType												m_Region;
+		SpacingType												m_Spacing;
+		PointType													m_Origin;
+		DirectionType											m_Direction;
+		double														m_Threshold;
+		double														m_BackgroundValue;
+
+		/** Position of each block in m_Blocks, in blocks, -1 for a dropped
+		 * block. The blocks are x-fastest, as are the voxels in a block. */
+		std::vector<int>									m_BlockTable;
+		std::vector<ScorePixelType>				m_Blocks;
+		SizeValueType											m_NumberOfStoredBlocks;
+
+		SizeValueType											m_NumberOfBlocksPerAxis[ImageDimension];
+		SizeValueType											m_BlockStride[ImageDimension];
+		SizeValueType											m_VoxelStride[ImageDimension];
+		SizeValueType											m_NumberOfVoxelsPerBlock;
+	};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkBlockSparseScoreImageFunction.txx"
+#endif
+
+#endif
@@ -0,0 +1,432 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+
+#ifndef __itkBlockSparseScoreImageFunction_txx
+#define __itkBlockSparseScoreImageFunction_txx
+
+#include "itkBlockSparseScoreImageFunction.h"
+#include <itkImageRegionConstIteratorWithIndex.h>
+#include <itkNumericTraits.h>
+#include "vnl/vnl_math.h"
+#include <fstream>
+#include <cstring>
+#include <omp.h>
+
+namespace itk
+{
+
+	/** First bytes of the files written by WriteFile(). */
+	static const char BlockSparseScoreFileMagic[8] = { 'B', 'S', 'S', 'C', 'O', 'R', 'E', '1' };
+	static const unsigned int BlockSparseScoreByteOrderMark = 0x01020304;
+
+	/**
+	 * Constructor
+	 */
+	template <class TScoreImage>
+	BlockSparseScoreImageFunction<TScoreImage>
+	::BlockSparseScoreImageFunction()
+	{
+		m_BlockSize.Fill( 8 );
+		m_Spacing.Fill( 1.0 );
+		m_Origin.Fill( 0.0 );
+		m_Direction.SetIdentity();
+		m_Threshold = 0.0;
+		m_BackgroundValue = 0.0;
+		m_NumberOfStoredBlocks = 0;
+		m_NumberOfVoxelsPerBlock = 0;
+		for(unsigned int i = 0; i < ImageDimension; i++)
+		{
+			m_NumberOfBlocksPerAxis[i] = 0;
+			m_BlockStride[i] = 0;
+			m_VoxelStride[i] = 0;
+		}
+	}
+
+	/**
+	 * Block layout of the region
+	 */
+	template <class TScoreImage>
+	void
+	BlockSparseScoreImageFunction<TScoreImage>
+	::ComputeBlockLayout()
+	{
+		SizeValueType blockStride = 1;
+		SizeValueType voxelStride = 1;
+		for(unsigned int i = 0; i < ImageDimension; i++)
+		{
+			if( m_BlockSize[i] == 0 )
+			{
+				itkExceptionMacro( << "The block size must be positive along each axis" );
+			}
+			m_NumberOfBlocksPerAxis[i] = (m_Region.GetSize()[i] + m_BlockSize[i] - 1) / m_BlockSize[i];
+			m_BlockStride[i] = blockStride;
+			m_VoxelStride[i] = voxelStride;
+			blockStride *= m_NumberOfBlocksPerAxis[i];
+			voxelStride *= m_BlockSize[i];
+		}
+		m_NumberOfVoxelsPerBlock = voxelStride;
+		m_BlockTable.assign( blockStride, -1 );
+	}
+
+	/**
+	 * Store the foreground blocks
+	 */
+	template <class TScoreImage>
+	void
+	BlockSparseScoreImageFunction<TScoreImage>
+	::Build(const ScoreImageType * score, double threshold)
+	{
+		if( !score )
+		{
+			itkExceptionMacro( << "No score image given" );
+		}
+		m_Region		= score->GetBufferedRegion();
+		m_Spacing		= score->GetSpacing();
+		m_Origin		= score->GetOrigin();
+		m_Direction	= score->GetDirection();
+		m_Threshold	= threshold;
+		this->ComputeBlockLayout();
+
+		const long numberOfBlocks = static_cast<long>( m_BlockTable.size() );
+		std::vector<unsigned char> isForeground( numberOfBlocks, 0 );
+		std::vector<double> blockMinimum( numberOfBlocks, 0.0 );
+
+		// Region of the score covered by each block; the last block along an
+		// axis may be cut by the border of the score.
+		std::vector<RegionType> blockRegions( numberOfBlocks );
+		for(long b = 0; b < numberOfBlocks; b++)
+		{
+			IndexType blockIndex;
+			SizeType blockSize;
+			for(unsigned int i = 0; i < ImageDimension; i++)
+			{
+				SizeValueType blockCoordinate = (b / m_BlockStride[i]) % m_NumberOfBlocksPerAxis[i];
+				blockIndex[i] = m_Region.GetIndex()[i] + static_cast<IndexValueType>( blockCoordinate * m_BlockSize[i] );
+				blockSize[i] = vnl_math_min( m_BlockSize[i], m_Region.GetSize()[i] - blockCoordinate * m_BlockSize[i] );
+			}
+			blockRegions[b].SetIndex( blockIndex );
+			blockRegions[b].SetSize( blockSize );
+		}
+
+#pragma omp parallel for schedule(dynamic)
+		for(long b = 0; b < numberOfBlocks; b++)
+		{
+			double minimum = NumericTraits<double>::max();
+			bool foreground = false;
+			ImageRegionConstIteratorWithIndex<ScoreImageType> it( score, blockRegions[b] );
+			for(it.GoToBegin(); !it.IsAtEnd(); ++it)
+			{
+				double value = static_cast<double>( it.Get() );
+				minimum = vnl_math_min( minimum, value );
+				foreground = foreground || value > threshold;
+			}
+			blockMinimum[b] = minimum;
+			isForeground[b] = foreground;
+		}
+
+		// The background is as slow as the slowest dropped voxel.
+		bool hasBackground = false;
+		m_BackgroundValue = threshold;
+		m_NumberOfStoredBlocks = 0;
+		for(long b = 0; b < numberOfBlocks; b++)
+		{
+			if( isForeground[b] )
+			{
+				m_BlockTable[b] = static_cast<int>( m_NumberOfStoredBlocks++ );
+			}
+			else
+			{
+				m_BackgroundValue = hasBackground ? vnl_math_min( m_BackgroundValue, blockMinimum[b] ) : blockMinimum[b];
+				hasBackground = true;
+			}
+		}
+
+		// Copy the foreground blocks, padding the cut ones with the background.
+		m_Blocks.assign( m_NumberOfStoredBlocks * m_NumberOfVoxelsPerBlock,
+										 static_cast<ScorePixelType>( m_BackgroundValue ) );
+#pragma omp parallel for schedule(dynamic)
+		for(long b = 0; b < numberOfBlocks; b++)
+		{
+			if( m_BlockTable[b] < 0 )
+			{
+				continue;
+			}
+			ScorePixelType * block = &m_Blocks[ m_BlockTable[b] * m_NumberOfVoxelsPerBlock ];
+			const IndexType & blockIndex = blockRegions[b].GetIndex();
+			ImageRegionConstIteratorWithIndex<ScoreImageType> it( score, blockRegions[b] );
+			for(it.GoToBegin(); !it.IsAtEnd(); ++it)
+			{
+				SizeValueType voxel = 0;
+				for(unsigned int i = 0; i < ImageDimension; i++)
+				{
+					voxel += (it.GetIndex()[i] - blockIndex[i]) * m_VoxelStride[i];
+				}
+				block[voxel] = it.Get();
+			}
+		}
+		this->Modified();
+	}
+
+	/**
+	 * Read the score
+	 */
+	template <class TScoreImage>
+	double
+	BlockSparseScoreImageFunction<TScoreImage>
+	::Evaluate(const IndexType & index) const
+	{
+		SizeValueType block = 0;
+		SizeValueType voxel = 0;
+		for(unsigned int i = 0; i < ImageDimension; i++)
+		{
+			SizeValueType position = static_cast<SizeValueType>( index[i] - m_Region.GetIndex()[i] );
+			SizeValueType blockCoordinate = position / m_BlockSize[i];
+			block += blockCoordinate * m_BlockStride[i];
+			voxel += (position - blockCoordinate * m_BlockSize[i]) * m_VoxelStride[i];
+		}
+		const int storedBlock = m_BlockTable[block];
+		if( storedBlock < 0 )
+		{
+			return m_BackgroundValue;
+		}
+		return static_cast<double>( m_Blocks[ storedBlock * m_NumberOfVoxelsPerBlock + voxel ] );
+	}
+
+	/**
+	 * Scale of strongest response
+	 */
+	template <class TScoreImage>
+	typename BlockSparseScoreImageFunction<TScoreImage>::IndexValueType
+	BlockSparseScoreImageFunction<TScoreImage>
+	::GetBestScaleIndex(const IndexType & index) const
+	{
+		const unsigned int scaleAxis = ImageDimension - 1;
+		IndexType scaleIndex = index;
+		IndexValueType bestScaleIndex = m_Region.GetIndex()[scaleAxis];
+		double bestScore = NumericTraits<double>::NonpositiveMin();
+		for(SizeValueType k = 0; k < m_Region.GetSize()[scaleAxis]; k++)
+		{
+			scaleIndex[scaleAxis] = m_Region.GetIndex()[scaleAxis] + static_cast<IndexValueType>( k );
+			double value = this->Evaluate( scaleIndex );
+			if( bestScore < value )
+			{
+				bestScore = value;
+				bestScaleIndex = scaleIndex[scaleAxis];
+			}
+		}
+		return bestScaleIndex;
+	}
+
+	/**
+	 * Geometry-only image
+	 */
+	template <class TScoreImage>
+	typename TScoreImage::Pointer
+	BlockSparseScoreImageFunction<TScoreImage>
+	::GetScoreInformation() const
+	{
+		typename ScoreImageType::Pointer information = ScoreImageType::New();
+		information->SetLargestPossibleRegion( m_Region );
+		information->SetRequestedRegion( m_Region );
+		information->SetSpacing( m_Spacing );
+		information->SetOrigin( m_Origin );
+		information->SetDirection( m_Direction );
+		return information;
+	}
+
+	/**
+	 * Write the file
+	 */
+	template <class TScoreImage>
+	void
+	BlockSparseScoreImageFunction<TScoreImage>
+	::WriteFile(const std::string & fileName) const
+	{
+		std::ofstream file( fileName.c_str(), std::ios::binary );
+		if( !file )
+		{
+			itkExceptionMacro( << "Could not open " << fileName << " for writing" );
+		}
+		const unsigned int dimension = ImageDimension;
+		const unsigned int pixelSize = sizeof(ScorePixelType);
+		file.write( BlockSparseScoreFileMagic, sizeof(BlockSparseScoreFileMagic) );
+		file.write( reinterpret_cast<const char *>( &BlockSparseScoreByteOrderMark ), sizeof(unsigned int) );
+		file.write( reinterpret_cast<const char *>( &dimension ), sizeof(dimension) );
+		file.write( reinterpret_cast<const char *>( &pixelSize ), sizeof(pixelSize) );
+		for(unsigned int i = 0; i < ImageDimension; i++)
+		{
+			long long index = m_Region.GetIndex()[i];
+			unsigned long long size = m_Region.GetSize()[i];
+			unsigned long long blockSize = m_BlockSize[i];
+			double spacing = m_Spacing[i];
+			double origin = m_Origin[i];
+			file.write( reinterpret_cast<const char *>( &index ), sizeof(index) );
+			file.write( reinterpret_cast<const char *>( &size ), sizeof(size) );
+			file.write( reinterpret_cast<const char *>( &blockSize ), sizeof(blockSize) );
+			file.write( reinterpret_cast<const char *>( &spacing ), sizeof(spacing) );
+			file.write( reinterpret_cast<const char *>( &origin ), sizeof(origin) );
+		}
+		for(unsigned int i = 0; i < ImageDimension; i++)
+		{
+			for(unsigned int j = 0; j < ImageDimension; j++)
+			{
+				double direction = m_Direction[i][j];
+				file.write( reinterpret_cast<const char *>( &direction ), sizeof(direction) );
+			}
+		}
+		unsigned long long numberOfStoredBlocks = m_NumberOfStoredBlocks;
+		file.write( reinterpret_cast<const char *>( &m_Threshold ), sizeof(m_Threshold) );
+		file.write( reinterpret_cast<const char *>( &m_BackgroundValue ), sizeof(m_BackgroundValue) );
+		file.write( reinterpret_cast<const char *>( &numberOfStoredBlocks ), sizeof(numberOfStoredBlocks) );
+		if( !m_BlockTable.empty() )
+		{
+			file.write( reinterpret_cast<const char *>( &m_BlockTable[0] ), m_BlockTable.size() * sizeof(int) );
+		}
+		if( !m_Blocks.empty() )
+		{
+			file.write( reinterpret_cast<const char *>( &m_Blocks[0] ), m_Blocks.size() * sizeof(ScorePixelType) );
+		}
+		if( !file )
+		{
+			itkExceptionMacro( << "Could not write " << fileName );
+		}
+	}
+
+	/**
+	 * Read the file
+	 */
+	template <class TScoreImage>
+	void
+	BlockSparseScoreImageFunction<TScoreImage>
+	::ReadFile(const std::string & fileName)
+	{
+		if( !CanReadFile( fileName ) )
+		{
+			itkExceptionMacro( << fileName << " is not a block sparse score file of this machine" );
+		}
+		std::ifstream file( fileName.c_str(), std::ios::binary );
+		char magic[sizeof(BlockSparseScoreFileMagic)];
+		unsigned int byteOrderMark, dimension, pixelSize;
+		file.read( magic, sizeof(magic) );
+		file.read( reinterpret_cast<char *>( &byteOrderMark ), sizeof(byteOrderMark) );
+		file.read( reinterpret_cast<char *>( &dimension ), sizeof(dimension) );
+		file.read( reinterpret_cast<char *>( &pixelSize ), sizeof(pixelSize) );
+		if( dimension != ImageDimension || pixelSize != sizeof(ScorePixelType) )
+		{
+			itkExceptionMacro( << fileName << " holds a score of dimension " << dimension << " with "
+												 << pixelSize << " bytes per pixel" );
+		}
+		IndexType regionIndex;
+		SizeType regionSize;
+		for(unsigned int i = 0; i < ImageDimension; i++)
+		{
+			long long index;
+			unsigned long long size, blockSize;
+			double spacing, origin;
+			file.read( reinterpret_cast<char *>( &index ), sizeof(index) );
+			file.read( reinterpret_cast<char *>( &size ), sizeof(size) );
+			file.read( reinterpret_cast<char *>( &blockSize ), sizeof(blockSize) );
+			file.read( reinterpret_cast<char *>( &spacing ), sizeof(spacing) );
+			file.read( reinterpret_cast<char *>( &origin ), sizeof(origin) );
+			regionIndex[i] = static_cast<IndexValueType>( index );
+			regionSize[i] = static_cast<SizeValueType>( size );
+			m_BlockSize[i] = static_cast<SizeValueType>( blockSize );
+			m_Spacing[i] = spacing;
+			m_Origin[i] = origin;
+		}
+		for(unsigned int i = 0; i < ImageDimension; i++)
+		{
+			for(unsigned int j = 0; j < ImageDimension; j++)
+			{
+				double direction;
+				file.read( reinterpret_cast<char *>( &direction ), sizeof(direction) );
+				m_Direction[i][j] = direction;
+			}
+		}
+		m_Region.SetIndex( regionIndex );
+		m_Region.SetSize( regionSize );
+		this->ComputeBlockLayout();
+
+		unsigned long long numberOfStoredBlocks;
+		file.read( reinterpret_cast<char *>( &m_Threshold ), sizeof(m_Threshold) );
+		file.read( reinterpret_cast<char *>( &m_BackgroundValue ), sizeof(m_BackgroundValue) );
+		file.read( reinterpret_cast<char *>( &numberOfStoredBlocks ), sizeof(numberOfStoredBlocks) );
+		m_NumberOfStoredBlocks = static_cast<SizeValueType>( numberOfStoredBlocks );
+		m_Blocks.resize( m_NumberOfStoredBlocks * m_NumberOfVoxelsPerBlock );
+		if( !m_BlockTable.empty() )
+		{
+			file.read( reinterpret_cast<char *>( &m_BlockTable[0] ), m_BlockTable.size() * sizeof(int) );
+		}
+		if( !m_Blocks.empty() )
+		{
+			file.read( reinterpret_cast<char *>( &m_Blocks[0] ), m_Blocks.size() * sizeof(ScorePixelType) );
+		}
+		if( !file )
+		{
+			itkExceptionMacro( << "Could not read " << fileName << ": the file is truncated" );
+		}
+		for(unsigned int b = 0; b < m_BlockTable.size(); b++)
+		{
+			if( m_BlockTable[b] >= static_cast<int>( m_NumberOfStoredBlocks ) )
+			{
+				itkExceptionMacro( << "Could not read " << fileName << ": the block table is corrupted" );
+			}
+		}
+		this->Modified();
+	}
+
+	/**
+	 * Check the header
+	 */
+	template <class TScoreImage>
+	bool
+	BlockSparseScoreImageFunction<TScoreImage>
+	::CanReadFile(const std::string & fileName)
+	{
+		std::ifstream file( fileName.c_str(), std::ios::binary );
+		char magic[sizeof(BlockSparseScoreFileMagic)];
+		unsigned int byteOrderMark = 0;
+		file.read( magic, sizeof(magic) );
+		file.read( reinterpret_cast<char *>( &byteOrderMark ), sizeof(byteOrderMark) );
+		return file && !std::memcmp( magic, BlockSparseScoreFileMagic, sizeof(magic) ) &&
+					 byteOrderMark == BlockSparseScoreByteOrderMark;
+	}
+
+	/**
+	 * PrintSelf
+	 */
+	template <class TScoreImage>
+	void
+	BlockSparseScoreImageFunction<TScoreImage>
+	::PrintSelf(std::ostream& os, Indent indent) const
+	{
+		Superclass::PrintSelf(os, indent);
+		os << indent << "BlockSize: " << m_BlockSize << std::endl;
+		os << indent << "Region: " << m_Region << std::endl;
+		os << indent << "Spacing: " << m_Spacing << std::endl;
+		os << indent << "Origin: " << m_Origin << std::endl;
+		os << indent << "Direction: " << m_Direction << std::endl;
+		os << indent << "Threshold: " << m_Threshold << std::endl;
+		os << indent << "BackgroundValue: " << m_BackgroundValue << std::endl;
+		os << indent << "NumberOfBlocks: " << this->GetNumberOfBlocks() << std::endl;
+		os << indent << "NumberOfStoredBlocks: " << m_NumberOfStoredBlocks << std::endl;
+		os << indent << "MemorySize: " << this->GetMemorySize() << std::endl;
+	}
+
+} // end namespace itk
+
+#endif
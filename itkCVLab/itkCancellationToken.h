@@ -0,0 +1,97 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+#ifndef __itkCancellationToken_h
+#define __itkCancellationToken_h
+
+#include <itkObject.h>
+#include <itkObjectFactory.h>
+#include <itkSimpleFastMutexLock.h>
+
+namespace itk
+{
+
+	/** \class CancellationToken
+	 * \brief Flag shared between the thread running a filter and the
+	 * thread(s) allowed to cancel it.
+	 *
+	 * Unlike AbortGenerateData, a token is owned by the caller and not
+	 * by the filter: it can be handed to several filters of one request,
+	 * and cancelling one request does not affect the others.
+	 *
+	 * \author : Fethallah Benmansour
+	 */
+	class CancellationToken : public Object
+	{
+	public:
+		/** Standard class typedefs. */
+		typedef CancellationToken								Self;
+		typedef Object													Superclass;
+		typedef SmartPointer<Self>							Pointer;
+		typedef SmartPointer<const Self>				ConstPointer;
+
+		/** Method for creation through the object factory. */
+		itkNewMacro(Self);
+
+		/** Run-time type information (and related methods). */
+		itkTypeMacro(CancellationToken, Object);
+
+		/** Request the cancellation. Can be called from any thread. */
+		void Cancel()
+		{
+			m_Lock.Lock();
+			m_Cancelled = true;
+			m_Lock.Unlock();
+		}
+
+		/** Clear a previous cancellation request. */
+		void Reset()
+		{
+			m_Lock.Lock();
+			m_Cancelled = false;
+			m_Lock.Unlock();
+		}
+
+		/** Whether the cancellation was requested. */
+		bool IsCancelled() const
+		{
+			m_Lock.Lock();
+			bool cancelled = m_Cancelled;
+			m_Lock.Unlock();
+			return cancelled;
+		}
+
+	protected:
+		CancellationToken(): m_Cancelled(false) {};
+		virtual ~CancellationToken() {};
+
+		void PrintSelf(std::ostream& os, Indent indent) const
+		{
+			Superclass::PrintSelf(os, indent);
+			os << indent << "Cancelled: " << this->IsCancelled() << std::endl;
+		}
+
+	private:
+		CancellationToken(const Self&); //purposely not implemented
+		void operator=(const Self&); //purposely not implemented
+
+		bool														m_Cancelled;
+		mutable SimpleFastMutexLock			m_Lock;
+	};
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,301 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+#ifndef __itkCompactEigenSystemPixel_h
+#define __itkCompactEigenSystemPixel_h
+
+#include <cstring>
+#include <ostream>
+
+#include <itkFixedArray.h>
+#include <itkVector.h>
+#include <itkMacro.h>
+#include <vcl_cmath.h>
+#include "vnl/vnl_math.h"
+
+namespace itk
+{
+
+	/** Convert a float to an IEEE 754 half precision float (binary16),
+	 * rounding to the nearest even. Values beyond 65504 become infinite. */
+	inline unsigned short FloatToHalf(float value)
+	{
+		unsigned int x;
+		std::memcpy(&x, &value, sizeof(x));
+		const unsigned int sign = (x >> 16) & 0x8000;
+		const unsigned int floatExponent = (x >> 23) & 0xff;
+		unsigned int mantissa = x & 0x7fffff;
+		if( floatExponent == 0xff )
+		{
+			// infinity or NaN
+			return static_cast<unsigned short>( sign | 0x7c00 | (mantissa ? 0x200 : 0) );
+		}
+		const int exponent = static_cast<int>( floatExponent ) - 127 + 15;
+		if( exponent >= 0x1f )
+		{
+			return static_cast<unsigned short>( sign | 0x7c00 );
+		}
+		if( exponent <= 0 )
+		{
+			// subnormal half
+			if( exponent < -10 )
+			{
+				return static_cast<unsigned short>( sign );
+			}
+			mantissa |= 0x800000;
+			const unsigned int shift = 14 - exponent;
+			unsigned int half = mantissa >> shift;
+			const unsigned int remainder = mantissa & ((1u << shift) - 1);
+			const unsigned int halfway = 1u << (shift - 1);
+			if( remainder > halfway || (remainder == halfway && (half & 1)) )
+			{
+				half++;
+			}
+			return static_cast<unsigned short>( sign | half );
+		}
+		unsigned int half = sign | (static_cast<unsigned int>( exponent ) << 10) | (mantissa >> 13);
+		const unsigned int remainder = mantissa & 0x1fff;
+		// a carry into the exponent gives the right result, up to infinity
+		if( remainder > 0x1000 || (remainder == 0x1000 && (half & 1)) )
+		{
+			half++;
+		}
+		return static_cast<unsigned short>( half );
+	}
+
+	/** Convert an IEEE 754 half precision float (binary16) to a float. */
+	inline float HalfToFloat(unsigned short half)
+	{
+		const unsigned int sign = static_cast<unsigned int>( half & 0x8000 ) << 16;
+		int exponent = (half >> 10) & 0x1f;
+		unsigned int mantissa = half & 0x3ff;
+		unsigned int x;
+		if( exponent == 0 )
+		{
+			if( mantissa == 0 )
+			{
+				x = sign;
+			}
+			else
+			{
+				// subnormal half, normal float
+				exponent = 1;
+				while( !(mantissa & 0x400) )
+				{
+					mantissa <<= 1;
+					exponent--;
+				}
+				mantissa &= 0x3ff;
+				x = sign | (static_cast<unsigned int>( exponent + 127 - 15 ) << 23) | (mantissa << 13);
+			}
+		}
+		else if( exponent == 0x1f )
+		{
+			x = sign | 0x7f800000 | (mantissa << 13);
+		}
+		else
+		{
+			x = sign | (static_cast<unsigned int>( exponent + 127 - 15 ) << 23) | (mantissa << 13);
+		}
+		float value;
+		std::memcpy(&value, &x, sizeof(value));
+		return value;
+	}
+
+	/** \class CompactEigenSystemPixel
+	 * \brief Eigenvalues and principal direction of a symmetric tensor in
+	 * 2 * (VDimension + 1) bytes.
+	 *
+	 * The eigenvalues are stored as half precision floats (about three
+	 * significant digits). Their magnitude is limited to 65504, the largest
+	 * finite half: larger eigenvalues are saturated to +/-65504 instead of
+	 * becoming infinite, so the input of the eigen analysis should be
+	 * scaled accordingly, e.g. when it is a 16-bit stack. The direction is an
+	 * axis, i.e. v and -v are the same direction, quantized on 16 bits:
+	 * in 3D with the hemi-octahedral mapping (8 bits per coordinate, the
+	 * error is below one degree), in 2D as an angle in [0, pi).
+	 * In 3D a pixel takes 8 bytes, against 24 for a
+	 * SymmetricSecondRankTensor of floats.
+	 *
+	 * \author : Fethallah Benmansour
+	 */
+	template <unsigned int VDimension>
+	class CompactEigenSystemPixel
+	{
+	public:
+		typedef CompactEigenSystemPixel							Self;
+		typedef FixedArray<float, VDimension>				EigenValuesArrayType;
+		typedef Vector<double, VDimension>					DirectionType;
+
+		itkStaticConstMacro(Dimension, unsigned int, VDimension);
+
+		CompactEigenSystemPixel(): m_Direction(0)
+		{
+			for(unsigned int i = 0; i < VDimension; i++)
+			{
+				m_EigenValues[i] = 0;
+			}
+		}
+
+		/** Largest magnitude of an eigenvalue, the largest finite half. */
+		static float GetMaximumEigenValueMagnitude()
+		{
+			return 65504.0f;
+		}
+
+		/** Set the eigenvalues from any array indexed with []. The values
+		 * beyond GetMaximumEigenValueMagnitude() are saturated. */
+		template <class TArray>
+		void SetEigenValues(const TArray & eigenValues)
+		{
+			const float maximum = GetMaximumEigenValueMagnitude();
+			for(unsigned int i = 0; i < VDimension; i++)
+			{
+				float value = static_cast<float>( eigenValues[i] );
+				// the comparisons are false for a NaN, which is kept as is
+				if( value > maximum )
+				{
+					value = maximum;
+				}
+				else if( value < -maximum )
+				{
+					value = -maximum;
+				}
+				m_EigenValues[i] = FloatToHalf( value );
+			}
+		}
+
+		EigenValuesArrayType GetEigenValues() const
+		{
+			EigenValuesArrayType eigenValues;
+			for(unsigned int i = 0; i < VDimension; i++)
+			{
+				eigenValues[i] = HalfToFloat( m_EigenValues[i] );
+			}
+			return eigenValues;
+		}
+
+		float GetEigenValue(unsigned int i) const
+		{
+			return HalfToFloat( m_EigenValues[i] );
+		}
+
+		/** Set the direction from any vector indexed with []; it does not
+		 * need to be normalized. */
+		template <class TVector>
+		void SetDirection(const TVector & direction)
+		{
+			DirectionType d;
+			for(unsigned int i = 0; i < VDimension; i++)
+			{
+				d[i] = direction[i];
+			}
+			m_Direction = EncodeDirection( d );
+		}
+
+		/** The direction as a unit vector. */
+		DirectionType GetDirection() const
+		{
+			return DecodeDirection( m_Direction );
+		}
+
+		unsigned short GetEncodedDirection() const
+		{
+			return m_Direction;
+		}
+
+		/** Quantize an axis on 16 bits. */
+		static unsigned short EncodeDirection(const DirectionType & direction)
+		{
+			if( VDimension == 2 )
+			{
+				double angle = vcl_atan2( direction[1], direction[0] );
+				if( angle < 0.0 )
+				{
+					angle += vnl_math::pi;
+				}
+				long code = static_cast<long>( vnl_math_rnd( angle / vnl_math::pi * 65536.0 ) );
+				return static_cast<unsigned short>( code & 0xffff );
+			}
+			else if( VDimension == 3 )
+			{
+				double l1 = vcl_fabs( direction[0] ) + vcl_fabs( direction[1] ) + vcl_fabs( direction[2] );
+				if( l1 <= 0.0 )
+				{
+					return EncodeCoordinates( 0.0, 0.0 );
+				}
+				// Flip the axis to the upper hemisphere, project it on the
+				// octahedron and rotate the diamond onto the square
+				double s = direction[2] < 0.0 ? -1.0 : 1.0;
+				double px = s * direction[0] / l1;
+				double py = s * direction[1] / l1;
+				return EncodeCoordinates( px + py, px - py );
+			}
+			else
+			{
+				itkGenericExceptionMacro("The direction is encoded only in dimensions 2 and 3");
+			}
+		}
+
+		/** Unit vector of a 16 bit code. */
+		static DirectionType DecodeDirection(unsigned short code)
+		{
+			DirectionType direction;
+			if( VDimension == 2 )
+			{
+				double angle = static_cast<double>( code ) / 65536.0 * vnl_math::pi;
+				direction[0] = vcl_cos( angle );
+				direction[1] = vcl_sin( angle );
+			}
+			else if( VDimension == 3 )
+			{
+				double a = static_cast<double>( code >> 8 ) / 255.0 * 2.0 - 1.0;
+				double b = static_cast<double>( code & 0xff ) / 255.0 * 2.0 - 1.0;
+				direction[0] = 0.5 * (a + b);
+				direction[1] = 0.5 * (a - b);
+				direction[2] = 1.0 - vcl_fabs( direction[0] ) - vcl_fabs( direction[1] );
+				direction.Normalize();
+			}
+			else
+			{
+				itkGenericExceptionMacro("The direction is encoded only in dimensions 2 and 3");
+			}
+			return direction;
+		}
+
+	private:
+		/** 8 bits for each coordinate of the square [-1, 1]^2. */
+		static unsigned short EncodeCoordinates(double a, double b)
+		{
+			unsigned int qa = static_cast<unsigned int>( vnl_math_rnd( (vnl_math_max(-1.0, vnl_math_min(1.0, a)) * 0.5 + 0.5) * 255.0 ) );
+			unsigned int qb = static_cast<unsigned int>( vnl_math_rnd( (vnl_math_max(-1.0, vnl_math_min(1.0, b)) * 0.5 + 0.5) * 255.0 ) );
+			return static_cast<unsigned short>( (qa << 8) | qb );
+		}
+
+		unsigned short		m_EigenValues[VDimension];
+		unsigned short		m_Direction;
+	};
+
+	template <unsigned int VDimension>
+	std::ostream & operator<<(std::ostream & os, const CompactEigenSystemPixel<VDimension> & pixel)
+	{
+		os << "[" << pixel.GetEigenValues() << ", " << pixel.GetDirection() << "]";
+		return os;
+	}
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,240 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+#ifndef __itkDijkstraImageFilter_h
+#define __itkDijkstraImageFilter_h
+
+#include <vector>
+
+#include <itkImageToImageFilter.h>
+#include <itkImage.h>
+#include <itkFunctionBase.h>
+#include "itkCancellationToken.h"
+#include "itkRadixHeap.h"
+
+namespace itk
+{
+
+	/** \class DijkstraImageFilter
+	 * \brief Approximate geodesic distance on the graph of the voxels, by
+	 * Dijkstra's algorithm.
+	 *
+	 * The voxels are the nodes of a graph whose edges link each voxel to the
+	 * neighbors of its Connectivity: the integer offsets with at most
+	 * Connectivity non-zero coordinates, all in {-1, 0, 1}. A Connectivity
+	 * of 1 gives the 2N face neighbors and a Connectivity of N the 3^N - 1
+	 * neighbors of the full neighborhood, e.g. 26 in 3D and 80 in 4D.
+	 * An edge costs its physical length times the mean of the inverse
+	 * speeds of its two ends, the speed being the input pixels (or the
+	 * SpeedFunction) divided by the NormalizationFactor, as in
+	 * FastMarchingImageFilter2.
+	 *
+	 * The distances are metrication biased towards the directions of the
+	 * neighborhood, but they are computed with a radix heap and without any
+	 * quadratic solve, and each reached voxel records the neighbor it was
+	 * reached from (see GetPredecessor()), so that a minimal path is a walk
+	 * of its length. This is meant for previews, the exact geodesic being
+	 * computed afterwards by the fast marching.
+	 *
+	 * The output is the distance on the OutputRegion (the largest possible
+	 * region of the input by default), the voxels not reached having
+	 * LargeValue. The propagation stops once all the target points, if
+	 * any, are settled, or once the first voxel of the TargetMask, if
+	 * any, is settled.
+	 *
+	 * \author : Fethallah Benmansour
+	 */
+	template <class TLevelSet, class TSpeedImage = TLevelSet>
+	class ITK_EXPORT DijkstraImageFilter:
+	public ImageToImageFilter<TSpeedImage, TLevelSet>
+	{
+	public:
+		/** Standard class typedefs. */
+		typedef DijkstraImageFilter																				Self;
+		typedef ImageToImageFilter<TSpeedImage, TLevelSet>								Superclass;
+		typedef SmartPointer<Self>																				Pointer;
+		typedef SmartPointer<const Self>																	ConstPointer;
+
+		/** Method for creation through the object factory. */
+		itkNewMacro(Self);
+
+		/** Run-time type information (and related methods). */
+		itkTypeMacro(DijkstraImageFilter, ImageToImageFilter);
+
+		itkStaticConstMacro(ImageDimension, unsigned int, TLevelSet::ImageDimension);
+
+		typedef TLevelSet																									LevelSetImageType;
+		typedef typename LevelSetImageType::PixelType											PixelType;
+		typedef TSpeedImage																								SpeedImageType;
+		typedef typename LevelSetImageType::IndexType											IndexType;
+		typedef typename LevelSetImageType::OffsetType										OffsetType;
+		typedef typename LevelSetImageType::RegionType										RegionType;
+
+		/** For each voxel, 0 if it was not reached or is a seed, else one plus
+		 * the number of the neighbor offset it was reached from. */
+		typedef Image<unsigned char, ImageDimension>											PredecessorImageType;
+		typedef typename PredecessorImageType::Pointer										PredecessorImagePointer;
+
+		/** Non-zero on the target voxels (see SetTargetMask()). */
+		typedef Image<unsigned char, ImageDimension>											TargetMaskImageType;
+
+		typedef FunctionBase<IndexType, double>														SpeedFunctionType;
+
+		/** The seeds, at distance 0. */
+		void SetSeeds(const std::vector<IndexType> & seeds)
+		{
+			m_Seeds = seeds;
+			this->Modified();
+		}
+		const std::vector<IndexType> & GetSeeds() const
+		{
+			return m_Seeds;
+		}
+
+		/** The target points; none by default, in which case the whole output
+		 * region is processed. */
+		void SetTargetPoints(const std::vector<IndexType> & targets)
+		{
+			m_TargetPoints = targets;
+			this->Modified();
+		}
+		const std::vector<IndexType> & GetTargetPoints() const
+		{
+			return m_TargetPoints;
+		}
+
+		/** Mask of target voxels, e.g. an existing reconstruction: the
+		 * propagation stops at the first settled voxel where it is non-zero.
+		 * None by default. */
+		itkSetConstObjectMacro(TargetMask, TargetMaskImageType);
+		itkGetConstObjectMacro(TargetMask, TargetMaskImageType);
+
+		/** Whether the last update settled a voxel of the target mask, and
+		 * the first one. */
+		itkGetConstMacro(TargetMaskReached, bool);
+		itkGetConstReferenceMacro(ReachedTargetMaskIndex, IndexType);
+
+		/** Region of the input on which the distance is computed. The largest
+		 * possible region of the input if it is empty (the default). */
+		itkSetMacro(OutputRegion, RegionType);
+		itkGetConstReferenceMacro(OutputRegion, RegionType);
+
+		/** Maximum number of non-zero coordinates of the neighbor offsets,
+		 * between 1 and ImageDimension, the default. */
+		itkSetClampMacro(Connectivity, unsigned int, 1, ImageDimension);
+		itkGetConstMacro(Connectivity, unsigned int);
+
+		/** Speed given as a function of the index, used instead of the input
+		 * pixels when it is set (see FastMarchingImageFilter2). */
+		itkSetConstObjectMacro(SpeedFunction, SpeedFunctionType);
+		itkGetConstObjectMacro(SpeedFunction, SpeedFunctionType);
+
+		/** The speeds are divided by this factor. Defaults to 1. */
+		itkSetMacro(NormalizationFactor, double);
+		itkGetConstMacro(NormalizationFactor, double);
+
+		/** Set/Get the token used to cancel the computation from another
+		 * thread. A cancelled computation throws a ProcessAborted exception. */
+		itkSetObjectMacro(CancellationToken, CancellationToken);
+		itkGetObjectMacro(CancellationToken, CancellationToken);
+
+		/** Distance of the voxels not reached. */
+		itkGetConstMacro(LargeValue, PixelType);
+
+		/** The predecessors of the last update. */
+		PredecessorImagePointer GetPredecessorImage() const
+		{
+			return m_PredecessorImage;
+		}
+
+		/** The voxel a reached voxel was reached from. Returns false for the
+		 * seeds and the voxels not reached. */
+		bool GetPredecessor(const IndexType & index, IndexType & predecessor) const
+		{
+			const unsigned char code = m_PredecessorImage->GetPixel( index );
+			if( code == 0 )
+			{
+				return false;
+			}
+			predecessor = index - m_NeighborOffsets[code - 1];
+			return true;
+		}
+
+		/** Number of neighbors of a voxel, 80 with the full 4D neighborhood. */
+		unsigned int GetNumberOfNeighbors() const
+		{
+			return static_cast<unsigned int>( m_NeighborOffsets.size() );
+		}
+
+		/** Statistics of the last update: the settled voxels, the heap pushes,
+		 * the largest heap size and the outdated heap entries popped. */
+		itkGetConstMacro(NumberOfSettledPoints, SizeValueType);
+		itkGetConstMacro(NumberOfHeapPushes, SizeValueType);
+		itkGetConstMacro(MaximumHeapSize, SizeValueType);
+		itkGetConstMacro(NumberOfStalePops, SizeValueType);
+
+	protected:
+		DijkstraImageFilter();
+		virtual ~DijkstraImageFilter() {}
+		void PrintSelf(std::ostream& os, Indent indent) const;
+
+		void GenerateOutputInformation();
+		void GenerateInputRequestedRegion();
+		void EnlargeOutputRequestedRegion(DataObject *output);
+		void GenerateData();
+
+	private:
+		DijkstraImageFilter(const Self&); //purposely not implemented
+		void operator=(const Self&); //purposely not implemented
+
+		/** Offsets of the neighbors of the Connectivity, and their lengths. */
+		void ComputeNeighborhood();
+
+		/** Inverse speed at a voxel of the output region, evaluated once. */
+		double GetInverseSpeed(const IndexType & index, SizeValueType offset);
+
+		std::vector<IndexType>												m_Seeds;
+		std::vector<IndexType>												m_TargetPoints;
+		typename TargetMaskImageType::ConstPointer		m_TargetMask;
+		bool																					m_TargetMaskReached;
+		IndexType																			m_ReachedTargetMaskIndex;
+		RegionType																		m_OutputRegion;
+		unsigned int																	m_Connectivity;
+		typename SpeedFunctionType::ConstPointer			m_SpeedFunction;
+		double																				m_NormalizationFactor;
+		CancellationToken::Pointer										m_CancellationToken;
+		PixelType																			m_LargeValue;
+
+		PredecessorImagePointer												m_PredecessorImage;
+		std::vector<OffsetType>												m_NeighborOffsets;
+		std::vector<OffsetValueType>									m_NeighborBufferOffsets;
+		std::vector<double>														m_NeighborLengths;
+		std::vector<float>														m_InverseSpeeds;
+		std::vector<bool>															m_Settled;
+
+		SizeValueType																	m_NumberOfSettledPoints;
+		SizeValueType																	m_NumberOfHeapPushes;
+		SizeValueType																	m_MaximumHeapSize;
+		SizeValueType																	m_NumberOfStalePops;
+	};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkDijkstraImageFilter.txx"
+#endif
+
+#endif
@@ -0,0 +1,351 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+#ifndef __itkDijkstraImageFilter_txx
+#define __itkDijkstraImageFilter_txx
+
+#include "itkDijkstraImageFilter.h"
+#include "itkMetricsRegistry.h"
+#include <itkNumericTraits.h>
+#include <itkProgressReporter.h>
+#include "vnl/vnl_math.h"
+
+namespace itk
+{
+
+	template <class TLevelSet, class TSpeedImage>
+	DijkstraImageFilter<TLevelSet, TSpeedImage>
+	::DijkstraImageFilter()
+	{
+		m_Connectivity = ImageDimension;
+		m_NormalizationFactor = 1.0;
+		m_LargeValue = static_cast<PixelType>( NumericTraits<PixelType>::max() / 2.0 );
+		m_PredecessorImage = PredecessorImageType::New();
+		m_TargetMaskReached = false;
+		m_ReachedTargetMaskIndex.Fill(0);
+		m_NumberOfSettledPoints = 0;
+		m_NumberOfHeapPushes = 0;
+		m_MaximumHeapSize = 0;
+		m_NumberOfStalePops = 0;
+	}
+
+	template <class TLevelSet, class TSpeedImage>
+	void
+	DijkstraImageFilter<TLevelSet, TSpeedImage>
+	::PrintSelf(std::ostream& os, Indent indent) const
+	{
+		Superclass::PrintSelf(os, indent);
+		os << indent << "Seeds: " << m_Seeds.size() << std::endl;
+		os << indent << "TargetPoints: " << m_TargetPoints.size() << std::endl;
+		os << indent << "TargetMask: " << m_TargetMask.GetPointer() << std::endl;
+		os << indent << "TargetMaskReached: " << m_TargetMaskReached << std::endl;
+		os << indent << "OutputRegion: " << m_OutputRegion << std::endl;
+		os << indent << "Connectivity: " << m_Connectivity << std::endl;
+		os << indent << "SpeedFunction: " << m_SpeedFunction.GetPointer() << std::endl;
+		os << indent << "NormalizationFactor: " << m_NormalizationFactor << std::endl;
+		os << indent << "CancellationToken: " << m_CancellationToken.GetPointer() << std::endl;
+		os << indent << "NumberOfSettledPoints: " << m_NumberOfSettledPoints << std::endl;
+		os << indent << "NumberOfHeapPushes: " << m_NumberOfHeapPushes << std::endl;
+		os << indent << "MaximumHeapSize: " << m_MaximumHeapSize << std::endl;
+		os << indent << "NumberOfStalePops: " << m_NumberOfStalePops << std::endl;
+	}
+
+	template <class TLevelSet, class TSpeedImage>
+	void
+	DijkstraImageFilter<TLevelSet, TSpeedImage>
+	::GenerateOutputInformation()
+	{
+		Superclass::GenerateOutputInformation();
+		if( m_OutputRegion.GetNumberOfPixels() > 0 )
+		{
+			this->GetOutput()->SetLargestPossibleRegion( m_OutputRegion );
+		}
+	}
+
+	template <class TLevelSet, class TSpeedImage>
+	void
+	DijkstraImageFilter<TLevelSet, TSpeedImage>
+	::GenerateInputRequestedRegion()
+	{
+		Superclass::GenerateInputRequestedRegion();
+		if( this->GetInput() )
+		{
+			SpeedImageType * input = const_cast<SpeedImageType *>( this->GetInput() );
+			input->SetRequestedRegionToLargestPossibleRegion();
+		}
+	}
+
+	template <class TLevelSet, class TSpeedImage>
+	void
+	DijkstraImageFilter<TLevelSet, TSpeedImage>
+	::EnlargeOutputRequestedRegion(DataObject *output)
+	{
+		LevelSetImageType * image = dynamic_cast<LevelSetImageType *>( output );
+		if( image )
+		{
+			image->SetRequestedRegionToLargestPossibleRegion();
+		}
+	}
+
+	template <class TLevelSet, class TSpeedImage>
+	void
+	DijkstraImageFilter<TLevelSet, TSpeedImage>
+	::ComputeNeighborhood()
+	{
+		const LevelSetImageType * output = this->GetOutput();
+		const typename LevelSetImageType::SpacingType & spacing = output->GetSpacing();
+		const OffsetValueType * offsetTable = output->GetOffsetTable();
+
+		m_NeighborOffsets.clear();
+		m_NeighborBufferOffsets.clear();
+		m_NeighborLengths.clear();
+
+		// Enumerate {-1, 0, 1}^N in base 3
+		unsigned int numberOfOffsets = 1;
+		for(unsigned int d = 0; d < ImageDimension; d++)
+		{
+			numberOfOffsets *= 3;
+		}
+		for(unsigned int n = 0; n < numberOfOffsets; n++)
+		{
+			OffsetType offset;
+			unsigned int numberOfNonZeros = 0;
+			unsigned int digits = n;
+			for(unsigned int d = 0; d < ImageDimension; d++)
+			{
+				offset[d] = static_cast<OffsetValueType>( digits % 3 ) - 1;
+				digits /= 3;
+				if( offset[d] != 0 )
+				{
+					numberOfNonZeros++;
+				}
+			}
+			if( numberOfNonZeros == 0 || numberOfNonZeros > m_Connectivity )
+			{
+				continue;
+			}
+			OffsetValueType bufferOffset = 0;
+			double squaredLength = 0.0;
+			for(unsigned int d = 0; d < ImageDimension; d++)
+			{
+				bufferOffset += offset[d] * offsetTable[d];
+				squaredLength += vnl_math_sqr( offset[d] * spacing[d] );
+			}
+			m_NeighborOffsets.push_back( offset );
+			m_NeighborBufferOffsets.push_back( bufferOffset );
+			m_NeighborLengths.push_back( vcl_sqrt( squaredLength ) );
+		}
+
+		if( m_NeighborOffsets.size() > NumericTraits<unsigned char>::max() )
+		{
+			itkExceptionMacro( << "The " << m_NeighborOffsets.size() << " neighbors can not be coded on a byte" );
+		}
+	}
+
+	template <class TLevelSet, class TSpeedImage>
+	double
+	DijkstraImageFilter<TLevelSet, TSpeedImage>
+	::GetInverseSpeed(const IndexType & index, SizeValueType offset)
+	{
+		float & inverseSpeed = m_InverseSpeeds[offset];
+		if( inverseSpeed < 0.0f )
+		{
+			double speed = m_SpeedFunction ? m_SpeedFunction->Evaluate( index )
+																		 : static_cast<double>( this->GetInput()->GetPixel( index ) );
+			speed /= m_NormalizationFactor;
+			inverseSpeed = speed > 0.0 ? static_cast<float>( 1.0 / speed ) : NumericTraits<float>::max();
+		}
+		return static_cast<double>( inverseSpeed );
+	}
+
+	template <class TLevelSet, class TSpeedImage>
+	void
+	DijkstraImageFilter<TLevelSet, TSpeedImage>
+	::GenerateData()
+	{
+		if( m_NormalizationFactor < vnl_math::eps )
+		{
+			itkExceptionMacro( << "Normalization Factor is null or negative" );
+		}
+		if( m_Seeds.empty() )
+		{
+			itkExceptionMacro( << "At least one seed must be provided" );
+		}
+
+		LevelSetImageType * output = this->GetOutput();
+		output->SetBufferedRegion( output->GetRequestedRegion() );
+		output->Allocate();
+		output->FillBuffer( m_LargeValue );
+		const RegionType region = output->GetBufferedRegion();
+
+		m_PredecessorImage->CopyInformation( output );
+		m_PredecessorImage->SetBufferedRegion( region );
+		m_PredecessorImage->Allocate();
+		m_PredecessorImage->FillBuffer( 0 );
+
+		this->ComputeNeighborhood();
+
+		const SizeValueType numberOfPixels = region.GetNumberOfPixels();
+		m_InverseSpeeds.assign( numberOfPixels, -1.0f );
+		m_Settled.assign( numberOfPixels, false );
+		PixelType * distances = output->GetBufferPointer();
+		unsigned char * predecessors = m_PredecessorImage->GetBufferPointer();
+
+		m_NumberOfSettledPoints = 0;
+		m_NumberOfHeapPushes = 0;
+		m_MaximumHeapSize = 0;
+		m_NumberOfStalePops = 0;
+		m_TargetMaskReached = false;
+		m_ReachedTargetMaskIndex.Fill(0);
+
+		RadixHeap<SizeValueType> heap;
+		for(unsigned int s = 0; s < m_Seeds.size(); s++)
+		{
+			if( region.IsInside( m_Seeds[s] ) )
+			{
+				const SizeValueType offset = output->ComputeOffset( m_Seeds[s] );
+				distances[offset] = NumericTraits<PixelType>::Zero;
+				heap.Push( 0.0, offset );
+				++m_NumberOfHeapPushes;
+			}
+		}
+
+		std::vector<SizeValueType> targetOffsets;
+		for(unsigned int t = 0; t < m_TargetPoints.size(); t++)
+		{
+			if( region.IsInside( m_TargetPoints[t] ) )
+			{
+				targetOffsets.push_back( output->ComputeOffset( m_TargetPoints[t] ) );
+			}
+		}
+		std::vector<bool> targetReached( targetOffsets.size(), false );
+		SizeValueType numberOfTargetsToReach = targetOffsets.size();
+		const bool hasTargets = numberOfTargetsToReach > 0;
+
+		IndexType lastIndex = region.GetIndex();
+		for(unsigned int d = 0; d < ImageDimension; d++)
+		{
+			lastIndex[d] += region.GetSize()[d] - 1;
+		}
+
+		ProgressReporter progress( this, 0, numberOfPixels, 100 );
+		const SizeValueType cancellationCheckInterval = 1024;
+
+		while( !heap.Empty() )
+		{
+			double distance;
+			SizeValueType offset;
+			heap.Pop( distance, offset );
+
+			// Outdated entry: the voxel was reached again, more cheaply
+			if( m_Settled[offset] || distance > static_cast<double>( distances[offset] ) )
+			{
+				++m_NumberOfStalePops;
+				continue;
+			}
+			m_Settled[offset] = true;
+			++m_NumberOfSettledPoints;
+			progress.CompletedPixel();
+
+			if( hasTargets )
+			{
+				for(unsigned int t = 0; t < targetOffsets.size(); t++)
+				{
+					if( !targetReached[t] && targetOffsets[t] == offset )
+					{
+						targetReached[t] = true;
+						--numberOfTargetsToReach;
+					}
+				}
+				if( numberOfTargetsToReach == 0 )
+				{
+					break;
+				}
+			}
+
+			const IndexType index = output->ComputeIndex( offset );
+			if( m_TargetMask && m_TargetMask->GetBufferedRegion().IsInside( index ) &&
+				 m_TargetMask->GetPixel( index ) != 0 )
+			{
+				m_TargetMaskReached = true;
+				m_ReachedTargetMaskIndex = index;
+				break;
+			}
+
+			if( m_NumberOfSettledPoints % cancellationCheckInterval == 0 &&
+				 ( this->GetAbortGenerateData() || ( m_CancellationToken && m_CancellationToken->IsCancelled() ) ) )
+			{
+				this->InvokeEvent( AbortEvent() );
+				this->ResetPipeline();
+				ProcessAborted e(__FILE__, __LINE__);
+				e.SetDescription("Process aborted.");
+				e.SetLocation(ITK_LOCATION);
+				throw e;
+			}
+
+			bool isInterior = true;
+			for(unsigned int d = 0; d < ImageDimension; d++)
+			{
+				if( index[d] <= region.GetIndex()[d] || index[d] >= lastIndex[d] )
+				{
+					isInterior = false;
+					break;
+				}
+			}
+
+			const double inverseSpeed = this->GetInverseSpeed( index, offset );
+			for(unsigned int k = 0; k < m_NeighborOffsets.size(); k++)
+			{
+				const IndexType neighborIndex = index + m_NeighborOffsets[k];
+				if( !isInterior && !region.IsInside( neighborIndex ) )
+				{
+					continue;
+				}
+				const SizeValueType neighborOffset = offset + m_NeighborBufferOffsets[k];
+				if( m_Settled[neighborOffset] )
+				{
+					continue;
+				}
+				const double cost = 0.5 * m_NeighborLengths[k] *
+					( inverseSpeed + this->GetInverseSpeed( neighborIndex, neighborOffset ) );
+				// The distances are stored, and pushed, with the precision of the
+				// output, which keeps the pushed keys monotone.
+				const PixelType neighborDistance = static_cast<PixelType>( distance + cost );
+				if( neighborDistance < distances[neighborOffset] )
+				{
+					distances[neighborOffset] = neighborDistance;
+					predecessors[neighborOffset] = static_cast<unsigned char>( k + 1 );
+					heap.Push( static_cast<double>( neighborDistance ), neighborOffset );
+					++m_NumberOfHeapPushes;
+					m_MaximumHeapSize = vnl_math_max( m_MaximumHeapSize, heap.Size() );
+				}
+			}
+		}
+
+		// The working buffers are only needed during the propagation
+		std::vector<float>().swap( m_InverseSpeeds );
+		std::vector<bool>().swap( m_Settled );
+
+		MetricsRegistry * metrics = MetricsRegistry::GetInstance();
+		metrics->Increment("dijkstra.settled", m_NumberOfSettledPoints);
+		metrics->Increment("dijkstra.heapPushes", m_NumberOfHeapPushes);
+		metrics->Increment("dijkstra.stalePops", m_NumberOfStalePops);
+		metrics->UpdateGaugeMaximum("dijkstra.peakHeapSize", m_MaximumHeapSize);
+	}
+
+} // end namespace itk
+
+#endif
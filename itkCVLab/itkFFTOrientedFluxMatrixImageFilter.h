@@ -22,12 +22,15 @@
 #include <itkSymmetricSecondRankTensor.h>
 #include <itkPixelTraits.h>
 #include <itkNthElementImageAdaptor.h>
-#include <itkPadImageFilter.h>
 #include <itkHalfHermitianToRealInverseFFTImageFilter.h>
 #include <itkRealToHalfHermitianForwardFFTImageFilter.h>
 #include <itkMultiplyImageFilter.h>
 #include <itkImageBoundaryCondition.h>
 #include <itkZeroFluxNeumannBoundaryCondition.h>
+#include "itkScratchArena.h"
+#include <map>
+#include <string>
+#include <vector>
 
 namespace itk
 {
@@ -40,6 +43,13 @@ namespace itk
 	 * 
 	 * PixelType of the output image type is SymmetricSecondRankTensor.
 	 *
+	 * With GenerateComponentImagesOn(), the tensor components are kept as
+	 * planar images (one contiguous float volume per component, in the
+	 * storage order of SymmetricSecondRankTensor) returned by
+	 * GetComponentImage(), and the tensor output is not filled: this saves
+	 * the interleaved copy and the tensor buffer for consumers that read the
+	 * components directly, such as the oriented flux measure filters.
+	 *
 	 * This code is heavily inspired from itkFFTConvolutionImageFilter
 	 * The main difference is that the kernels are generated in the Fourier domain directly.
 	 *
@@ -135,6 +145,49 @@ namespace itk
 		RealType GetSigma0( );
 		void SetRadius( RealType radius);
 		RealType GetRadius( );
+		
+		/** Type of the planar images of the tensor components. */
+		typedef InternalImageType																	ComponentImageType;
+		
+		/** Number of independent components of the tensor. */
+		itkStaticConstMacro(NumberOfComponents, unsigned int, ImageDimension * (ImageDimension + 1) / 2);
+		
+		/** Set/Get whether the components are produced as planar images
+		 * instead of the tensor output. Off by default. */
+		itkSetMacro(GenerateComponentImages, bool);
+		itkGetConstMacro(GenerateComponentImages, bool);
+		itkBooleanMacro(GenerateComponentImages);
+		
+		/** Planar image of one tensor component, available after an update
+		 * with GenerateComponentImages on; NULL otherwise. */
+		ComponentImageType * GetComponentImage(unsigned int element);
+		
+		/** Drop the component images, giving their blocks back to the
+		 * scratch arena, if any. The images must no longer be read, e.g. by
+		 * a measure filter they are the inputs of. Also done by the next
+		 * update and by the destructor. */
+		void ReleaseComponentImages();
+		
+		/** Wall-clock time spent in each stage of the last update, in seconds.
+		 * The stages are "pad", "forwardFFT", "kernel", "multiply",
+		 * "inverseFFT", "crop" and "copy" (to the tensor output, absent with
+		 * GenerateComponentImages on). */
+		typedef std::map< std::string, double >										StageTimesType;
+		const StageTimesType & GetStageTimes() const { return m_StageTimes; }
+		
+		/** Set/Get an arena lending the buffers of the padded input, of the
+		 * kernels (the products with the spectrum are computed in place) and
+		 * of the cropped components. The component images of
+		 * GenerateComponentImages outlive the update and keep their blocks
+		 * until ReleaseComponentImages(). NULL by default: all the images are
+		 * allocated by ITK. */
+		itkSetObjectMacro(ScratchArena, ScratchArena);
+		itkGetObjectMacro(ScratchArena, ScratchArena);
+		
+		/** Get the pad size, the size of the padded input and of the
+		 * inverse transforms; the kernels and products have the size of its
+		 * half Hermitian spectrum. Needs the input information. */
+		InputSizeType GetPadSize() const;
 
 #ifdef ITK_USE_CONCEPT_CHECKING
 		/** Begin concept checking */
@@ -148,10 +201,12 @@ namespace itk
 	protected:
 		
 		FFTOrientedFluxMatrixImageFilter();
-		virtual ~FFTOrientedFluxMatrixImageFilter() {};
+		virtual ~FFTOrientedFluxMatrixImageFilter() { this->ReleaseComponentImages(); };
 		void PrintSelf(std::ostream& os, Indent indent) const;
 		
-		void GenerateOrientedFluxMatrixElementKernel(InternalComplexImagePointerType &kernel,
+		/** Generate the kernel of an element of the matrix. Returns the
+		 * scratch block of the kernel, if any. */
+		void * GenerateOrientedFluxMatrixElementKernel(InternalComplexImagePointerType &kernel,
 																								 InternalComplexImagePointerType &input, 
 																								 unsigned int derivA, unsigned int derivB, 
 																								 float radius, float sigma0);
@@ -164,19 +219,44 @@ namespace itk
 		void PrepareInput(const InputImageType * input,
 											InternalComplexImagePointerType & preparedInput);
 		
-		/** Pad the input image. */
-		void PadInput(const InputImageType * input,
+		/** Pad the input image. The padded image is directly produced in the
+		 * internal precision, the input is cast while being copied. Returns
+		 * the scratch block of the padded image, if any. */
+		void * PadInput(const InputImageType * input,
 									InternalImagePointerType & paddedInput);
 		
 		/** Take the Fourier transform of the padded input. */
 		void TransformPaddedInput(const InternalImageType * paddedInput,
 															InternalComplexImagePointerType & transformedInput);
 		
-		/** Produce output from the final Fourier domain image. */
-		void ProduceOutput(InternalComplexImageType * paddedOutput, InternalImagePointerType & internalOutput);
+		/** Produce output from the final Fourier domain image. Returns the
+		 * scratch block of the output, if any. */
+		void * ProduceOutput(InternalComplexImageType * paddedOutput, InternalImagePointerType & internalOutput);
 		
-		/** Crop the padded version of the output. */
-		void CropOutput(InternalImageType * paddedOutput, InternalImagePointerType & croppedOutput);
+		/** Crop the padded version of the output. Returns the scratch block
+		 * of the cropped output, if any. */
+		void * CropOutput(InternalImageType * paddedOutput, InternalImagePointerType & croppedOutput);
+		
+		/** Allocate a temporary image, in a block of the scratch arena if
+		 * one is set. Returns the block, to be given back with
+		 * ReturnScratchBlock(). */
+		template <class TImage>
+		void * AllocateScratchImage(TImage * image, bool useArena)
+		{
+			if( useArena && m_ScratchArena )
+			{
+				return m_ScratchArena->AllocateImage( image );
+			}
+			image->Allocate();
+			return 0;
+		}
+		void ReturnScratchBlock(void * block)
+		{
+			if( m_ScratchArena )
+			{
+				m_ScratchArena->Return( block );
+			}
+		}
 		
 		/** Get the lower bound for the padding of both the kernel and input
 		 * images. Assuming that the regions of the kernel and input are the
@@ -186,9 +266,6 @@ namespace itk
 		 * images. */
 		InputSizeType GetPadLowerBound() const;
 		
-		/** Get the pad size. */
-		InputSizeType GetPadSize() const;
-		
 		/** Get whether the X dimension has an odd size. */
 		bool GetXDimensionIsOdd() const;
 		
@@ -204,6 +281,14 @@ namespace itk
 		BoundaryConditionPointerType m_BoundaryCondition;
 		
 		OutputImageAdaptorPointer		m_ImageAdaptor;
+		
+		bool												m_GenerateComponentImages;
+		std::vector<InternalImagePointerType>	m_ComponentImages;
+		std::vector<void *>									m_ComponentBlocks;
+		
+		StageTimesType							m_StageTimes;
+		
+		ScratchArena::Pointer				m_ScratchArena;
 	};
 	
 } // end namespace itk
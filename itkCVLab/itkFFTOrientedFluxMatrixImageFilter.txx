@@ -19,8 +19,12 @@
 #define __itkFFTOrientedFluxMatrixImageFilter_txx
 
 #include "itkFFTOrientedFluxMatrixImageFilter.h"
-#include "itkCastImageFilter.h"
 #include "itkExtractImageFilter.h"
+#include "itkTimeProbe.h"
+#include "itkMetricsRegistry.h"
+#include "itkTraceEventRecorder.h"
+
+#include <omp.h>
 
 
 namespace itk
@@ -36,6 +40,7 @@ namespace itk
 		m_Radius = 1.0;
 		m_BoundaryCondition = &m_DefaultBoundaryCondition;
 		m_ImageAdaptor = OutputImageAdaptorType::New();
+		m_GenerateComponentImages = false;
 	}
 	
 	/**
@@ -90,6 +95,37 @@ namespace itk
 		return m_Radius;
 	}
 	
+	/**
+	 * Get Component Image
+	 */
+	template <typename TInputImage, typename TOutputImage >
+	typename FFTOrientedFluxMatrixImageFilter<TInputImage,TOutputImage>::ComponentImageType *
+	FFTOrientedFluxMatrixImageFilter<TInputImage,TOutputImage>
+	::GetComponentImage( unsigned int element )
+	{
+		if( element >= m_ComponentImages.size() )
+		{
+			return NULL;
+		}
+		return m_ComponentImages[element];
+	}
+	
+	/**
+	 * Release Component Images
+	 */
+	template <typename TInputImage, typename TOutputImage >
+	void
+	FFTOrientedFluxMatrixImageFilter<TInputImage,TOutputImage>
+	::ReleaseComponentImages()
+	{
+		m_ComponentImages.clear();
+		for(unsigned int b = 0; b < m_ComponentBlocks.size(); b++)
+		{
+			this->ReturnScratchBlock( m_ComponentBlocks[b] );
+		}
+		m_ComponentBlocks.clear();
+	}
+	
 	/***************************************************************************************
 	 *  For 2 given directions, Generates the oriented flux matix kernel in the fourier
 	 *  domain as Given by Eq.8 in:
@@ -100,7 +136,7 @@ namespace itk
 	 * \author Fethallah Benmansour
 	 ***************************************************************************************/
 	template <typename TInputImage, typename TOutputImage >
-	void
+	void *
 	FFTOrientedFluxMatrixImageFilter<TInputImage,TOutputImage >
 	::GenerateOrientedFluxMatrixElementKernel(InternalComplexImagePointerType &kernel,
 																					InternalComplexImagePointerType &input, 
@@ -136,7 +172,7 @@ namespace itk
 		kernel->SetSpacing( freqSpacing );
 		kernel->SetOrigin(origin);
 		kernel->SetBufferedRegion( input->GetBufferedRegion() );
-		kernel->Allocate();
+		void * kernelBlock = this->AllocateScratchImage( kernel.GetPointer(), true );
 		// The multiply image filter checks that the 2 images occupy exactly the same space
 		// therefore, the physical space of the fourtier transform of the input image needs to be modified
 		input->SetSpacing( freqSpacing );
@@ -235,6 +271,7 @@ namespace itk
 			it.Set(value);
 			++it;
 		}		
+		return kernelBlock;
 	}
 	
 	/**
@@ -258,18 +295,28 @@ namespace itk
 		localInput->Graft( this->GetInput() );
 		localInput->Update();
 		
+		m_StageTimes.clear();
+		
 		InternalComplexImagePointerType inputFourierTransform = NULL;
 		InternalComplexImagePointerType kernel = NULL;
 		PrepareInput( localInput, inputFourierTransform );
+		// The spectrum is the largest buffer of a scale: the kernels and the
+		// products have its size.
+		MetricsRegistry::GetInstance()->UpdateGaugeMaximum("oof.spectrumBytes",
+			inputFourierTransform->GetBufferedRegion().GetNumberOfPixels() * sizeof(typename InternalComplexImageType::PixelType));
 		
 		//The original spacing is needed for generating properly the kernels
 		SpacingType originalSpacing = inputImage->GetSpacing();
-		// Prepare Image adaptor
-		m_ImageAdaptor->SetImage( this->GetOutput() );
-		m_ImageAdaptor->SetLargestPossibleRegion( this->GetInput()->GetLargestPossibleRegion() );
-		m_ImageAdaptor->SetBufferedRegion( this->GetInput()->GetBufferedRegion() );
-		m_ImageAdaptor->SetRequestedRegion( this->GetInput()->GetRequestedRegion() );
-		m_ImageAdaptor->Allocate();
+		// Prepare Image adaptor, unless the components are kept planar
+		this->ReleaseComponentImages();
+		if( !m_GenerateComponentImages )
+		{
+			m_ImageAdaptor->SetImage( this->GetOutput() );
+			m_ImageAdaptor->SetLargestPossibleRegion( this->GetInput()->GetLargestPossibleRegion() );
+			m_ImageAdaptor->SetBufferedRegion( this->GetInput()->GetBufferedRegion() );
+			m_ImageAdaptor->SetRequestedRegion( this->GetInput()->GetRequestedRegion() );
+			m_ImageAdaptor->Allocate();
+		}
 		unsigned int element = 0;
 		for(unsigned int i = 0; i < ImageDimension; i++)
 		{
@@ -282,21 +329,43 @@ namespace itk
 				// this is done because the multiply image filter require that the 2 input images occupy 
 				// the exact same physical domain.
 				inputFourierTransform->SetSpacing( originalSpacing );
-				GenerateOrientedFluxMatrixElementKernel( kernel, inputFourierTransform, i, j, this->GetRadius(), this->GetSigma0() );
+				TraceTimeProbe kernelTime("kernel", "oof");
+				kernelTime.Start();
+				void * kernelBlock = GenerateOrientedFluxMatrixElementKernel( kernel, inputFourierTransform, i, j, this->GetRadius(), this->GetSigma0() );
+				kernelTime.Stop();
+				m_StageTimes["kernel"] += kernelTime.GetTotal();
 				typedef itk::MultiplyImageFilter< InternalComplexImageType,
 				InternalComplexImageType,
 				InternalComplexImageType > MultType;
 				typename MultType::Pointer multiplyFilter = MultType::New();
-				multiplyFilter->SetInput1( inputFourierTransform );
-				multiplyFilter->SetInput2( kernel );
+				// The product overwrites the kernel, which is not used afterwards
+				multiplyFilter->SetInput1( kernel );
+				multiplyFilter->SetInput2( inputFourierTransform );
 				multiplyFilter->SetNumberOfThreads( this->GetNumberOfThreads() );
 				multiplyFilter->SetReleaseDataFlag( true );
-				multiplyFilter->SetInPlace( false );
+				multiplyFilter->SetInPlace( true );
+				TraceTimeProbe multiplyTime("multiply", "oof");
+				multiplyTime.Start();
 				multiplyFilter->Update();
+				multiplyTime.Stop();
+				m_StageTimes["multiply"] += multiplyTime.GetTotal();
 				// Free up the memory for the prepared kernel
 				kernel = NULL;
 				InternalImagePointerType croppedOutput = NULL;
-				this->ProduceOutput( multiplyFilter->GetOutput(), croppedOutput );
+				void * croppedBlock = this->ProduceOutput( multiplyFilter->GetOutput(), croppedOutput );
+				// The product, in the block of the kernel, was consumed by the
+				// inverse transform.
+				this->ReturnScratchBlock( kernelBlock );
+				if( m_GenerateComponentImages )
+				{
+					// The cropped component already is a contiguous planar volume
+					m_ComponentImages.push_back( croppedOutput );
+					m_ComponentBlocks.push_back( croppedBlock );
+					element++;
+					continue;
+				}
+				TraceTimeProbe copyTime("copy", "oof");
+				copyTime.Start();
 				ImageRegionIteratorWithIndex< InternalImageType > it(croppedOutput, croppedOutput->GetRequestedRegion());
 				m_ImageAdaptor->SelectNthElement( element++ );
 				ImageRegionIteratorWithIndex< OutputImageAdaptorType > ot( m_ImageAdaptor, m_ImageAdaptor->GetRequestedRegion());
@@ -308,6 +377,9 @@ namespace itk
 					++it;
 					++ot;
 				}
+				this->ReturnScratchBlock( croppedBlock );
+				copyTime.Stop();
+				m_StageTimes["copy"] += copyTime.GetTotal();
 			}
 		}
 	}
@@ -319,8 +391,18 @@ namespace itk
 								 InternalComplexImagePointerType & preparedInput)
 	{
 		InternalImagePointerType paddedInput;
-		this->PadInput( input, paddedInput );
+		TraceTimeProbe padTime("pad", "oof");
+		padTime.Start();
+		void * paddedBlock = this->PadInput( input, paddedInput );
+		padTime.Stop();
+		m_StageTimes["pad"] += padTime.GetTotal();
+		
+		TraceTimeProbe forwardFFTTime("forwardFFT", "oof");
+		forwardFFTTime.Start();
 		this->TransformPaddedInput( paddedInput, preparedInput );
+		this->ReturnScratchBlock( paddedBlock );
+		forwardFFTTime.Stop();
+		m_StageTimes["forwardFFT"] += forwardFFTTime.GetTotal();
 	}
 	
 	template <typename TInputImage, typename TOutputImage>
@@ -339,51 +421,114 @@ namespace itk
 	}
 	
 	template <typename TInputImage, typename TOutputImage>
-	void
+	void *
 	FFTOrientedFluxMatrixImageFilter< TInputImage, TOutputImage >
 	::PadInput(const InputImageType * input,
 						 InternalImagePointerType & paddedInput)
 	{
-		// Pad the image
+		// Pad and cast in a single pass: the padded image is written directly in
+		// the internal precision of the FFT, so that no padded copy of the input
+		// in its own pixel type (uint8, uint16, float...) is ever allocated.
 		InputSizeType padSize = this->GetPadSize();
-		InputRegionType inputRegion = input->GetLargestPossibleRegion();
-		InputSizeType inputSize = inputRegion.GetSize();
-		
-		typedef PadImageFilter< InputImageType, InputImageType > InputPadFilterType;
-		typename InputPadFilterType::Pointer inputPadder = InputPadFilterType::New();
-		inputPadder->SetBoundaryCondition( this->GetBoundaryCondition() );
-		
 		InputSizeType inputLowerBound = this->GetPadLowerBound();
-		inputPadder->SetPadLowerBound( inputLowerBound );
+		InputRegionType inputRegion = input->GetBufferedRegion();
+		IndexType inputStart = inputRegion.GetIndex();
+		IndexType inputEnd = inputStart + inputRegion.GetSize();
 		
-		InputSizeType inputUpperBound;
+		IndexType paddedStart;
 		for (unsigned int i = 0; i < ImageDimension; ++i)
-    {
-			inputUpperBound[i] = (padSize[i] - inputSize[i]) / 2;
-			if ( ( padSize[i] - inputSize[i] ) % 2 == 1 )
-      {
-				inputUpperBound[i]++;
-      }
-    }
-		inputPadder->SetPadUpperBound( inputUpperBound );
-		inputPadder->SetNumberOfThreads( this->GetNumberOfThreads() );
-		inputPadder->SetInput( input );
-		inputPadder->ReleaseDataFlagOn();
+		{
+			paddedStart[i] = inputStart[i] - static_cast<typename IndexType::IndexValueType>( inputLowerBound[i] );
+		}
+		InputRegionType paddedRegion;
+		paddedRegion.SetIndex( paddedStart );
+		paddedRegion.SetSize( padSize );
 		
-		// We could avoid a separate cast here by setting the output type of
-		// the padder to the InternalImageType, but doing so complicates the
-		// definition of the boundary condition passed into this class and
-		// requires the InternalImageType to be exposed publicly.
-		typedef CastImageFilter< InputImageType, InternalImageType > InputCastFilterType;
-		typename InputCastFilterType::Pointer inputCaster = InputCastFilterType::New();
-		// See if we can avoid unnecessary casting and copying of memory
-		inputCaster->InPlaceOn();
-		inputCaster->SetNumberOfThreads( this->GetNumberOfThreads() );
-		inputCaster->SetInput( inputPadder->GetOutput() );
-		inputCaster->ReleaseDataFlagOn();
-		inputCaster->Update();
+		paddedInput = InternalImageType::New();
+		paddedInput->CopyInformation( input );
+		paddedInput->SetRegions( paddedRegion );
+		void * paddedBlock = this->AllocateScratchImage( paddedInput.GetPointer(), true );
 		
-		paddedInput = inputCaster->GetOutput();
+		// Fill the padded image line by line along X, the lines being shared
+		// between the threads. The part of a line lying inside the input is
+		// copied with a plain pointer loop. With the default zero-flux Neumann
+		// condition the remaining voxels are read from the input at the index
+		// clamped to its buffered region, without any virtual call; any other
+		// boundary condition is evaluated voxel by voxel.
+		const bool clampToInput = ( m_BoundaryCondition == &m_DefaultBoundaryCondition );
+		const SizeValueType paddedLineLength = padSize[0];
+		const SizeValueType inputLineLength = inputRegion.GetSize()[0];
+		SizeValueType numberOfLines = 1;
+		for (unsigned int i = 1; i < ImageDimension; ++i)
+		{
+			numberOfLines *= padSize[i];
+		}
+		const PixelType * inputBuffer = input->GetBufferPointer();
+		const OffsetValueType * inputOffsetTable = input->GetOffsetTable();
+		InternalPrecision * paddedBuffer = paddedInput->GetBufferPointer();
+		const long numberOfLinesAsLong = static_cast< long >( numberOfLines );
+#pragma omp parallel for schedule(static) num_threads(this->GetNumberOfThreads())
+		for (long line = 0; line < numberOfLinesAsLong; ++line)
+		{
+			IndexType index;
+			index[0] = paddedStart[0];
+			bool lineCrossesInput = true;
+			OffsetValueType lineOffset = 0;
+			SizeValueType remainder = static_cast< SizeValueType >( line );
+			for (unsigned int i = 1; i < ImageDimension; ++i)
+			{
+				index[i] = paddedStart[i] + static_cast< typename IndexType::IndexValueType >( remainder % padSize[i] );
+				remainder /= padSize[i];
+				typename IndexType::IndexValueType clamped = index[i];
+				if( clamped < inputStart[i] )
+				{
+					clamped = inputStart[i];
+					lineCrossesInput = false;
+				}
+				else if( clamped >= inputEnd[i] )
+				{
+					clamped = inputEnd[i] - 1;
+					lineCrossesInput = false;
+				}
+				lineOffset += ( clamped - inputStart[i] ) * inputOffsetTable[i];
+			}
+			
+			InternalPrecision * dst = paddedBuffer + static_cast< SizeValueType >( line ) * paddedLineLength;
+			const SizeValueType lowerLength = inputLowerBound[0];
+			const SizeValueType upperStart = lowerLength + inputLineLength;
+			if( clampToInput || lineCrossesInput )
+			{
+				const PixelType * src = inputBuffer + lineOffset;
+				for (SizeValueType k = 0; k < inputLineLength; ++k)
+				{
+					dst[lowerLength + k] = static_cast< InternalPrecision >( src[k] );
+				}
+			}
+			if( clampToInput )
+			{
+				const InternalPrecision lowerValue = dst[lowerLength];
+				for (SizeValueType k = 0; k < lowerLength; ++k)
+				{
+					dst[k] = lowerValue;
+				}
+				const InternalPrecision upperValue = dst[upperStart - 1];
+				for (SizeValueType k = upperStart; k < paddedLineLength; ++k)
+				{
+					dst[k] = upperValue;
+				}
+				continue;
+			}
+			for (SizeValueType k = 0; k < paddedLineLength; ++k)
+			{
+				if( lineCrossesInput && k >= lowerLength && k < upperStart )
+				{
+					continue;
+				}
+				index[0] = paddedStart[0] + static_cast< typename IndexType::IndexValueType >( k );
+				dst[k] = static_cast< InternalPrecision >( m_BoundaryCondition->GetPixel( index, input ) );
+			}
+		}
+		return paddedBlock;
 	}
 	
 	template <typename TInputImage, typename TOutputImage>
@@ -439,7 +584,7 @@ namespace itk
 	}
 	
 	template <typename TInputImage, typename TOutputImage>
-	void
+	void *
 	FFTOrientedFluxMatrixImageFilter< TInputImage, TOutputImage >
 	::ProduceOutput(InternalComplexImageType * paddedOutput, InternalImagePointerType & internalOutput)
 	{
@@ -448,12 +593,24 @@ namespace itk
 		ifftFilter->SetNumberOfThreads( this->GetNumberOfThreads() );
 		ifftFilter->SetInput( paddedOutput );
 		ifftFilter->ReleaseDataFlagOn();
+		// Run the inverse transform on its own, so that it is timed apart
+		// from the crop that consumes its output.
+		TraceTimeProbe inverseFFTTime("inverseFFT", "oof");
+		inverseFFTTime.Start();
+		ifftFilter->Update();
+		inverseFFTTime.Stop();
+		m_StageTimes["inverseFFT"] += inverseFFTTime.GetTotal();
 		
-		this->CropOutput( ifftFilter->GetOutput(), internalOutput );
+		TraceTimeProbe cropTime("crop", "oof");
+		cropTime.Start();
+		void * croppedBlock = this->CropOutput( ifftFilter->GetOutput(), internalOutput );
+		cropTime.Stop();
+		m_StageTimes["crop"] += cropTime.GetTotal();
+		return croppedBlock;
 	}
 	
 	template <typename TInputImage, typename TOutputImage>
-	void
+	void *
 	FFTOrientedFluxMatrixImageFilter< TInputImage, TOutputImage >
 	::CropOutput(InternalImageType * paddedOutput, InternalImagePointerType & croppedOutput)
 	{
@@ -463,7 +620,9 @@ namespace itk
 		croppedOutput->SetLargestPossibleRegion( this->GetInput()->GetLargestPossibleRegion() );
 		croppedOutput->SetBufferedRegion( this->GetInput()->GetLargestPossibleRegion() );
 		croppedOutput->CopyInformation( this->GetInput() );
-		croppedOutput->Allocate();
+		// The components kept as planar images keep their block after the
+		// update, until ReleaseComponentImages()
+		void * croppedBlock = this->AllocateScratchImage( croppedOutput.GetPointer(), true );
 		// Now crop the output to the desired size.
 		typedef ExtractImageFilter< InternalImageType, InternalImageType > ExtractFilterType;
 		typename ExtractFilterType::Pointer extractFilter = ExtractFilterType::New();
@@ -478,6 +637,7 @@ namespace itk
 		extractFilter->SetInput( paddedOutput );
 		extractFilter->GetOutput()->SetRequestedRegion( croppedOutput->GetRequestedRegion() );
 		extractFilter->Update();
+		return croppedBlock;
 	}
 	
 	template <typename TInputImage, typename TOutputImage>
@@ -492,6 +652,8 @@ namespace itk
 		<< this->m_Radius << std::endl;
 		os << indent << "ImageAdaptor: " << std::endl
 		<< this->m_ImageAdaptor << std::endl;
+		os << indent << "GenerateComponentImages: " << this->m_GenerateComponentImages << std::endl;
+		os << indent << "ScratchArena: " << this->m_ScratchArena.GetPointer() << std::endl;
 	}
 } // end namespace itk
 
@@ -21,10 +21,15 @@
 #include "itkImageToImageFilter.h"
 #include "itkImageRegionConstIteratorWithIndex.h"
 #include "itkLevelSet.h"
+#include "itkCancellationToken.h"
+#include "itkFunctionBase.h"
+#include "itkMortonBrickLayout.h"
+#include "itkImportImageContainer.h"
 #include "vnl/vnl_math.h"
 
 #include <functional>
 #include <queue>
+#include <vector>
 
 namespace itk
 {
@@ -83,6 +88,14 @@ namespace itk
  * and SetOutputOrigin(). Else if the speed image is not NULL, the output information
  * is copied from the input speed image.
  *
+ * With UseBrickedStorage on, the arrival times and the labels are held
+ * during the marching in bricks of 2^BrickSizeLog2 voxels per axis, the
+ * voxels of a brick being in Z-order (see MortonBrickLayout), instead of
+ * the row-major buffers of the output and label images: the front, which
+ * grows in all the directions, then touches fewer cache lines and pages
+ * per accepted point. The images are allocated and filled from the
+ * bricks at the end of GenerateData().
+ *
  * Possible Improvements:
  * In the current implemenation, std::priority_queue only allows
  * taking nodes out from the front and putting nodes in from the back.
@@ -266,6 +279,15 @@ private:
   itkSetMacro(NormalizationFactor, double);
   itkGetConstMacro(NormalizationFactor, double);
 
+  /** Speed given as a function of the index, e.g. a speed reconstructed
+   * from a compressed representation, for speeds too large to be held as
+   * an image. When it is set, it is used instead of the speed image, which
+   * then only gives the output information and may have no pixel buffer.
+   * The values are divided by the Normalization Factor as well. */
+  typedef FunctionBase< IndexType, double > SpeedFunctionType;
+  itkSetConstObjectMacro(SpeedFunction, SpeedFunctionType);
+  itkGetConstObjectMacro(SpeedFunction, SpeedFunctionType);
+
   /** Set the Fast Marching algorithm Stopping Value. The Fast Marching
    * algorithm is terminated when the value of the smallest trial point
    * is greater than the stopping value. */
@@ -293,6 +315,29 @@ private:
     return m_ProcessedPoints;
   }
 
+  /** Set/Get the cancellation token. When a token is given and gets
+   * cancelled, GenerateData() stops and throws a ProcessAborted exception,
+   * as it does when AbortGenerateData is set. */
+  itkSetObjectMacro(CancellationToken, CancellationToken);
+  itkGetObjectMacro(CancellationToken, CancellationToken);
+
+  /** Set/Get the number of points accepted between two checks of the
+   * cancellation token and of AbortGenerateData. The progress is also
+   * updated at this rate. Defaults to 1024. */
+  itkSetMacro(CancellationCheckInterval, SizeValueType);
+  itkGetConstMacro(CancellationCheckInterval, SizeValueType);
+
+  /** Get the number of points accepted (made alive) by the last run. */
+  itkGetConstMacro(NumberOfAcceptedPoints, SizeValueType);
+
+  /** Heap statistics of the last run: the number of nodes pushed on the
+   * trial heap, the largest size the heap reached, and the number of
+   * popped nodes that were discarded because they were outdated (a point
+   * updated again after being pushed) or already alive. */
+  itkGetConstMacro(NumberOfHeapPushes, SizeValueType);
+  itkGetConstMacro(MaximumHeapSize, SizeValueType);
+  itkGetConstMacro(NumberOfStalePops, SizeValueType);
+
   /** The output largeset possible, spacing and origin is computed as follows.
    * If the speed image is NULL or if the OverrideOutputInformation is true,
    * the output information is set from user specified parameters. These
@@ -315,6 +360,17 @@ private:
   itkGetConstReferenceMacro(OverrideOutputInformation, bool);
   itkBooleanMacro(OverrideOutputInformation);
 
+  /** Set/Get whether the working images are held in Z-order bricks during
+   * the marching. Off by default. */
+  itkSetMacro(UseBrickedStorage, bool);
+  itkGetConstReferenceMacro(UseBrickedStorage, bool);
+  itkBooleanMacro(UseBrickedStorage);
+
+  /** Set/Get the edge of the bricks, 2^BrickSizeLog2 voxels. Defaults to 3,
+   * i.e. bricks of 8 voxels per axis. */
+  itkSetClampMacro(BrickSizeLog2, unsigned int, 0, 8);
+  itkGetConstMacro(BrickSizeLog2, unsigned int);
+
 #ifdef ITK_USE_CONCEPT_CHECKING
   /** Begin concept checking */
   itkConceptMacro( SameDimensionCheck,
@@ -337,12 +393,32 @@ protected:
   virtual void UpdateNeighbors(const IndexType & index,
                                const SpeedImageType *, LevelSetImageType *);
 
-  virtual double UpdateValue(const IndexType & index,
+  /** Update the value of a point from its alive neighbors, offset being
+   * the storage offset of index. */
+  virtual double UpdateValue(const IndexType & index, SizeValueType offset,
                              const SpeedImageType *, LevelSetImageType *);
 
+  /** Estimate the progress of the marching, between 0 and 1, after the
+   * point with the given value was accepted. When a stopping value is set
+   * the estimate is the current value over the stopping value, otherwise
+   * it is the fraction of the output region already accepted. Subclasses
+   * knowing where the marching will stop can do better. */
+  virtual double EstimateProgress(double currentValue) const;
+
   const AxisNodeType & GetNodeUsedInCalculation(unsigned int idx) const
   { return m_NodesUsed[idx]; }
 
+  /** Push a node on the trial heap, keeping the heap statistics. */
+  void PushTrialNode(const AxisNodeType & node)
+  {
+    m_TrialHeap.push(node);
+    ++m_NumberOfHeapPushes;
+    if ( m_TrialHeap.size() > m_MaximumHeapSize )
+      {
+      m_MaximumHeapSize = m_TrialHeap.size();
+      }
+  }
+
   void GenerateData();
 
   /** Generate the output image meta information. */
@@ -363,10 +439,76 @@ protected:
 
   itkGetConstReferenceMacro(StartIndex, LevelSetIndexType);
   itkGetConstReferenceMacro(LastIndex, LevelSetIndexType);
+
+  /** Access to the working level set and labels by offset, the offset of
+   * an index depending on the storage (row-major or bricked). They are
+   * valid between Initialize() and the end of GenerateData(). */
+  SizeValueType ComputeStorageOffset(const IndexType & index) const
+  {
+    if ( m_UseBrickedStorage )
+      {
+      return m_BrickLayout.ComputeOffset(index);
+      }
+    SizeValueType offset = 0;
+    for ( unsigned int j = 0; j < SetDimension; j++ )
+      {
+      offset += static_cast< SizeValueType >( index[j] - m_StartIndex[j] ) * m_StorageStride[j];
+      }
+    return offset;
+  }
+
+  /** Offset of index[axis] + step, step being -1 or 1, from the offset of
+   * index. The neighbor must be in the buffered region. */
+  SizeValueType ComputeNeighborStorageOffset(SizeValueType offset, const IndexType & index,
+                                             unsigned int axis, int step) const
+  {
+    if ( m_UseBrickedStorage )
+      {
+      return m_BrickLayout.GetNeighborOffset(offset, index, axis, step);
+      }
+    return step > 0 ? offset + m_StorageStride[axis] : offset - m_StorageStride[axis];
+  }
+
+  PixelType GetLevelSetValue(SizeValueType offset) const
+  { return m_LevelSetBuffer[offset]; }
+  void SetLevelSetValue(SizeValueType offset, PixelType value)
+  { m_LevelSetBuffer[offset] = value; }
+  unsigned char GetLabel(SizeValueType offset) const
+  { return m_LabelBuffer[offset]; }
+  void SetLabel(SizeValueType offset, unsigned char label)
+  { m_LabelBuffer[offset] = label; }
+
+  /** Layout of the bricks, when UseBrickedStorage is on. */
+  const MortonBrickLayout< SetDimension > & GetBrickLayout() const
+  { return m_BrickLayout; }
+
+  /** Allocate the output and label images and fill them from the bricks,
+   * releasing each bricked buffer once it is copied, so that a buffer and
+   * its image are not both held for long. Called at the end of
+   * GenerateData() when UseBrickedStorage is on; subclasses holding
+   * bricked images of their own copy them back here as well. */
+  virtual void CopyBrickedStorageToImages(LevelSetImageType *output);
+
+  /** Release the bricks, if any. Called whenever GenerateData() is left,
+   * on an abort or an exception as well; subclasses release their own
+   * bricks here as well. */
+  virtual void ReleaseBrickedStorage();
+
 private:
   FastMarchingImageFilter2(const Self &); //purposely not implemented
   void operator=(const Self &);          //purposely not implemented
 
+  /** Releases the bricks of a filter when it goes out of scope. */
+  class BrickedStorageReleaser
+  {
+  public:
+    BrickedStorageReleaser(Self *filter):m_Filter(filter) {}
+    ~BrickedStorageReleaser() { m_Filter->ReleaseBrickedStorage(); }
+  private:
+    Self *m_Filter;
+  };
+  friend class BrickedStorageReleaser;
+
   NodeContainerPointer m_AlivePoints;
   NodeContainerPointer m_TrialPoints;
   NodeContainerPointer m_OutsidePoints;
@@ -400,6 +542,27 @@ private:
   HeapType m_TrialHeap;
 
   double m_NormalizationFactor;
+
+  typename SpeedFunctionType::ConstPointer m_SpeedFunction;
+
+  CancellationToken::Pointer m_CancellationToken;
+  SizeValueType              m_CancellationCheckInterval;
+  SizeValueType              m_NumberOfAcceptedPoints;
+  SizeValueType              m_NumberOfHeapPushes;
+  SizeValueType              m_MaximumHeapSize;
+  SizeValueType              m_NumberOfStalePops;
+
+  bool         m_UseBrickedStorage;
+  unsigned int m_BrickSizeLog2;
+
+  /** Working level set and labels: the buffers of the output and label
+   * images, or the bricks. */
+  PixelType *                       m_LevelSetBuffer;
+  unsigned char *                   m_LabelBuffer;
+  SizeValueType                     m_StorageStride[SetDimension];
+  MortonBrickLayout< SetDimension > m_BrickLayout;
+  typename ImportImageContainer< SizeValueType, PixelType >::Pointer     m_BrickedLevelSet;
+  typename ImportImageContainer< SizeValueType, unsigned char >::Pointer m_BrickedLabels;
 };
 } // namespace itk
 
@@ -20,14 +20,13 @@
 
 #include "itkFastMarchingImageFilter2.h"
 #include "itkImageRegionIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
 #include "itkNumericTraits.h"
+#include "itkMetricsRegistry.h"
+#include "itkParallelFillBuffer.h"
 #include "vnl/vnl_math.h"
 #include <algorithm>
 
-#ifdef WITH_JAVA
-extern bool pleaseStop;
-#endif
-
 namespace itk
 {
 template< class TLevelSet, class TSpeedImage >
@@ -64,6 +63,21 @@ FastMarchingImageFilter2< TLevelSet, TSpeedImage >
   m_CollectPoints = false;
 
   m_NormalizationFactor = 1.0;
+
+  m_CancellationCheckInterval = 1024;
+  m_NumberOfAcceptedPoints = 0;
+  m_NumberOfHeapPushes = 0;
+  m_MaximumHeapSize = 0;
+  m_NumberOfStalePops = 0;
+
+  m_UseBrickedStorage = false;
+  m_BrickSizeLog2 = 3;
+  m_LevelSetBuffer = NULL;
+  m_LabelBuffer = NULL;
+  for ( unsigned int j = 0; j < SetDimension; j++ )
+    {
+    m_StorageStride[j] = 0;
+    }
 }
 
 template< class TLevelSet, class TSpeedImage >
@@ -80,7 +94,16 @@ FastMarchingImageFilter2< TLevelSet, TSpeedImage >
      << static_cast< typename NumericTraits< PixelType >::PrintType >( m_LargeValue )
      << std::endl;
   os << indent << "Normalization Factor: " << m_NormalizationFactor << std::endl;
+  os << indent << "Speed function: " << m_SpeedFunction.GetPointer() << std::endl;
   os << indent << "Collect points: " << m_CollectPoints << std::endl;
+  os << indent << "CancellationToken: " << m_CancellationToken.GetPointer() << std::endl;
+  os << indent << "CancellationCheckInterval: " << m_CancellationCheckInterval << std::endl;
+  os << indent << "NumberOfAcceptedPoints: " << m_NumberOfAcceptedPoints << std::endl;
+  os << indent << "NumberOfHeapPushes: " << m_NumberOfHeapPushes << std::endl;
+  os << indent << "MaximumHeapSize: " << m_MaximumHeapSize << std::endl;
+  os << indent << "NumberOfStalePops: " << m_NumberOfStalePops << std::endl;
+  os << indent << "UseBrickedStorage: " << m_UseBrickedStorage << std::endl;
+  os << indent << "BrickSizeLog2: " << m_BrickSizeLog2 << std::endl;
   os << indent << "OverrideOutputInformation: ";
   os << m_OverrideOutputInformation << std::endl;
   os << indent << "OutputRegion: " << m_OutputRegion << std::endl;
@@ -138,9 +161,7 @@ void
 FastMarchingImageFilter2< TLevelSet, TSpeedImage >
 ::Initialize(LevelSetImageType *output)
 {
-  // allocate memory for the output buffer
   output->SetBufferedRegion( output->GetRequestedRegion() );
-  output->Allocate();
 
   // cache some buffered region information
   m_BufferedRegion = output->GetBufferedRegion();
@@ -150,46 +171,53 @@ FastMarchingImageFilter2< TLevelSet, TSpeedImage >
   offset.Fill(1);
   m_LastIndex -= offset;
 
-  // allocate memory for the PointTypeImage
   m_LabelImage->CopyInformation(output);
   m_LabelImage->SetBufferedRegion(
     output->GetBufferedRegion() );
-  m_LabelImage->Allocate();
-
-  // set all output value to infinity
-  typedef ImageRegionIterator< LevelSetImageType >
-  OutputIterator;
-
-  OutputIterator outIt ( output, output->GetBufferedRegion() );
 
   PixelType outputPixel;
   outputPixel = m_LargeValue;
 
-  outIt.GoToBegin();
-
-  while( !outIt.IsAtEnd() )
+  if ( m_UseBrickedStorage )
     {
-    outIt.Set(outputPixel);
-    ++outIt;
+    // the images are allocated when the marching is over, see
+    // CopyBrickedStorageToImages(); the bricks are filled in parallel, as
+    // the images would be, for their pages to be spread over the nodes
+    m_BrickLayout.SetRegion(m_BufferedRegion, m_BrickSizeLog2);
+    m_BrickedLevelSet = ImportImageContainer< SizeValueType, PixelType >::New();
+    m_BrickedLabels = ImportImageContainer< SizeValueType, unsigned char >::New();
+    ParallelReserveAndFill( m_BrickedLevelSet.GetPointer(), m_BrickLayout.GetNumberOfElements(),
+                            outputPixel, this->GetNumberOfThreads() );
+    ParallelReserveAndFill( m_BrickedLabels.GetPointer(), m_BrickLayout.GetNumberOfElements(),
+                            static_cast< unsigned char >( FarPoint ), this->GetNumberOfThreads() );
+    m_LevelSetBuffer = m_BrickedLevelSet->GetBufferPointer();
+    m_LabelBuffer = m_BrickedLabels->GetBufferPointer();
     }
-
-  // set all points type to FarPoint
-  typedef ImageRegionIterator< LabelImageType > LabelIterator;
-
-  LabelIterator typeIt( m_LabelImage,
-                        m_LabelImage->GetBufferedRegion() );
-
-
-  typeIt.GoToBegin();
-  while( !typeIt.IsAtEnd() )
+  else
     {
-    typeIt.Set(FarPoint);
-    ++typeIt;
+    // allocate memory for the output buffer and the PointTypeImage
+    output->Allocate();
+    m_LabelImage->Allocate();
+
+    // set all output value to infinity and all points type to FarPoint,
+    // in parallel: this first touch spreads the pages of large images over
+    // the memory nodes
+    ParallelFillBuffer( output, outputPixel, this->GetNumberOfThreads() );
+    ParallelFillBuffer( m_LabelImage.GetPointer(), static_cast< unsigned char >( FarPoint ),
+                        this->GetNumberOfThreads() );
+
+    m_LevelSetBuffer = output->GetBufferPointer();
+    m_LabelBuffer = m_LabelImage->GetBufferPointer();
+    for ( unsigned int j = 0; j < SetDimension; j++ )
+      {
+      m_StorageStride[j] = static_cast< SizeValueType >( output->GetOffsetTable()[j] );
+      }
     }
 
   // process input alive points
   AxisNodeType node;
   NodeIndexType idx;
+  SizeValueType storageOffset;
 
   if ( m_AlivePoints )
     {
@@ -206,10 +234,11 @@ FastMarchingImageFilter2< TLevelSet, TSpeedImage >
       if ( m_BufferedRegion.IsInside( idx ) )
         {
         // make this an alive point
-        m_LabelImage->SetPixel(idx, AlivePoint);
+        storageOffset = this->ComputeStorageOffset(idx);
+        this->SetLabel(storageOffset, AlivePoint);
 
         outputPixel = node.GetValue();
-        output->SetPixel(idx, outputPixel);
+        this->SetLevelSetValue(storageOffset, outputPixel);
         }
 
       ++pointsIter;
@@ -230,11 +259,12 @@ FastMarchingImageFilter2< TLevelSet, TSpeedImage >
       // check if node index is within the output level set
       if ( m_BufferedRegion.IsInside( idx ) )
         {
-        // make this an alive point
-        m_LabelImage->SetPixel(idx, OutsidePoint );
+        // make this an outside point
+        storageOffset = this->ComputeStorageOffset(idx);
+        this->SetLabel(storageOffset, OutsidePoint);
 
         outputPixel = node.GetValue();
-        output->SetPixel(idx, outputPixel);
+        this->SetLevelSetValue(storageOffset, outputPixel);
         }
 
       ++pointsIter;
@@ -246,6 +276,9 @@ FastMarchingImageFilter2< TLevelSet, TSpeedImage >
     {
     m_TrialHeap.pop();
     }
+  m_NumberOfHeapPushes = 0;
+  m_MaximumHeapSize = 0;
+  m_NumberOfStalePops = 0;
 
   // process the input trial points
   if ( m_TrialPoints )
@@ -263,12 +296,13 @@ FastMarchingImageFilter2< TLevelSet, TSpeedImage >
       if ( m_BufferedRegion.IsInside( idx ) )
         {
         // make this an initial trial point
-        m_LabelImage->SetPixel(idx, InitialTrialPoint);
+        storageOffset = this->ComputeStorageOffset(idx);
+        this->SetLabel(storageOffset, InitialTrialPoint);
 
         outputPixel = node.GetValue();
-        output->SetPixel(idx, outputPixel);
+        this->SetLevelSetValue(storageOffset, outputPixel);
 
-        m_TrialHeap.push(node);
+        this->PushTrialNode(node);
         }
       ++pointsIter;
       }
@@ -291,6 +325,9 @@ FastMarchingImageFilter2< TLevelSet, TSpeedImage >
   LevelSetPointer        output      = this->GetOutput();
   SpeedImageConstPointer speedImage  = this->GetInput();
 
+  // the bricks are released however the marching ends
+  BrickedStorageReleaser brickedStorageReleaser(this);
+
   this->Initialize(output);
 
   if ( m_CollectPoints )
@@ -302,6 +339,9 @@ FastMarchingImageFilter2< TLevelSet, TSpeedImage >
   AxisNodeType node;
   double       currentValue;
   double       oldProgress = 0;
+  SizeValueType nextCheck = m_CancellationCheckInterval;
+
+  m_NumberOfAcceptedPoints = 0;
 
   this->UpdateProgress(0.0);   // Send first progress event
 
@@ -312,16 +352,16 @@ FastMarchingImageFilter2< TLevelSet, TSpeedImage >
     m_TrialHeap.pop();
 
     // does this node contain the current value ?
-    currentValue = static_cast< double >( output->GetPixel( node.GetIndex() ) );
+    const SizeValueType nodeOffset = this->ComputeStorageOffset( node.GetIndex() );
+    currentValue = static_cast< double >( this->GetLevelSetValue(nodeOffset) );
 
     if ( node.GetValue() == currentValue )
       {
       // is this node already alive ?
-      if ( m_LabelImage->GetPixel( node.GetIndex() ) != AlivePoint )
+      if ( this->GetLabel(nodeOffset) != AlivePoint )
         {
         if ( currentValue > m_StoppingValue )
           {
-          this->UpdateProgress(1.0);
           break;
           }
 
@@ -331,42 +371,83 @@ FastMarchingImageFilter2< TLevelSet, TSpeedImage >
           }
 
         // set this node as alive
-        m_LabelImage->SetPixel(node.GetIndex(), AlivePoint);
+        this->SetLabel(nodeOffset, AlivePoint);
 
         // update its neighbors
         this->UpdateNeighbors(node.GetIndex(), speedImage, output);
 
-#ifdef WITH_JAVA
-					if (pleaseStop) 
-					{
-						this->InvokeEvent( AbortEvent() );
-						this->ResetPipeline();
-						ProcessAborted e(__FILE__,__LINE__);
-						e.SetDescription("Process aborted.");
-						e.SetLocation(ITK_LOCATION);
-						throw e;
-					}
-#endif					
-					
-        // Send events every certain number of points.
-        const double newProgress = currentValue / m_StoppingValue;
+        ++m_NumberOfAcceptedPoints;
+
+        // Check for cancellation and send events every certain number
+        // of points, so that the checks do not cost anything per point.
+        if ( m_NumberOfAcceptedPoints < nextCheck )
+          {
+          continue;
+          }
+        nextCheck = m_NumberOfAcceptedPoints + vnl_math_max( m_CancellationCheckInterval,
+                                                             static_cast< SizeValueType >( 1 ) );
+
+        if ( this->GetAbortGenerateData() ||
+             ( m_CancellationToken && m_CancellationToken->IsCancelled() ) )
+          {
+          this->InvokeEvent( AbortEvent() );
+          this->ResetPipeline();
+          ProcessAborted e(__FILE__, __LINE__);
+          e.SetDescription("Process aborted.");
+          e.SetLocation(ITK_LOCATION);
+          throw e;
+          }
+
+        const double newProgress = this->EstimateProgress(currentValue);
         if ( newProgress - oldProgress > 0.01 )  // update every 1%
           {
-          this->UpdateProgress(newProgress);
+          this->UpdateProgress( vnl_math_min(newProgress, 1.0) );
           oldProgress = newProgress;
-          if ( this->GetAbortGenerateData() )
-            {
-            this->InvokeEvent( AbortEvent() );
-            this->ResetPipeline();
-            ProcessAborted e(__FILE__, __LINE__);
-            e.SetDescription("Process aborted.");
-            e.SetLocation(ITK_LOCATION);
-            throw e;
-            }
           }
         }
+      else
+        {
+        ++m_NumberOfStalePops;
+        }
+      }
+    else
+      {
+      // outdated node, the point was updated again after being pushed
+      ++m_NumberOfStalePops;
       }
     }
+
+  // The progress is only sampled every CancellationCheckInterval points:
+  // report the end of the marching however it ended, be it on the
+  // stopping value or on an empty heap.
+  this->UpdateProgress(1.0);
+
+  if ( m_UseBrickedStorage )
+    {
+    this->CopyBrickedStorageToImages(output);
+    }
+
+  MetricsRegistry *metrics = MetricsRegistry::GetInstance();
+  metrics->Increment("fastMarching.accepted", m_NumberOfAcceptedPoints);
+  metrics->Increment("fastMarching.heapPushes", m_NumberOfHeapPushes);
+  metrics->Increment("fastMarching.stalePops", m_NumberOfStalePops);
+  metrics->UpdateGaugeMaximum("fastMarching.peakHeapSize", m_MaximumHeapSize);
+}
+
+template< class TLevelSet, class TSpeedImage >
+double
+FastMarchingImageFilter2< TLevelSet, TSpeedImage >
+::EstimateProgress(double currentValue) const
+{
+  // The stopping value defaults to the large value: the value of the
+  // last accepted point says nothing about the remaining work then.
+  if ( m_StoppingValue < static_cast< double >( m_LargeValue ) )
+    {
+    return currentValue / m_StoppingValue;
+    }
+  const double numberOfPoints =
+    static_cast< double >( m_BufferedRegion.GetNumberOfPixels() );
+  return static_cast< double >( m_NumberOfAcceptedPoints ) / numberOfPoints;
 }
 
 template< class TLevelSet, class TSpeedImage >
@@ -379,37 +460,30 @@ FastMarchingImageFilter2< TLevelSet, TSpeedImage >
 {
   IndexType neighIndex = index;
   unsigned char label;
+  const SizeValueType offset = this->ComputeStorageOffset(index);
 
   for ( unsigned int j = 0; j < SetDimension; j++ )
     {
-    // update left neighbor
-    if ( index[j] > m_StartIndex[j] )
-      {
-      neighIndex[j] = index[j] - 1;
-      }
-
-    label = m_LabelImage->GetPixel(neighIndex);
-
-    if ( ( label != AlivePoint ) &&
-         ( label != InitialTrialPoint ) &&
-         ( label != OutsidePoint ) )
-      {
-      this->UpdateValue(neighIndex, speedImage, output);
-      }
-
-    // update right neighbor
-    if ( index[j] < m_LastIndex[j] )
+    // update left neighbor, then right neighbor
+    for ( int s = -1; s < 2; s = s + 2 )
       {
-      neighIndex[j] = index[j] + 1;
-      }
+      if ( ( s < 0 && index[j] <= m_StartIndex[j] ) ||
+           ( s > 0 && index[j] >= m_LastIndex[j] ) )
+        {
+        continue;
+        }
 
-    label = m_LabelImage->GetPixel(neighIndex);
+      const SizeValueType neighOffset =
+        this->ComputeNeighborStorageOffset(offset, index, j, s);
+      label = this->GetLabel(neighOffset);
 
-    if ( ( label != AlivePoint ) &&
-         ( label != InitialTrialPoint ) &&
-         ( label != OutsidePoint ) )
-      {
-      this->UpdateValue(neighIndex, speedImage, output);
+      if ( ( label != AlivePoint ) &&
+           ( label != InitialTrialPoint ) &&
+           ( label != OutsidePoint ) )
+        {
+        neighIndex[j] = index[j] + s;
+        this->UpdateValue(neighIndex, neighOffset, speedImage, output);
+        }
       }
 
     //reset neighIndex
@@ -422,8 +496,9 @@ double
 FastMarchingImageFilter2< TLevelSet, TSpeedImage >
 ::UpdateValue(
   const IndexType & index,
+  SizeValueType offset,
   const SpeedImageType *speedImage,
-  LevelSetImageType *output)
+  LevelSetImageType *itkNotUsed(output))
 {
   IndexType neighIndex = index;
 
@@ -449,9 +524,11 @@ FastMarchingImageFilter2< TLevelSet, TSpeedImage >
         continue;
         }
 
-      if ( m_LabelImage->GetPixel( neighIndex ) == AlivePoint )
+      const SizeValueType neighOffset =
+        this->ComputeNeighborStorageOffset(offset, index, j, s);
+      if ( this->GetLabel(neighOffset) == AlivePoint )
         {
-        neighValue = static_cast< PixelType >( output->GetPixel(neighIndex) );
+        neighValue = this->GetLevelSetValue(neighOffset);
 
         // let's find the minimum value given a direction j
         if ( node.GetValue() > neighValue )
@@ -480,7 +557,12 @@ FastMarchingImageFilter2< TLevelSet, TSpeedImage >
   double bb( 0.0 );
   double cc( m_InverseSpeed );
 
-  if ( speedImage )
+  if ( m_SpeedFunction )
+    {
+    cc = m_SpeedFunction->Evaluate(index) / m_NormalizationFactor;
+    cc = -1.0 * vnl_math_sqr(1.0 / cc);
+    }
+  else if ( speedImage )
     {
     cc = static_cast< double >( speedImage->GetPixel(index)  ) / m_NormalizationFactor;
     cc = -1.0 * vnl_math_sqr(1.0 / cc);
@@ -526,17 +608,59 @@ FastMarchingImageFilter2< TLevelSet, TSpeedImage >
     {
     // write solution to m_OutputLevelSet
     PixelType outputPixel = static_cast< PixelType >( solution );
-    output->SetPixel(index, outputPixel);
+    this->SetLevelSetValue(offset, outputPixel);
 
     // insert point into trial heap
-    m_LabelImage->SetPixel(index, TrialPoint);
+    this->SetLabel(offset, TrialPoint);
     node.SetValue( outputPixel );
     node.SetIndex( index );
-    m_TrialHeap.push(node);
+    this->PushTrialNode(node);
     }
 
   return solution;
 }
+
+template< class TLevelSet, class TSpeedImage >
+void
+FastMarchingImageFilter2< TLevelSet, TSpeedImage >
+::CopyBrickedStorageToImages(LevelSetImageType *output)
+{
+  // one buffer at a time: each bricked buffer is released as soon as its
+  // image is filled
+  output->Allocate();
+  typedef ImageRegionIteratorWithIndex< LevelSetImageType > OutputIterator;
+  OutputIterator outIt( output, m_BufferedRegion );
+  for ( outIt.GoToBegin(); !outIt.IsAtEnd(); ++outIt )
+    {
+    outIt.Set( m_LevelSetBuffer[ m_BrickLayout.ComputeOffset( outIt.GetIndex() ) ] );
+    }
+  m_BrickedLevelSet = NULL;
+  m_LevelSetBuffer = NULL;
+
+  m_LabelImage->Allocate();
+  typedef ImageRegionIteratorWithIndex< LabelImageType > LabelIterator;
+  LabelIterator typeIt( m_LabelImage, m_BufferedRegion );
+  for ( typeIt.GoToBegin(); !typeIt.IsAtEnd(); ++typeIt )
+    {
+    typeIt.Set( m_LabelBuffer[ m_BrickLayout.ComputeOffset( typeIt.GetIndex() ) ] );
+    }
+  m_BrickedLabels = NULL;
+  m_LabelBuffer = NULL;
+}
+
+template< class TLevelSet, class TSpeedImage >
+void
+FastMarchingImageFilter2< TLevelSet, TSpeedImage >
+::ReleaseBrickedStorage()
+{
+  if ( m_BrickedLevelSet.IsNotNull() || m_BrickedLabels.IsNotNull() )
+    {
+    m_BrickedLevelSet = NULL;
+    m_BrickedLabels = NULL;
+    m_LevelSetBuffer = NULL;
+    m_LabelBuffer = NULL;
+    }
+}
 } // namespace itk
 
 #endif
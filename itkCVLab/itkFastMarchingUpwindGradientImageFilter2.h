@@ -49,6 +49,23 @@ namespace itk
  * met. This way the solution is computed a bit downstream the Target points,
  * so that the level sets of T(x) corresponding to the Target are smooth.
  *
+ * The targets can also be given as a mask, e.g. the voxels of an already
+ * traced tree: the front then stops (after TargetOffset) at the first
+ * accepted point where the mask is non-zero, which is found by a single
+ * lookup per accepted point whatever the number of target voxels.
+ *
+ *
+ * With UseBrickedStorage on, the gradient vectors are held in the bricks
+ * of the base class during the marching as well, and copied to the
+ * gradient image at the end.
+ *
+ * As a compact alternative to the gradient, the filter can record for each
+ * accepted point the alive neighbor it was reached from, i.e. the neighbor
+ * of steepest descent of T(x) when the point is accepted, as a one byte
+ * direction code (see GeneratePredecessorImage). Since a predecessor is
+ * always accepted before the point, following the codes from any reached
+ * point ends at a seed in at most the number of accepted points steps,
+ * which gives a voxel accurate minimal path without any interpolation.
  *
  * \author Luca Antiga Ph.D.  Biomedical Technologies Laboratory,
  *                            Bioengineering Deparment, Mario Negri Institute, Italy.
@@ -113,6 +130,23 @@ public:
   NodeContainerPointer GetReachedTargetPoints()
   { return m_ReachedTargetPoints; }
 
+  /** TargetMaskImage typedef support. */
+  typedef Image< unsigned char,
+                 itkGetStaticConstMacro(SetDimension) > TargetMaskImageType;
+  typedef typename TargetMaskImageType::ConstPointer TargetMaskImageConstPointer;
+
+  /** Set/Get the target mask. If it is set, the propagation stops once a
+   * point where the mask is non-zero is accepted, independently of the
+   * target points and of the TargetReachedMode. Points outside of the
+   * buffered region of the mask are not targets. */
+  itkSetConstObjectMacro(TargetMask, TargetMaskImageType);
+  itkGetConstObjectMacro(TargetMask, TargetMaskImageType);
+
+  /** Whether the last update reached the target mask, and the first
+   * accepted point of the mask. */
+  itkGetConstMacro(TargetMaskReached, bool);
+  itkGetConstReferenceMacro(ReachedTargetMaskIndex, IndexType);
+
   /** GradientPixel typedef support. */
   typedef CovariantVector< PixelType,
                            itkGetStaticConstMacro(SetDimension) > GradientPixelType;
@@ -136,6 +170,35 @@ public:
   itkGetConstReferenceMacro(GenerateGradientImage, bool);
   itkBooleanMacro(GenerateGradientImage);
 
+  /** PredecessorImage typedef support. A pixel holds NoPredecessor for the
+   * points that were not accepted and for the seeds, and otherwise the
+   * code of the step to its predecessor (see EncodePredecessor()). */
+  typedef Image< unsigned char,
+                 itkGetStaticConstMacro(SetDimension) > PredecessorImageType;
+  typedef typename PredecessorImageType::Pointer PredecessorImagePointer;
+
+  enum { NoPredecessor = 0 };
+
+  /** Get the predecessor image. */
+  PredecessorImagePointer GetPredecessorImage() const
+  { return m_PredecessorImage; }
+
+  /** Set/Get the GeneratePredecessorImage flag. Record for each accepted
+   * point the neighbor it was reached from while fast marching. */
+  itkSetMacro(GeneratePredecessorImage, bool);
+  itkGetConstReferenceMacro(GeneratePredecessorImage, bool);
+  itkBooleanMacro(GeneratePredecessorImage);
+
+  /** Code of the step from a point to its neighbor index[axis] + step,
+   * step being -1 or 1, and back. */
+  static unsigned char EncodePredecessor(unsigned int axis, int step)
+  { return static_cast< unsigned char >( 1 + 2 * axis + ( step > 0 ? 1 : 0 ) ); }
+  static void DecodePredecessor(unsigned char code, unsigned int & axis, int & step)
+  {
+    axis = ( code - 1 ) / 2;
+    step = ( ( code - 1 ) % 2 ) ? 1 : -1;
+  }
+
   /** Set how long (in terms of arrival times) after targets are reached the
    * front must stop.  This is useful to ensure that the level set of target
    * arrival time is smooth. */
@@ -166,7 +229,9 @@ public:
 
   /** Get the arrival time corresponding to the last reached target.
    *  If TargetReachedMode is set to NoTargets, TargetValue contains
-   *  the last (aka largest) Eikonal solution value generated.
+   *  the last (aka largest) Eikonal solution value generated, unless
+   *  the target mask was reached, in which case it is the arrival time
+   *  of the reached mask point.
    */
   itkGetConstReferenceMacro(TargetValue, double);
 
@@ -202,6 +267,21 @@ protected:
                                const LabelImageType *labelImage,
                                GradientImageType *gradientImage);
 
+  /** Record the predecessor of an accepted point: its alive neighbor of
+   * steepest descent. */
+  virtual void ComputePredecessor(const IndexType & index);
+
+  /** When target points are given, the progress is estimated from how
+   * close the accepted points came to the targets. */
+  virtual double EstimateProgress(double currentValue) const;
+
+  /** Copy the bricked gradient vectors and predecessors to their images as
+   * well. */
+  virtual void CopyBrickedStorageToImages(LevelSetImageType *output);
+
+  /** Release the gradient and predecessor bricks as well. */
+  virtual void ReleaseBrickedStorage();
+
 private:
   FastMarchingUpwindGradientImageFilter2(const Self &); //purposely not
                                                        // implemented
@@ -211,10 +291,24 @@ private:
   NodeContainerPointer m_TargetPoints;
   NodeContainerPointer m_ReachedTargetPoints;
 
+  TargetMaskImageConstPointer m_TargetMask;
+  bool                        m_TargetMaskReached;
+  IndexType                   m_ReachedTargetMaskIndex;
+
   GradientImagePointer m_GradientImage;
 
+  /** Gradient vectors during the marching, when UseBrickedStorage is on. */
+  typename ImportImageContainer< SizeValueType, GradientPixelType >::Pointer m_BrickedGradient;
+
   bool m_GenerateGradientImage;
 
+  PredecessorImagePointer m_PredecessorImage;
+
+  /** Predecessors during the marching, when UseBrickedStorage is on. */
+  typename ImportImageContainer< SizeValueType, unsigned char >::Pointer m_BrickedPredecessors;
+
+  bool m_GeneratePredecessorImage;
+
   double m_TargetOffset;
 
   int m_TargetReachedMode;
@@ -222,6 +316,14 @@ private:
   double m_TargetValue;
 
   SizeValueType m_NumberOfTargets;
+
+  /** For each target point, squared index distance to the first accepted
+   * point and to the closest accepted point so far. */
+  std::vector< double > m_TargetInitialDistances;
+  std::vector< double > m_TargetClosestDistances;
+
+  /** Sorted storage offsets of the target points inside the output. */
+  std::vector< SizeValueType > m_TargetStorageOffsets;
 };
 } // namespace itk
 
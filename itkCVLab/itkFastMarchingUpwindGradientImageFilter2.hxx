@@ -20,6 +20,8 @@
 
 #include "itkFastMarchingUpwindGradientImageFilter2.h"
 #include "itkImageRegionIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkParallelFillBuffer.h"
 #include "itkNumericTraits.h"
 #include "vnl/vnl_math.h"
 #include <algorithm>
@@ -35,8 +37,13 @@ FastMarchingUpwindGradientImageFilter2< TLevelSet, TSpeedImage >
 {
   m_TargetPoints = NULL;
   m_ReachedTargetPoints = NULL;
+  m_TargetMask = NULL;
+  m_TargetMaskReached = false;
+  m_ReachedTargetMaskIndex.Fill(0);
   m_GradientImage = GradientImageType::New();
   m_GenerateGradientImage = false;
+  m_PredecessorImage = PredecessorImageType::New();
+  m_GeneratePredecessorImage = false;
   m_TargetOffset = 1.0;
   m_TargetReachedMode = NoTargets;
   m_TargetValue = 0.0;
@@ -54,8 +61,13 @@ FastMarchingUpwindGradientImageFilter2< TLevelSet, TSpeedImage >
   Superclass::PrintSelf(os, indent);
   os << indent << "Target points: " << m_TargetPoints.GetPointer() << std::endl;
   os << indent << "Reached points: " << m_ReachedTargetPoints.GetPointer() << std::endl;
+  os << indent << "Target mask: " << m_TargetMask.GetPointer() << std::endl;
+  os << indent << "Target mask reached: " << m_TargetMaskReached << std::endl;
+  os << indent << "Reached target mask index: " << m_ReachedTargetMaskIndex << std::endl;
   os << indent << "Gradient image: " << m_GradientImage.GetPointer() << std::endl;
   os << indent << "Generate gradient image: " << m_GenerateGradientImage << std::endl;
+  os << indent << "Predecessor image: " << m_PredecessorImage.GetPointer() << std::endl;
+  os << indent << "Generate predecessor image: " << m_GeneratePredecessorImage << std::endl;
   os << indent << "Number of targets: " << m_NumberOfTargets << std::endl;
   os << indent << "Target offset: " << m_TargetOffset << std::endl;
   os << indent << "Target reach mode: " << m_TargetReachedMode << std::endl;
@@ -72,33 +84,85 @@ FastMarchingUpwindGradientImageFilter2< TLevelSet, TSpeedImage >
 {
   Superclass::Initialize(output);
 
-  // allocate memory for the GradientImage if requested
+  // allocate memory for the GradientImage if requested, and set all
+  // gradient vectors to zero
   if ( m_GenerateGradientImage )
     {
     m_GradientImage->CopyInformation( this->GetInput() );
     m_GradientImage->SetBufferedRegion( output->GetBufferedRegion() );
-    m_GradientImage->Allocate();
-    }
-
-  // set all gradient vectors to zero
-  if ( m_GenerateGradientImage )
-    {
-    typedef ImageRegionIterator< GradientImageType > GradientIterator;
-
-    GradientIterator gradientIt( m_GradientImage,
-                                 m_GradientImage->GetBufferedRegion() );
 
     GradientPixelType zeroGradient;
     typedef typename GradientPixelType::ValueType GradientPixelValueType;
     zeroGradient.Fill(NumericTraits< GradientPixelValueType >::Zero);
-    for ( gradientIt.GoToBegin(); !gradientIt.IsAtEnd(); ++gradientIt )
+
+    if ( this->GetUseBrickedStorage() )
+      {
+      m_BrickedGradient = ImportImageContainer< SizeValueType, GradientPixelType >::New();
+      ParallelReserveAndFill( m_BrickedGradient.GetPointer(), this->GetBrickLayout().GetNumberOfElements(),
+                              zeroGradient, this->GetNumberOfThreads() );
+      }
+    else
+      {
+      m_GradientImage->Allocate();
+      ParallelFillBuffer( m_GradientImage.GetPointer(), zeroGradient, this->GetNumberOfThreads() );
+      }
+    }
+
+  // same for the predecessor image, all points without predecessor
+  if ( m_GeneratePredecessorImage )
+    {
+    m_PredecessorImage->CopyInformation( this->GetInput() );
+    m_PredecessorImage->SetBufferedRegion( output->GetBufferedRegion() );
+
+    const unsigned char noPredecessor = static_cast< unsigned char >( NoPredecessor );
+    if ( this->GetUseBrickedStorage() )
+      {
+      m_BrickedPredecessors = ImportImageContainer< SizeValueType, unsigned char >::New();
+      ParallelReserveAndFill( m_BrickedPredecessors.GetPointer(), this->GetBrickLayout().GetNumberOfElements(),
+                              noPredecessor, this->GetNumberOfThreads() );
+      }
+    else
       {
-      gradientIt.Set(zeroGradient);
+      m_PredecessorImage->Allocate();
+      ParallelFillBuffer( m_PredecessorImage.GetPointer(), noPredecessor, this->GetNumberOfThreads() );
       }
     }
 
   // Need to reset the target value.
   m_TargetValue = 0.0;
+  m_TargetMaskReached = false;
+  m_ReachedTargetMaskIndex.Fill(0);
+
+  m_TargetInitialDistances.clear();
+  m_TargetClosestDistances.clear();
+
+  // Storage offsets of the target points, sorted, so that an accepted
+  // point is looked up rather than compared with all the targets.
+  m_TargetStorageOffsets.clear();
+  if ( m_TargetReachedMode != NoTargets && m_TargetPoints )
+    {
+    const LevelSetIndexType & startIndex = this->GetStartIndex();
+    const LevelSetIndexType & lastIndex = this->GetLastIndex();
+    typename NodeContainer::ConstIterator pointsIter = m_TargetPoints->Begin();
+    typename NodeContainer::ConstIterator pointsEnd = m_TargetPoints->End();
+    for (; pointsIter != pointsEnd; ++pointsIter )
+      {
+      const IndexType & targetIndex = pointsIter.Value().GetIndex();
+      bool inside = true;
+      for ( unsigned int j = 0; j < SetDimension; j++ )
+        {
+        if ( targetIndex[j] < startIndex[j] || targetIndex[j] > lastIndex[j] )
+          {
+          inside = false;
+          }
+        }
+      if ( inside )
+        {
+        m_TargetStorageOffsets.push_back( this->ComputeStorageOffset(targetIndex) );
+        }
+      }
+    std::sort( m_TargetStorageOffsets.begin(), m_TargetStorageOffsets.end() );
+    }
 
   if ( m_TargetReachedMode == SomeTargets || m_TargetReachedMode == AllTargets )
     {
@@ -151,6 +215,27 @@ FastMarchingUpwindGradientImageFilter2< TLevelSet, TSpeedImage >
     this->ComputeGradient(index, output, this->GetLabelImage(), m_GradientImage);
     }
 
+  if ( m_GeneratePredecessorImage )
+    {
+    this->ComputePredecessor(index);
+    }
+
+  // The first accepted point of the target mask stops the front, as a
+  // target point would in OneTarget mode.
+  if ( m_TargetMask && !m_TargetMaskReached &&
+       m_TargetMask->GetBufferedRegion().IsInside(index) &&
+       m_TargetMask->GetPixel(index) != 0 )
+    {
+    m_TargetMaskReached = true;
+    m_ReachedTargetMaskIndex = index;
+    m_TargetValue = static_cast< double >( this->GetLevelSetValue( this->ComputeStorageOffset(index) ) );
+    double newStoppingValue = m_TargetValue + m_TargetOffset;
+    if ( newStoppingValue < this->GetStoppingValue() )
+      {
+      this->SetStoppingValue(newStoppingValue);
+      }
+    }
+
   AxisNodeType node;
 
   // Only check for reached targets if the mode is not NoTargets and
@@ -159,64 +244,82 @@ FastMarchingUpwindGradientImageFilter2< TLevelSet, TSpeedImage >
     {
     bool targetReached = false;
 
-    if ( m_TargetReachedMode == OneTarget )
+    // Keep track of how close the front came to each target, this is
+    // only used to estimate the progress. The front is sampled once every
+    // CancellationCheckInterval accepted points, just before the progress
+    // is estimated, so that the hot loop does not pay for all the targets.
+    const bool firstAcceptedPoint = m_TargetInitialDistances.empty();
+    if ( firstAcceptedPoint )
       {
-      typename NodeContainer::ConstIterator pointsIter = m_TargetPoints->Begin();
-      typename NodeContainer::ConstIterator pointsEnd = m_TargetPoints->End();
-      for (; pointsIter != pointsEnd; ++pointsIter )
-        {
-        node = pointsIter.Value();
-        if ( node.GetIndex() == index )
-          {
-          targetReached = true;
-          break;
-          }
-        }
+      m_TargetInitialDistances.resize( m_TargetPoints->Size() );
+      m_TargetClosestDistances.resize( m_TargetPoints->Size() );
       }
-    else if ( m_TargetReachedMode == SomeTargets )
+    const SizeValueType checkInterval = vnl_math_max( this->GetCancellationCheckInterval(),
+                                                      static_cast< SizeValueType >( 1 ) );
+    const bool sampleFront = firstAcceptedPoint ||
+                             ( this->GetNumberOfAcceptedPoints() + 1 ) % checkInterval == 0;
+    unsigned int targetNumber = 0;
+    typename NodeContainer::ConstIterator targetIter = m_TargetPoints->Begin();
+    typename NodeContainer::ConstIterator targetEnd = sampleFront ? m_TargetPoints->End() : targetIter;
+    for (; targetIter != targetEnd; ++targetIter, ++targetNumber )
       {
-      typename NodeContainer::ConstIterator pointsIter = m_TargetPoints->Begin();
-      typename NodeContainer::ConstIterator pointsEnd = m_TargetPoints->End();
-      for (; pointsIter != pointsEnd; ++pointsIter )
+      const IndexType & targetIndex = targetIter.Value().GetIndex();
+      double squaredDistance = 0.0;
+      for ( unsigned int j = 0; j < SetDimension; j++ )
         {
-        node = pointsIter.Value();
-
-        if ( node.GetIndex() == index )
-          {
-          m_ReachedTargetPoints->InsertElement(m_ReachedTargetPoints->Size(), node);
-          break;
-          }
+        const double d = static_cast< double >( targetIndex[j] - index[j] );
+        squaredDistance += d * d;
         }
-
-      if ( static_cast< SizeValueType >( m_ReachedTargetPoints->Size() ) == m_NumberOfTargets )
+      if ( firstAcceptedPoint )
+        {
+        m_TargetInitialDistances[targetNumber] = squaredDistance;
+        m_TargetClosestDistances[targetNumber] = squaredDistance;
+        }
+      else if ( squaredDistance < m_TargetClosestDistances[targetNumber] )
         {
-        targetReached = true;
+        m_TargetClosestDistances[targetNumber] = squaredDistance;
         }
       }
-    else if ( m_TargetReachedMode == AllTargets )
+
+    // Only an accepted point which is a target goes through the target
+    // list, to find which one it is.
+    const bool isTarget = std::binary_search( m_TargetStorageOffsets.begin(), m_TargetStorageOffsets.end(),
+                                              this->ComputeStorageOffset(index) );
+    if ( m_TargetReachedMode == OneTarget )
       {
-      typename NodeContainer::ConstIterator pointsIter = m_TargetPoints->Begin();
-      typename NodeContainer::ConstIterator pointsEnd = m_TargetPoints->End();
-      for (; pointsIter != pointsEnd; ++pointsIter )
+      targetReached = isTarget;
+      }
+    else if ( m_TargetReachedMode == SomeTargets || m_TargetReachedMode == AllTargets )
+      {
+      if ( isTarget )
         {
-        node = pointsIter.Value();
-
-        if ( node.GetIndex() == index )
+        typename NodeContainer::ConstIterator pointsIter = m_TargetPoints->Begin();
+        typename NodeContainer::ConstIterator pointsEnd = m_TargetPoints->End();
+        for (; pointsIter != pointsEnd; ++pointsIter )
           {
-          m_ReachedTargetPoints->InsertElement(m_ReachedTargetPoints->Size(), node);
-          break;
+          node = pointsIter.Value();
+
+          if ( node.GetIndex() == index )
+            {
+            m_ReachedTargetPoints->InsertElement(m_ReachedTargetPoints->Size(), node);
+            break;
+            }
           }
         }
 
-      if ( m_ReachedTargetPoints->Size() == m_TargetPoints->Size() )
+      if ( m_TargetReachedMode == SomeTargets )
+        {
+        targetReached = static_cast< SizeValueType >( m_ReachedTargetPoints->Size() ) == m_NumberOfTargets;
+        }
+      else
         {
-        targetReached = true;
+        targetReached = m_ReachedTargetPoints->Size() == m_TargetPoints->Size();
         }
       }
 
     if ( targetReached )
       {
-      m_TargetValue = static_cast< double >( output->GetPixel(index) );
+      m_TargetValue = static_cast< double >( this->GetLevelSetValue( this->ComputeStorageOffset(index) ) );
       double newStoppingValue = m_TargetValue + m_TargetOffset;
       if ( newStoppingValue < this->GetStoppingValue() )
         {
@@ -228,10 +331,54 @@ FastMarchingUpwindGradientImageFilter2< TLevelSet, TSpeedImage >
         }
       }
     }
-  else
+  else if ( !m_TargetMaskReached )
+    {
+    m_TargetValue = static_cast< double >( this->GetLevelSetValue( this->ComputeStorageOffset(index) ) );
+    }
+}
+
+/**
+ *
+ */
+template< class TLevelSet, class TSpeedImage >
+double
+FastMarchingUpwindGradientImageFilter2< TLevelSet, TSpeedImage >
+::EstimateProgress(double currentValue) const
+{
+  if ( m_TargetReachedMode == NoTargets || !m_TargetPoints ||
+       m_TargetClosestDistances.empty() )
+    {
+    return Superclass::EstimateProgress(currentValue);
+    }
+
+  // Once the marching has reached the targets, only the points within the
+  // target offset remain.
+  if ( this->GetStoppingValue() < static_cast< double >( this->GetLargeValue() ) )
+    {
+    return Superclass::EstimateProgress(currentValue);
+    }
+
+  // Fraction of the initial distance to each target already covered by
+  // the front. One target is enough in OneTarget mode, otherwise all of
+  // them count.
+  double sumOfProximities = 0.0;
+  double maximumProximity = 0.0;
+  for ( unsigned int k = 0; k < m_TargetClosestDistances.size(); k++ )
+    {
+    double proximity = 1.0;
+    if ( m_TargetInitialDistances[k] > 0.0 )
+      {
+      proximity = 1.0 - vcl_sqrt( m_TargetClosestDistances[k] / m_TargetInitialDistances[k] );
+      }
+    sumOfProximities += proximity;
+    maximumProximity = vnl_math_max(maximumProximity, proximity);
+    }
+
+  if ( m_TargetReachedMode == OneTarget )
     {
-    m_TargetValue = static_cast< double >( output->GetPixel(index) );
+    return maximumProximity;
     }
+  return sumOfProximities / static_cast< double >( m_TargetClosestDistances.size() );
 }
 
 /**
@@ -241,11 +388,10 @@ template< class TLevelSet, class TSpeedImage >
 void
 FastMarchingUpwindGradientImageFilter2< TLevelSet, TSpeedImage >
 ::ComputeGradient(const IndexType & index,
-                  const LevelSetImageType *output,
+                  const LevelSetImageType *itkNotUsed(output),
                   const LabelImageType *itkNotUsed(labelImage),
                   GradientImageType *gradientImage)
 {
-  IndexType neighIndex = index;
 
   typedef typename TLevelSet::PixelType LevelSetPixelType;
   LevelSetPixelType centerPixel;
@@ -261,40 +407,32 @@ FastMarchingUpwindGradientImageFilter2< TLevelSet, TSpeedImage >
 
   OutputSpacingType spacing = this->GetOutput()->GetSpacing();
 
-  unsigned int xStride[itkGetStaticConstMacro(SetDimension)];
+  const SizeValueType offset = this->ComputeStorageOffset(index);
+  centerPixel = this->GetLevelSetValue(offset);
 
   for ( unsigned int j = 0; j < SetDimension; j++ )
     {
-    centerPixel = output->GetPixel(index);
-
-    neighIndex = index;
-
-    // Set stride of one in each direction
-    xStride[j] = 1;
-
     // Compute one-sided finite differences with alive neighbors
     // (the front can only come from there)
     dx_backward = 0.0;
-    neighIndex[j] = index[j] - xStride[j];
 
-    if ( !( neighIndex[j] > lastIndex[j]
-            || neighIndex[j] < startIndex[j] ) )
+    if ( index[j] > startIndex[j] )
       {
-      if ( this->GetLabelImage()->GetPixel(neighIndex) == Superclass::AlivePoint )
+      const SizeValueType neighOffset = this->ComputeNeighborStorageOffset(offset, index, j, -1);
+      if ( this->GetLabel(neighOffset) == Superclass::AlivePoint )
         {
-        dx_backward = centerPixel - output->GetPixel(neighIndex);
+        dx_backward = centerPixel - this->GetLevelSetValue(neighOffset);
         }
       }
 
     dx_forward = 0.0;
-    neighIndex[j] = index[j] + xStride[j];
 
-    if ( !( neighIndex[j] > lastIndex[j]
-            || neighIndex[j] < startIndex[j] ) )
+    if ( index[j] < lastIndex[j] )
       {
-      if ( this->GetLabelImage()->GetPixel(neighIndex) == Superclass::AlivePoint )
+      const SizeValueType neighOffset = this->ComputeNeighborStorageOffset(offset, index, j, 1);
+      if ( this->GetLabel(neighOffset) == Superclass::AlivePoint )
         {
-        dx_forward = output->GetPixel(neighIndex) - centerPixel;
+        dx_forward = this->GetLevelSetValue(neighOffset) - centerPixel;
         }
       }
 
@@ -314,7 +452,126 @@ FastMarchingUpwindGradientImageFilter2< TLevelSet, TSpeedImage >
     gradientPixel[j] /= spacing[j];
     }
 
-  gradientImage->SetPixel(index, gradientPixel);
+  if ( this->GetUseBrickedStorage() )
+    {
+    m_BrickedGradient->GetBufferPointer()[offset] = gradientPixel;
+    }
+  else
+    {
+    gradientImage->SetPixel(index, gradientPixel);
+    }
+}
+
+/**
+ *
+ */
+template< class TLevelSet, class TSpeedImage >
+void
+FastMarchingUpwindGradientImageFilter2< TLevelSet, TSpeedImage >
+::ComputePredecessor(const IndexType & index)
+{
+  const LevelSetIndexType & lastIndex = this->GetLastIndex();
+  const LevelSetIndexType & startIndex = this->GetStartIndex();
+
+  OutputSpacingType spacing = this->GetOutput()->GetSpacing();
+
+  const SizeValueType offset = this->ComputeStorageOffset(index);
+  const double centerValue = static_cast< double >( this->GetLevelSetValue(offset) );
+
+  // The alive neighbors were accepted before this point, so that the
+  // predecessors never form a cycle; among them, keep the steepest one.
+  unsigned char code = static_cast< unsigned char >( NoPredecessor );
+  double steepestSlope = NumericTraits< double >::NonpositiveMin();
+
+  for ( unsigned int j = 0; j < SetDimension; j++ )
+    {
+    for ( int s = -1; s < 2; s = s + 2 )
+      {
+      if ( ( s < 0 && index[j] <= startIndex[j] ) ||
+           ( s > 0 && index[j] >= lastIndex[j] ) )
+        {
+        continue;
+        }
+
+      const SizeValueType neighOffset = this->ComputeNeighborStorageOffset(offset, index, j, s);
+      if ( this->GetLabel(neighOffset) == Superclass::AlivePoint )
+        {
+        const double slope =
+          ( centerValue - static_cast< double >( this->GetLevelSetValue(neighOffset) ) ) / spacing[j];
+        if ( slope > steepestSlope )
+          {
+          steepestSlope = slope;
+          code = EncodePredecessor(j, s);
+          }
+        }
+      }
+    }
+
+  if ( this->GetUseBrickedStorage() )
+    {
+    m_BrickedPredecessors->GetBufferPointer()[offset] = code;
+    }
+  else
+    {
+    m_PredecessorImage->SetPixel(index, code);
+    }
+}
+
+/**
+ *
+ */
+template< class TLevelSet, class TSpeedImage >
+void
+FastMarchingUpwindGradientImageFilter2< TLevelSet, TSpeedImage >
+::CopyBrickedStorageToImages(LevelSetImageType *output)
+{
+  if ( m_GenerateGradientImage )
+    {
+    m_GradientImage->Allocate();
+
+    typedef ImageRegionIteratorWithIndex< GradientImageType > GradientIterator;
+
+    GradientIterator gradientIt( m_GradientImage,
+                                 m_GradientImage->GetBufferedRegion() );
+
+    for ( gradientIt.GoToBegin(); !gradientIt.IsAtEnd(); ++gradientIt )
+      {
+      gradientIt.Set( m_BrickedGradient->GetBufferPointer()[ this->GetBrickLayout().ComputeOffset( gradientIt.GetIndex() ) ] );
+      }
+    m_BrickedGradient = NULL;
+    }
+
+  if ( m_GeneratePredecessorImage )
+    {
+    m_PredecessorImage->Allocate();
+
+    typedef ImageRegionIteratorWithIndex< PredecessorImageType > PredecessorIterator;
+
+    PredecessorIterator predecessorIt( m_PredecessorImage,
+                                       m_PredecessorImage->GetBufferedRegion() );
+
+    for ( predecessorIt.GoToBegin(); !predecessorIt.IsAtEnd(); ++predecessorIt )
+      {
+      predecessorIt.Set( m_BrickedPredecessors->GetBufferPointer()[ this->GetBrickLayout().ComputeOffset( predecessorIt.GetIndex() ) ] );
+      }
+    m_BrickedPredecessors = NULL;
+    }
+
+  Superclass::CopyBrickedStorageToImages(output);
+}
+
+/**
+ *
+ */
+template< class TLevelSet, class TSpeedImage >
+void
+FastMarchingUpwindGradientImageFilter2< TLevelSet, TSpeedImage >
+::ReleaseBrickedStorage()
+{
+  m_BrickedGradient = NULL;
+  m_BrickedPredecessors = NULL;
+
+  Superclass::ReleaseBrickedStorage();
 }
 } // namespace itk
 
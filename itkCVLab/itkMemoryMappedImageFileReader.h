@@ -0,0 +1,179 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+#ifndef __itkMemoryMappedImageFileReader_h
+#define __itkMemoryMappedImageFileReader_h
+
+#include <string>
+#include <itkImageSource.h>
+#include <itkImportImageContainer.h>
+
+namespace itk
+{
+
+	/** \class MemoryMappedImportImageContainer
+	 * \brief Pixel container whose memory is a read-only mapping of a file.
+	 *
+	 * The mapping is released when the container is destroyed, i.e. when
+	 * the last image sharing it (through Graft for instance) goes away.
+	 * Writing to the pixels is not allowed: the pages are mapped read-only.
+	 */
+	template <typename TElementIdentifier, typename TElement>
+	class MemoryMappedImportImageContainer:
+	public ImportImageContainer<TElementIdentifier, TElement>
+	{
+	public:
+		/** Standard class typedefs. */
+		typedef MemoryMappedImportImageContainer									Self;
+		typedef ImportImageContainer<TElementIdentifier, TElement>	Superclass;
+		typedef SmartPointer<Self>																Pointer;
+		typedef SmartPointer<const Self>													ConstPointer;
+
+		/** Method for creation through the object factory. */
+		itkNewMacro(Self);
+
+		/** Run-time type information (and related methods).   */
+		itkTypeMacro( MemoryMappedImportImageContainer, ImportImageContainer );
+
+		/** Map numberOfElements elements of the file, starting at the given
+		 * byte offset. Throws an exception if the file can not be mapped. */
+		void MapFile(const std::string & fileName,
+								 unsigned long long offset,
+								 TElementIdentifier numberOfElements);
+
+	protected:
+		MemoryMappedImportImageContainer();
+		virtual ~MemoryMappedImportImageContainer();
+
+		void Unmap();
+
+	private:
+		MemoryMappedImportImageContainer(const Self&); //purposely not implemented
+		void operator=(const Self&); //purposely not implemented
+
+		void*																				m_MappedAddress;
+		unsigned long long													m_MappedLength;
+#ifdef _WIN32
+		void*																				m_FileHandle;
+		void*																				m_MappingHandle;
+#endif
+	};
+
+	/** \class MemoryMappedImageFileReader
+	 * \brief Reads an uncompressed MetaImage file (.mha, or .mhd with its raw
+	 * data file) by mapping its data in memory instead of copying it.
+	 *
+	 * The output buffer points directly in the mapping: pages are only read
+	 * from the disk when they are accessed, and they are shared between
+	 * the processes mapping the same file. The output is read-only.
+	 *
+	 * Only files whose pixels can be used as they are can be mapped: no
+	 * compression, one channel, the byte order of the host and a pixel type
+	 * of the same size and kind as the output pixel type.
+	 * CanReadFile() tells whether a file satisfies these conditions; if it
+	 * does not, use an itk::ImageFileReader.
+	 *
+	 * The whole image is always produced.
+	 *
+	 * \author : Fethallah Benmansour
+	 */
+	template <typename TOutputImage>
+	class ITK_EXPORT MemoryMappedImageFileReader:
+	public ImageSource<TOutputImage>
+	{
+	public:
+		/** Standard class typedefs. */
+		typedef MemoryMappedImageFileReader												Self;
+		typedef ImageSource<TOutputImage>													Superclass;
+		typedef SmartPointer<Self>																Pointer;
+		typedef SmartPointer<const Self>													ConstPointer;
+
+		/** Type of the output Image */
+		typedef TOutputImage																			OutputImageType;
+		typedef typename OutputImageType::Pointer									OutputImagePointer;
+		typedef typename OutputImageType::PixelType								PixelType;
+		typedef typename OutputImageType::RegionType							RegionType;
+		typedef typename OutputImageType::SizeType								SizeType;
+		typedef typename OutputImageType::IndexType								IndexType;
+		typedef typename OutputImageType::SpacingType							SpacingType;
+		typedef typename OutputImageType::PointType								PointType;
+		typedef typename OutputImageType::DirectionType						DirectionType;
+
+		typedef MemoryMappedImportImageContainer<SizeValueType, PixelType>	PixelContainerType;
+
+		/** Image dimension. */
+		itkStaticConstMacro(ImageDimension, unsigned int,
+												TOutputImage::ImageDimension);
+
+		/** Run-time type information (and related methods).   */
+		itkTypeMacro( MemoryMappedImageFileReader, ImageSource );
+
+		/** Method for creation through the object factory. */
+		itkNewMacro(Self);
+
+		/** Set/Get the file name. */
+		itkSetStringMacro(FileName);
+		itkGetStringMacro(FileName);
+
+		/** Whether the file can be mapped as an image of the output type. */
+		static bool CanReadFile(const char * fileName);
+
+	protected:
+		MemoryMappedImageFileReader();
+		virtual ~MemoryMappedImageFileReader() {};
+		void PrintSelf(std::ostream& os, Indent indent) const;
+
+		/** Read the header and set the output information. */
+		void GenerateOutputInformation();
+
+		/** The whole image is produced. */
+		void EnlargeOutputRequestedRegion(DataObject *output);
+
+		/** Map the data. */
+		void GenerateData();
+
+		/** What is read from the header */
+		struct HeaderInformation
+		{
+			SizeType						Size;
+			SpacingType					Spacing;
+			PointType						Origin;
+			DirectionType				Direction;
+			std::string					DataFileName;
+			unsigned long long	DataOffset;
+		};
+
+		/** Parse the header of fileName. Returns false and fills errorMessage
+		 * if the file can not be mapped. */
+		static bool ReadHeader(const std::string & fileName,
+													 HeaderInformation & header,
+													 std::string & errorMessage);
+
+	private:
+		MemoryMappedImageFileReader(const Self&); //purposely not implemented
+		void operator=(const Self&); //purposely not implemented
+
+		std::string									m_FileName;
+		HeaderInformation						m_Header;
+	};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkMemoryMappedImageFileReader.txx"
+#endif
+
+#endif
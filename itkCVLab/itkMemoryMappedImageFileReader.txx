@@ -0,0 +1,470 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+
+#ifndef __itkMemoryMappedImageFileReader_txx
+#define __itkMemoryMappedImageFileReader_txx
+
+#include "itkMemoryMappedImageFileReader.h"
+#include <itkByteSwapper.h>
+#include <itkNumericTraits.h>
+#include <itksys/SystemTools.hxx>
+#include <fstream>
+#include <sstream>
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+namespace itk
+{
+
+	/**
+	 * Constructor
+	 */
+	template <typename TElementIdentifier, typename TElement>
+	MemoryMappedImportImageContainer<TElementIdentifier, TElement>
+	::MemoryMappedImportImageContainer()
+	{
+		m_MappedAddress = NULL;
+		m_MappedLength = 0;
+#ifdef _WIN32
+		m_FileHandle = NULL;
+		m_MappingHandle = NULL;
+#endif
+	}
+
+	/**
+	 * Destructor
+	 */
+	template <typename TElementIdentifier, typename TElement>
+	MemoryMappedImportImageContainer<TElementIdentifier, TElement>
+	::~MemoryMappedImportImageContainer()
+	{
+		this->Unmap();
+	}
+
+	/**
+	 * Map the file
+	 */
+	template <typename TElementIdentifier, typename TElement>
+	void
+	MemoryMappedImportImageContainer<TElementIdentifier, TElement>
+	::MapFile(const std::string & fileName,
+						unsigned long long offset,
+						TElementIdentifier numberOfElements)
+	{
+		this->Unmap();
+
+		unsigned long long dataLength = static_cast<unsigned long long>(numberOfElements) * sizeof(TElement);
+
+		// The mapping has to start on a page boundary, the data is found
+		// at offset - pageOffset in the mapping.
+#ifdef _WIN32
+		SYSTEM_INFO systemInfo;
+		GetSystemInfo(&systemInfo);
+		unsigned long long granularity = systemInfo.dwAllocationGranularity;
+#else
+		unsigned long long granularity = sysconf(_SC_PAGESIZE);
+#endif
+		unsigned long long mappingStart = (offset / granularity) * granularity;
+		unsigned long long pageOffset = offset - mappingStart;
+		unsigned long long mappedLength = dataLength + pageOffset;
+
+#ifdef _WIN32
+		HANDLE fileHandle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+																		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if( fileHandle == INVALID_HANDLE_VALUE )
+		{
+			itkExceptionMacro( "Can not open " << fileName );
+		}
+		HANDLE mappingHandle = CreateFileMapping(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if( mappingHandle == NULL )
+		{
+			CloseHandle(fileHandle);
+			itkExceptionMacro( "Can not create a mapping of " << fileName );
+		}
+		void* address = MapViewOfFile(mappingHandle, FILE_MAP_READ,
+																	static_cast<DWORD>(mappingStart >> 32),
+																	static_cast<DWORD>(mappingStart & 0xFFFFFFFF),
+																	static_cast<SIZE_T>(mappedLength));
+		if( address == NULL )
+		{
+			CloseHandle(mappingHandle);
+			CloseHandle(fileHandle);
+			itkExceptionMacro( "Can not map " << mappedLength << " bytes of " << fileName );
+		}
+		m_FileHandle = fileHandle;
+		m_MappingHandle = mappingHandle;
+#else
+		int fileDescriptor = open(fileName.c_str(), O_RDONLY);
+		if( fileDescriptor < 0 )
+		{
+			itkExceptionMacro( "Can not open " << fileName );
+		}
+		void* address = mmap(NULL, mappedLength, PROT_READ, MAP_SHARED, fileDescriptor, mappingStart);
+		// The mapping stays valid once the file is closed.
+		close(fileDescriptor);
+		if( address == MAP_FAILED )
+		{
+			itkExceptionMacro( "Can not map " << mappedLength << " bytes of " << fileName );
+		}
+#endif
+		m_MappedAddress = address;
+		m_MappedLength = mappedLength;
+
+		// The container does not own this memory, it is not to be deleted
+		// but unmapped.
+		TElement* data = reinterpret_cast<TElement*>(static_cast<char*>(address) + pageOffset);
+		this->SetImportPointer(data, numberOfElements, false);
+	}
+
+	/**
+	 * Release the mapping
+	 */
+	template <typename TElementIdentifier, typename TElement>
+	void
+	MemoryMappedImportImageContainer<TElementIdentifier, TElement>
+	::Unmap()
+	{
+		if( m_MappedAddress == NULL )
+		{
+			return;
+		}
+#ifdef _WIN32
+		UnmapViewOfFile(m_MappedAddress);
+		CloseHandle(static_cast<HANDLE>(m_MappingHandle));
+		CloseHandle(static_cast<HANDLE>(m_FileHandle));
+		m_MappingHandle = NULL;
+		m_FileHandle = NULL;
+#else
+		munmap(m_MappedAddress, m_MappedLength);
+#endif
+		m_MappedAddress = NULL;
+		m_MappedLength = 0;
+	}
+
+	/**
+	 * Constructor
+	 */
+	template <typename TOutputImage>
+	MemoryMappedImageFileReader<TOutputImage>
+	::MemoryMappedImageFileReader()
+	{
+		m_Header.DataOffset = 0;
+	}
+
+	/**
+	 * PrintSelf
+	 */
+	template <typename TOutputImage>
+	void
+	MemoryMappedImageFileReader<TOutputImage>
+	::PrintSelf(std::ostream& os, Indent indent) const
+	{
+		Superclass::PrintSelf(os, indent);
+		os << indent << "FileName: " << m_FileName << std::endl;
+		os << indent << "DataFileName: " << m_Header.DataFileName << std::endl;
+		os << indent << "DataOffset: " << m_Header.DataOffset << std::endl;
+	}
+
+	/**
+	 * Parse the MetaImage header
+	 */
+	template <typename TOutputImage>
+	bool
+	MemoryMappedImageFileReader<TOutputImage>
+	::ReadHeader(const std::string & fileName,
+							 HeaderInformation & header,
+							 std::string & errorMessage)
+	{
+		std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+		if( !file )
+		{
+			errorMessage = "Can not open " + fileName;
+			return false;
+		}
+
+		header.Size.Fill(1);
+		header.Spacing.Fill(1.0);
+		header.Origin.Fill(0.0);
+		header.Direction.SetIdentity();
+		header.DataFileName.clear();
+		header.DataOffset = 0;
+
+		unsigned int nDims = 0;
+		std::string elementType;
+		long long headerSize = 0;
+		bool sizeGiven = false;
+		bool dataFileGiven = false;
+
+		std::string line;
+		while( !dataFileGiven && std::getline(file, line) )
+		{
+			std::string::size_type equal = line.find('=');
+			if( equal == std::string::npos )
+			{
+				continue;
+			}
+			std::string key = itksys::SystemTools::TrimWhitespace( line.substr(0, equal) );
+			std::string value = itksys::SystemTools::TrimWhitespace( line.substr(equal + 1) );
+			std::istringstream values(value);
+
+			if( key == "NDims" )
+			{
+				values >> nDims;
+				if( nDims != ImageDimension )
+				{
+					errorMessage = "The image dimension does not match the output dimension";
+					return false;
+				}
+			}
+			else if( key == "CompressedData" )
+			{
+				if( value == "True" )
+				{
+					errorMessage = "Compressed data can not be mapped";
+					return false;
+				}
+			}
+			else if( key == "ElementNumberOfChannels" )
+			{
+				if( value != "1" )
+				{
+					errorMessage = "Multi-channel data can not be mapped";
+					return false;
+				}
+			}
+			else if( key == "BinaryDataByteOrderMSB" || key == "ElementByteOrderMSB" )
+			{
+				bool isMSB = ( value == "True" );
+				if( isMSB != ByteSwapper<int>::SystemIsBigEndian() )
+				{
+					errorMessage = "The byte order of the data is not the one of this system";
+					return false;
+				}
+			}
+			else if( key == "DimSize" )
+			{
+				for(unsigned int i = 0; i < ImageDimension; i++)
+				{
+					values >> header.Size[i];
+				}
+				sizeGiven = true;
+			}
+			else if( key == "ElementSpacing" )
+			{
+				for(unsigned int i = 0; i < ImageDimension; i++)
+				{
+					values >> header.Spacing[i];
+				}
+			}
+			else if( key == "Offset" || key == "Position" || key == "Origin" )
+			{
+				for(unsigned int i = 0; i < ImageDimension; i++)
+				{
+					values >> header.Origin[i];
+				}
+			}
+			else if( key == "TransformMatrix" || key == "Rotation" || key == "Orientation" )
+			{
+				// MetaImage stores the direction cosines column by column
+				for(unsigned int j = 0; j < ImageDimension; j++)
+				{
+					for(unsigned int i = 0; i < ImageDimension; i++)
+					{
+						values >> header.Direction[i][j];
+					}
+				}
+			}
+			else if( key == "HeaderSize" )
+			{
+				values >> headerSize;
+			}
+			else if( key == "ElementType" )
+			{
+				elementType = value;
+			}
+			else if( key == "ElementDataFile" )
+			{
+				header.DataFileName = value;
+				dataFileGiven = true;
+			}
+		}
+
+		if( !dataFileGiven || !sizeGiven || nDims == 0 )
+		{
+			errorMessage = fileName + " is not a MetaImage header";
+			return false;
+		}
+
+		// The element type must be usable as the output pixel type as is.
+		unsigned int elementSize = 0;
+		bool elementIsInteger = true;
+		bool elementIsSigned = true;
+		if( elementType == "MET_CHAR" )				{ elementSize = 1; }
+		else if( elementType == "MET_UCHAR" )	{ elementSize = 1; elementIsSigned = false; }
+		else if( elementType == "MET_SHORT" )	{ elementSize = 2; }
+		else if( elementType == "MET_USHORT" ){ elementSize = 2; elementIsSigned = false; }
+		else if( elementType == "MET_INT" )		{ elementSize = 4; }
+		else if( elementType == "MET_UINT" )	{ elementSize = 4; elementIsSigned = false; }
+		else if( elementType == "MET_FLOAT" )	{ elementSize = 4; elementIsInteger = false; }
+		else if( elementType == "MET_DOUBLE" ){ elementSize = 8; elementIsInteger = false; }
+		if( elementSize != sizeof(PixelType) ||
+			 elementIsInteger != NumericTraits<PixelType>::is_integer ||
+			 ( elementIsInteger && elementIsSigned != NumericTraits<PixelType>::is_signed ) )
+		{
+			errorMessage = "The element type " + elementType + " does not match the output pixel type";
+			return false;
+		}
+
+		unsigned long long dataLength = sizeof(PixelType);
+		for(unsigned int i = 0; i < ImageDimension; i++)
+		{
+			dataLength *= header.Size[i];
+		}
+
+		// Locate the data
+		if( header.DataFileName == "LOCAL" )
+		{
+			header.DataFileName = fileName;
+			header.DataOffset = static_cast<unsigned long long>( file.tellg() );
+		}
+		else
+		{
+			if( header.DataFileName == "LIST" || header.DataFileName.find('%') != std::string::npos )
+			{
+				errorMessage = "Data split in several files can not be mapped";
+				return false;
+			}
+			if( !itksys::SystemTools::FileIsFullPath( header.DataFileName.c_str() ) )
+			{
+				header.DataFileName = itksys::SystemTools::GetFilenamePath( fileName ) + "/" + header.DataFileName;
+			}
+			header.DataOffset = 0;
+		}
+
+		unsigned long long fileLength = itksys::SystemTools::FileLength( header.DataFileName.c_str() );
+		if( headerSize == -1 )
+		{
+			// The data is at the end of the file
+			if( fileLength < dataLength )
+			{
+				errorMessage = header.DataFileName + " is too short";
+				return false;
+			}
+			header.DataOffset = fileLength - dataLength;
+		}
+		else
+		{
+			header.DataOffset += headerSize;
+		}
+
+		if( header.DataOffset + dataLength > fileLength )
+		{
+			errorMessage = header.DataFileName + " is too short";
+			return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * CanReadFile
+	 */
+	template <typename TOutputImage>
+	bool
+	MemoryMappedImageFileReader<TOutputImage>
+	::CanReadFile(const char * fileName)
+	{
+		if( fileName == NULL )
+		{
+			return false;
+		}
+		HeaderInformation header;
+		std::string errorMessage;
+		return ReadHeader(fileName, header, errorMessage);
+	}
+
+	/**
+	 * GenerateOutputInformation
+	 */
+	template <typename TOutputImage>
+	void
+	MemoryMappedImageFileReader<TOutputImage>
+	::GenerateOutputInformation()
+	{
+		if( m_FileName == "" )
+		{
+			itkExceptionMacro( "A FileName must be specified." );
+		}
+
+		std::string errorMessage;
+		if( !ReadHeader(m_FileName, m_Header, errorMessage) )
+		{
+			itkExceptionMacro( "Can not map " << m_FileName << ": " << errorMessage );
+		}
+
+		OutputImagePointer output = this->GetOutput();
+
+		IndexType start;
+		start.Fill(0);
+		RegionType region;
+		region.SetIndex( start );
+		region.SetSize( m_Header.Size );
+
+		output->SetLargestPossibleRegion( region );
+		output->SetSpacing( m_Header.Spacing );
+		output->SetOrigin( m_Header.Origin );
+		output->SetDirection( m_Header.Direction );
+	}
+
+	/**
+	 * EnlargeOutputRequestedRegion
+	 */
+	template <typename TOutputImage>
+	void
+	MemoryMappedImageFileReader<TOutputImage>
+	::EnlargeOutputRequestedRegion(DataObject *output)
+	{
+		output->SetRequestedRegionToLargestPossibleRegion();
+	}
+
+	/**
+	 * GenerateData
+	 */
+	template <typename TOutputImage>
+	void
+	MemoryMappedImageFileReader<TOutputImage>
+	::GenerateData()
+	{
+		OutputImagePointer output = this->GetOutput();
+		RegionType region = output->GetLargestPossibleRegion();
+
+		typename PixelContainerType::Pointer container = PixelContainerType::New();
+		container->MapFile( m_Header.DataFileName, m_Header.DataOffset, region.GetNumberOfPixels() );
+
+		output->SetBufferedRegion( region );
+		output->SetPixelContainer( container );
+	}
+
+} // end namespace itk
+
+#endif
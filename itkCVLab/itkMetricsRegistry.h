@@ -0,0 +1,267 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+#ifndef __itkMetricsRegistry_h
+#define __itkMetricsRegistry_h
+
+#include <map>
+#include <string>
+#include <sstream>
+#include <ostream>
+
+#include <itkObject.h>
+#include <itkObjectFactory.h>
+#include <itkEventObject.h>
+#include <itkSimpleFastMutexLock.h>
+#include <itkTimeProbe.h>
+#include <itkNumericTraits.h>
+#include "vnl/vnl_math.h"
+
+namespace itk
+{
+
+	/** Event invoked by MetricsRegistry::Publish(). */
+	itkEventMacro( MetricsEvent, AnyEvent );
+
+	/** \class MetricsRegistry
+	 * \brief Process-wide collection of timers, counters and gauges.
+	 *
+	 * The filters of the library record the time spent in their stages, the
+	 * number of operations they did and the size of their largest buffers
+	 * under dotted names, e.g. "oof.forwardFFT" or "fastMarching.heapPushes".
+	 * Recording is thread-safe and does nothing while the registry is
+	 * disabled, which is the default.
+	 *
+	 * The content is read with WriteJSON() / GetJSON(). Publish() invokes a
+	 * MetricsEvent, so that observers (itk::Command) get the metrics when
+	 * the caller decides, e.g. at the end of each request; observers are
+	 * called in the thread calling Publish().
+	 *
+	 * \author : Fethallah Benmansour
+	 */
+	class MetricsRegistry : public Object
+	{
+	public:
+		/** Standard class typedefs. */
+		typedef MetricsRegistry									Self;
+		typedef Object													Superclass;
+		typedef SmartPointer<Self>							Pointer;
+		typedef SmartPointer<const Self>				ConstPointer;
+
+		/** Run-time type information (and related methods). */
+		itkTypeMacro(MetricsRegistry, Object);
+
+		/** Statistics of a timer, in seconds. */
+		struct TimerType
+		{
+			SizeValueType		Count;
+			double					Total;
+			double					Minimum;
+			double					Maximum;
+		};
+
+		/** The registry of the process (of the shared library, for the
+		 * plugins). */
+		static Self * GetInstance()
+		{
+			static Pointer instance;
+			static SimpleFastMutexLock instanceLock;
+			instanceLock.Lock();
+			if( instance.IsNull() )
+			{
+				instance = new Self;
+				instance->UnRegister();
+			}
+			instanceLock.Unlock();
+			return instance.GetPointer();
+		}
+
+		/** Enable or disable the recording. */
+		void SetEnabled(bool enabled)
+		{
+			m_Lock.Lock();
+			m_Enabled = enabled;
+			m_Lock.Unlock();
+		}
+
+		bool GetEnabled() const
+		{
+			m_Lock.Lock();
+			bool enabled = m_Enabled;
+			m_Lock.Unlock();
+			return enabled;
+		}
+
+		/** Add one measurement to a timer. */
+		void AddTime(const std::string & name, double seconds)
+		{
+			m_Lock.Lock();
+			if( m_Enabled )
+			{
+				TimerType & timer = m_Timers[name];
+				if( timer.Count == 0 )
+				{
+					timer.Minimum = seconds;
+					timer.Maximum = seconds;
+				}
+				timer.Count++;
+				timer.Total += seconds;
+				timer.Minimum = vnl_math_min(timer.Minimum, seconds);
+				timer.Maximum = vnl_math_max(timer.Maximum, seconds);
+			}
+			m_Lock.Unlock();
+		}
+
+		/** Add a value to a counter. */
+		void Increment(const std::string & name, SizeValueType value = 1)
+		{
+			m_Lock.Lock();
+			if( m_Enabled )
+			{
+				m_Counters[name] += value;
+			}
+			m_Lock.Unlock();
+		}
+
+		/** Set a gauge to a value. */
+		void SetGauge(const std::string & name, double value)
+		{
+			m_Lock.Lock();
+			if( m_Enabled )
+			{
+				m_Gauges[name] = value;
+			}
+			m_Lock.Unlock();
+		}
+
+		/** Keep the largest value given to a gauge, e.g. a peak memory. */
+		void UpdateGaugeMaximum(const std::string & name, double value)
+		{
+			m_Lock.Lock();
+			if( m_Enabled )
+			{
+				std::map<std::string, double>::iterator it = m_Gauges.find(name);
+				if( it == m_Gauges.end() )
+				{
+					m_Gauges[name] = value;
+				}
+				else if( value > it->second )
+				{
+					it->second = value;
+				}
+			}
+			m_Lock.Unlock();
+		}
+
+		/** Clear all the metrics. */
+		void Reset()
+		{
+			m_Lock.Lock();
+			m_Timers.clear();
+			m_Counters.clear();
+			m_Gauges.clear();
+			m_Lock.Unlock();
+		}
+
+		/** Write the metrics as one JSON object:
+		 * {"timers":{"name":{"count":..,"total":..,"min":..,"max":..}},
+		 *  "counters":{"name":..}, "gauges":{"name":..}} */
+		void WriteJSON(std::ostream & os) const
+		{
+			m_Lock.Lock();
+			os << "{\"timers\":{";
+			for(std::map<std::string, TimerType>::const_iterator it = m_Timers.begin(); it != m_Timers.end(); ++it)
+			{
+				os << (it == m_Timers.begin() ? "" : ",") << "\"" << it->first << "\":{"
+					 << "\"count\":" << it->second.Count << ",\"total\":" << it->second.Total
+					 << ",\"min\":" << it->second.Minimum << ",\"max\":" << it->second.Maximum << "}";
+			}
+			os << "},\"counters\":{";
+			for(std::map<std::string, SizeValueType>::const_iterator it = m_Counters.begin(); it != m_Counters.end(); ++it)
+			{
+				os << (it == m_Counters.begin() ? "" : ",") << "\"" << it->first << "\":" << it->second;
+			}
+			os << "},\"gauges\":{";
+			for(std::map<std::string, double>::const_iterator it = m_Gauges.begin(); it != m_Gauges.end(); ++it)
+			{
+				os << (it == m_Gauges.begin() ? "" : ",") << "\"" << it->first << "\":" << it->second;
+			}
+			os << "}}";
+			m_Lock.Unlock();
+		}
+
+		std::string GetJSON() const
+		{
+			std::ostringstream stream;
+			this->WriteJSON(stream);
+			return stream.str();
+		}
+
+		/** Invoke a MetricsEvent if the registry is enabled; observers read
+		 * the metrics with GetJSON(). */
+		void Publish()
+		{
+			if( this->GetEnabled() )
+			{
+				this->InvokeEvent( MetricsEvent() );
+			}
+		}
+
+		/** \class ScopedTimer
+		 * Adds the time between its construction and its destruction to a
+		 * timer of the registry. */
+		class ScopedTimer
+		{
+		public:
+			ScopedTimer(const std::string & name): m_Name(name)
+			{
+				m_Probe.Start();
+			}
+			~ScopedTimer()
+			{
+				m_Probe.Stop();
+				MetricsRegistry::GetInstance()->AddTime(m_Name, m_Probe.GetTotal());
+			}
+		private:
+			std::string		m_Name;
+			TimeProbe			m_Probe;
+		};
+
+	protected:
+		MetricsRegistry(): m_Enabled(false) {}
+		~MetricsRegistry() {}
+
+		void PrintSelf(std::ostream& os, Indent indent) const
+		{
+			Superclass::PrintSelf(os, indent);
+			os << indent << "Enabled: " << this->GetEnabled() << std::endl;
+			os << indent << "Metrics: " << this->GetJSON() << std::endl;
+		}
+
+	private:
+		MetricsRegistry(const Self&); //purposely not implemented
+		void operator=(const Self&); //purposely not implemented
+
+		mutable SimpleFastMutexLock								m_Lock;
+		bool																			m_Enabled;
+		std::map<std::string, TimerType>					m_Timers;
+		std::map<std::string, SizeValueType>			m_Counters;
+		std::map<std::string, double>							m_Gauges;
+	};
+
+} // end namespace itk
+
+#endif
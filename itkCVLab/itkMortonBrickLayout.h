@@ -0,0 +1,166 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+#ifndef __itkMortonBrickLayout_h
+#define __itkMortonBrickLayout_h
+
+#include <vector>
+
+#include <itkImageRegion.h>
+#include <itkIndex.h>
+#include <itkMacro.h>
+
+namespace itk
+{
+
+	/** \class MortonBrickLayout
+	 * \brief Maps the indices of a region to offsets in a buffer made of
+	 * cubic bricks, the voxels of a brick being in Z-order (Morton order).
+	 *
+	 * The bricks have 2^BrickSizeLog2 voxels along each axis and follow each
+	 * other in row-major order. Within a brick, the bits of the coordinates
+	 * are interleaved, so that the voxels close in space are close in
+	 * memory whatever the axis: a front growing in all the directions
+	 * touches few cache lines and few pages.
+	 * GetNeighborOffset() steps to a face neighbour with a few bit
+	 * operations when it is in the same brick.
+	 * The bricks cut by the border of the region are padded, so that the
+	 * buffer may be slightly larger than the region.
+	 *
+	 * \author : Fethallah Benmansour
+	 */
+	template <unsigned int VDimension>
+	class MortonBrickLayout
+	{
+	public:
+		typedef ImageRegion<VDimension>					RegionType;
+		typedef Index<VDimension>								IndexType;
+		typedef typename IndexType::IndexValueType	IndexValueType;
+
+		MortonBrickLayout(): m_BrickSizeLog2(0), m_NumberOfVoxelsPerBrick(1), m_NumberOfElements(0)
+		{
+			for(unsigned int i = 0; i < VDimension; i++)
+			{
+				m_BrickStride[i] = 0;
+				m_AxisMask[i] = 0;
+			}
+		}
+
+		/** Set the region and the edge of the bricks, 2^brickSizeLog2 voxels. */
+		void SetRegion(const RegionType & region, unsigned int brickSizeLog2)
+		{
+			if( brickSizeLog2 * VDimension >= 8 * sizeof(SizeValueType) - 1 )
+			{
+				itkGenericExceptionMacro( << "Bricks of 2^" << brickSizeLog2 << " voxels per axis are too large" );
+			}
+			m_Region = region;
+			m_BrickSizeLog2 = brickSizeLog2;
+			const SizeValueType brickSize = SizeValueType(1) << brickSizeLog2;
+
+			SizeValueType numberOfBricks = 1;
+			for(unsigned int i = 0; i < VDimension; i++)
+			{
+				m_BrickStride[i] = numberOfBricks;
+				numberOfBricks *= (region.GetSize()[i] + brickSize - 1) >> brickSizeLog2;
+			}
+			m_NumberOfVoxelsPerBrick = SizeValueType(1) << (brickSizeLog2 * VDimension);
+			m_NumberOfElements = numberOfBricks * m_NumberOfVoxelsPerBrick;
+
+			// Z-order code of each coordinate in a brick, for each axis: the
+			// bit b of the coordinate goes to the bit b * VDimension + axis.
+			for(unsigned int i = 0; i < VDimension; i++)
+			{
+				m_Spread[i].resize( brickSize );
+				for(SizeValueType c = 0; c < brickSize; c++)
+				{
+					SizeValueType code = 0;
+					for(unsigned int b = 0; b < brickSizeLog2; b++)
+					{
+						code |= ((c >> b) & 1) << (b * VDimension + i);
+					}
+					m_Spread[i][c] = code;
+				}
+				m_AxisMask[i] = m_Spread[i][brickSize - 1];
+			}
+		}
+
+		const RegionType & GetRegion() const
+		{
+			return m_Region;
+		}
+
+		unsigned int GetBrickSizeLog2() const
+		{
+			return m_BrickSizeLog2;
+		}
+
+		/** Size of the buffer, padding included. */
+		SizeValueType GetNumberOfElements() const
+		{
+			return m_NumberOfElements;
+		}
+
+		/** Offset of an index of the region. */
+		SizeValueType ComputeOffset(const IndexType & index) const
+		{
+			const SizeValueType localMask = (SizeValueType(1) << m_BrickSizeLog2) - 1;
+			SizeValueType brick = 0;
+			SizeValueType code = 0;
+			for(unsigned int i = 0; i < VDimension; i++)
+			{
+				SizeValueType position = static_cast<SizeValueType>( index[i] - m_Region.GetIndex()[i] );
+				brick += (position >> m_BrickSizeLog2) * m_BrickStride[i];
+				code |= m_Spread[i][ position & localMask ];
+			}
+			return brick * m_NumberOfVoxelsPerBrick + code;
+		}
+
+		/** Offset of the neighbour index[axis] + step (step being -1 or 1) of
+		 * the index at the given offset. The neighbour must be in the region. */
+		SizeValueType GetNeighborOffset(SizeValueType offset, const IndexType & index,
+																		unsigned int axis, int step) const
+		{
+			const SizeValueType localMask = (SizeValueType(1) << m_BrickSizeLog2) - 1;
+			const SizeValueType local = static_cast<SizeValueType>( index[axis] - m_Region.GetIndex()[axis] ) & localMask;
+			const SizeValueType code = offset & (m_NumberOfVoxelsPerBrick - 1);
+			const SizeValueType axisMask = m_AxisMask[axis];
+			if( step > 0 && local < localMask )
+			{
+				// add one to the bits of the axis, the carry going through the others
+				return offset - code + ((((code | ~axisMask) + 1) & axisMask) | (code & ~axisMask));
+			}
+			if( step < 0 && local > 0 )
+			{
+				return offset - code + ((((code & axisMask) - 1) & axisMask) | (code & ~axisMask));
+			}
+			IndexType neighbor = index;
+			neighbor[axis] += step;
+			return this->ComputeOffset( neighbor );
+		}
+
+	private:
+		RegionType										m_Region;
+		unsigned int									m_BrickSizeLog2;
+		SizeValueType									m_NumberOfVoxelsPerBrick;
+		SizeValueType									m_NumberOfElements;
+		SizeValueType									m_BrickStride[VDimension];
+		SizeValueType									m_AxisMask[VDimension];
+		std::vector<SizeValueType>		m_Spread[VDimension];
+	};
+
+} // end namespace itk
+
+#endif
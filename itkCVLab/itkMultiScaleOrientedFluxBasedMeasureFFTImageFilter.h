@@ -21,7 +21,9 @@
 #include <itkImage.h>
 #include <itkDivideByConstantImageFilter.h>
 #include <itkFFTOrientedFluxMatrixImageFilter.h>
+#include "itkScratchArena.h"
 #include <itkTimeProbe.h>
+#include "itkCompactEigenSystemPixel.h"
 
 namespace itk
 {
@@ -40,9 +42,11 @@ namespace itk
 	 * 
 	 * The filter computes an other output images:
 	 *         GetScaleOutput();//containing the scales at which each pixel gave the best reponse.
+	 *         GetScaleIndexOutput();//containing the index of that scale, on 8 bits.
 	 *         GetHessianOutput();//containing the Oriented Flux matrix at which the scale gave the best reponse
 	 *         GetNPlus1DHessianOutput();// containing the Oriented Flux matrix at each scale space voxel
 	 *				 GetNPlus1DImageOutput();// containg the responses at each scale space voxel
+	 *         GetNPlus1DEigenSystemOutput();// containing the eigenvalues and the tube direction at each scale space voxel
 	 *
 	 * We kept the "Hessian" naming convension so the interface functions of the "Oriented Flux"-Based
 	 * and Hessian-Based are similar.  
@@ -102,6 +106,10 @@ namespace itk
 		::itk::GetImageDimension<OutputNDImageType>::ImageDimension + 1>					OutputNPlus1DImageType;
 		typedef Image<typename HessianImageType::PixelType, 
 		::itk::GetImageDimension<HessianImageType>::ImageDimension + 1>						NPlus1DHessianImageType;
+		typedef CompactEigenSystemPixel< 
+		::itk::GetImageDimension<TInputImage>::ImageDimension >										EigenSystemPixelType;
+		typedef Image<EigenSystemPixelType, 
+		::itk::GetImageDimension<TInputImage>::ImageDimension + 1>								NPlus1DEigenSystemImageType;
 		
 		typedef typename TInputImage::PixelType																		InputPixelType;
 		typedef typename TInputImage::RegionType																	InputRegionType;
@@ -119,6 +127,11 @@ namespace itk
 		/** Types for Scale image */
 		typedef typename ScaleImageType::PixelType																ScalePixelType;
 		
+		/** Image of the index of the best scale, a quarter of the size of a
+		 * float scale image. */
+		typedef unsigned char																											ScaleIndexPixelType;
+		typedef Image< ScaleIndexPixelType, itkGetStaticConstMacro(ImageDimension) >	ScaleIndexImageType;
+		
 		/** Update image buffer that holds the best objectness response. This is not redundant from
 		 the output image because the latter may not be of float type, which is required for the comparisons 
 		 between responses at different scales. */ 
@@ -170,10 +183,21 @@ namespace itk
 		 * best response */
 		ScaleImageType* GetScaleOutput();
 		
+		/** Get the image containing the index of the scale at which each pixel
+		 * gave the best response: index k stands for
+		 * SigmaMinimum + k * (SigmaMaximum - SigmaMinimum) / (NumberOfSigmaSteps - 1).
+		 * Requires at most 256 scales. */
+		ScaleIndexImageType* GetScaleIndexOutput();
+		
 		/** Get the (N+1)-D image containing the hessian based measure
 		 * responses at all scales. */
 		OutputNPlus1DImageType* GetNPlus1DImageOutput();
 		
+		/** Get the (N+1)-D image containing the eigenvalues of the oriented
+		 * flux matrix and the direction of the tube (the eigenvector left out
+		 * of the cross section) at all the scales. */
+		NPlus1DEigenSystemImageType* GetNPlus1DEigenSystemOutput();
+		
 		void EnlargeOutputRequestedRegion (DataObject *);
 		
 		/** Methods to turn on/off flag to generate an image with scale values at
@@ -182,6 +206,12 @@ namespace itk
 		itkGetConstMacro(GenerateScaleOutput,bool);
 		itkBooleanMacro(GenerateScaleOutput);
 		
+		/** Methods to turn on/off flag to generate an image with the index of
+		 *  the scale of the best vesselness response at each pixel */
+		itkSetMacro(GenerateScaleIndexOutput,bool);
+		itkGetConstMacro(GenerateScaleIndexOutput,bool);
+		itkBooleanMacro(GenerateScaleIndexOutput);
+		
 		/** 
 		 * Methods to turn on/off flag to generate an image with hessian 
 		 * matrices at each pixel for the best vesselness response 
@@ -198,6 +228,17 @@ namespace itk
 		itkGetConstMacro(GenerateNPlus1DHessianOutput,bool);
 		itkBooleanMacro(GenerateNPlus1DHessianOutput);
 		
+		/** 
+		 * Methods to turn on/off flag to generate the (N+1)-D image with the
+		 * eigenvalues and the tube direction at each pixel for all possible
+		 * scales, in CompactEigenSystemPixel: 8 bytes per voxel in 3D instead
+		 * of the 24 of the (N+1)-D Hessian output. The eigen analysis is done
+		 * with the measure of each scale.
+		 */
+		itkSetMacro(GenerateNPlus1DEigenSystemOutput,bool);
+		itkGetConstMacro(GenerateNPlus1DEigenSystemOutput,bool);
+		itkBooleanMacro(GenerateNPlus1DEigenSystemOutput);
+		
 		/** 
 		 * Methods to turn on/off flag to treat the structures as bright or dark. 
 		 * Its value is true by default.
@@ -212,6 +253,51 @@ namespace itk
 		itkGetConstMacro(GenerateNPlus1DHessianMeasureOutput,bool);
 		itkBooleanMacro(GenerateNPlus1DHessianMeasureOutput);
 		
+		/** 
+		 * Methods to turn on/off flag to pass the oriented flux to the measure
+		 * filter as planar component images (see
+		 * FFTOrientedFluxMatrixImageFilter::SetGenerateComponentImages)
+		 * instead of a tensor image. This skips the interleaved copy and the
+		 * tensor buffer of each scale. It is ignored when a Hessian output is
+		 * generated, since those are tensor images. Off by default.
+		 */
+		itkSetMacro(UseComponentImages,bool);
+		itkGetConstMacro(UseComponentImages,bool);
+		itkBooleanMacro(UseComponentImages);
+		
+		/** Set/Get the maximum number of scales processed at the same time.
+		 * Each scale being processed holds its own padded FFT buffers, this
+		 * bounds the memory used by the filter. 0 (the default) lets OpenMP
+		 * decide. */
+		itkSetMacro(NumberOfParallelScales, unsigned int);
+		itkGetConstMacro(NumberOfParallelScales, unsigned int);
+		
+		/** Set/Get whether the temporary images of the scales (padded input,
+		 * kernels and products, cropped components) are lent by a scratch
+		 * arena owned by the filter, sized once at the start of an update
+		 * from the pad size of the largest scale and freed at its end,
+		 * instead of being allocated and freed by each scale. On by
+		 * default. */
+		itkSetMacro(UseScratchArena, bool);
+		itkGetConstMacro(UseScratchArena, bool);
+		itkBooleanMacro(UseScratchArena);
+		
+		/** Set/Get whether the blocks of the scratch arena are backed by
+		 * (transparent) huge pages. Off by default. */
+		itkSetMacro(UseHugePages, bool);
+		itkGetConstMacro(UseHugePages, bool);
+		itkBooleanMacro(UseHugePages);
+		
+		/** Time spent in each stage of the last update, in seconds. The
+		 * stages of the oriented flux filter (see
+		 * FFTOrientedFluxMatrixImageFilter::GetStageTimes) and "measure" are
+		 * summed over the scales: when several scales run in parallel, they
+		 * add up to more than the elapsed time. "reduction" (the maximum over
+		 * the scales and the scale-space output) and "total" are wall-clock
+		 * times. */
+		typedef typename OrientedFluxFilterType::StageTimesType						StageTimesType;
+		const StageTimesType & GetStageTimes() const { return m_StageTimes; }
+		
 		/** This is overloaded to create the Scale and Hessian output images */
 		virtual DataObjectPointer MakeOutput(unsigned int idx);
 		
@@ -232,8 +318,18 @@ namespace itk
 		
 	private:
 		void UpdateMaximumResponse(double sigma, unsigned int scaleLevel);
+		
+		/** Maximum over one scale, with the outputs to update resolved at
+		 * compile time so that the loop over the voxels has no branch on the
+		 * flags. */
+		template <bool VScale, bool VScaleIndex, bool VHessian>
+		void ReduceScale(double sigma, unsigned int scaleLevel);
 		double ComputeSigmaValue(int scaleLevel);
 		
+		/** Eigen analysis of the oriented flux of one scale, written to the
+		 * scaleLevel layer of the (N+1)-D eigen system output. */
+		void ComputeEigenSystems(FFTOrientedFluxType * orientedFluxFilter, unsigned int scaleLevel);
+		
 		void AllocateUpdateBuffer();
 		
 		//purposely not implemented
@@ -251,12 +347,22 @@ namespace itk
 		typename UpdateBufferType::Pointer								m_UpdateBuffer;
 		
 		bool																							m_GenerateScaleOutput;
+		bool																							m_GenerateScaleIndexOutput;
 		bool																							m_GenerateHessianOutput;
 		bool																							m_GenerateNPlus1DHessianOutput;	
 		bool																							m_GenerateNPlus1DHessianMeasureOutput;
+		bool																							m_GenerateNPlus1DEigenSystemOutput;
 		
 		bool																							m_BrightObject;
+		bool																							m_UseComponentImages;
+		
+		unsigned int																			m_NumberOfParallelScales;
+		
+		bool																							m_UseScratchArena;
+		bool																							m_UseHugePages;
+		ScratchArena::Pointer															m_ScratchArena;
 		
+		StageTimesType																		m_StageTimes;
 	};
 	
 } // end namespace itk
@@ -31,8 +31,14 @@
 #include "itkMultiScaleOrientedFluxBasedMeasureFFTImageFilter.h"
 #include "itkImageRegionIterator.h"
 #include "itkImageRegionConstIterator.h"
+#include "itkMetricsRegistry.h"
+#include "itkTraceEventRecorder.h"
+#include "itkParallelFillBuffer.h"
+#include "itkSymmetricEigenAnalysis.h"
 #include "vnl/vnl_math.h"
 #include <omp.h>
+#include <sstream>
+#include <algorithm>
 
 namespace itk
 {
@@ -64,17 +70,26 @@ namespace itk
 		m_FixedSigmaForHessianImage = 1.0;
 		
 		m_BrightObject = true;
+		m_UseComponentImages = false;
+		m_NumberOfParallelScales = 0;
+		m_UseScratchArena = true;
+		m_UseHugePages = false;
+		m_ScratchArena = ScratchArena::New();
 		
 		m_GenerateScaleOutput = false;
+		m_GenerateScaleIndexOutput = false;
 		m_GenerateHessianOutput = false;
 		m_GenerateNPlus1DHessianOutput = false;
 		m_GenerateNPlus1DHessianMeasureOutput = false;
+		m_GenerateNPlus1DEigenSystemOutput = false;
 		
-		this->ProcessObject::SetNumberOfRequiredOutputs(5);
+		this->ProcessObject::SetNumberOfRequiredOutputs(7);
 		this->ProcessObject::SetNthOutput(1,this->MakeOutput(1));
 		this->ProcessObject::SetNthOutput(2,this->MakeOutput(2));
 		this->ProcessObject::SetNthOutput(3,this->MakeOutput(3));	
 		this->ProcessObject::SetNthOutput(4,this->MakeOutput(4));	
+		this->ProcessObject::SetNthOutput(5,this->MakeOutput(5));
+		this->ProcessObject::SetNthOutput(6,this->MakeOutput(6));
 	}
 	
 	/**
@@ -143,6 +158,10 @@ namespace itk
 		typename NPlus1DHessianImageType::Pointer  nPlus1DHessianPtr = 
 		dynamic_cast<NPlus1DHessianImageType*>(this->ProcessObject::GetOutput(4));
 		nPlus1DHessianPtr->SetRequestedRegionToLargestPossibleRegion();
+		
+		typename NPlus1DEigenSystemImageType::Pointer  nPlus1DEigenSystemPtr = 
+		dynamic_cast<NPlus1DEigenSystemImageType*>(this->ProcessObject::GetOutput(6));
+		nPlus1DEigenSystemPtr->SetRequestedRegionToLargestPossibleRegion();
 	}
 	
 	/**
@@ -175,6 +194,14 @@ namespace itk
 		{
 			return static_cast<DataObject*>(NPlus1DHessianImageType::New().GetPointer());
 		}	
+		else if (idx == 5)
+		{
+			return static_cast<DataObject*>(ScaleIndexImageType::New().GetPointer());
+		}
+		else if (idx == 6)
+		{
+			return static_cast<DataObject*>(NPlus1DEigenSystemImageType::New().GetPointer());
+		}
 		else // (idx == 0)
 		{
 			return static_cast<DataObject*>(OutputNDImageType::New().GetPointer());		
@@ -223,6 +250,11 @@ namespace itk
 					output->CopyInformation(input);
 				}
 			}
+			output = this->ProcessObject::GetOutput(5);
+			if( output )
+			{
+				output->CopyInformation(input);
+			}
 		}
 		
 		// Now, copy information for the (N+1)-D output image.
@@ -315,6 +347,18 @@ namespace itk
 			outputNPlus1DHessianPtr->SetDirection( outputDirection );
 			outputNPlus1DHessianPtr->SetNumberOfComponentsPerPixel( // propagate vector length info
 																														 inputPtr->GetNumberOfComponentsPerPixel());
+			
+			// And for the (N+1)-D eigen system image.
+			typename NPlus1DEigenSystemImageType::Pointer  outputNPlus1DEigenSystemPtr = 
+			dynamic_cast<NPlus1DEigenSystemImageType*>(this->ProcessObject::GetOutput(6));
+			if ( !outputNPlus1DEigenSystemPtr )
+			{
+				return;
+			}
+			outputNPlus1DEigenSystemPtr->SetLargestPossibleRegion( outputLargestPossibleRegion );
+			outputNPlus1DEigenSystemPtr->SetSpacing( outputSpacing );
+			outputNPlus1DEigenSystemPtr->SetOrigin( outputOrigin );
+			outputNPlus1DEigenSystemPtr->SetDirection( outputDirection );
 		}
 	}
 	
@@ -345,7 +389,9 @@ namespace itk
 		m_UpdateBuffer->SetBufferedRegion(output->GetBufferedRegion());
 		m_UpdateBuffer->Allocate();
 		
-		m_UpdateBuffer->FillBuffer( itk::NumericTraits< BufferValueType >::NonpositiveMin() );
+		// Filled by the chunks of ReduceScale(), see ParallelFillBuffer()
+		ParallelFillBuffer( m_UpdateBuffer.GetPointer(), itk::NumericTraits< BufferValueType >::NonpositiveMin(),
+											 this->GetNumberOfThreads() );
 	}
 	
 	/**
@@ -372,7 +418,23 @@ namespace itk
 			
 			scaleImage->SetBufferedRegion(scaleImage->GetRequestedRegion());
 			scaleImage->Allocate();
-			scaleImage->FillBuffer(0);
+			ParallelFillBuffer( scaleImage.GetPointer(), ScalePixelType(0), this->GetNumberOfThreads() );
+		}
+		
+		if (m_GenerateScaleIndexOutput)
+		{
+			if( m_NumberOfSigmaSteps > static_cast<unsigned int>( NumericTraits<ScaleIndexPixelType>::max() ) + 1 )
+			{
+				itkExceptionMacro(<< "The scale index output holds at most "
+													<< static_cast<unsigned int>( NumericTraits<ScaleIndexPixelType>::max() ) + 1
+													<< " scales, " << m_NumberOfSigmaSteps << " requested");
+			}
+			typename ScaleIndexImageType::Pointer scaleIndexImage = 
+			dynamic_cast<ScaleIndexImageType*>(this->ProcessObject::GetOutput(5));
+			
+			scaleIndexImage->SetBufferedRegion(scaleIndexImage->GetRequestedRegion());
+			scaleIndexImage->Allocate();
+			ParallelFillBuffer( scaleIndexImage.GetPointer(), ScaleIndexPixelType(0), this->GetNumberOfThreads() );
 		}
 		
 		if (m_GenerateHessianOutput)
@@ -385,7 +447,7 @@ namespace itk
 			// SymmetricSecondRankTensor is already filled with zero elements at construction. 
 			// No strict need of filling the buffer, but we do it explicitly here to make sure.
 			typename HessianImageType::PixelType zeroTensor(0.0);
-			hessianImage->FillBuffer(zeroTensor);
+			ParallelFillBuffer( hessianImage.GetPointer(), zeroTensor, this->GetNumberOfThreads() );
 		}
 		
 		if (m_GenerateNPlus1DHessianOutput)
@@ -405,6 +467,15 @@ namespace itk
 			outputNPlus1DImage->SetBufferedRegion(outputNPlus1DImage->GetRequestedRegion());
 			outputNPlus1DImage->Allocate();
 		}
+		
+		if( m_GenerateNPlus1DEigenSystemOutput )
+		{
+			typename NPlus1DEigenSystemImageType::Pointer nPlus1DEigenSystemImage = 
+			dynamic_cast<NPlus1DEigenSystemImageType*>(this->ProcessObject::GetOutput(6));
+			
+			nPlus1DEigenSystemImage->SetBufferedRegion(nPlus1DEigenSystemImage->GetRequestedRegion());
+			nPlus1DEigenSystemImage->Allocate();
+		}
 	}
 	
 	/**
@@ -420,6 +491,10 @@ namespace itk
 	<TInputImage,THessianImage,TScaleImage,THessianToMeasureFilter,TOutputNDImage>
 	::GenerateData()
 	{
+		itk::TimeProbe totalTime;
+		totalTime.Start();
+		m_StageTimes.clear();
+		
 		// Allocate outputs
 		AllocateOutputs();
 		// Allocate the buffer
@@ -427,63 +502,177 @@ namespace itk
 		
 		typename InputImageType::ConstPointer input = this->GetInput();
 		
-		std::cout << "sigma0 is :" << m_FixedSigmaForHessianImage << std::endl;
+		MetricsRegistry * metrics = MetricsRegistry::GetInstance();
+		metrics->SetGauge("oof.fixedSigma", m_FixedSigmaForHessianImage);
+		metrics->Increment("oof.scales", m_NumberOfSigmaSteps);
 		
 		m_OrientedFluxToMeasureFilterList.resize(m_NumberOfSigmaSteps);
 		
-#pragma omp parallel for schedule(dynamic)
+		// The Hessian outputs are copied from the tensor images
+		const bool useComponentImages = m_UseComponentImages && !m_GenerateHessianOutput && !m_GenerateNPlus1DHessianOutput;
+		
+		int numberOfParallelScales = omp_get_max_threads();
+		if( m_NumberOfParallelScales > 0 )
+		{
+			numberOfParallelScales = vnl_math_min( numberOfParallelScales, (int)m_NumberOfParallelScales );
+		}
+		
+		// Size the scratch arena once, from the largest scale which has the
+		// largest padding: each scale being processed borrows a block of the
+		// size of the spectrum for its padded input, then for its kernels,
+		// and blocks of the size of the input for its cropped components: one
+		// at a time when they are copied to the tensor output, all of them
+		// until the measure is computed when they are kept planar.
+		const SizeValueType scratchMissesBefore = m_ScratchArena->GetNumberOfMisses();
+		if( m_UseScratchArena && m_NumberOfSigmaSteps > 0 )
+		{
+			RealType largestSigma = m_Sigmas[0];
+			for(unsigned int i = 1; i < m_NumberOfSigmaSteps; i++)
+			{
+				largestSigma = vnl_math_max( largestSigma, m_Sigmas[i] );
+			}
+			typename FFTOrientedFluxType::Pointer largestScale = FFTOrientedFluxType::New();
+			largestScale->SetInput( input );
+			largestScale->SetRadius( vcl_sqrt( largestSigma * largestSigma + m_FixedSigmaForHessianImage * m_FixedSigmaForHessianImage ) );
+			const typename FFTOrientedFluxType::InputSizeType padSize = largestScale->GetPadSize();
+			SizeValueType spectrumPixels = padSize[0] / 2 + 1;
+			for(unsigned int d = 1; d < ImageDimension; d++)
+			{
+				spectrumPixels *= padSize[d];
+			}
+			const SizeValueType numberOfConcurrentScales = vnl_math_min( (unsigned int)numberOfParallelScales, m_NumberOfSigmaSteps );
+			m_ScratchArena->SetUseHugePages( m_UseHugePages );
+			m_ScratchArena->Reserve( numberOfConcurrentScales,
+															spectrumPixels * sizeof(typename FFTOrientedFluxType::InternalComplexType) );
+			const SizeValueType componentBlocksPerScale = useComponentImages ? FFTOrientedFluxType::NumberOfComponents : 1;
+			m_ScratchArena->Reserve( numberOfConcurrentScales * componentBlocksPerScale,
+															input->GetLargestPossibleRegion().GetNumberOfPixels() *
+															sizeof(typename FFTOrientedFluxType::InternalPrecision) );
+		}
+		
+#pragma omp parallel for schedule(dynamic) num_threads(numberOfParallelScales)
 		for (int i = 0; i < ((int)m_NumberOfSigmaSteps); i++)
 		{
+			// One track per thread of the scale loop on the timeline
+			TraceEventRecorder * recorder = TraceEventRecorder::GetInstance();
+			std::ostringstream scaleName;
+			scaleName << "scale " << m_Sigmas[i];
+			recorder->SetCurrentThreadName("OOF scale thread");
+			TraceEventRecorder::ScopedEvent scaleEvent(scaleName.str(), "oof");
+			
 			typename FFTOrientedFluxType::Pointer conv = FFTOrientedFluxType::New();
 			//conv->SetInput( threadInput );
 			conv->SetInput( input );
 			conv->SetSigma0( m_FixedSigmaForHessianImage );
 			conv->SetNumberOfThreads( this->GetNumberOfThreads() );
+			conv->SetGenerateComponentImages( useComponentImages );
+			if( m_UseScratchArena )
+			{
+				conv->SetScratchArena( m_ScratchArena );
+			}
 			/** TODO Feth: some justifications for themodified  scale */
 			conv->SetRadius( vcl_sqrt( m_Sigmas[i] * m_Sigmas[i] + m_FixedSigmaForHessianImage * m_FixedSigmaForHessianImage) );
 			itk::TimeProbe time;
 			time.Start();
 			conv->Update();
 			time.Stop();
-			
-#pragma omp critical
-			{
-				std::cout << "at scale :" << m_Sigmas[i] << std::endl;
-				std::cout << "elapsed time for computing the Oriented Flux matrix: " << time.GetMean() << " seconds" <<  std::endl;
-			}
+			metrics->AddTime("oof.orientedFlux", time.GetTotal());
 			
 			typename OrientedFluxToMeasureFilterType::Pointer orientedFluxToMeasureFilter = OrientedFluxToMeasureFilterType::New();
 			orientedFluxToMeasureFilter->SetBrightObject(m_BrightObject);
-			orientedFluxToMeasureFilter->SetInput( conv->GetOutput() );
+			if( useComponentImages )
+			{
+				for(unsigned int c = 0; c < FFTOrientedFluxType::NumberOfComponents; c++)
+				{
+					orientedFluxToMeasureFilter->SetComponentImage( c, conv->GetComponentImage( c ) );
+				}
+			}
+			else
+			{
+				orientedFluxToMeasureFilter->SetInput( conv->GetOutput() );
+			}
+			TraceTimeProbe measureTime("measure", "oof");
+			measureTime.Start();
 			orientedFluxToMeasureFilter->Update();
+			if( m_GenerateNPlus1DEigenSystemOutput )
+			{
+				this->ComputeEigenSystems( conv, i );
+			}
+			if( useComponentImages )
+			{
+				// The components are not read anymore: their blocks go back to
+				// the arena for the next scales
+				for(unsigned int c = 0; c < FFTOrientedFluxType::NumberOfComponents; c++)
+				{
+					orientedFluxToMeasureFilter->SetComponentImage( c, NULL );
+				}
+				conv->ReleaseComponentImages();
+			}
+			measureTime.Stop();
 			
 			m_OrientedFluxToMeasureFilterList[i] = orientedFluxToMeasureFilter;
+			
+#pragma omp critical
+			{
+				const typename OrientedFluxFilterType::StageTimesType & convStageTimes = conv->GetStageTimes();
+				for(typename StageTimesType::const_iterator st = convStageTimes.begin(); st != convStageTimes.end(); ++st)
+				{
+					m_StageTimes[st->first] += st->second;
+				}
+				m_StageTimes["measure"] += measureTime.GetTotal();
+			}
+			for(typename StageTimesType::const_iterator st = conv->GetStageTimes().begin(); st != conv->GetStageTimes().end(); ++st)
+			{
+				metrics->AddTime("oof." + st->first, st->second);
+			}
+			metrics->AddTime("oof.measure", measureTime.GetTotal());
 		}
 		
+		if( m_UseScratchArena )
+		{
+			metrics->UpdateGaugeMaximum("oof.scratchBytes", m_ScratchArena->GetCapacity());
+			metrics->Increment("oof.scratchMisses", m_ScratchArena->GetNumberOfMisses() - scratchMissesBefore);
+			// No image of the scales uses the blocks anymore: the measure
+			// filters were disconnected from the components
+			m_ScratchArena->Clear();
+		}
 		
+		TraceTimeProbe reductionTime("reduction", "oof");
+		reductionTime.Start();
 		for(unsigned int i = 0; i < m_NumberOfSigmaSteps; i++) 
 		{
 			this->UpdateMaximumResponse(m_Sigmas[i], i);
 		}
 		// Write out the best response to the output image
 		// we can assume that the meta-data should match between these two
-		// images, therefore we iterate over the desired output region
+		// images, therefore we copy the desired output region, by the chunks
+		// of ReduceScale(): this is the first touch of the output.
 		OutputNDRegionType outputRegion = this->GetOutput()->GetBufferedRegion();
-		ImageRegionIterator<UpdateBufferType> it( m_UpdateBuffer, outputRegion );
-		it.GoToBegin();
+		const SizeValueType numberOfPixels = outputRegion.GetNumberOfPixels();
+		const BufferValueType * best = m_UpdateBuffer->GetBufferPointer() + m_UpdateBuffer->ComputeOffset( outputRegion.GetIndex() );
+		OutputNDPixelType * output = this->GetOutput()->GetBufferPointer();
+		const int numberOfChunks = GetNumberOfParallelChunks( numberOfPixels, this->GetNumberOfThreads() );
 		
-		ImageRegionIterator<TOutputNDImage> oit( this->GetOutput(), outputRegion );
-		oit.GoToBegin();
-		
-		while(!oit.IsAtEnd())
+#pragma omp parallel for schedule(static) num_threads(numberOfChunks)
+		for(int chunk = 0; chunk < numberOfChunks; chunk++)
 		{
-			oit.Value() = static_cast< OutputNDPixelType >( it.Get() );
-			++oit;
-			++it;
+			SizeValueType begin, end;
+			GetParallelChunk( numberOfPixels, numberOfChunks, chunk, begin, end );
+			for(SizeValueType i = begin; i < end; i++)
+			{
+				output[i] = static_cast< OutputNDPixelType >( best[i] );
+			}
 		}
 		
 		// Release data from the update buffer.
 		m_UpdateBuffer->ReleaseData();
+		reductionTime.Stop();
+		m_StageTimes["reduction"] = reductionTime.GetTotal();
+		
+		totalTime.Stop();
+		m_StageTimes["total"] = totalTime.GetTotal();
+		metrics->AddTime("oof.reduction", reductionTime.GetTotal());
+		metrics->AddTime("oof.total", totalTime.GetTotal());
 	}
 	
 	
@@ -500,112 +689,246 @@ namespace itk
 	<TInputImage,THessianImage,TScaleImage,THessianToMeasureFilter,TOutputNDImage>
 	::UpdateMaximumResponse(double sigma, unsigned int scaleLevel)
 	{
-		// the meta-data should match between these images, therefore we
-		// iterate over the desired output region 
-		OutputNDRegionType outputRegion = this->GetOutput()->GetBufferedRegion();
-		ImageRegionIterator<UpdateBufferType> oit( m_UpdateBuffer, outputRegion );
-		
-		typename ScaleImageType::Pointer scaleImage = static_cast<ScaleImageType*>(this->ProcessObject::GetOutput(1));
-		ImageRegionIterator<ScaleImageType> osit;
-		
-		typename HessianImageType::Pointer hessianImage = static_cast<HessianImageType*>(this->ProcessObject::GetOutput(2));
-		ImageRegionIterator<HessianImageType> ohit;
+		// One instantiation of the loop per combination of the N-D outputs
+		switch( (m_GenerateScaleOutput ? 1 : 0) | (m_GenerateScaleIndexOutput ? 2 : 0) | (m_GenerateHessianOutput ? 4 : 0) )
+		{
+			case 0: ReduceScale<false, false, false>(sigma, scaleLevel); break;
+			case 1: ReduceScale<true,  false, false>(sigma, scaleLevel); break;
+			case 2: ReduceScale<false, true,  false>(sigma, scaleLevel); break;
+			case 3: ReduceScale<true,  true,  false>(sigma, scaleLevel); break;
+			case 4: ReduceScale<false, false, true >(sigma, scaleLevel); break;
+			case 5: ReduceScale<true,  false, true >(sigma, scaleLevel); break;
+			case 6: ReduceScale<false, true,  true >(sigma, scaleLevel); break;
+			default: ReduceScale<true,  true,  true >(sigma, scaleLevel); break;
+		}
 		
-		typename OutputNPlus1DImageType::Pointer outputNPlus1DImage = 
-		static_cast<OutputNPlus1DImageType*>(this->ProcessObject::GetOutput(3));
-		ImageRegionIterator<OutputNPlus1DImageType> o2it;
+		m_OrientedFluxToMeasureFilterList[scaleLevel] = NULL;
+	}
+	
+	/**
+	 * ReduceScale
+	 */
+	template <typename TInputImage,
+	typename THessianImage,
+	typename TScaleImage,
+	typename THessianToMeasureFilter,
+	typename TOutputNDImage>
+	template <bool VScale, bool VScaleIndex, bool VHessian>
+	void
+	MultiScaleOrientedFluxBasedMeasureFFTImageFilter
+	<TInputImage,THessianImage,TScaleImage,THessianToMeasureFilter,TOutputNDImage>
+	::ReduceScale(double sigma, unsigned int scaleLevel)
+	{
+		typedef typename OrientedFluxToMeasureFilterType::OutputImageType OrientedFluxToMeasureOutputImageType;
+		typedef typename OrientedFluxToMeasureOutputImageType::PixelType	MeasurePixelType;
+		typedef typename HessianImageType::PixelType											HessianPixelType;
 		
-		typename NPlus1DHessianImageType::Pointer nPlus1DHessianImage = 
-		static_cast<NPlus1DHessianImageType*>(this->ProcessObject::GetOutput(4));
-		ImageRegionIterator<NPlus1DHessianImageType> o3it;	
+		// The meta-data match between these images and all of them are
+		// buffered over the output region, so that the voxels are walked
+		// with plain pointers to their first voxel in the region.
+		OutputNDRegionType outputRegion = this->GetOutput()->GetBufferedRegion();
+		const typename OutputNDRegionType::IndexType & outputIndex = outputRegion.GetIndex();
+		const SizeValueType numberOfPixels = outputRegion.GetNumberOfPixels();
 		
-		oit.GoToBegin();
-		if( m_GenerateScaleOutput )
+		const OrientedFluxToMeasureOutputImageType * measureImage = m_OrientedFluxToMeasureFilterList[scaleLevel]->GetOutput();
+		if( measureImage->GetBufferedRegion() != outputRegion )
 		{
-			osit = ImageRegionIterator<ScaleImageType> ( scaleImage, outputRegion );
-			osit.GoToBegin();
+			itkExceptionMacro(<< "The measure of scale " << scaleLevel << " is not buffered over the output region "
+												<< outputRegion);
 		}
-		if( m_GenerateHessianOutput )
+		const MeasurePixelType * measure = measureImage->GetBufferPointer() + measureImage->ComputeOffset( outputIndex );
+		
+		// The oriented flux tensors are only read for the Hessian outputs; the
+		// measure may have been computed from the component images.
+		const HessianPixelType * orientedFlux = 0;
+		if( VHessian || m_GenerateNPlus1DHessianOutput )
 		{
-			ohit = ImageRegionIterator<HessianImageType> ( hessianImage, outputRegion );
-			ohit.GoToBegin();
+			const HessianImageType * orientedFluxImage = m_OrientedFluxToMeasureFilterList[scaleLevel]->GetInput();
+			if( !orientedFluxImage || orientedFluxImage->GetBufferedRegion() != outputRegion )
+			{
+				itkExceptionMacro(<< "The oriented flux of scale " << scaleLevel << " is not buffered over the output region "
+													<< outputRegion);
+			}
+			orientedFlux = orientedFluxImage->GetBufferPointer() + orientedFluxImage->ComputeOffset( outputIndex );
 		}
+		BufferValueType * best = m_UpdateBuffer->GetBufferPointer() + m_UpdateBuffer->ComputeOffset( outputIndex );
 		
-		// Create an iterator for the given sigma layer of the (N+1)-D image.
-		OutputNPlus1DRegionType outputNPlus1DRegion;
-		if( m_GenerateNPlus1DHessianMeasureOutput || m_GenerateNPlus1DHessianOutput )
+		ScalePixelType * scale = 0;
+		if( VScale )
 		{
-			this->CallCopyInputRegionToOutputRegion(outputNPlus1DRegion, outputRegion);
-			typename OutputNPlus1DImageType::IndexType outputNPlus1DRegionIndex = outputNPlus1DRegion.GetIndex();
-			typename OutputNPlus1DImageType::SizeType outputNPlus1DRegionSize = outputNPlus1DRegion.GetSize();
-			outputNPlus1DRegionIndex[OutputNPlus1DImageType::ImageDimension-1] = scaleLevel;
-			outputNPlus1DRegionSize[OutputNPlus1DImageType::ImageDimension-1] = 1;
-			outputNPlus1DRegion.SetIndex( outputNPlus1DRegionIndex );
-			outputNPlus1DRegion.SetSize( outputNPlus1DRegionSize );
+			ScaleImageType * scaleImage = static_cast<ScaleImageType*>(this->ProcessObject::GetOutput(1));
+			scale = scaleImage->GetBufferPointer() + scaleImage->ComputeOffset( outputIndex );
 		}
-		
-		if( m_GenerateNPlus1DHessianMeasureOutput )
+		ScaleIndexPixelType * scaleIndex = 0;
+		if( VScaleIndex )
 		{
-			o2it = ImageRegionIterator<OutputNPlus1DImageType> ( outputNPlus1DImage, outputNPlus1DRegion );
-			o2it.GoToBegin();
+			ScaleIndexImageType * scaleIndexImage = static_cast<ScaleIndexImageType*>(this->ProcessObject::GetOutput(5));
+			scaleIndex = scaleIndexImage->GetBufferPointer() + scaleIndexImage->ComputeOffset( outputIndex );
 		}
-		
-		if( m_GenerateNPlus1DHessianOutput )
+		HessianPixelType * hessian = 0;
+		if( VHessian )
 		{
-			o3it = ImageRegionIterator<NPlus1DHessianImageType> ( nPlus1DHessianImage, outputNPlus1DRegion );
-			o3it.GoToBegin();
+			HessianImageType * hessianImage = static_cast<HessianImageType*>(this->ProcessObject::GetOutput(2));
+			hessian = hessianImage->GetBufferPointer() + hessianImage->ComputeOffset( outputIndex );
 		}
 		
+		// The sigma layer of the (N+1)-D images is contiguous, it starts at
+		// the first voxel of the output region in that layer.
+		typename OutputNPlus1DImageType::PixelType * nPlus1DMeasure = 0;
+		typename NPlus1DHessianImageType::PixelType * nPlus1DHessian = 0;
+		if( m_GenerateNPlus1DHessianMeasureOutput || m_GenerateNPlus1DHessianOutput )
+		{
+			OutputNPlus1DRegionType outputNPlus1DRegion;
+			this->CallCopyInputRegionToOutputRegion(outputNPlus1DRegion, outputRegion);
+			typename OutputNPlus1DImageType::IndexType outputNPlus1DIndex = outputNPlus1DRegion.GetIndex();
+			outputNPlus1DIndex[OutputNPlus1DImageType::ImageDimension-1] = scaleLevel;
+			
+			if( m_GenerateNPlus1DHessianMeasureOutput )
+			{
+				OutputNPlus1DImageType * outputNPlus1DImage = 
+				static_cast<OutputNPlus1DImageType*>(this->ProcessObject::GetOutput(3));
+				nPlus1DMeasure = outputNPlus1DImage->GetBufferPointer() + outputNPlus1DImage->ComputeOffset( outputNPlus1DIndex );
+			}
+			if( m_GenerateNPlus1DHessianOutput )
+			{
+				NPlus1DHessianImageType * nPlus1DHessianImage = 
+				static_cast<NPlus1DHessianImageType*>(this->ProcessObject::GetOutput(4));
+				nPlus1DHessian = nPlus1DHessianImage->GetBufferPointer() + nPlus1DHessianImage->ComputeOffset( outputNPlus1DIndex );
+			}
+		}
 		
-		typedef typename OrientedFluxToMeasureFilterType::OutputImageType OrientedFluxToMeasureOutputImageType;
-		
-		ImageRegionIterator<OrientedFluxToMeasureOutputImageType> it( m_OrientedFluxToMeasureFilterList[scaleLevel]->GetOutput(), outputRegion );
-		ImageRegionConstIterator<HessianImageType> hit( m_OrientedFluxToMeasureFilterList[scaleLevel]->GetInput(), outputRegion );
+		const ScalePixelType scaleValue = static_cast< ScalePixelType >( sigma );
+		const ScaleIndexPixelType scaleIndexValue = static_cast< ScaleIndexPixelType >( scaleLevel );
 		
-		it.GoToBegin();
-		hit.GoToBegin();
+		// Contiguous chunks of voxels, one per thread: the loops over a chunk
+		// are branch-free selects (but for the tensor copy) that the compiler
+		// can vectorize.
+		const int numberOfChunks = GetNumberOfParallelChunks( numberOfPixels, this->GetNumberOfThreads() );
 		
-		while(!oit.IsAtEnd())
+#pragma omp parallel for schedule(static) num_threads(numberOfChunks)
+		for(int chunk = 0; chunk < numberOfChunks; chunk++)
 		{
-			if( oit.Value() < it.Value() )
+			SizeValueType begin, end;
+			GetParallelChunk( numberOfPixels, numberOfChunks, chunk, begin, end );
+			
+			for(SizeValueType i = begin; i < end; i++)
 			{
-				oit.Value() = it.Value();
-				if( m_GenerateScaleOutput )
+				const BufferValueType response = static_cast< BufferValueType >( measure[i] );
+				const bool better = best[i] < response;
+				best[i] = better ? response : best[i];
+				if( VScale )
 				{
-					osit.Value() = static_cast< ScalePixelType >( sigma );
+					scale[i] = better ? scaleValue : scale[i];
 				}
-				if( m_GenerateHessianOutput )
+				if( VScaleIndex )
 				{
-					ohit.Value() = hit.Value();
+					scaleIndex[i] = better ? scaleIndexValue : scaleIndex[i];
+				}
+				if( VHessian && better )
+				{
+					hessian[i] = orientedFlux[i];
 				}
 			}
-			if( m_GenerateNPlus1DHessianMeasureOutput )
+			if( nPlus1DMeasure )
 			{
-				o2it.Value() = it.Value();
-				++o2it;
+				for(SizeValueType i = begin; i < end; i++)
+				{
+					nPlus1DMeasure[i] = static_cast< typename OutputNPlus1DImageType::PixelType >( measure[i] );
+				}
 			}
-			if( m_GenerateNPlus1DHessianOutput )
+			if( nPlus1DHessian )
 			{
-				o3it.Value() = hit.Value();
-				++o3it;
+				std::copy( orientedFlux + begin, orientedFlux + end, nPlus1DHessian + begin );
 			}
-			++oit;
-			++it;
-			if( m_GenerateScaleOutput )
+		}
+	}
+	
+	/**
+	 * ComputeEigenSystems
+	 */
+	template <typename TInputImage,
+	typename THessianImage,
+	typename TScaleImage,
+	typename THessianToMeasureFilter,
+	typename TOutputNDImage>
+	void
+	MultiScaleOrientedFluxBasedMeasureFFTImageFilter
+	<TInputImage,THessianImage,TScaleImage,THessianToMeasureFilter,TOutputNDImage>
+	::ComputeEigenSystems(FFTOrientedFluxType * orientedFluxFilter, unsigned int scaleLevel)
+	{
+		typedef typename HessianImageType::PixelType											HessianPixelType;
+		typedef typename FFTOrientedFluxType::ComponentImageType					ComponentImageType;
+		typedef Matrix<double, ImageDimension, ImageDimension>						MatrixType;
+		typedef FixedArray<double, ImageDimension>												EigenValuesArrayType;
+		typedef SymmetricEigenAnalysis<MatrixType, EigenValuesArrayType, MatrixType>	EigenAnalysisType;
+		
+		OutputNDRegionType outputRegion = this->GetOutput()->GetBufferedRegion();
+		const typename OutputNDRegionType::IndexType & outputIndex = outputRegion.GetIndex();
+		const SizeValueType numberOfPixels = outputRegion.GetNumberOfPixels();
+		
+		// The oriented flux is read either from the planar components or from
+		// the tensor image, both buffered over the output region.
+		const unsigned int numberOfComponents = FFTOrientedFluxType::NumberOfComponents;
+		const float * components[FFTOrientedFluxType::NumberOfComponents];
+		const HessianPixelType * tensors = 0;
+		if( orientedFluxFilter->GetGenerateComponentImages() )
+		{
+			for(unsigned int c = 0; c < numberOfComponents; c++)
 			{
-				++osit;
+				const ComponentImageType * componentImage = orientedFluxFilter->GetComponentImage( c );
+				if( componentImage->GetBufferedRegion() != outputRegion )
+				{
+					itkExceptionMacro(<< "The oriented flux of scale " << scaleLevel << " is not buffered over the output region "
+														<< outputRegion);
+				}
+				components[c] = componentImage->GetBufferPointer() + componentImage->ComputeOffset( outputIndex );
 			}
-			if( m_GenerateHessianOutput )
+		}
+		else
+		{
+			const HessianImageType * tensorImage = orientedFluxFilter->GetOutput();
+			if( tensorImage->GetBufferedRegion() != outputRegion )
 			{
-				++ohit;
+				itkExceptionMacro(<< "The oriented flux of scale " << scaleLevel << " is not buffered over the output region "
+													<< outputRegion);
 			}
-			if( m_GenerateHessianOutput || m_GenerateNPlus1DHessianOutput )
+			tensors = tensorImage->GetBufferPointer() + tensorImage->ComputeOffset( outputIndex );
+		}
+		
+		// The sigma layer of the (N+1)-D image is contiguous
+		NPlus1DEigenSystemImageType * eigenSystemImage = 
+		static_cast<NPlus1DEigenSystemImageType*>(this->ProcessObject::GetOutput(6));
+		OutputNPlus1DRegionType outputNPlus1DRegion;
+		this->CallCopyInputRegionToOutputRegion(outputNPlus1DRegion, outputRegion);
+		typename OutputNPlus1DImageType::IndexType outputNPlus1DIndex = outputNPlus1DRegion.GetIndex();
+		outputNPlus1DIndex[OutputNPlus1DImageType::ImageDimension-1] = scaleLevel;
+		EigenSystemPixelType * eigenSystems = eigenSystemImage->GetBufferPointer() + eigenSystemImage->ComputeOffset( outputNPlus1DIndex );
+		
+		// The eigenvalues are in ascending order, as in the measure filters:
+		// the cross section of a bright tube has the smallest ones, so that
+		// its direction is the eigenvector of the largest, and conversely.
+		const unsigned int axis = m_BrightObject ? ImageDimension - 1 : 0;
+		EigenAnalysisType eigenAnalysis( ImageDimension );
+		MatrixType matrix;
+		EigenValuesArrayType eigenValues;
+		MatrixType eigenVectors;
+		for(SizeValueType k = 0; k < numberOfPixels; k++)
+		{
+			unsigned int element = 0;
+			for(unsigned int i = 0; i < ImageDimension; i++)
 			{
-				++hit;
+				for(unsigned int j = i; j < ImageDimension; j++)
+				{
+					double value = tensors ? tensors[k][element] : components[element][k];
+					matrix(i, j) = value;
+					matrix(j, i) = value;
+					element++;
+				}
 			}
+			eigenAnalysis.ComputeEigenValuesAndVectors( matrix, eigenValues, eigenVectors );
+			eigenSystems[k].SetEigenValues( eigenValues );
+			eigenSystems[k].SetDirection( eigenVectors[axis] );
 		}
-		
-		m_OrientedFluxToMeasureFilterList[scaleLevel] = NULL;
 	}
 	
 	template <typename TInputImage,
@@ -641,6 +964,20 @@ namespace itk
 		return static_cast<OutputNPlus1DImageType*>(this->ProcessObject::GetOutput(3));
 	}
 	
+	template <typename TInputImage,
+	typename THessianImage,
+	typename TScaleImage,
+	typename THessianToMeasureFilter,
+	typename TOutputNDImage>
+	typename MultiScaleOrientedFluxBasedMeasureFFTImageFilter
+	<TInputImage,THessianImage,TScaleImage,THessianToMeasureFilter,TOutputNDImage>::NPlus1DEigenSystemImageType * 
+	MultiScaleOrientedFluxBasedMeasureFFTImageFilter
+	<TInputImage,THessianImage,TScaleImage,THessianToMeasureFilter,TOutputNDImage>
+	::GetNPlus1DEigenSystemOutput()
+	{
+		return static_cast<NPlus1DEigenSystemImageType*>(this->ProcessObject::GetOutput(6));
+	}
+	
 	template <typename TInputImage,
 	typename THessianImage,
 	typename TScaleImage,
@@ -683,6 +1020,20 @@ namespace itk
 		return static_cast<const ScaleImageType*>(this->ProcessObject::GetOutput(1));
 	}
 	
+	template <typename TInputImage,
+	typename THessianImage,
+	typename TScaleImage,
+	typename THessianToMeasureFilter,
+	typename TOutputNDImage>
+	typename MultiScaleOrientedFluxBasedMeasureFFTImageFilter
+	<TInputImage,THessianImage,TScaleImage,THessianToMeasureFilter,TOutputNDImage>::ScaleIndexImageType * 
+	MultiScaleOrientedFluxBasedMeasureFFTImageFilter
+	<TInputImage,THessianImage,TScaleImage,THessianToMeasureFilter,TOutputNDImage>
+	::GetScaleIndexOutput()
+	{
+		return static_cast<ScaleIndexImageType*>(this->ProcessObject::GetOutput(5));
+	}
+	
 	template <typename TInputImage,
 	typename THessianImage,
 	typename TScaleImage,
@@ -699,10 +1050,16 @@ namespace itk
 		os << indent << "SigmaMaximum:  " << m_SigmaMaximum  << std::endl;
 		os << indent << "NumberOfSigmaSteps:  " << m_NumberOfSigmaSteps  << std::endl;
 		os << indent << "BrightObject: " << m_BrightObject << std::endl;
+		os << indent << "UseComponentImages: " << m_UseComponentImages << std::endl;
 		os << indent << "GenerateScaleOutput: " << m_GenerateScaleOutput << std::endl;
+		os << indent << "GenerateScaleIndexOutput: " << m_GenerateScaleIndexOutput << std::endl;
 		os << indent << "GenerateHessianOutput: " << m_GenerateHessianOutput << std::endl;
 		os << indent << "GenerateNPlus1DHessianMeasureOutput: " << m_GenerateNPlus1DHessianMeasureOutput << std::endl;
 		os << indent << "GenerateNPlus1DHessianOutput: " << m_GenerateNPlus1DHessianOutput << std::endl;
+		os << indent << "GenerateNPlus1DEigenSystemOutput: " << m_GenerateNPlus1DEigenSystemOutput << std::endl;
+		os << indent << "NumberOfParallelScales: " << m_NumberOfParallelScales << std::endl;
+		os << indent << "UseScratchArena: " << m_UseScratchArena << std::endl;
+		os << indent << "UseHugePages: " << m_UseHugePages << std::endl;
 	}
 	
 	
@@ -30,6 +30,10 @@ namespace itk
 	 * of the 2 first eigenvalues.
 	 * PixelType of the input image is supposed to be SymmetricSecondRankTensor
 	 *
+	 * Instead of the tensor image, the filter can take the planar images of
+	 * the tensor components (see SetComponentImage), which it reads with
+	 * unit stride along the lines of the output.
+	 *
 	 * \author : Fethallah Benmansour
 	 */
 	template <typename TInputImage, 
@@ -85,6 +89,20 @@ namespace itk
 		void SetBrightObject( bool bIsBrightObject );
 		bool GetBrightObject() const;
 		
+		/** Planar image of one component of the oriented flux tensor, as given
+		 * by FFTOrientedFluxMatrixImageFilter::GetComponentImage. */
+		typedef Image< float, itkGetStaticConstMacro(ImageDimension) >	ComponentImageType;
+		itkStaticConstMacro(NumberOfComponents, unsigned int, ImageDimension * (ImageDimension + 1) / 2);
+		
+		/** Set/Get the image of one tensor component, in the storage order of
+		 * SymmetricSecondRankTensor. Once all the components are set, they are
+		 * used instead of the tensor input, which may then be left unset. */
+		void SetComponentImage( unsigned int element, const ComponentImageType * image );
+		const ComponentImageType * GetComponentImage( unsigned int element ) const;
+		
+		/** Whether the measure is computed from the component images. */
+		bool GetUseComponentImages() const;
+		
 		/** OrientedFluxCrossSectionTraceMeasureFilter needs all of the input to produce an
 		 * output. Therefore, OrientedFluxCrossSectionTraceMeasureFilter needs to provide
 		 * an implementation for GenerateInputRequestedRegion in order to inform
@@ -98,6 +116,10 @@ namespace itk
 		virtual ~OrientedFluxCrossSectionTraceMeasureFilter() {};
 		void PrintSelf(std::ostream& os, Indent indent) const;
 		
+		/** Take the output information from the component images when they
+		 * are used. */
+		void GenerateOutputInformation();
+		
 		/** Before Threaded Generate Data */
 		//void BeforeThreadedGenerateData( );
 		
@@ -19,6 +19,8 @@
 #define __itkOrientedFluxCrossSectionTraceMeasureFilter_txx
 
 #include "itkOrientedFluxCrossSectionTraceMeasure.h"
+#include "itkTraceEventRecorder.h"
+#include "itkImageLinearIteratorWithIndex.h"
 
 namespace itk
 {
@@ -30,6 +32,8 @@ namespace itk
 	::OrientedFluxCrossSectionTraceMeasureFilter()
 	{
 		m_IsBright = true;
+		// The tensor input is not required when the component images are given
+		this->SetNumberOfRequiredInputs( 0 );
 	}
 	
 	/**
@@ -56,6 +60,76 @@ namespace itk
 		return m_IsBright;
 	}
 	
+	/**
+	 * Set Component Image
+	 */
+	template <typename TInputImage, typename TOutputImage>
+	void
+	OrientedFluxCrossSectionTraceMeasureFilter<TInputImage,TOutputImage>
+	::SetComponentImage( unsigned int element, const ComponentImageType * image )
+	{
+		if( element >= NumberOfComponents )
+		{
+			itkExceptionMacro( "Component " << element << " out of range, the tensor has "
+												 << NumberOfComponents << " components" );
+		}
+		// The components are the inputs following the tensor input
+		this->ProcessObject::SetNthInput( 1 + element, const_cast< ComponentImageType * >( image ) );
+	}
+	
+	/**
+	 * Get Component Image
+	 */
+	template <typename TInputImage, typename TOutputImage>
+	const typename OrientedFluxCrossSectionTraceMeasureFilter<TInputImage,TOutputImage>::ComponentImageType *
+	OrientedFluxCrossSectionTraceMeasureFilter<TInputImage,TOutputImage>
+	::GetComponentImage( unsigned int element ) const
+	{
+		if( 1 + element >= this->GetNumberOfInputs() )
+		{
+			return NULL;
+		}
+		return static_cast< const ComponentImageType * >( this->ProcessObject::GetInput( 1 + element ) );
+	}
+	
+	/**
+	 * Get Use Component Images
+	 */
+	template <typename TInputImage, typename TOutputImage>
+	bool
+	OrientedFluxCrossSectionTraceMeasureFilter<TInputImage,TOutputImage>
+	::GetUseComponentImages( ) const
+	{
+		for(unsigned int element = 0; element < NumberOfComponents; element++)
+		{
+			if( !this->GetComponentImage( element ) )
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+	
+	//
+	//
+	//
+	template <typename TInputImage, typename TOutputImage>
+	void
+	OrientedFluxCrossSectionTraceMeasureFilter<TInputImage,TOutputImage>
+	::GenerateOutputInformation()
+	{
+		if( this->GetUseComponentImages() )
+		{
+			this->GetOutput()->CopyInformation( this->GetComponentImage( 0 ) );
+			return;
+		}
+		if( !this->GetInput() )
+		{
+			itkExceptionMacro( "Input image or component images must be provided" );
+		}
+		Superclass::GenerateOutputInformation();
+	}
+	
 	//
 	//
 	//
@@ -99,6 +173,13 @@ namespace itk
 	OrientedFluxCrossSectionTraceMeasureFilter<TInputImage,TOutputImage>
 	::BeforeThreadedGenerateData( )
 	{
+		// The eigenvalues are computed on the fly from the component images
+		if( this->GetUseComponentImages() )
+		{
+			m_eigenAnalysisFilter = NULL;
+			return;
+		}
+		
 		//Get Input and Output
 		InputImageConstPointer input  = this->GetInput();
 		
@@ -129,10 +210,61 @@ namespace itk
 	::ThreadedGenerateData( const OutputImageRegionType& outputRegionForThread,
 												 ThreadIdType threadId)
 	{
+		TraceEventRecorder::ScopedEvent threadEvent("crossSectionTrace", "measure");
 		
 		// support progress methods/callbacks
 		ProgressReporter progress(this, threadId, outputRegionForThread.GetNumberOfPixels());
 		
+		if( this->GetUseComponentImages() )
+		{
+			// Gather the tensor of each voxel from the planar components, read
+			// line by line along X, and sum the eigenvalues of the cross
+			// section as below.
+			const SizeValueType lineLength = outputRegionForThread.GetSize()[0];
+			PixelType tensor;
+			typename PixelType::EigenValuesArrayType eigenValues;
+			
+			typedef ImageLinearIteratorWithIndex< OutputImageType > LineIteratorType;
+			LineIteratorType lit( this->GetOutput(), outputRegionForThread );
+			lit.SetDirection( 0 );
+			for(lit.GoToBegin(); !lit.IsAtEnd(); lit.NextLine())
+			{
+				const typename OutputImageType::IndexType index = lit.GetIndex();
+				const float * components[NumberOfComponents];
+				for(unsigned int c = 0; c < NumberOfComponents; c++)
+				{
+					const ComponentImageType * componentImage = this->GetComponentImage( c );
+					components[c] = componentImage->GetBufferPointer() + componentImage->ComputeOffset( index );
+				}
+				OutputPixelType * out = &( lit.Value() );
+				for(SizeValueType k = 0; k < lineLength; k++)
+				{
+					for(unsigned int c = 0; c < NumberOfComponents; c++)
+					{
+						tensor[c] = components[c][k];
+					}
+					tensor.ComputeEigenValues( eigenValues );
+					RealType value = 0.0;
+					if (m_IsBright) 
+					{
+						for (unsigned int i = 0; i < ImageDimension-1; i++) 
+						{
+							value -= eigenValues[i];
+						}
+					}
+					else
+					{
+						for (unsigned int i = 1; i < ImageDimension; i++) 
+						{
+							value += eigenValues[i];
+						}
+					}
+					out[k] = static_cast< OutputPixelType >( value );
+					progress.CompletedPixel();
+				}
+			}
+			return;
+		}
 		
 		ImageRegionIterator<OutputImageType>				 outputIt;
 		typedef ImageRegionConstIterator< EigenValueImageType> EigenValueIteratorType;
@@ -179,6 +311,7 @@ namespace itk
 		Superclass::PrintSelf(os,indent);
 		os << indent << "is Bright: " << std::endl
 		<< this->m_IsBright << std::endl;
+		os << indent << "UseComponentImages: " << this->GetUseComponentImages() << std::endl;
 	}
 	
 	
@@ -27,6 +27,10 @@ namespace itk
 	 * \brief This filter takes as input the oriented flux response of an image
 	 * and computes the trace.
 	 * PixelType of the input image is supposed to be SymmetricSecondRankTensor
+	 *
+	 * Instead of the tensor image, the filter can take the planar images of
+	 * the tensor components (see SetComponentImage), which it reads with
+	 * unit stride along the lines of the output.
 	 * TODO: give this filter a more generic name, 
 	 * since this filter is doing nothing but computing traces
 	 *
@@ -77,6 +81,20 @@ namespace itk
 		void SetBrightObject( bool bIsBrightObject );
 		bool GetBrightObject() const;
 		
+		/** Planar image of one component of the oriented flux tensor, as given
+		 * by FFTOrientedFluxMatrixImageFilter::GetComponentImage. */
+		typedef Image< float, itkGetStaticConstMacro(ImageDimension) >	ComponentImageType;
+		itkStaticConstMacro(NumberOfComponents, unsigned int, ImageDimension * (ImageDimension + 1) / 2);
+		
+		/** Set/Get the image of one tensor component, in the storage order of
+		 * SymmetricSecondRankTensor. Once all the components are set, they are
+		 * used instead of the tensor input, which may then be left unset. */
+		void SetComponentImage( unsigned int element, const ComponentImageType * image );
+		const ComponentImageType * GetComponentImage( unsigned int element ) const;
+		
+		/** Whether the measure is computed from the component images. */
+		bool GetUseComponentImages() const;
+		
 		/** OrientedFluxTraceMeasureFilter needs all of the input to produce an
 		 * output. Therefore, OrientedFluxTraceMeasureFilter needs to provide
 		 * an implementation for GenerateInputRequestedRegion in order to inform
@@ -90,6 +108,10 @@ namespace itk
 		virtual ~OrientedFluxTraceMeasureFilter() {};
 		void PrintSelf(std::ostream& os, Indent indent) const;
 		
+		/** Take the output information from the component images when they
+		 * are used. */
+		void GenerateOutputInformation();
+		
 		/** Before Threaded Generate Data */
 		//void BeforeThreadedGenerateData( );
 		
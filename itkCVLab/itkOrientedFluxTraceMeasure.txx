@@ -19,6 +19,8 @@
 #define __itkOrientedFluxTraceMeasureFilter_txx
 
 #include "itkOrientedFluxTraceMeasure.h"
+#include "itkTraceEventRecorder.h"
+#include "itkImageLinearIteratorWithIndex.h"
 
 namespace itk
 {
@@ -32,6 +34,8 @@ namespace itk
 	::OrientedFluxTraceMeasureFilter()
 	{
 		m_IsBright = true;
+		// The tensor input is not required when the component images are given
+		this->SetNumberOfRequiredInputs( 0 );
 	}
 	
 	/**
@@ -58,6 +62,76 @@ namespace itk
 		return m_IsBright;
 	}
 	
+	/**
+	 * Set Component Image
+	 */
+	template <typename TInputImage, typename TOutputImage>
+	void
+	OrientedFluxTraceMeasureFilter<TInputImage,TOutputImage>
+	::SetComponentImage( unsigned int element, const ComponentImageType * image )
+	{
+		if( element >= NumberOfComponents )
+		{
+			itkExceptionMacro( "Component " << element << " out of range, the tensor has "
+												 << NumberOfComponents << " components" );
+		}
+		// The components are the inputs following the tensor input
+		this->ProcessObject::SetNthInput( 1 + element, const_cast< ComponentImageType * >( image ) );
+	}
+	
+	/**
+	 * Get Component Image
+	 */
+	template <typename TInputImage, typename TOutputImage>
+	const typename OrientedFluxTraceMeasureFilter<TInputImage,TOutputImage>::ComponentImageType *
+	OrientedFluxTraceMeasureFilter<TInputImage,TOutputImage>
+	::GetComponentImage( unsigned int element ) const
+	{
+		if( 1 + element >= this->GetNumberOfInputs() )
+		{
+			return NULL;
+		}
+		return static_cast< const ComponentImageType * >( this->ProcessObject::GetInput( 1 + element ) );
+	}
+	
+	/**
+	 * Get Use Component Images
+	 */
+	template <typename TInputImage, typename TOutputImage>
+	bool
+	OrientedFluxTraceMeasureFilter<TInputImage,TOutputImage>
+	::GetUseComponentImages( ) const
+	{
+		for(unsigned int element = 0; element < NumberOfComponents; element++)
+		{
+			if( !this->GetComponentImage( element ) )
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+	
+	//
+	//
+	//
+	template <typename TInputImage, typename TOutputImage>
+	void
+	OrientedFluxTraceMeasureFilter<TInputImage,TOutputImage>
+	::GenerateOutputInformation()
+	{
+		if( this->GetUseComponentImages() )
+		{
+			this->GetOutput()->CopyInformation( this->GetComponentImage( 0 ) );
+			return;
+		}
+		if( !this->GetInput() )
+		{
+			itkExceptionMacro( "Input image or component images must be provided" );
+		}
+		Superclass::GenerateOutputInformation();
+	}
+	
 	//
 	//
 	//
@@ -104,10 +178,52 @@ namespace itk
 	::ThreadedGenerateData( const OutputImageRegionType& outputRegionForThread,
 												 ThreadIdType threadId)
 	{
+		TraceEventRecorder::ScopedEvent threadEvent("trace", "measure");
 		
 		// support progress methods/callbacks
 		ProgressReporter progress(this, threadId, outputRegionForThread.GetNumberOfPixels());
 		
+		if( this->GetUseComponentImages() )
+		{
+			// Sum of the planar diagonal components, line by line along X.
+			// Element (i, i) of a SymmetricSecondRankTensor is stored at
+			// i * ImageDimension - i * (i - 1) / 2.
+			const ComponentImageType * diagonalImages[ImageDimension];
+			for(unsigned int i = 0; i < ImageDimension; i++)
+			{
+				diagonalImages[i] = this->GetComponentImage( i * ImageDimension - i * (i - 1) / 2 );
+			}
+			const RealType sign = m_IsBright ? -1.0 : 1.0;
+			const SizeValueType lineLength = outputRegionForThread.GetSize()[0];
+			
+			typedef ImageLinearIteratorWithIndex< OutputImageType > LineIteratorType;
+			LineIteratorType lit( this->GetOutput(), outputRegionForThread );
+			lit.SetDirection( 0 );
+			for(lit.GoToBegin(); !lit.IsAtEnd(); lit.NextLine())
+			{
+				const typename OutputImageType::IndexType index = lit.GetIndex();
+				const float * diagonal[ImageDimension];
+				for(unsigned int i = 0; i < ImageDimension; i++)
+				{
+					diagonal[i] = diagonalImages[i]->GetBufferPointer() + diagonalImages[i]->ComputeOffset( index );
+				}
+				OutputPixelType * out = &( lit.Value() );
+				for(SizeValueType k = 0; k < lineLength; k++)
+				{
+					RealType value = 0.0;
+					for(unsigned int i = 0; i < ImageDimension; i++)
+					{
+						value += diagonal[i][k];
+					}
+					out[k] = static_cast< OutputPixelType >( sign * value );
+				}
+				for(SizeValueType k = 0; k < lineLength; k++)
+				{
+					progress.CompletedPixel();
+				}
+			}
+			return;
+		}
 		
 		ImageRegionIterator<OutputImageType>				 outputIt;
 		typedef ImageRegionConstIterator< InputImageType> OrientedFluxIteratorType;
@@ -152,6 +268,7 @@ namespace itk
 		Superclass::PrintSelf(os,indent);
 		os << indent << "is Bright: " << std::endl
 		<< this->m_IsBright << std::endl;
+		os << indent << "UseComponentImages: " << this->GetUseComponentImages() << std::endl;
 	}
 	
 	
@@ -0,0 +1,87 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+#ifndef __itkParallelFillBuffer_h
+#define __itkParallelFillBuffer_h
+
+#include <algorithm>
+
+#include <itkIntTypes.h>
+#include <vnl/vnl_math.h>
+#include <omp.h>
+
+namespace itk
+{
+
+	/** Bounds of a chunk of a buffer of n elements cut in numberOfChunks
+	 * contiguous chunks. The loops that fill a buffer and those that later
+	 * walk it use the same chunks with schedule(static), so that the thread
+	 * writing a page first, which places it on its NUMA node, is the thread
+	 * that works on it afterwards. */
+	inline void GetParallelChunk(SizeValueType n, int numberOfChunks, int chunk,
+															 SizeValueType & begin, SizeValueType & end)
+	{
+		begin = n * chunk / numberOfChunks;
+		end = n * (chunk + 1) / numberOfChunks;
+	}
+
+	/** Number of chunks for a buffer of n elements and numberOfThreads
+	 * threads: one per thread, at least one, at most one per element. */
+	inline int GetNumberOfParallelChunks(SizeValueType n, int numberOfThreads)
+	{
+		return vnl_math_max( 1, static_cast<int>( vnl_math_min( static_cast<SizeValueType>( numberOfThreads ), n ) ) );
+	}
+
+	/** Fill n elements with a value, one contiguous chunk per thread. */
+	template <class TValue>
+	void ParallelFill(TValue * buffer, SizeValueType n, const TValue & value, int numberOfThreads)
+	{
+		const int numberOfChunks = GetNumberOfParallelChunks( n, numberOfThreads );
+#pragma omp parallel for schedule(static) num_threads(numberOfChunks)
+		for(int chunk = 0; chunk < numberOfChunks; chunk++)
+		{
+			SizeValueType begin, end;
+			GetParallelChunk( n, numberOfChunks, chunk, begin, end );
+			std::fill( buffer + begin, buffer + end, value );
+		}
+	}
+
+	/** Allocate n elements in a container, e.g. an ImportImageContainer,
+	 * without initializing them, then fill them in parallel: the pages are
+	 * first touched by the threads, as in ParallelFillBuffer(). */
+	template <class TContainer>
+	void ParallelReserveAndFill(TContainer * container, SizeValueType n,
+															const typename TContainer::Element & value, int numberOfThreads)
+	{
+		container->Reserve( n );
+		ParallelFill( container->GetBufferPointer(), n, value, numberOfThreads );
+	}
+
+	/** Parallel FillBuffer() of the buffered region of an image. The image
+	 * must be allocated; for the first touch to place the pages, its pixel
+	 * type must not initialize its elements on construction (scalars do
+	 * not, tensors do). */
+	template <class TImage>
+	void ParallelFillBuffer(TImage * image, const typename TImage::PixelType & value, int numberOfThreads)
+	{
+		ParallelFill( image->GetBufferPointer(),
+									static_cast<SizeValueType>( image->GetBufferedRegion().GetNumberOfPixels() ),
+									value, numberOfThreads );
+	}
+
+} // end namespace itk
+
+#endif
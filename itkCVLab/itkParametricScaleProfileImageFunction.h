@@ -0,0 +1,182 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+#ifndef __itkParametricScaleProfileImageFunction_h
+#define __itkParametricScaleProfileImageFunction_h
+
+#include <vector>
+
+#include <itkFunctionBase.h>
+#include <itkObjectFactory.h>
+#include <itkImageRegion.h>
+#include "itkCompactEigenSystemPixel.h"
+
+namespace itk
+{
+
+	/** \class ScaleProfilePixel
+	 * \brief Parameters of the response of one voxel along the scale axis,
+	 * in 16 bytes.
+	 *
+	 * The profile is an asymmetric Gaussian bump over a constant baseline:
+	 * score(s) = Baseline + (Peak - Baseline) * exp( -(s - BestScale)^2 / (2 w^2) ),
+	 * with w = LeftWidth below the best scale and RightWidth above it. The
+	 * scales are continuous scale indices, relative to the first scale. The
+	 * peak and the baseline are floats, the other parameters are half
+	 * precision floats (see FloatToHalf). FitError is the largest error of
+	 * the model on the sampled scales, relative to Peak - Baseline.
+	 */
+	struct ScaleProfilePixel
+	{
+		float						Peak;
+		float						Baseline;
+		unsigned short	BestScale;
+		unsigned short	LeftWidth;
+		unsigned short	RightWidth;
+		unsigned short	FitError;
+	};
+
+	/** \class ParametricScaleProfileImageFunction
+	 * \brief Compressed scale-space tubularity score, evaluated on the fly.
+	 *
+	 * Compress() fits a ScaleProfilePixel to the scale profile of every
+	 * spatial voxel of a score image (scale along the last axis), after
+	 * which the score image can be released: the profiles take 16 bytes per
+	 * voxel, against 4 bytes per voxel and per scale for a float score, i.e.
+	 * the memory is divided by a quarter of the number of scales.
+	 *
+	 * Evaluate() reconstructs score(x, y, z, s) at an index of the score
+	 * image, so that the function can replace the score as the speed of
+	 * FastMarchingImageFilter2 (see SetSpeedFunction()). The responses of
+	 * the oriented flux filters are smooth and unimodal along the scale axis
+	 * at most voxels; where they are not, e.g. at junctions with two tubes
+	 * of different radii, the reconstruction keeps the strongest mode only,
+	 * and GetFitError() tells how far the model is from the samples.
+	 *
+	 * \author : Fethallah Benmansour
+	 */
+	template <class TScoreImage>
+	class ITK_EXPORT ParametricScaleProfileImageFunction:
+	public FunctionBase<typename TScoreImage::IndexType, double>
+	{
+	public:
+		/** Standard class typedefs. */
+		typedef ParametricScaleProfileImageFunction													Self;
+		typedef FunctionBase<typename TScoreImage::IndexType, double>				Superclass;
+		typedef SmartPointer<Self>																					Pointer;
+		typedef SmartPointer<const Self>																		ConstPointer;
+
+		/** Method for creation through the object factory. */
+		itkNewMacro(Self);
+
+		/** Run-time type information (and related methods). */
+		itkTypeMacro(ParametricScaleProfileImageFunction, FunctionBase);
+
+		/** Dimension of the score, the last axis being the scale. */
+		itkStaticConstMacro(ImageDimension, unsigned int, TScoreImage::ImageDimension);
+
+		typedef TScoreImage																									ScoreImageType;
+		typedef typename ScoreImageType::PixelType													ScorePixelType;
+		typedef typename ScoreImageType::IndexType													IndexType;
+		typedef typename ScoreImageType::IndexValueType											IndexValueType;
+		typedef typename ScoreImageType::RegionType													RegionType;
+		typedef typename ScoreImageType::SpacingType												SpacingType;
+		typedef typename ScoreImageType::PointType													PointType;
+		typedef typename ScoreImageType::DirectionType											DirectionType;
+		typedef ScaleProfilePixel																						ProfileType;
+
+		/** Fit the profiles of the buffered region of a score image. The
+		 * image can be released afterwards. */
+		void Compress(const ScoreImageType * score);
+
+		/** Score at an index of the score image. The index must be inside
+		 * the region of the compressed score. */
+		double Evaluate(const IndexType & index) const;
+
+		/** Index of the scale of strongest response at a spatial location;
+		 * the scale coordinate of the given index is ignored. */
+		IndexValueType GetBestScaleIndex(const IndexType & index) const;
+
+		/** Parameters of the profile at a spatial location. */
+		const ProfileType & GetProfile(const IndexType & index) const
+		{
+			return m_Profiles[ this->ComputeSpatialOffset( index ) ];
+		}
+
+		/** Largest error of the model relative to the dynamic of the profile,
+		 * at a spatial location and over all the voxels. */
+		double GetFitError(const IndexType & index) const
+		{
+			return HalfToFloat( this->GetProfile( index ).FitError );
+		}
+		itkGetConstMacro(MaximumFitError, double);
+
+		/** Geometry of the compressed score. */
+		itkGetConstReferenceMacro(Region, RegionType);
+		itkGetConstReferenceMacro(Spacing, SpacingType);
+		itkGetConstReferenceMacro(Origin, PointType);
+		itkGetConstReferenceMacro(Direction, DirectionType);
+
+		/** An image with the geometry of the compressed score and no pixel
+		 * buffer, to stand for the score where only its geometry is used
+		 * (e.g. as the input of TubularMetricToPathFilter). */
+		typename ScoreImageType::Pointer GetScoreInformation() const;
+
+		/** Size in bytes of the profiles. */
+		SizeValueType GetMemorySize() const
+		{
+			return static_cast<SizeValueType>( m_Profiles.size() * sizeof(ProfileType) );
+		}
+
+	protected:
+		ParametricScaleProfileImageFunction();
+		virtual ~ParametricScaleProfileImageFunction() {}
+		void PrintSelf(std::ostream& os, Indent indent) const;
+
+	private:
+		ParametricScaleProfileImageFunction(const Self&); //purposely not implemented
+		void operator=(const Self&); //purposely not implemented
+
+		/** Offset of the profile of the spatial part of an index. */
+		SizeValueType ComputeSpatialOffset(const IndexType & index) const
+		{
+			SizeValueType offset = 0;
+			for(int i = ImageDimension - 2; i >= 0; i--)
+			{
+				offset = offset * m_Region.GetSize()[i] + (index[i] - m_Region.GetIndex()[i]);
+			}
+			return offset;
+		}
+
+		/** Fit the profile of numberOfScales samples, strided by scaleStride. */
+		static ProfileType FitProfile(const ScorePixelType * samples, SizeValueType scaleStride,
+																	unsigned int numberOfScales);
+
+		std::vector<ProfileType>					m_Profiles;
+		RegionType												m_Region;
+		SpacingType												m_Spacing;
+		PointType													m_Origin;
+		DirectionType											m_Direction;
+		double														m_MaximumFitError;
+	};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkParametricScaleProfileImageFunction.txx"
+#endif
+
+#endif
@@ -0,0 +1,259 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+
+#ifndef __itkParametricScaleProfileImageFunction_txx
+#define __itkParametricScaleProfileImageFunction_txx
+
+#include "itkParametricScaleProfileImageFunction.h"
+#include <vcl_cmath.h>
+#include "vnl/vnl_math.h"
+#include <omp.h>
+
+namespace itk
+{
+
+	/**
+	 * Constructor
+	 */
+	template <class TScoreImage>
+	ParametricScaleProfileImageFunction<TScoreImage>
+	::ParametricScaleProfileImageFunction()
+	{
+		m_Spacing.Fill( 1.0 );
+		m_Origin.Fill( 0.0 );
+		m_Direction.SetIdentity();
+		m_MaximumFitError = 0.0;
+	}
+
+	/**
+	 * Fit the profiles of all the spatial voxels
+	 */
+	template <class TScoreImage>
+	void
+	ParametricScaleProfileImageFunction<TScoreImage>
+	::Compress(const ScoreImageType * score)
+	{
+		if( !score )
+		{
+			itkExceptionMacro( << "No score image given" );
+		}
+		RegionType region = score->GetBufferedRegion();
+		const unsigned int numberOfScales = region.GetSize()[ImageDimension-1];
+		if( numberOfScales == 0 )
+		{
+			itkExceptionMacro( << "The score image is empty" );
+		}
+
+		m_Region		= region;
+		m_Spacing		= score->GetSpacing();
+		m_Origin		= score->GetOrigin();
+		m_Direction	= score->GetDirection();
+
+		// The scale is the slowest axis: the profile of a voxel is strided by
+		// the number of spatial voxels.
+		const SizeValueType numberOfVoxels = region.GetNumberOfPixels() / numberOfScales;
+		m_Profiles.resize( numberOfVoxels );
+		const ScorePixelType * buffer = score->GetBufferPointer();
+		const long numberOfVoxelsLong = static_cast<long>( numberOfVoxels );
+#pragma omp parallel for schedule(static)
+		for(long v = 0; v < numberOfVoxelsLong; v++)
+		{
+			m_Profiles[v] = FitProfile( buffer + v, numberOfVoxels, numberOfScales );
+		}
+
+		m_MaximumFitError = 0.0;
+		for(SizeValueType v = 0; v < numberOfVoxels; v++)
+		{
+			m_MaximumFitError = vnl_math_max( m_MaximumFitError, static_cast<double>( HalfToFloat( m_Profiles[v].FitError ) ) );
+		}
+		this->Modified();
+	}
+
+	/**
+	 * Fit one profile
+	 */
+	template <class TScoreImage>
+	typename ParametricScaleProfileImageFunction<TScoreImage>::ProfileType
+	ParametricScaleProfileImageFunction<TScoreImage>
+	::FitProfile(const ScorePixelType * samples, SizeValueType scaleStride, unsigned int numberOfScales)
+	{
+		// Strongest and weakest responses
+		unsigned int bestScale = 0;
+		double peak = static_cast<double>( samples[0] );
+		double baseline = peak;
+		for(unsigned int k = 1; k < numberOfScales; k++)
+		{
+			double value = static_cast<double>( samples[k * scaleStride] );
+			if( value > peak )
+			{
+				peak = value;
+				bestScale = k;
+			}
+			baseline = vnl_math_min( baseline, value );
+		}
+
+		ProfileType profile;
+		profile.Baseline = static_cast<float>( baseline );
+		profile.FitError = FloatToHalf( 0.0f );
+		const double flatWidth = static_cast<double>( numberOfScales );
+		if( peak <= baseline )
+		{
+			profile.Peak = static_cast<float>( peak );
+			profile.BestScale = FloatToHalf( static_cast<float>( bestScale ) );
+			profile.LeftWidth = FloatToHalf( static_cast<float>( flatWidth ) );
+			profile.RightWidth = profile.LeftWidth;
+			return profile;
+		}
+
+		// Sub-scale position of the maximum, from the parabola through the
+		// maximum and its two neighbours.
+		double scale = static_cast<double>( bestScale );
+		if( bestScale > 0 && bestScale + 1 < numberOfScales )
+		{
+			double previous = static_cast<double>( samples[(bestScale - 1) * scaleStride] );
+			double next = static_cast<double>( samples[(bestScale + 1) * scaleStride] );
+			double curvature = previous - 2.0 * peak + next;
+			if( curvature < 0.0 )
+			{
+				double shift = 0.5 * (previous - next) / curvature;
+				shift = vnl_math_max( -0.5, vnl_math_min( 0.5, shift ) );
+				scale += shift;
+				peak -= 0.25 * (previous - next) * shift;
+			}
+		}
+
+		// Width of each side: least squares fit of log((v - b) / (p - b)) by
+		// -d^2 / (2 w^2), d being the distance to the best scale.
+		const double dynamic = peak - baseline;
+		double width[2];
+		for(unsigned int side = 0; side < 2; side++)
+		{
+			double numerator = 0.0;
+			double denominator = 0.0;
+			for(unsigned int k = 0; k < numberOfScales; k++)
+			{
+				double d = static_cast<double>( k ) - scale;
+				if( (side == 0 && d >= 0.0) || (side == 1 && d <= 0.0) )
+				{
+					continue;
+				}
+				double ratio = (static_cast<double>( samples[k * scaleStride] ) - baseline) / dynamic;
+				ratio = vnl_math_max( 1e-6, vnl_math_min( 1.0, ratio ) );
+				numerator -= d * d * vcl_log( ratio );
+				denominator += d * d * d * d;
+			}
+			width[side] = numerator > 0.0 ? vcl_sqrt( 0.5 * denominator / numerator ) : flatWidth;
+			width[side] = vnl_math_min( width[side], flatWidth );
+		}
+		// A maximum on the first or the last scale says nothing about the
+		// missing side, make it symmetric.
+		if( scale <= 0.0 )
+		{
+			width[0] = width[1];
+		}
+		if( scale >= static_cast<double>( numberOfScales - 1 ) )
+		{
+			width[1] = width[0];
+		}
+
+		profile.Peak = static_cast<float>( peak );
+		profile.BestScale = FloatToHalf( static_cast<float>( scale ) );
+		profile.LeftWidth = FloatToHalf( static_cast<float>( width[0] ) );
+		profile.RightWidth = FloatToHalf( static_cast<float>( width[1] ) );
+
+		// Largest error of the quantized model on the samples
+		const double quantizedScale = HalfToFloat( profile.BestScale );
+		const double quantizedWidth[2] = { HalfToFloat( profile.LeftWidth ), HalfToFloat( profile.RightWidth ) };
+		double fitError = 0.0;
+		for(unsigned int k = 0; k < numberOfScales; k++)
+		{
+			double d = static_cast<double>( k ) - quantizedScale;
+			double w = quantizedWidth[ d < 0.0 ? 0 : 1 ];
+			double model = baseline + dynamic * vcl_exp( -0.5 * d * d / (w * w) );
+			fitError = vnl_math_max( fitError, vcl_fabs( model - static_cast<double>( samples[k * scaleStride] ) ) );
+		}
+		profile.FitError = FloatToHalf( static_cast<float>( fitError / dynamic ) );
+		return profile;
+	}
+
+	/**
+	 * Reconstruct the score
+	 */
+	template <class TScoreImage>
+	double
+	ParametricScaleProfileImageFunction<TScoreImage>
+	::Evaluate(const IndexType & index) const
+	{
+		const ProfileType & profile = m_Profiles[ this->ComputeSpatialOffset( index ) ];
+		const double d = static_cast<double>( index[ImageDimension-1] - m_Region.GetIndex()[ImageDimension-1] )
+										 - HalfToFloat( profile.BestScale );
+		const double w = HalfToFloat( d < 0.0 ? profile.LeftWidth : profile.RightWidth );
+		return profile.Baseline + (profile.Peak - profile.Baseline) * vcl_exp( -0.5 * d * d / (w * w) );
+	}
+
+	/**
+	 * Scale of strongest response
+	 */
+	template <class TScoreImage>
+	typename ParametricScaleProfileImageFunction<TScoreImage>::IndexValueType
+	ParametricScaleProfileImageFunction<TScoreImage>
+	::GetBestScaleIndex(const IndexType & index) const
+	{
+		const ProfileType & profile = m_Profiles[ this->ComputeSpatialOffset( index ) ];
+		IndexValueType maxScale = static_cast<IndexValueType>( m_Region.GetSize()[ImageDimension-1] ) - 1;
+		IndexValueType scale = static_cast<IndexValueType>( vnl_math_rnd( HalfToFloat( profile.BestScale ) ) );
+		scale = vnl_math_max( IndexValueType(0), vnl_math_min( maxScale, scale ) );
+		return m_Region.GetIndex()[ImageDimension-1] + scale;
+	}
+
+	/**
+	 * Geometry-only image
+	 */
+	template <class TScoreImage>
+	typename TScoreImage::Pointer
+	ParametricScaleProfileImageFunction<TScoreImage>
+	::GetScoreInformation() const
+	{
+		typename ScoreImageType::Pointer information = ScoreImageType::New();
+		information->SetLargestPossibleRegion( m_Region );
+		information->SetRequestedRegion( m_Region );
+		information->SetSpacing( m_Spacing );
+		information->SetOrigin( m_Origin );
+		information->SetDirection( m_Direction );
+		return information;
+	}
+
+	/**
+	 * PrintSelf
+	 */
+	template <class TScoreImage>
+	void
+	ParametricScaleProfileImageFunction<TScoreImage>
+	::PrintSelf(std::ostream& os, Indent indent) const
+	{
+		Superclass::PrintSelf(os, indent);
+		os << indent << "Region: " << m_Region << std::endl;
+		os << indent << "Spacing: " << m_Spacing << std::endl;
+		os << indent << "Origin: " << m_Origin << std::endl;
+		os << indent << "Direction: " << m_Direction << std::endl;
+		os << indent << "MemorySize: " << this->GetMemorySize() << std::endl;
+		os << indent << "MaximumFitError: " << m_MaximumFitError << std::endl;
+	}
+
+} // end namespace itk
+
+#endif
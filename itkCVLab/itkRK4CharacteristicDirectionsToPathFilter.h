@@ -182,6 +182,14 @@ namespace itk
 		
 		PathStatusType GetPathStatus(unsigned int);
 		
+		/** Statistics of the last update, summed over all the paths: the
+		 * number of descent steps, and how many of them fell back to a
+		 * discrete step because the path was oscillating or because the
+		 * gradient was zero. */
+		itkGetConstMacro(NumberOfSteps, SizeValueType);
+		itkGetConstMacro(NumberOfOscillationFallbacks, SizeValueType);
+		itkGetConstMacro(NumberOfZeroGradientFallbacks, SizeValueType);
+		
 	protected:
 		RK4CharacteristicDirectionsToPathFilter();
 		~RK4CharacteristicDirectionsToPathFilter();
@@ -228,6 +236,10 @@ namespace itk
 		InputImageIndexType																					m_StartIndex;
 		InputImageIndexType																					m_LastIndex;
 		
+		SizeValueType																								m_NumberOfSteps;
+		SizeValueType																								m_NumberOfOscillationFallbacks;
+		SizeValueType																								m_NumberOfZeroGradientFallbacks;
+		
 	};
 	
 }
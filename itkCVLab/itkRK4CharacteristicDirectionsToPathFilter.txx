@@ -19,6 +19,7 @@
 #define __itkRK4CharacteristicDirectionsToPathFilter_txx
 
 #include "itkRK4CharacteristicDirectionsToPathFilter.h"
+#include "itkMetricsRegistry.h"
 
 namespace itk
 {
@@ -34,6 +35,9 @@ namespace itk
 		m_NbMaxIter = 10000;
 		m_OscillationThreshold = 0.1;
 		m_NumOfPastPoints = 10; 
+		m_NumberOfSteps = 0;
+		m_NumberOfOscillationFallbacks = 0;
+		m_NumberOfZeroGradientFallbacks = 0;
 		// prepare the interpolator
 		m_Interpolator = InterpolatorType::New();
 	}
@@ -296,6 +300,10 @@ namespace itk
 		/** Set the interpolator input */
 		m_Interpolator->SetInputImage( this->GetInput() );
 		
+		m_NumberOfSteps = 0;
+		m_NumberOfOscillationFallbacks = 0;
+		m_NumberOfZeroGradientFallbacks = 0;
+		
 		// For loop for each output (each endpoint)
 		for ( unsigned int n=0; n < numberOfOutputs; n++ )
     {
@@ -443,6 +451,7 @@ namespace itk
 					 // One of the reasons might be that the used precision is not enough (then use double or long double )
 					 // In that case, we just take the best point among neighboors, using the distance (objective map) values
 					 itkWarningMacro("Gradient is null at this point, this's likely due to the precision, current descent step will be done discretely ");
+					++m_NumberOfZeroGradientFallbacks;
 					ContinuousIndexType nextCIndex;
 					this->MakeDiscreteDescentStep(cindex, nextCIndex);
 					cindex = nextCIndex;
@@ -480,6 +489,7 @@ namespace itk
 				if( isOscillating )
 				{  // path is oscillating
 					 itkWarningMacro("Path is osciallating, current descent step will be done discreetly ");
+					++m_NumberOfOscillationFallbacks;
 					ContinuousIndexType nextCIndex;
 					this->MakeDiscreteDescentStep(cindex, nextCIndex);
 					cindex = nextCIndex;
@@ -487,6 +497,7 @@ namespace itk
 				}
 				
 				count++;
+				++m_NumberOfSteps;
 			}
 			
 			if( count >=  m_NbMaxIter )
@@ -523,6 +534,11 @@ namespace itk
 				m_PathStatusList[n] = NotReachedStartPoint;
 			}			
     }
+		
+		MetricsRegistry * metrics = MetricsRegistry::GetInstance();
+		metrics->Increment("descent.steps", m_NumberOfSteps);
+		metrics->Increment("descent.oscillationFallbacks", m_NumberOfOscillationFallbacks);
+		metrics->Increment("descent.zeroGradientFallbacks", m_NumberOfZeroGradientFallbacks);
 	}
 	
 	/**
@@ -541,6 +557,9 @@ namespace itk
 		os << indent << "Step"									<< m_Step << std::endl;
 		os << indent << "NbMaxIter"							<< m_NbMaxIter << std::endl;
 		os << indent << "Oscillation Threshold"	<< m_OscillationThreshold << std::endl;
+		os << indent << "NumberOfSteps: "				<< m_NumberOfSteps << std::endl;
+		os << indent << "NumberOfOscillationFallbacks: "	<< m_NumberOfOscillationFallbacks << std::endl;
+		os << indent << "NumberOfZeroGradientFallbacks: "	<< m_NumberOfZeroGradientFallbacks << std::endl;
 		
 	}
 	
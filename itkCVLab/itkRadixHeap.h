@@ -0,0 +1,172 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+#ifndef __itkRadixHeap_h
+#define __itkRadixHeap_h
+
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include <itkIntTypes.h>
+#include <itkMacro.h>
+
+namespace itk
+{
+
+	/** \class RadixHeap
+	 * \brief Monotone priority queue of values keyed by non-negative doubles.
+	 *
+	 * A radix heap only accepts keys not smaller than the last popped key,
+	 * which is the case of the distances settled by Dijkstra's algorithm,
+	 * and in exchange pushes in O(1) and pops in O(log C) amortized, without
+	 * the comparisons and the cache misses of a binary heap.
+	 * The non-negative doubles are ordered as their bit patterns, which are
+	 * used as 64 bits integer keys: bucket 0 holds the keys equal to the
+	 * last popped one, and bucket b the keys whose highest bit differing
+	 * from it is the bit b - 1. When bucket 0 is empty, the first non-empty
+	 * bucket is spread over the lower ones from its smallest key.
+	 *
+	 * \author : Fethallah Benmansour
+	 */
+	template <class TValue>
+	class RadixHeap
+	{
+	public:
+		typedef double					KeyType;
+		typedef TValue					ValueType;
+
+		RadixHeap(): m_Last(0), m_Size(0) {}
+
+		bool Empty() const
+		{
+			return m_Size == 0;
+		}
+
+		SizeValueType Size() const
+		{
+			return m_Size;
+		}
+
+		/** Remove all the values, and accept any key again. */
+		void Clear()
+		{
+			for(unsigned int b = 0; b < NumberOfBuckets; b++)
+			{
+				m_Buckets[b].clear();
+			}
+			m_Last = 0;
+			m_Size = 0;
+		}
+
+		/** Add a value. The key must be non-negative and not smaller than the
+		 * key of the last popped value. */
+		void Push(KeyType key, const ValueType & value)
+		{
+			const uint64_t bits = ToBits( key );
+			if( key < 0.0 || bits < m_Last )
+			{
+				itkGenericExceptionMacro( << "Key " << key << " is negative or smaller than the last popped key" );
+			}
+			m_Buckets[ BucketIndex( bits, m_Last ) ].push_back( EntryType( bits, value ) );
+			++m_Size;
+		}
+
+		/** Remove a value of smallest key. The heap must not be empty. */
+		void Pop(KeyType & key, ValueType & value)
+		{
+			if( m_Buckets[0].empty() )
+			{
+				unsigned int b = 1;
+				while( m_Buckets[b].empty() )
+				{
+					++b;
+				}
+				uint64_t smallest = m_Buckets[b][0].first;
+				for(SizeValueType e = 1; e < m_Buckets[b].size(); e++)
+				{
+					if( m_Buckets[b][e].first < smallest )
+					{
+						smallest = m_Buckets[b][e].first;
+					}
+				}
+				m_Last = smallest;
+				for(SizeValueType e = 0; e < m_Buckets[b].size(); e++)
+				{
+					const EntryType & entry = m_Buckets[b][e];
+					m_Buckets[ BucketIndex( entry.first, m_Last ) ].push_back( entry );
+				}
+				m_Buckets[b].clear();
+			}
+			key = FromBits( m_Buckets[0].back().first );
+			value = m_Buckets[0].back().second;
+			m_Buckets[0].pop_back();
+			--m_Size;
+		}
+
+	private:
+		typedef std::pair< uint64_t, ValueType >		EntryType;
+
+		itkStaticConstMacro(NumberOfBuckets, unsigned int, 65);
+
+		static uint64_t ToBits(KeyType key)
+		{
+			// +0.0 and -0.0 are the same key
+			if( key == 0.0 )
+			{
+				return 0;
+			}
+			uint64_t bits;
+			std::memcpy( &bits, &key, sizeof(bits) );
+			return bits;
+		}
+
+		static KeyType FromBits(uint64_t bits)
+		{
+			KeyType key;
+			std::memcpy( &key, &bits, sizeof(key) );
+			return key;
+		}
+
+		/** 0 if the keys are equal, else one plus the highest differing bit. */
+		static unsigned int BucketIndex(uint64_t bits, uint64_t last)
+		{
+			uint64_t difference = bits ^ last;
+			if( difference == 0 )
+			{
+				return 0;
+			}
+#if defined(__GNUC__)
+			return 64 - __builtin_clzll( difference );
+#else
+			unsigned int b = 0;
+			while( difference )
+			{
+				difference >>= 1;
+				++b;
+			}
+			return b;
+#endif
+		}
+
+		std::vector< EntryType >		m_Buckets[NumberOfBuckets];
+		uint64_t										m_Last;
+		SizeValueType								m_Size;
+	};
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,288 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+#ifndef __itkScratchArena_h
+#define __itkScratchArena_h
+
+#include <vector>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include <itkObject.h>
+#include <itkObjectFactory.h>
+#include <itkSimpleFastMutexLock.h>
+
+namespace itk
+{
+
+	/** \class ScratchArena
+	 * \brief Pool of large aligned memory blocks lent to the temporary
+	 * images of a computation and kept from one use to the next.
+	 *
+	 * Allocating and freeing a multi-GB image per stage and per scale costs
+	 * a system call, a page fault per page on the first write and address
+	 * space fragmentation. The blocks of an arena are allocated once, e.g.
+	 * by Reserve() from the size of the largest temporaries, and lent by
+	 * Borrow() to any request they are large enough for (the smallest such
+	 * free block is chosen); a request that no free block satisfies gets a
+	 * new block, which then stays in the arena. Blocks are aligned on
+	 * Alignment bytes, and with UseHugePages on they are rounded to 2 MB
+	 * and advised to the kernel as transparent huge pages (Linux).
+	 *
+	 * AllocateImage() makes an image use a borrowed block as its buffer;
+	 * the image does not own it, and the block must be returned with
+	 * Return() once the image is no longer read. The arena is thread safe.
+	 *
+	 * \author : Fethallah Benmansour
+	 */
+	class ScratchArena : public Object
+	{
+	public:
+		/** Standard class typedefs. */
+		typedef ScratchArena										Self;
+		typedef Object													Superclass;
+		typedef SmartPointer<Self>							Pointer;
+		typedef SmartPointer<const Self>				ConstPointer;
+
+		/** Method for creation through the object factory. */
+		itkNewMacro(Self);
+
+		/** Run-time type information (and related methods). */
+		itkTypeMacro(ScratchArena, Object);
+
+		/** Alignment of the blocks in bytes, a power of two. Defaults to 64,
+		 * a cache line. Used by the next allocations. */
+		itkSetMacro(Alignment, SizeValueType);
+		itkGetConstMacro(Alignment, SizeValueType);
+
+		/** Whether the blocks are backed by huge pages. Off by default. Used
+		 * by the next allocations. */
+		itkSetMacro(UseHugePages, bool);
+		itkGetConstMacro(UseHugePages, bool);
+		itkBooleanMacro(UseHugePages);
+
+		/** Add numberOfBlocks free blocks of the given size. */
+		void Reserve(SizeValueType numberOfBlocks, SizeValueType bytes)
+		{
+			m_Lock.Lock();
+			for(SizeValueType b = 0; b < numberOfBlocks; b++)
+			{
+				Block block = this->AllocateBlock( bytes );
+				m_Blocks.push_back( block );
+			}
+			m_Lock.Unlock();
+		}
+
+		/** A free block of at least the given size. Throws an exception if
+		 * the memory can not be allocated. */
+		void * Borrow(SizeValueType bytes)
+		{
+			m_Lock.Lock();
+			m_NumberOfBorrows++;
+			Block * bestFit = 0;
+			for(unsigned int b = 0; b < m_Blocks.size(); b++)
+			{
+				if( !m_Blocks[b].Busy && m_Blocks[b].Size >= bytes &&
+					 ( !bestFit || m_Blocks[b].Size < bestFit->Size ) )
+				{
+					bestFit = &m_Blocks[b];
+				}
+			}
+			if( !bestFit )
+			{
+				Block block;
+				try
+				{
+					block = this->AllocateBlock( bytes );
+				}
+				catch(...)
+				{
+					m_Lock.Unlock();
+					throw;
+				}
+				m_NumberOfMisses++;
+				m_Blocks.push_back( block );
+				bestFit = &m_Blocks.back();
+			}
+			bestFit->Busy = true;
+			void * pointer = bestFit->Pointer;
+			m_Lock.Unlock();
+			return pointer;
+		}
+
+		/** Give back a block obtained from Borrow(). */
+		void Return(void * pointer)
+		{
+			if( !pointer )
+			{
+				return;
+			}
+			m_Lock.Lock();
+			for(unsigned int b = 0; b < m_Blocks.size(); b++)
+			{
+				if( m_Blocks[b].Pointer == pointer )
+				{
+					m_Blocks[b].Busy = false;
+					break;
+				}
+			}
+			m_Lock.Unlock();
+		}
+
+		/** Make the buffered region of an image use a borrowed block, as
+		 * Allocate() would; the pixels are not initialized. Returns the
+		 * block, to be given to Return(). */
+		template <class TImage>
+		void * AllocateImage(TImage * image)
+		{
+			typedef typename TImage::PixelType PixelType;
+			const SizeValueType numberOfPixels = image->GetBufferedRegion().GetNumberOfPixels();
+			void * block = this->Borrow( numberOfPixels * sizeof(PixelType) );
+			image->GetPixelContainer()->SetImportPointer( static_cast<PixelType *>( block ), numberOfPixels, false );
+			// Computes the offset table; the container is already large enough.
+			image->Allocate();
+			return block;
+		}
+
+		/** Free all the blocks. None may be borrowed. */
+		void Clear()
+		{
+			m_Lock.Lock();
+			for(unsigned int b = 0; b < m_Blocks.size(); b++)
+			{
+				FreeBlock( m_Blocks[b] );
+			}
+			m_Blocks.clear();
+			m_Lock.Unlock();
+		}
+
+		/** Number and total size in bytes of the blocks. */
+		SizeValueType GetNumberOfBlocks() const
+		{
+			m_Lock.Lock();
+			SizeValueType numberOfBlocks = m_Blocks.size();
+			m_Lock.Unlock();
+			return numberOfBlocks;
+		}
+		SizeValueType GetCapacity() const
+		{
+			m_Lock.Lock();
+			SizeValueType capacity = 0;
+			for(unsigned int b = 0; b < m_Blocks.size(); b++)
+			{
+				capacity += m_Blocks[b].Size;
+			}
+			m_Lock.Unlock();
+			return capacity;
+		}
+
+		/** Number of calls to Borrow(), and of those that allocated a block. */
+		itkGetConstMacro(NumberOfBorrows, SizeValueType);
+		itkGetConstMacro(NumberOfMisses, SizeValueType);
+
+	protected:
+		ScratchArena(): m_Alignment(64), m_UseHugePages(false), m_NumberOfBorrows(0), m_NumberOfMisses(0) {};
+		virtual ~ScratchArena()
+		{
+			for(unsigned int b = 0; b < m_Blocks.size(); b++)
+			{
+				FreeBlock( m_Blocks[b] );
+			}
+		};
+
+		void PrintSelf(std::ostream& os, Indent indent) const
+		{
+			Superclass::PrintSelf(os, indent);
+			os << indent << "Alignment: " << m_Alignment << std::endl;
+			os << indent << "UseHugePages: " << m_UseHugePages << std::endl;
+			os << indent << "NumberOfBlocks: " << this->GetNumberOfBlocks() << std::endl;
+			os << indent << "Capacity: " << this->GetCapacity() << std::endl;
+			os << indent << "NumberOfBorrows: " << m_NumberOfBorrows << std::endl;
+			os << indent << "NumberOfMisses: " << m_NumberOfMisses << std::endl;
+		}
+
+	private:
+		ScratchArena(const Self&); //purposely not implemented
+		void operator=(const Self&); //purposely not implemented
+
+		struct Block
+		{
+			void *					Pointer;
+			SizeValueType		Size;
+			bool						Busy;
+		};
+
+		Block AllocateBlock(SizeValueType bytes) const
+		{
+			const SizeValueType hugePageSize = 2 * 1024 * 1024;
+			SizeValueType alignment = m_Alignment < sizeof(void*) ? sizeof(void*) : m_Alignment;
+			SizeValueType size = bytes > 0 ? bytes : 1;
+			if( m_UseHugePages )
+			{
+				alignment = hugePageSize;
+				size = (size + hugePageSize - 1) / hugePageSize * hugePageSize;
+			}
+			Block block;
+			block.Pointer = 0;
+			block.Size = size;
+			block.Busy = false;
+#ifdef _WIN32
+			block.Pointer = _aligned_malloc( size, alignment );
+#else
+			if( posix_memalign( &block.Pointer, alignment, size ) != 0 )
+			{
+				block.Pointer = 0;
+			}
+#endif
+			if( !block.Pointer )
+			{
+				itkExceptionMacro( << "Failed to allocate a scratch block of " << size << " bytes" );
+			}
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+			if( m_UseHugePages )
+			{
+				madvise( block.Pointer, size, MADV_HUGEPAGE );
+			}
+#endif
+			return block;
+		}
+
+		static void FreeBlock(Block & block)
+		{
+#ifdef _WIN32
+			_aligned_free( block.Pointer );
+#else
+			free( block.Pointer );
+#endif
+			block.Pointer = 0;
+		}
+
+		SizeValueType										m_Alignment;
+		bool														m_UseHugePages;
+		std::vector<Block>							m_Blocks;
+		SizeValueType										m_NumberOfBorrows;
+		SizeValueType										m_NumberOfMisses;
+		mutable SimpleFastMutexLock			m_Lock;
+	};
+
+} // end namespace itk
+
+#endif
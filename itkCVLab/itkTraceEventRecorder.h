@@ -0,0 +1,331 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+#ifndef __itkTraceEventRecorder_h
+#define __itkTraceEventRecorder_h
+
+#include <map>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <ostream>
+#include <iomanip>
+#include <cstddef>
+
+#include <itkObject.h>
+#include <itkObjectFactory.h>
+#include <itkSimpleFastMutexLock.h>
+#include <itkRealTimeClock.h>
+#include <itkTimeProbe.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+namespace itk
+{
+
+	/** \class TraceEventRecorder
+	 * \brief Process-wide timeline of the stages of the pipeline, written in
+	 * the trace event format of chrome://tracing and Perfetto.
+	 *
+	 * Each event is a named interval on the track of the thread that ran
+	 * it, so that the scales computed in parallel, the threads of the
+	 * measure filters and the tracing workers appear side by side.
+	 * Events are recorded with ScopedEvent or TraceTimeProbe, both of which
+	 * do nothing but read the clock while the recorder is disabled, which
+	 * is the default.
+	 *
+	 * \author : Fethallah Benmansour
+	 */
+	class TraceEventRecorder : public Object
+	{
+	public:
+		/** Standard class typedefs. */
+		typedef TraceEventRecorder							Self;
+		typedef Object													Superclass;
+		typedef SmartPointer<Self>							Pointer;
+		typedef SmartPointer<const Self>				ConstPointer;
+
+		/** Run-time type information (and related methods). */
+		itkTypeMacro(TraceEventRecorder, Object);
+
+		/** The recorder of the process (of the shared library, for the
+		 * plugins). */
+		static Self * GetInstance()
+		{
+			static Pointer instance;
+			static SimpleFastMutexLock instanceLock;
+			instanceLock.Lock();
+			if( instance.IsNull() )
+			{
+				instance = new Self;
+				instance->UnRegister();
+			}
+			instanceLock.Unlock();
+			return instance.GetPointer();
+		}
+
+		/** Enable or disable the recording. */
+		void SetEnabled(bool enabled)
+		{
+			m_Lock.Lock();
+			m_Enabled = enabled;
+			m_Lock.Unlock();
+		}
+
+		bool GetEnabled() const
+		{
+			m_Lock.Lock();
+			bool enabled = m_Enabled;
+			m_Lock.Unlock();
+			return enabled;
+		}
+
+		/** Time since the creation of the recorder, in microseconds. */
+		double GetTimeStamp() const
+		{
+			return (m_Clock->GetTimeStamp() - m_StartTime) * 1e6;
+		}
+
+		/** Name the track of the calling thread, e.g. "tracing worker". */
+		void SetCurrentThreadName(const std::string & name)
+		{
+			m_Lock.Lock();
+			if( m_Enabled )
+			{
+				m_ThreadNames[ this->GetCurrentThreadIndex() ] = name;
+			}
+			m_Lock.Unlock();
+		}
+
+		/** Add an interval to the track of the calling thread. */
+		void AddCompleteEvent(const std::string & name, const std::string & category,
+													double startTime, double duration)
+		{
+			m_Lock.Lock();
+			if( m_Enabled )
+			{
+				EventType event;
+				event.Name = name;
+				event.Category = category;
+				event.Start = startTime;
+				event.Duration = duration;
+				event.Thread = this->GetCurrentThreadIndex();
+				m_Events.push_back( event );
+			}
+			m_Lock.Unlock();
+		}
+
+		/** Remove all the events. */
+		void Clear()
+		{
+			m_Lock.Lock();
+			m_Events.clear();
+			m_Lock.Unlock();
+		}
+
+		/** Write the events as a trace event JSON object. */
+		void WriteJSON(std::ostream & os) const
+		{
+			m_Lock.Lock();
+			// Timestamps are in microseconds, written to the nanosecond: with
+			// the default 6 significant digits they would be rounded to the
+			// second after a few seconds of recording.
+			const std::ios_base::fmtflags flags = os.flags();
+			const std::streamsize precision = os.precision();
+			os << std::fixed << std::setprecision(3);
+			os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+			bool first = true;
+			for(std::map<unsigned int, std::string>::const_iterator it = m_ThreadNames.begin(); it != m_ThreadNames.end(); ++it)
+			{
+				os << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << it->first
+					 << ",\"args\":{\"name\":";
+				WriteJSONString( os, it->second );
+				os << "}}";
+				first = false;
+			}
+			for(unsigned int i = 0; i < m_Events.size(); i++)
+			{
+				const EventType & event = m_Events[i];
+				os << (first ? "" : ",") << "\n{\"name\":";
+				WriteJSONString( os, event.Name );
+				os << ",\"cat\":";
+				WriteJSONString( os, event.Category );
+				os << ",\"ph\":\"X\",\"ts\":" << event.Start << ",\"dur\":" << event.Duration
+					 << ",\"pid\":1,\"tid\":" << event.Thread << "}";
+				first = false;
+			}
+			os << "\n]}" << std::endl;
+			os.flags( flags );
+			os.precision( precision );
+			m_Lock.Unlock();
+		}
+
+		/** Write the events to a file. Returns false if the file can not be written. */
+		bool WriteFile(const std::string & fileName) const
+		{
+			std::ofstream file( fileName.c_str() );
+			if( !file )
+			{
+				return false;
+			}
+			this->WriteJSON( file );
+			return file.good();
+		}
+
+		/** \class ScopedEvent
+		 * Records the interval between its construction and its destruction. */
+		class ScopedEvent
+		{
+		public:
+			ScopedEvent(const std::string & name, const std::string & category):
+			m_Name(name), m_Category(category)
+			{
+				m_Start = TraceEventRecorder::GetInstance()->GetTimeStamp();
+			}
+			~ScopedEvent()
+			{
+				TraceEventRecorder * recorder = TraceEventRecorder::GetInstance();
+				recorder->AddCompleteEvent(m_Name, m_Category, m_Start, recorder->GetTimeStamp() - m_Start);
+			}
+		private:
+			std::string		m_Name;
+			std::string		m_Category;
+			double				m_Start;
+		};
+
+	protected:
+		TraceEventRecorder(): m_Enabled(false)
+		{
+			m_Clock = RealTimeClock::New();
+			m_StartTime = m_Clock->GetTimeStamp();
+		}
+		~TraceEventRecorder() {}
+
+		void PrintSelf(std::ostream& os, Indent indent) const
+		{
+			Superclass::PrintSelf(os, indent);
+			os << indent << "Enabled: " << this->GetEnabled() << std::endl;
+			m_Lock.Lock();
+			os << indent << "NumberOfEvents: " << m_Events.size() << std::endl;
+			m_Lock.Unlock();
+		}
+
+	private:
+		TraceEventRecorder(const Self&); //purposely not implemented
+		void operator=(const Self&); //purposely not implemented
+
+		struct EventType
+		{
+			std::string		Name;
+			std::string		Category;
+			double				Start;
+			double				Duration;
+			unsigned int	Thread;
+		};
+
+		/** Write a string as a quoted JSON string, escaping the quotes, the
+		 * backslashes and the control characters. */
+		static void WriteJSONString(std::ostream & os, const std::string & value)
+		{
+			os << '"';
+			for(std::string::size_type i = 0; i < value.size(); i++)
+			{
+				const unsigned char c = static_cast<unsigned char>( value[i] );
+				switch( c )
+				{
+					case '"':  os << "\\\""; break;
+					case '\\': os << "\\\\"; break;
+					case '\n': os << "\\n"; break;
+					case '\r': os << "\\r"; break;
+					case '\t': os << "\\t"; break;
+					default:
+						if( c < 0x20 )
+						{
+							const char * hexDigits = "0123456789abcdef";
+							os << "\\u00" << hexDigits[c >> 4] << hexDigits[c & 0xf];
+						}
+						else
+						{
+							os << value[i];
+						}
+				}
+			}
+			os << '"';
+		}
+
+		/** Small index of the calling thread, in order of first event.
+		 * Called with the lock held. */
+		unsigned int GetCurrentThreadIndex()
+		{
+#ifdef _WIN32
+			std::size_t id = static_cast<std::size_t>( GetCurrentThreadId() );
+#else
+			std::size_t id = (std::size_t) pthread_self();
+#endif
+			std::map<std::size_t, unsigned int>::iterator it = m_ThreadIndices.find( id );
+			if( it != m_ThreadIndices.end() )
+			{
+				return it->second;
+			}
+			unsigned int index = static_cast<unsigned int>( m_ThreadIndices.size() ) + 1;
+			m_ThreadIndices[id] = index;
+			return index;
+		}
+
+		mutable SimpleFastMutexLock								m_Lock;
+		bool																			m_Enabled;
+		RealTimeClock::Pointer										m_Clock;
+		double																		m_StartTime;
+		std::vector<EventType>										m_Events;
+		std::map<std::size_t, unsigned int>				m_ThreadIndices;
+		std::map<unsigned int, std::string>				m_ThreadNames;
+	};
+
+	/** \class TraceTimeProbe
+	 * \brief TimeProbe that also records each Start()/Stop() interval in the
+	 * TraceEventRecorder, so that a timed stage appears on the timeline. */
+	class TraceTimeProbe : public TimeProbe
+	{
+	public:
+		TraceTimeProbe(const std::string & name, const std::string & category):
+		m_Name(name), m_Category(category), m_EventStart(0.0) {}
+
+		void Start()
+		{
+			m_EventStart = TraceEventRecorder::GetInstance()->GetTimeStamp();
+			TimeProbe::Start();
+		}
+
+		void Stop()
+		{
+			TimeProbe::Stop();
+			TraceEventRecorder * recorder = TraceEventRecorder::GetInstance();
+			recorder->AddCompleteEvent(m_Name, m_Category, m_EventStart, recorder->GetTimeStamp() - m_EventStart);
+		}
+
+	private:
+		std::string		m_Name;
+		std::string		m_Category;
+		double				m_EventStart;
+	};
+
+} // end namespace itk
+
+#endif
@@ -31,6 +31,7 @@
 #include "itkFastMarchingUpwindGradientImageFilter2.h"
 #include "itkMultiplyByConstantImageFilter.h"
 #include "itkRK4CharacteristicDirectionsToPathFilter.h"
+#include "itkDijkstraImageFilter.h"
 
 namespace itk
 {
@@ -52,6 +53,25 @@ namespace itk
 	 * In practice, even if such a scenario is very unlikely to happen, 
 	 * we prefere to let the Fast Marching explore the whole domain.
 	 * 
+	 * With the PredecessorWalk path extraction mode, the Fast Marching records for
+	 * each accepted voxel the neighbor it was reached from instead of the
+	 * characteristic directions, and the paths are extracted by following these
+	 * predecessors from the endpoints back to the start point: the paths are voxel
+	 * accurate, but need neither the gradient image nor any interpolation. They can
+	 * be smoothed afterwards, e.g. with PolyLineParametricTubularPath::SmoothVertexLocations().
+	 * 
+	 * With the Dijkstra geodesic solver, the Fast Marching is replaced by Dijkstra's
+	 * algorithm on the graph of the voxels (see DijkstraImageFilter), on the same region
+	 * and from the same points, and the paths are walks through its predecessors. The
+	 * paths are approximate, biased towards the directions of the neighborhood, but
+	 * they are computed fast enough for a preview of the path while an endpoint moves.
+	 * 
+	 * With a TargetMask, e.g. the rasterized paths of an existing reconstruction
+	 * (see RasterizePaths()), the end points are ignored: the front stops at the
+	 * first voxel of the mask it reaches, and the single output path links the start
+	 * point to this voxel. Connecting a new branch to a tree thus costs one
+	 * propagation, whatever the number of voxels of the tree.
+	 * 
 	 *
 	 *
 	 * \author Fethallah Benmansour, fethallah[at]gmail.com
@@ -108,7 +128,15 @@ namespace itk
 		typedef typename NodeContainerType::Pointer									NodeContainerPointer;
 		typedef typename FastMarchingFilterType::NodeType						NodeType;
 		typedef typename FastMarchingFilterType::GradientImageType	CharacteristicsImageType;
+		typedef typename FastMarchingFilterType::PredecessorImageType	PredecessorImageType;
 		typedef typename FastMarchingFilterType::LevelSetImageType	DistanceImageType;
+		typedef typename FastMarchingFilterType::SpeedFunctionType	SpeedFunctionType;
+		typedef typename FastMarchingFilterType::TargetMaskImageType	TargetMaskImageType;
+		typedef typename TargetMaskImageType::Pointer								TargetMaskImagePointer;
+		
+		/** Declare the Dijkstra filter type */
+		typedef DijkstraImageFilter< InputImageType, InputImageType >	DijkstraFilterType;
+		typedef typename DijkstraFilterType::Pointer								DijkstraFilterPointer;
 		
 		/** Declare Characteristics to path filter  */
 		typedef RK4CharacteristicDirectionsToPathFilter
@@ -179,6 +207,98 @@ namespace itk
 		itkSetMacro(NbMaxIter, unsigned int);
 		itkGetMacro(NbMaxIter, unsigned int);
 		
+		/** Set/Get the token used to cancel the computation from another thread.
+		 * It is forwarded to the fast marching filter. */
+		itkSetObjectMacro(CancellationToken, CancellationToken);
+		itkGetObjectMacro(CancellationToken, CancellationToken);
+		
+		/** Set/Get a function giving the tubularity at an index of the input,
+		 * e.g. a ParametricScaleProfileImageFunction. When it is set, the fast
+		 * marching evaluates it instead of reading the input pixels, and the
+		 * input only gives the geometry: it may be an image without pixel
+		 * buffer, such as ParametricScaleProfileImageFunction::GetScoreInformation(). */
+		itkSetConstObjectMacro(SpeedFunction, SpeedFunctionType);
+		itkGetConstObjectMacro(SpeedFunction, SpeedFunctionType);
+		
+		/** Ways of extracting the paths: a Runge-Kutta descent along the
+		 * interpolated characteristic directions (the default), or a walk
+		 * through the predecessors recorded by the fast marching. */
+		enum {
+			CharacteristicDescent,
+			PredecessorWalk
+		};
+		itkSetMacro(PathExtractionMode, int);
+		itkGetConstMacro(PathExtractionMode, int);
+		void SetPathExtractionModeToCharacteristicDescent()
+		{ this->SetPathExtractionMode(CharacteristicDescent); }
+		void SetPathExtractionModeToPredecessorWalk()
+		{ this->SetPathExtractionMode(PredecessorWalk); }
+		
+		/** Set/Get the mask of the target voxels. When it is set, the end points
+		 * are ignored and a single path is extracted, to the first voxel of the
+		 * mask reached from the start point; the mask must have the geometry of
+		 * the input. None by default. */
+		itkSetConstObjectMacro(TargetMask, TargetMaskImageType);
+		itkGetConstObjectMacro(TargetMask, TargetMaskImageType);
+		
+		/** The voxel of the target mask reached by the last update. */
+		itkGetConstReferenceMacro(ReachedTargetMaskIndex, IndexType);
+		
+		/** A target mask with the geometry of the given image, non-zero on the
+		 * voxels along the segments of the paths, whose vertices are continuous
+		 * indices of the image. With allScales, the scale being the last axis,
+		 * the voxels are marked at all the scales, so that a path may reach the
+		 * existing ones at another radius. */
+		static TargetMaskImagePointer RasterizePaths(const std::vector<PathPointer>& paths,
+																								 const InputImageType* geometry,
+																								 bool allScales = true);
+		
+		/** Solvers of the geodesic distance: the Fast Marching (the default),
+		 * or Dijkstra's algorithm for approximate paths. */
+		enum {
+			FastMarchingSolver,
+			DijkstraSolver
+		};
+		itkSetMacro(GeodesicSolver, int);
+		itkGetConstMacro(GeodesicSolver, int);
+		void SetGeodesicSolverToFastMarching()
+		{ this->SetGeodesicSolver(FastMarchingSolver); }
+		void SetGeodesicSolverToDijkstra()
+		{ this->SetGeodesicSolver(DijkstraSolver); }
+		
+		/** Set/Get the connectivity of the Dijkstra solver, the maximum number
+		 * of non-zero coordinates of the neighbor offsets (see
+		 * DijkstraImageFilter::SetConnectivity()). Defaults to the dimension,
+		 * the full neighborhood. */
+		itkSetClampMacro(DijkstraConnectivity, unsigned int, 1, SetDimension);
+		itkGetConstMacro(DijkstraConnectivity, unsigned int);
+		
+		/** Set/Get whether the fast marching holds its working images in
+		 * Z-order bricks (see FastMarchingImageFilter2::SetUseBrickedStorage()).
+		 * Off by default. */
+		itkSetMacro(UseBrickedStorage, bool);
+		itkGetConstMacro(UseBrickedStorage, bool);
+		itkBooleanMacro(UseBrickedStorage);
+		
+		/** Statistics of the last update, copied from the internal filters.
+		 * Fast marching (or Dijkstra propagation): the wall-clock time, the number of accepted points,
+		 * the heap pushes, the largest heap size, the discarded (stale) heap
+		 * nodes and the size in bytes of the image the paths are extracted
+		 * from (characteristic directions or predecessors).
+		 * Back-tracing: the wall-clock time, the descent steps (voxel steps
+		 * of the predecessor walk) and the discrete steps taken because of
+		 * oscillations or of a zero gradient. */
+		itkGetConstMacro(FastMarchingTime, double);
+		itkGetConstMacro(NumberOfAcceptedPoints, SizeValueType);
+		itkGetConstMacro(NumberOfHeapPushes, SizeValueType);
+		itkGetConstMacro(MaximumHeapSize, SizeValueType);
+		itkGetConstMacro(NumberOfStalePops, SizeValueType);
+		itkGetConstMacro(GradientImageMemorySize, SizeValueType);
+		itkGetConstMacro(PathExtractionTime, double);
+		itkGetConstMacro(NumberOfDescentSteps, SizeValueType);
+		itkGetConstMacro(NumberOfOscillationFallbacks, SizeValueType);
+		itkGetConstMacro(NumberOfZeroGradientFallbacks, SizeValueType);
+		
 		
 	protected:
 		TubularMetricToPathFilter();
@@ -206,6 +326,18 @@ namespace itk
 											std::vector<PathPointer>& outputPathList,
 											std::vector<double>& outputDistanceList);
 		
+		void ComputeDijkstraPaths(const InputImageType* input,
+															std::vector<PathPointer>& outputPathList,
+															std::vector<double>& outputDistanceList);
+		
+		void SetOutputPaths(const std::vector<PathPointer>& outputPathList,
+												const std::vector<double>& outputDistanceList);
+		
+		void ComputePathsByPredecessorWalk(const PredecessorImageType* predecessorImage,
+																			 const DistanceImageType* distImage,
+																			 std::vector<PathPointer>& outputPathList,
+																			 std::vector<double>& outputDistanceList);
+		
 		
 		double																		m_TerminationDistanceFactor;
 		double																		m_OscillationFactor;
@@ -217,8 +349,29 @@ namespace itk
 		std::vector<IndexType>										m_EndPointList;
 		std::vector<double>												m_EndPointDistanceList;
 		
+		typename TargetMaskImageType::ConstPointer	m_TargetMask;
+		IndexType																	m_ReachedTargetMaskIndex;
+		
 		RegionType																m_RegionToProcess;
 		
+		CancellationToken::Pointer								m_CancellationToken;
+		typename SpeedFunctionType::ConstPointer	m_SpeedFunction;
+		bool																			m_UseBrickedStorage;
+		int																				m_PathExtractionMode;
+		int																				m_GeodesicSolver;
+		unsigned int															m_DijkstraConnectivity;
+		
+		double																		m_FastMarchingTime;
+		SizeValueType															m_NumberOfAcceptedPoints;
+		SizeValueType															m_NumberOfHeapPushes;
+		SizeValueType															m_MaximumHeapSize;
+		SizeValueType															m_NumberOfStalePops;
+		SizeValueType															m_GradientImageMemorySize;
+		double																		m_PathExtractionTime;
+		SizeValueType															m_NumberOfDescentSteps;
+		SizeValueType															m_NumberOfOscillationFallbacks;
+		SizeValueType															m_NumberOfZeroGradientFallbacks;
+		
 	};
 	
 }
@@ -19,6 +19,11 @@
 #define __itkTubularMetricToPathFilter_txx
 
 #include "itkTubularMetricToPathFilter.h"
+#include "itkProgressAccumulator.h"
+#include "itkTimeProbe.h"
+#include "itkMetricsRegistry.h"
+#include "itkTraceEventRecorder.h"
+#include "vnl/vnl_math.h"
 
 namespace itk
 {
@@ -32,6 +37,22 @@ namespace itk
 		m_NbMaxIter									= 50000;
 		m_IsStartPointGiven         = false;
 		m_OscillationFactor         = 0.1;
+		m_UseBrickedStorage					= false;
+		m_PathExtractionMode				= CharacteristicDescent;
+		m_GeodesicSolver						= FastMarchingSolver;
+		m_DijkstraConnectivity			= SetDimension;
+		m_ReachedTargetMaskIndex.Fill( 0 );
+		
+		m_FastMarchingTime							= 0.0;
+		m_NumberOfAcceptedPoints				= 0;
+		m_NumberOfHeapPushes						= 0;
+		m_MaximumHeapSize								= 0;
+		m_NumberOfStalePops							= 0;
+		m_GradientImageMemorySize				= 0;
+		m_PathExtractionTime						= 0.0;
+		m_NumberOfDescentSteps					= 0;
+		m_NumberOfOscillationFallbacks	= 0;
+		m_NumberOfZeroGradientFallbacks	= 0;
 	}
 	
 	/**
@@ -47,6 +68,23 @@ namespace itk
 		os << indent << "DescentStepFactor:  "				 << m_DescentStepFactor << std::endl;
 		os << indent << "NbMaxIter:  "								 << m_NbMaxIter << std::endl;
 		os << indent << "IsStartPointGiven:  "				 << m_IsStartPointGiven << std::endl;
+		os << indent << "SpeedFunction:  "						 << m_SpeedFunction.GetPointer() << std::endl;
+		os << indent << "UseBrickedStorage:  "				 << m_UseBrickedStorage << std::endl;
+		os << indent << "PathExtractionMode:  "				 << m_PathExtractionMode << std::endl;
+		os << indent << "GeodesicSolver:  "						 << m_GeodesicSolver << std::endl;
+		os << indent << "DijkstraConnectivity:  "			 << m_DijkstraConnectivity << std::endl;
+		os << indent << "TargetMask:  "								 << m_TargetMask.GetPointer() << std::endl;
+		os << indent << "ReachedTargetMaskIndex:  "		 << m_ReachedTargetMaskIndex << std::endl;
+		os << indent << "FastMarchingTime:  "					 << m_FastMarchingTime << std::endl;
+		os << indent << "NumberOfAcceptedPoints:  "		 << m_NumberOfAcceptedPoints << std::endl;
+		os << indent << "NumberOfHeapPushes:  "				 << m_NumberOfHeapPushes << std::endl;
+		os << indent << "MaximumHeapSize:  "					 << m_MaximumHeapSize << std::endl;
+		os << indent << "NumberOfStalePops:  "				 << m_NumberOfStalePops << std::endl;
+		os << indent << "GradientImageMemorySize:  "	 << m_GradientImageMemorySize << std::endl;
+		os << indent << "PathExtractionTime:  "				 << m_PathExtractionTime << std::endl;
+		os << indent << "NumberOfDescentSteps:  "			 << m_NumberOfDescentSteps << std::endl;
+		os << indent << "NumberOfOscillationFallbacks:  "	<< m_NumberOfOscillationFallbacks << std::endl;
+		os << indent << "NumberOfZeroGradientFallbacks:  " << m_NumberOfZeroGradientFallbacks << std::endl;
 	}
 	
 	
@@ -148,6 +186,10 @@ namespace itk
 	TubularMetricToPathFilter<TInputImage,TOutputPath>
 	::GetNumberOfPathsToExtract() const
 	{
+		if( m_TargetMask )
+		{
+			return 1;
+		}
 		return m_EndPointList.size();
 	}
 	
@@ -159,8 +201,82 @@ namespace itk
 	TubularMetricToPathFilter<TInputImage,TOutputPath>
 	::GetEndPoint(unsigned int i)
 	{
+		if( m_TargetMask )
+		{
+			return m_ReachedTargetMaskIndex;
+		}
 		return m_EndPointList[i];
 	}
+	
+	/**
+	 *
+	 */
+	template<class TInputImage, class TOutputPath>
+	typename TubularMetricToPathFilter<TInputImage,TOutputPath>::TargetMaskImagePointer
+	TubularMetricToPathFilter<TInputImage,TOutputPath>
+	::RasterizePaths(const std::vector<PathPointer>& paths,
+									 const InputImageType* geometry,
+									 bool allScales)
+	{
+		TargetMaskImagePointer mask = TargetMaskImageType::New();
+		mask->CopyInformation( geometry );
+		mask->SetRegions( geometry->GetLargestPossibleRegion() );
+		mask->Allocate();
+		mask->FillBuffer( 0 );
+		
+		const RegionType region = mask->GetBufferedRegion();
+		const unsigned int scaleAxis = SetDimension - 1;
+		const IndexValueType firstScale = region.GetIndex()[scaleAxis];
+		const IndexValueType lastScale = firstScale + static_cast<IndexValueType>( region.GetSize()[scaleAxis] ) - 1;
+		
+		for(unsigned int p = 0; p < paths.size(); p++)
+		{
+			if( paths[p].IsNull() )
+			{
+				continue;
+			}
+			const typename PathType::VertexListType * vertices = paths[p]->GetVertexList();
+			const unsigned int numberOfVertices = vertices->Size();
+			for(unsigned int v = 0; v < numberOfVertices; v++)
+			{
+				const VertexType & a = vertices->ElementAt( v );
+				const VertexType & b = vertices->ElementAt( v + 1 < numberOfVertices ? v + 1 : v );
+				
+				// Steps of at most half a voxel along each axis, so that no voxel
+				// crossed by the segment is skipped.
+				double length = 0.0;
+				for(unsigned int d = 0; d < SetDimension; d++)
+				{
+					length = vnl_math_max( length, vnl_math_abs( b[d] - a[d] ) );
+				}
+				const unsigned int numberOfSteps = vnl_math_max( 1, vnl_math_ceil( 2.0 * length ) );
+				for(unsigned int s = 0; s <= numberOfSteps; s++)
+				{
+					const double t = static_cast<double>( s ) / numberOfSteps;
+					IndexType index;
+					for(unsigned int d = 0; d < SetDimension; d++)
+					{
+						index[d] = vnl_math_rnd( a[d] + t * ( b[d] - a[d] ) );
+					}
+					if( allScales )
+					{
+						for(index[scaleAxis] = firstScale; index[scaleAxis] <= lastScale; index[scaleAxis]++)
+						{
+							if( region.IsInside( index ) )
+							{
+								mask->SetPixel( index, 1 );
+							}
+						}
+					}
+					else if( region.IsInside( index ) )
+					{
+						mask->SetPixel( index, 1 );
+					}
+				}
+			}
+		}
+		return mask;
+	}
 		
 	/**
 	 *
@@ -182,7 +298,7 @@ namespace itk
 			itkExceptionMacro( "Start Point must be provided" );
 		}
 		
-		if( m_EndPointList.size() == 0 )
+		if( m_EndPointList.size() == 0 && !m_TargetMask )
 		{
 			itkExceptionMacro( "At least one end point must be provided" );
 			return;
@@ -195,7 +311,7 @@ namespace itk
 		{
 			isValidRegion = false;
 		}
-		for(unsigned int i = 0; i < m_EndPointList.size(); i++)
+		for(unsigned int i = 0; i < m_EndPointList.size() && !m_TargetMask; i++)
 		{
 			if( !m_RegionToProcess.IsInside( m_EndPointList[i] ) )
 			{
@@ -205,7 +321,7 @@ namespace itk
 		}
 		if( !isValidRegion )
 		{
-			m_RegionToProcess = input->GetBufferedRegion();
+			m_RegionToProcess = m_SpeedFunction ? input->GetLargestPossibleRegion() : input->GetBufferedRegion();
 			
 			itkWarningMacro("The region to be processed is expanded to the buffered "
 											<<"region of the input image since it does not include "
@@ -213,10 +329,24 @@ namespace itk
 											<<"call the SetRegionToProcess() method.");	
 		}
 		
+		std::vector<PathPointer> outputPathList;
+		std::vector<double> outputDistanceList;
+		if( m_GeodesicSolver == DijkstraSolver )
+		{
+			this->ComputeDijkstraPaths( input, outputPathList, outputDistanceList );
+			this->SetOutputPaths( outputPathList, outputDistanceList );
+			return;
+		}
+		
 		// Set up the fast marching filter.
+		const bool usePredecessorWalk = m_PathExtractionMode == PredecessorWalk;
 		FastMarchingFilterPointer fastMarching = FastMarchingFilterType::New();
-		fastMarching->SetGenerateGradientImage(true);
+		fastMarching->SetGenerateGradientImage( !usePredecessorWalk );
+		fastMarching->SetGeneratePredecessorImage( usePredecessorWalk );
 		fastMarching->SetInput( input );
+		fastMarching->SetCancellationToken( m_CancellationToken );
+		fastMarching->SetSpeedFunction( m_SpeedFunction );
+		fastMarching->SetUseBrickedStorage( m_UseBrickedStorage );
 		
 		// Confine the processing to the given region.
 		fastMarching->SetOverrideOutputInformation( true );
@@ -236,31 +366,101 @@ namespace itk
 		seed->InsertElement( 0, node );
 		fastMarching->SetTrialPoints( seed );
 		
-		//Add the set of endPoints to the fast marching filter, so it does not process in useless regions
-		unsigned int numberOfOutputs = this->GetNumberOfPathsToExtract();
-		NodeContainerPointer endPoints = NodeContainerType::New();
-		endPoints->Initialize();
-		for (unsigned int i = 0; i < numberOfOutputs; i++) 
+		if( m_TargetMask )
 		{
-			NodeType endPoint;
-			endPoint.SetIndex( m_EndPointList[i] );
-			endPoints->InsertElement( i, endPoint );
+			fastMarching->SetTargetMask( m_TargetMask );
+		}
+		else
+		{
+			//Add the set of endPoints to the fast marching filter, so it does not process in useless regions
+			unsigned int numberOfOutputs = this->GetNumberOfPathsToExtract();
+			NodeContainerPointer endPoints = NodeContainerType::New();
+			endPoints->Initialize();
+			for (unsigned int i = 0; i < numberOfOutputs; i++) 
+			{
+				NodeType endPoint;
+				endPoint.SetIndex( m_EndPointList[i] );
+				endPoints->InsertElement( i, endPoint );
+			}
+			
+			fastMarching->SetTargetPoints( endPoints );
+			fastMarching->SetTargetReachedModeToAllTargets();
 		}
 		
-		fastMarching->SetTargetPoints( endPoints );
-		fastMarching->SetTargetReachedModeToAllTargets();
+		// The fast marching dominates the computation time, its progress
+		// is reported as the progress of this filter.
+		ProgressAccumulator::Pointer progress = ProgressAccumulator::New();
+		progress->SetMiniPipelineFilter( this );
+		progress->RegisterInternalFilter( fastMarching, 0.95f );
 		
+		TraceTimeProbe fastMarchingTime("fastMarching", "tracing");
+		fastMarchingTime.Start();
 		fastMarching->Update();
+		fastMarchingTime.Stop();
+		
+		if( m_TargetMask )
+		{
+			if( !fastMarching->GetTargetMaskReached() )
+			{
+				itkExceptionMacro( "No voxel of the target mask was reached from the start point" );
+			}
+			m_ReachedTargetMaskIndex = fastMarching->GetReachedTargetMaskIndex();
+		}
+		
+		m_FastMarchingTime				= fastMarchingTime.GetTotal();
+		m_NumberOfAcceptedPoints	= fastMarching->GetNumberOfAcceptedPoints();
+		m_NumberOfHeapPushes			= fastMarching->GetNumberOfHeapPushes();
+		m_MaximumHeapSize					= fastMarching->GetMaximumHeapSize();
+		m_NumberOfStalePops				= fastMarching->GetNumberOfStalePops();
+		MetricsRegistry * metrics = MetricsRegistry::GetInstance();
+		metrics->AddTime("tracing.fastMarching", m_FastMarchingTime);
+		if( usePredecessorWalk )
+		{
+			m_GradientImageMemorySize	= fastMarching->GetPredecessorImage()->GetBufferedRegion().GetNumberOfPixels() *
+																	sizeof( typename PredecessorImageType::PixelType );
+			metrics->UpdateGaugeMaximum("tracing.predecessorImageBytes", m_GradientImageMemorySize);
+		}
+		else
+		{
+			m_GradientImageMemorySize	= fastMarching->GetGradientImage()->GetBufferedRegion().GetNumberOfPixels() *
+																	sizeof( typename CharacteristicsImageType::PixelType );
+			metrics->UpdateGaugeMaximum("tracing.gradientImageBytes", m_GradientImageMemorySize);
+		}
 		
 		// Compute the minimal paths and their distances.		
-		std::vector<PathPointer> outputPathList;
-		std::vector<double> outputDistanceList;
-		ComputePaths(input, 
-								 fastMarching->GetGradientImage(),
-								 fastMarching->GetOutput(),
-								 outputPathList,
-								 outputDistanceList);
+		TraceTimeProbe pathExtractionTime("pathExtraction", "tracing");
+		pathExtractionTime.Start();
+		if( usePredecessorWalk )
+		{
+			ComputePathsByPredecessorWalk(fastMarching->GetPredecessorImage(),
+																		fastMarching->GetOutput(),
+																		outputPathList,
+																		outputDistanceList);
+		}
+		else
+		{
+			ComputePaths(input, 
+									 fastMarching->GetGradientImage(),
+									 fastMarching->GetOutput(),
+									 outputPathList,
+									 outputDistanceList);
+		}
+		pathExtractionTime.Stop();
+		m_PathExtractionTime = pathExtractionTime.GetTotal();
+		metrics->AddTime("tracing.pathExtraction", m_PathExtractionTime);
 		
+		this->SetOutputPaths( outputPathList, outputDistanceList );
+	}
+	
+	/**
+	 *
+	 */
+	template <class TInputImage, class TOutputPath>
+	void
+	TubularMetricToPathFilter<TInputImage,TOutputPath>
+	::SetOutputPaths(const std::vector<PathPointer>& outputPathList,
+									 const std::vector<double>& outputDistanceList)
+	{
 		// Set the output paths and their distances.
 		m_EndPointDistanceList.resize( this->GetNumberOfPathsToExtract() );
 		for( unsigned int i = 0; i < this->GetNumberOfPathsToExtract(); i++ )
@@ -268,7 +468,108 @@ namespace itk
 			this->ProcessObject::SetNthOutput( i, outputPathList[i].GetPointer() );
 			m_EndPointDistanceList[i] = outputDistanceList[i];
 		}
+	}
+	
+	/**
+	 *
+	 */
+	template <class TInputImage, class TOutputPath>
+	void
+	TubularMetricToPathFilter<TInputImage,TOutputPath>
+	::ComputeDijkstraPaths(const InputImageType* input,
+												 std::vector<PathPointer>& outputPathList,
+												 std::vector<double>& outputDistanceList)
+	{
+		DijkstraFilterPointer dijkstra = DijkstraFilterType::New();
+		dijkstra->SetInput( input );
+		dijkstra->SetSpeedFunction( m_SpeedFunction );
+		dijkstra->SetCancellationToken( m_CancellationToken );
+		dijkstra->SetConnectivity( m_DijkstraConnectivity );
+		dijkstra->SetOutputRegion( m_RegionToProcess );
+		dijkstra->SetSeeds( std::vector<IndexType>( 1, m_StartPoint ) );
+		if( m_TargetMask )
+		{
+			dijkstra->SetTargetMask( m_TargetMask );
+		}
+		else
+		{
+			dijkstra->SetTargetPoints( m_EndPointList );
+		}
+		
+		ProgressAccumulator::Pointer progress = ProgressAccumulator::New();
+		progress->SetMiniPipelineFilter( this );
+		progress->RegisterInternalFilter( dijkstra, 0.95f );
+		
+		TraceTimeProbe dijkstraTime("dijkstra", "tracing");
+		dijkstraTime.Start();
+		dijkstra->Update();
+		dijkstraTime.Stop();
+		
+		if( m_TargetMask )
+		{
+			if( !dijkstra->GetTargetMaskReached() )
+			{
+				itkExceptionMacro( "No voxel of the target mask was reached from the start point" );
+			}
+			m_ReachedTargetMaskIndex = dijkstra->GetReachedTargetMaskIndex();
+		}
+		
+		m_FastMarchingTime				= dijkstraTime.GetTotal();
+		m_NumberOfAcceptedPoints	= dijkstra->GetNumberOfSettledPoints();
+		m_NumberOfHeapPushes			= dijkstra->GetNumberOfHeapPushes();
+		m_MaximumHeapSize					= dijkstra->GetMaximumHeapSize();
+		m_NumberOfStalePops				= dijkstra->GetNumberOfStalePops();
+		m_GradientImageMemorySize	= dijkstra->GetPredecessorImage()->GetBufferedRegion().GetNumberOfPixels() *
+																sizeof( typename DijkstraFilterType::PredecessorImageType::PixelType );
+		MetricsRegistry * metrics = MetricsRegistry::GetInstance();
+		metrics->AddTime("tracing.dijkstra", m_FastMarchingTime);
+		metrics->UpdateGaugeMaximum("tracing.predecessorImageBytes", m_GradientImageMemorySize);
 		
+		TraceTimeProbe pathExtractionTime("pathExtraction", "tracing");
+		pathExtractionTime.Start();
+		m_NumberOfDescentSteps					= 0;
+		m_NumberOfOscillationFallbacks	= 0;
+		m_NumberOfZeroGradientFallbacks	= 0;
+		
+		unsigned int numberOfOutputs = GetNumberOfPathsToExtract();
+		outputPathList.resize( numberOfOutputs );
+		outputDistanceList.resize( numberOfOutputs );
+		for ( unsigned int n=0; n < numberOfOutputs; n++ )
+		{
+			outputDistanceList[n] = dijkstra->GetOutput()->GetPixel( this->GetEndPoint( n ) );
+			
+			PathPointer path = PathType::New();
+			IndexType index = this->GetEndPoint( n );
+			IndexType predecessor;
+			VertexType vertex;
+			while( true )
+			{
+				for(unsigned int d = 0; d < SetDimension; d++)
+				{
+					vertex[d] = index[d];
+				}
+				path->AddVertex( vertex );
+				if( !dijkstra->GetPredecessor( index, predecessor ) )
+				{
+					break;
+				}
+				index = predecessor;
+				++m_NumberOfDescentSteps;
+			}
+			
+			if( index != m_StartPoint )
+			{
+				itkWarningMacro("Start point not reached from the end point " << this->GetEndPoint( n ));
+			}
+			
+			// Reverse the path so that it is from the source vertex to the target one.
+			path->Reverse();
+			
+			outputPathList[n] = path;
+		}
+		pathExtractionTime.Stop();
+		m_PathExtractionTime = pathExtractionTime.GetTotal();
+		metrics->AddTime("tracing.pathExtraction", m_PathExtractionTime);
 	}
 	
 	
@@ -297,11 +598,15 @@ namespace itk
 		outputDistanceList.resize( numberOfOutputs );
 		for (unsigned int i = 0; i < numberOfOutputs; i++) 
 		{
-			charPathFilter->AddPathEndPoint( m_EndPointList[i] );
-			outputDistanceList[i] = distImage->GetPixel( m_EndPointList[i] );
+			charPathFilter->AddPathEndPoint( this->GetEndPoint( i ) );
+			outputDistanceList[i] = distImage->GetPixel( this->GetEndPoint( i ) );
 		}
 		charPathFilter->Update();
 		
+		m_NumberOfDescentSteps					= charPathFilter->GetNumberOfSteps();
+		m_NumberOfOscillationFallbacks	= charPathFilter->GetNumberOfOscillationFallbacks();
+		m_NumberOfZeroGradientFallbacks	= charPathFilter->GetNumberOfZeroGradientFallbacks();
+		
 		outputPathList.resize( numberOfOutputs );
 		for ( unsigned int n=0; n < numberOfOutputs; n++ )
 		{
@@ -313,6 +618,67 @@ namespace itk
 			outputPathList[n] = path;
 		}
 	}
+	
+	/**
+	 *
+	 */
+	template<class TInputImage, class TOutputPath>
+	void 
+	TubularMetricToPathFilter<TInputImage,TOutputPath>
+	::ComputePathsByPredecessorWalk(const PredecessorImageType* predecessorImage,
+																	const DistanceImageType* distImage,
+																	std::vector<PathPointer>& outputPathList,
+																	std::vector<double>& outputDistanceList)
+	{
+		unsigned int numberOfOutputs = GetNumberOfPathsToExtract();
+		
+		m_NumberOfDescentSteps					= 0;
+		m_NumberOfOscillationFallbacks	= 0;
+		m_NumberOfZeroGradientFallbacks	= 0;
+		
+		outputPathList.resize( numberOfOutputs );
+		outputDistanceList.resize( numberOfOutputs );
+		for ( unsigned int n=0; n < numberOfOutputs; n++ )
+		{
+			outputDistanceList[n] = distImage->GetPixel( this->GetEndPoint( n ) );
+			
+			// Each predecessor was accepted before its successor, so that the
+			// walk ends, at the start point unless the end point was not reached.
+			PathPointer path = PathType::New();
+			IndexType index = this->GetEndPoint( n );
+			VertexType vertex;
+			unsigned char code;
+			while( true )
+			{
+				for(unsigned int d = 0; d < SetDimension; d++)
+				{
+					vertex[d] = index[d];
+				}
+				path->AddVertex( vertex );
+				
+				code = predecessorImage->GetPixel( index );
+				if( code == FastMarchingFilterType::NoPredecessor )
+				{
+					break;
+				}
+				unsigned int axis;
+				int step;
+				FastMarchingFilterType::DecodePredecessor( code, axis, step );
+				index[axis] += step;
+				++m_NumberOfDescentSteps;
+			}
+			
+			if( index != m_StartPoint )
+			{
+				itkWarningMacro("Start point not reached from the end point " << this->GetEndPoint( n ));
+			}
+			
+			// Reverse the path so that it is from the source vertex to the target one.
+			path->Reverse();
+			
+			outputPathList[n] = path;
+		}
+	}
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,777 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+#ifndef __itkTubularPathSpatialIndex_h
+#define __itkTubularPathSpatialIndex_h
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include <itksys/hash_map.hxx>
+#include <itkObject.h>
+#include <itkObjectFactory.h>
+#include <itkIntTypes.h>
+#include <itkFixedArray.h>
+#include <vnl/vnl_math.h>
+#include <vcl_cmath.h>
+#include "itkPolyLineParametricTubularPath.h"
+
+namespace itk
+{
+
+	/** \class TubularPathSpatialIndex
+	 * \brief Store of traced paths indexed by a uniform hash grid, for
+	 * snapping and overlap tests in time independent of the number of
+	 * stored vertices.
+	 *
+	 * The paths are PolyLineParametricTubularPath, whose last coordinate is
+	 * the scale (or the radius) and is ignored by the geometry: the
+	 * distances are measured on the first VDimension - 1 coordinates,
+	 * multiplied by the Spacing (1 by default, e.g. for paths already in
+	 * physical coordinates). The space is cut into cubic cells of CellSize;
+	 * each cell of the hash grid lists the vertices it contains and the
+	 * segments (consecutive vertices) whose bounding box overlaps it, so
+	 * that a query only visits the cells around its point or segment.
+	 * With CellSize about the typical query radius and paths resampled
+	 * finer than a cell, a query costs a few cells whatever the size of the
+	 * reconstruction.
+	 *
+	 * The queries are the nearest vertex of a point, the vertices within a
+	 * radius of a point, and the segments within a tolerance of the
+	 * segments of a path, e.g. a new trace overlapping the stored ones.
+	 * The paths are copied when added and are referred to by the identifier
+	 * AddPath() returns. The index is not thread safe.
+	 *
+	 * \author : Fethallah Benmansour
+	 */
+	template <unsigned int VDimension>
+	class TubularPathSpatialIndex : public Object
+	{
+	public:
+		/** Standard class typedefs. */
+		typedef TubularPathSpatialIndex					Self;
+		typedef Object													Superclass;
+		typedef SmartPointer<Self>							Pointer;
+		typedef SmartPointer<const Self>				ConstPointer;
+
+		/** Method for creation through the object factory. */
+		itkNewMacro(Self);
+
+		/** Run-time type information (and related methods). */
+		itkTypeMacro(TubularPathSpatialIndex, Object);
+
+		/** The dimension of the geometry, the scale excluded. */
+		itkStaticConstMacro(SpatialDimension, unsigned int, VDimension - 1);
+
+		typedef PolyLineParametricTubularPath<VDimension>		PathType;
+		typedef typename PathType::VertexType								VertexType;
+		typedef typename PathType::RadiusType								RadiusType;
+		typedef SizeValueType																PathIdentifierType;
+
+		/** A vertex found by a query: its path, its number along the path and
+		 * its distance to the query point. */
+		struct VertexHit
+		{
+			PathIdentifierType	PathId;
+			unsigned int				VertexIndex;
+			double							Distance;
+		};
+
+		/** A stored segment, from the vertex SegmentIndex of its path to the
+		 * next one, found within the tolerance of the segment of the query
+		 * path starting at its vertex QuerySegmentIndex. */
+		struct SegmentHit
+		{
+			PathIdentifierType	PathId;
+			unsigned int				SegmentIndex;
+			unsigned int				QuerySegmentIndex;
+			double							Distance;
+		};
+
+		/** Edge of the cells of the grid, in the units of the spacing.
+		 * Defaults to 8. Can only be changed while the index is empty. */
+		void SetCellSize(double cellSize)
+		{
+			if( m_NumberOfVertices > 0 )
+			{
+				itkExceptionMacro( << "The cell size of a non-empty index can not be changed" );
+			}
+			if( cellSize <= 0.0 )
+			{
+				itkExceptionMacro( << "The cell size must be positive" );
+			}
+			m_CellSize = cellSize;
+			this->Modified();
+		}
+		itkGetConstMacro(CellSize, double);
+
+		/** Spacing of the first VDimension - 1 coordinates of the vertices.
+		 * Can only be changed while the index is empty. */
+		void SetSpacing(const double spacing[SpatialDimension])
+		{
+			if( m_NumberOfVertices > 0 )
+			{
+				itkExceptionMacro( << "The spacing of a non-empty index can not be changed" );
+			}
+			for(unsigned int d = 0; d < SpatialDimension; d++)
+			{
+				m_Spacing[d] = spacing[d];
+			}
+			this->Modified();
+		}
+		const double * GetSpacing() const
+		{
+			return m_Spacing;
+		}
+
+		/** Add a copy of a path, returns its identifier. */
+		PathIdentifierType AddPath(const PathType * path)
+		{
+			if( !path )
+			{
+				itkExceptionMacro( << "No path given" );
+			}
+			const PathIdentifierType pathId = m_NextPathId++;
+			StoredPath & stored = m_Paths[pathId];
+			const typename PathType::VertexListType * vertices = path->GetVertexList();
+			const unsigned int numberOfVertices = vertices->Size();
+			stored.Vertices.resize( numberOfVertices );
+			stored.Radii.resize( numberOfVertices );
+			for(unsigned int k = 0; k < numberOfVertices; k++)
+			{
+				stored.Vertices[k] = vertices->ElementAt( k );
+				stored.Radii[k] = path->GetVertexRadius( k );
+			}
+			this->InsertPathInGrid( pathId, stored );
+			m_NumberOfVertices += numberOfVertices;
+			this->Modified();
+			return pathId;
+		}
+
+		/** Remove a path. Returns false if there is no such path. */
+		bool RemovePath(PathIdentifierType pathId)
+		{
+			typename PathMapType::iterator it = m_Paths.find( pathId );
+			if( it == m_Paths.end() )
+			{
+				return false;
+			}
+			this->ErasePathFromGrid( pathId, it->second );
+			m_NumberOfVertices -= it->second.Vertices.size();
+			m_Paths.erase( it );
+			this->Modified();
+			return true;
+		}
+
+		/** Remove all the paths. */
+		void Clear()
+		{
+			m_Paths.clear();
+			m_VertexCells.clear();
+			m_SegmentCells.clear();
+			for(unsigned int d = 0; d < SpatialDimension; d++)
+			{
+				m_CellCoordinateCounts[d].clear();
+			}
+			this->UpdateCellBounds();
+			m_NumberOfVertices = 0;
+			this->Modified();
+		}
+
+		/** Number of stored paths, of their vertices, and of the non-empty
+		 * cells of the grid. */
+		SizeValueType GetNumberOfPaths() const
+		{
+			return m_Paths.size();
+		}
+		itkGetConstMacro(NumberOfVertices, SizeValueType);
+		SizeValueType GetNumberOfCells() const
+		{
+			return m_SegmentCells.size();
+		}
+
+		/** Whether a path is stored, and its vertices and radii. */
+		bool HasPath(PathIdentifierType pathId) const
+		{
+			return m_Paths.find( pathId ) != m_Paths.end();
+		}
+		const std::vector<VertexType> & GetPathVertices(PathIdentifierType pathId) const
+		{
+			return this->GetStoredPath( pathId ).Vertices;
+		}
+		const std::vector<RadiusType> & GetPathRadii(PathIdentifierType pathId) const
+		{
+			return this->GetStoredPath( pathId ).Radii;
+		}
+
+		/** The stored vertex nearest to a point, if one is within maxDistance.
+		 * The cells are visited in rings of growing distance around the cell
+		 * of the point, up to the first ring farther than the nearest vertex
+		 * found, than maxDistance or than the cells holding a vertex; only
+		 * the shell of each ring is visited. */
+		bool FindNearestVertex(const VertexType & point, double maxDistance, VertexHit & hit) const
+		{
+			if( m_NumberOfVertices == 0 || maxDistance < 0.0 )
+			{
+				return false;
+			}
+			CellIndexType center;
+			this->ComputeCellIndex( point, center );
+
+			// No ring beyond the cells of the farthest vertex, nor beyond
+			// maxDistance, can hold a closer vertex.
+			long maximumRing = 0;
+			for(unsigned int d = 0; d < SpatialDimension; d++)
+			{
+				maximumRing = vnl_math_max( maximumRing, vnl_math_max( center[d] - m_MinimumCell[d], m_MaximumCell[d] - center[d] ) );
+			}
+			maximumRing = vnl_math_min( maximumRing, static_cast<long>( vcl_ceil( maxDistance / m_CellSize ) ) + 1 );
+
+			bool found = false;
+			double bestDistance = maxDistance;
+			for(long ring = 0; ring <= maximumRing; ring++)
+			{
+				// A vertex of the ring is at least (ring - 1) cells away.
+				if( found && ( ring - 1 ) * m_CellSize > bestDistance )
+				{
+					break;
+				}
+				// Only the cells of the shell of the ring are visited: for each
+				// axis d, the two faces where the cell is ring cells away along d,
+				// the axes before d being restricted to the inside of the ring so
+				// that the cells shared by several faces are visited once.
+				for(unsigned int faceAxis = 0; faceAxis < SpatialDimension; faceAxis++)
+				{
+					for(int side = -1; side <= 1; side += 2)
+					{
+						if( ring == 0 && side > 0 )
+						{
+							break;
+						}
+						CellIndexType first, last;
+						for(unsigned int d = 0; d < SpatialDimension; d++)
+						{
+							const long extent = ( d < faceAxis ) ? ring - 1 : ring;
+							first[d] = center[d] - extent;
+							last[d] = center[d] + extent;
+						}
+						first[faceAxis] = last[faceAxis] = center[faceAxis] + side * ring;
+						if( !this->ClampCellRange( first, last ) )
+						{
+							continue;
+						}
+						CellIndexType cell = first;
+						do
+						{
+							this->FindNearestVertexInCell( point, cell, found, bestDistance, hit );
+						}
+						while( this->NextCell( cell, first, last ) );
+					}
+					if( ring == 0 )
+					{
+						break;
+					}
+				}
+			}
+			return found;
+		}
+
+		/** The stored vertices within a radius of a point, in no particular
+		 * order. */
+		void FindVerticesInRadius(const VertexType & point, double radius, std::vector<VertexHit> & hits) const
+		{
+			hits.clear();
+			if( m_NumberOfVertices == 0 || radius < 0.0 )
+			{
+				return;
+			}
+			CellIndexType first, last;
+			this->ComputeCellRange( point, point, radius, first, last );
+			if( !this->ClampCellRange( first, last ) )
+			{
+				return;
+			}
+			CellIndexType cell = first;
+			do
+			{
+				typename CellMapType::const_iterator it = m_VertexCells.find( this->ComputeCellKey( cell ) );
+				if( it == m_VertexCells.end() )
+				{
+					continue;
+				}
+				for(unsigned int e = 0; e < it->second.size(); e++)
+				{
+					const CellEntry & entry = it->second[e];
+					const double distance = this->ComputeDistance( point, this->GetStoredPath( entry.PathId ).Vertices[entry.Index] );
+					if( distance <= radius )
+					{
+						VertexHit hit;
+						hit.PathId = entry.PathId;
+						hit.VertexIndex = entry.Index;
+						hit.Distance = distance;
+						hits.push_back( hit );
+					}
+				}
+			}
+			while( this->NextCell( cell, first, last ) );
+		}
+
+		/** The stored segments within a tolerance of the segments of a path,
+		 * each pair of segments being reported once, e.g. to test whether a
+		 * new trace overlaps or crosses the stored ones. */
+		void FindIntersectingSegments(const PathType * path, double tolerance, std::vector<SegmentHit> & hits) const
+		{
+			hits.clear();
+			if( !path || m_NumberOfVertices == 0 || tolerance < 0.0 )
+			{
+				return;
+			}
+			const typename PathType::VertexListType * vertices = path->GetVertexList();
+			const unsigned int numberOfVertices = vertices->Size();
+			std::set< std::pair<PathIdentifierType, unsigned int> > candidates;
+			for(unsigned int q = 0; q < numberOfVertices; q++)
+			{
+				const VertexType & a = vertices->ElementAt( q );
+				const VertexType & b = vertices->ElementAt( q + 1 < numberOfVertices ? q + 1 : q );
+				if( q + 1 == numberOfVertices && numberOfVertices > 1 )
+				{
+					break;
+				}
+
+				// A stored segment overlaps several cells, but is tested once per
+				// query segment.
+				candidates.clear();
+				CellIndexType first, last;
+				this->ComputeCellRange( a, b, tolerance, first, last );
+				if( !this->ClampCellRange( first, last ) )
+				{
+					continue;
+				}
+				CellIndexType cell = first;
+				do
+				{
+					typename CellMapType::const_iterator it = m_SegmentCells.find( this->ComputeCellKey( cell ) );
+					if( it == m_SegmentCells.end() )
+					{
+						continue;
+					}
+					for(unsigned int e = 0; e < it->second.size(); e++)
+					{
+						const CellEntry & entry = it->second[e];
+						if( !candidates.insert( std::make_pair( entry.PathId, entry.Index ) ).second )
+						{
+							continue;
+						}
+						const std::vector<VertexType> & storedVertices = this->GetStoredPath( entry.PathId ).Vertices;
+						const unsigned int next = entry.Index + 1 < storedVertices.size() ? entry.Index + 1 : entry.Index;
+						const double distance = this->ComputeSegmentDistance( a, b, storedVertices[entry.Index], storedVertices[next] );
+						if( distance <= tolerance )
+						{
+							SegmentHit hit;
+							hit.PathId = entry.PathId;
+							hit.SegmentIndex = entry.Index;
+							hit.QuerySegmentIndex = q;
+							hit.Distance = distance;
+							hits.push_back( hit );
+						}
+					}
+				}
+				while( this->NextCell( cell, first, last ) );
+			}
+		}
+
+		/** Approximate memory used by the paths and the grid, in bytes. */
+		SizeValueType GetMemorySize() const
+		{
+			SizeValueType size = m_NumberOfVertices * ( sizeof(VertexType) + sizeof(RadiusType) );
+			size += this->GetNumberOfEntries( m_VertexCells ) * sizeof(CellEntry);
+			size += this->GetNumberOfEntries( m_SegmentCells ) * sizeof(CellEntry);
+			return size;
+		}
+
+	protected:
+		TubularPathSpatialIndex(): m_CellSize(8.0), m_NextPathId(1), m_NumberOfVertices(0)
+		{
+			for(unsigned int d = 0; d < SpatialDimension; d++)
+			{
+				m_Spacing[d] = 1.0;
+				m_MinimumCell[d] = 0;
+				m_MaximumCell[d] = 0;
+			}
+		}
+		virtual ~TubularPathSpatialIndex() {}
+
+		void PrintSelf(std::ostream& os, Indent indent) const
+		{
+			Superclass::PrintSelf(os, indent);
+			os << indent << "CellSize: " << m_CellSize << std::endl;
+			os << indent << "NumberOfPaths: " << m_Paths.size() << std::endl;
+			os << indent << "NumberOfVertices: " << m_NumberOfVertices << std::endl;
+			os << indent << "NumberOfCells: " << m_SegmentCells.size() << std::endl;
+		}
+
+	private:
+		TubularPathSpatialIndex(const Self&); //purposely not implemented
+		void operator=(const Self&); //purposely not implemented
+
+		struct StoredPath
+		{
+			std::vector<VertexType>		Vertices;
+			std::vector<RadiusType>		Radii;
+		};
+
+		/** A vertex, or the segment from this vertex to the next, of a path. */
+		struct CellEntry
+		{
+			PathIdentifierType	PathId;
+			unsigned int				Index;
+		};
+
+		typedef FixedArray<long, SpatialDimension>					CellIndexType;
+		typedef uint64_t																	CellKeyType;
+
+		struct CellKeyHash
+		{
+			size_t operator()(CellKeyType key) const
+			{
+				// Mix the bits of the coordinates packed in the key
+				key ^= key >> 33;
+				key *= 0xff51afd7ed558ccdULL;
+				key ^= key >> 33;
+				return static_cast<size_t>( key );
+			}
+		};
+
+		typedef itksys::hash_map< CellKeyType, std::vector<CellEntry>, CellKeyHash >	CellMapType;
+		typedef std::map< PathIdentifierType, StoredPath >							PathMapType;
+
+		const StoredPath & GetStoredPath(PathIdentifierType pathId) const
+		{
+			typename PathMapType::const_iterator it = m_Paths.find( pathId );
+			if( it == m_Paths.end() )
+			{
+				itkExceptionMacro( << "No path " << pathId << " in the index" );
+			}
+			return it->second;
+		}
+
+		void ComputeCellIndex(const VertexType & vertex, CellIndexType & cell) const
+		{
+			for(unsigned int d = 0; d < SpatialDimension; d++)
+			{
+				cell[d] = static_cast<long>( vcl_floor( vertex[d] * m_Spacing[d] / m_CellSize ) );
+			}
+		}
+
+		/** The cells overlapped by the bounding box of two vertices, padded by
+		 * a margin. */
+		void ComputeCellRange(const VertexType & a, const VertexType & b, double margin,
+													CellIndexType & first, CellIndexType & last) const
+		{
+			for(unsigned int d = 0; d < SpatialDimension; d++)
+			{
+				const double minimum = vnl_math_min( a[d], b[d] ) * m_Spacing[d] - margin;
+				const double maximum = vnl_math_max( a[d], b[d] ) * m_Spacing[d] + margin;
+				first[d] = static_cast<long>( vcl_floor( minimum / m_CellSize ) );
+				last[d] = static_cast<long>( vcl_floor( maximum / m_CellSize ) );
+			}
+		}
+
+		/** Restrict a box of cells to the cells that held a vertex, so that a
+		 * large radius does not visit empty cells. False if nothing is left. */
+		bool ClampCellRange(CellIndexType & first, CellIndexType & last) const
+		{
+			for(unsigned int d = 0; d < SpatialDimension; d++)
+			{
+				first[d] = vnl_math_max( first[d], m_MinimumCell[d] );
+				last[d] = vnl_math_min( last[d], m_MaximumCell[d] );
+				if( first[d] > last[d] )
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		/** The cell coordinates packed in 64 bits, 64 / SpatialDimension bits
+		 * each. */
+		CellKeyType ComputeCellKey(const CellIndexType & cell) const
+		{
+			const unsigned int bits = 64 / SpatialDimension;
+			const CellKeyType mask = ( bits >= 64 ) ? ~CellKeyType(0) : ( ( CellKeyType(1) << bits ) - 1 );
+			CellKeyType key = 0;
+			for(unsigned int d = 0; d < SpatialDimension; d++)
+			{
+				key = ( key << bits ) | ( static_cast<CellKeyType>( cell[d] ) & mask );
+			}
+			return key;
+		}
+
+		/** Next cell of a box of cells, in raster order; false after the last. */
+		static bool NextCell(CellIndexType & cell, const CellIndexType & first, const CellIndexType & last)
+		{
+			for(unsigned int d = 0; d < SpatialDimension; d++)
+			{
+				if( cell[d] < last[d] )
+				{
+					cell[d]++;
+					return true;
+				}
+				cell[d] = first[d];
+			}
+			return false;
+		}
+
+		/** Keep the vertex of a cell nearest to a point if it is closer than
+		 * bestDistance. */
+		void FindNearestVertexInCell(const VertexType & point, const CellIndexType & cell,
+																 bool & found, double & bestDistance, VertexHit & hit) const
+		{
+			typename CellMapType::const_iterator it = m_VertexCells.find( this->ComputeCellKey( cell ) );
+			if( it == m_VertexCells.end() )
+			{
+				return;
+			}
+			for(unsigned int e = 0; e < it->second.size(); e++)
+			{
+				const CellEntry & entry = it->second[e];
+				const double distance = this->ComputeDistance( point, this->GetStoredPath( entry.PathId ).Vertices[entry.Index] );
+				if( distance <= bestDistance && ( !found || distance < hit.Distance ) )
+				{
+					found = true;
+					bestDistance = distance;
+					hit.PathId = entry.PathId;
+					hit.VertexIndex = entry.Index;
+					hit.Distance = distance;
+				}
+			}
+		}
+
+		/** Count the vertices of a cell in the cell bounds, or uncount them,
+		 * and update the bounds. */
+		void AddToCellBounds(const CellIndexType & cell, bool add)
+		{
+			for(unsigned int d = 0; d < SpatialDimension; d++)
+			{
+				if( add )
+				{
+					m_CellCoordinateCounts[d][ cell[d] ]++;
+					continue;
+				}
+				typename std::map<long, SizeValueType>::iterator it = m_CellCoordinateCounts[d].find( cell[d] );
+				if( it != m_CellCoordinateCounts[d].end() && --it->second == 0 )
+				{
+					m_CellCoordinateCounts[d].erase( it );
+				}
+			}
+			this->UpdateCellBounds();
+		}
+
+		void UpdateCellBounds()
+		{
+			for(unsigned int d = 0; d < SpatialDimension; d++)
+			{
+				if( m_CellCoordinateCounts[d].empty() )
+				{
+					m_MinimumCell[d] = m_MaximumCell[d] = 0;
+					continue;
+				}
+				m_MinimumCell[d] = m_CellCoordinateCounts[d].begin()->first;
+				m_MaximumCell[d] = m_CellCoordinateCounts[d].rbegin()->first;
+			}
+		}
+
+		double ComputeDistance(const VertexType & a, const VertexType & b) const
+		{
+			double squaredDistance = 0.0;
+			for(unsigned int d = 0; d < SpatialDimension; d++)
+			{
+				const double difference = ( a[d] - b[d] ) * m_Spacing[d];
+				squaredDistance += difference * difference;
+			}
+			return vcl_sqrt( squaredDistance );
+		}
+
+		/** Distance between the segments [p0, p1] and [q0, q1], from their
+		 * closest points. */
+		double ComputeSegmentDistance(const VertexType & p0, const VertexType & p1,
+																	const VertexType & q0, const VertexType & q1) const
+		{
+			double u[SpatialDimension], v[SpatialDimension], w[SpatialDimension];
+			double uu = 0.0, uv = 0.0, vv = 0.0, uw = 0.0, vw = 0.0;
+			for(unsigned int d = 0; d < SpatialDimension; d++)
+			{
+				u[d] = ( p1[d] - p0[d] ) * m_Spacing[d];
+				v[d] = ( q1[d] - q0[d] ) * m_Spacing[d];
+				w[d] = ( p0[d] - q0[d] ) * m_Spacing[d];
+				uu += u[d] * u[d];
+				uv += u[d] * v[d];
+				vv += v[d] * v[d];
+				uw += u[d] * w[d];
+				vw += v[d] * w[d];
+			}
+
+			// Parameters s along [p0, p1] and t along [q0, q1] of the closest
+			// points, clamped to the segments.
+			double s = 0.0;
+			double t = 0.0;
+			const double denominator = uu * vv - uv * uv;
+			if( uu <= 0.0 && vv <= 0.0 )
+			{
+				s = t = 0.0;
+			}
+			else if( uu <= 0.0 )
+			{
+				t = vnl_math_max( 0.0, vnl_math_min( 1.0, vw / vv ) );
+			}
+			else if( vv <= 0.0 )
+			{
+				s = vnl_math_max( 0.0, vnl_math_min( 1.0, -uw / uu ) );
+			}
+			else
+			{
+				s = denominator > 0.0 ? vnl_math_max( 0.0, vnl_math_min( 1.0, ( uv * vw - vv * uw ) / denominator ) ) : 0.0;
+				t = ( uv * s + vw ) / vv;
+				if( t < 0.0 )
+				{
+					t = 0.0;
+					s = vnl_math_max( 0.0, vnl_math_min( 1.0, -uw / uu ) );
+				}
+				else if( t > 1.0 )
+				{
+					t = 1.0;
+					s = vnl_math_max( 0.0, vnl_math_min( 1.0, ( uv - uw ) / uu ) );
+				}
+			}
+
+			double squaredDistance = 0.0;
+			for(unsigned int d = 0; d < SpatialDimension; d++)
+			{
+				const double difference = w[d] + s * u[d] - t * v[d];
+				squaredDistance += difference * difference;
+			}
+			return vcl_sqrt( squaredDistance );
+		}
+
+		void InsertPathInGrid(PathIdentifierType pathId, const StoredPath & stored)
+		{
+			const unsigned int numberOfVertices = stored.Vertices.size();
+			for(unsigned int k = 0; k < numberOfVertices; k++)
+			{
+				CellEntry entry;
+				entry.PathId = pathId;
+				entry.Index = k;
+
+				CellIndexType cell;
+				this->ComputeCellIndex( stored.Vertices[k], cell );
+				m_VertexCells[ this->ComputeCellKey( cell ) ].push_back( entry );
+				this->AddToCellBounds( cell, true );
+
+				// The segment to the next vertex, or the vertex alone for a path
+				// of one vertex.
+				if( k + 1 == numberOfVertices && numberOfVertices > 1 )
+				{
+					break;
+				}
+				const VertexType & next = stored.Vertices[ k + 1 < numberOfVertices ? k + 1 : k ];
+				CellIndexType first, last;
+				this->ComputeCellRange( stored.Vertices[k], next, 0.0, first, last );
+				cell = first;
+				do
+				{
+					m_SegmentCells[ this->ComputeCellKey( cell ) ].push_back( entry );
+				}
+				while( this->NextCell( cell, first, last ) );
+			}
+		}
+
+		void ErasePathFromGrid(PathIdentifierType pathId, const StoredPath & stored)
+		{
+			// The cells of the path are those of its vertices and segments.
+			const unsigned int numberOfVertices = stored.Vertices.size();
+			for(unsigned int k = 0; k < numberOfVertices; k++)
+			{
+				CellIndexType cell;
+				this->ComputeCellIndex( stored.Vertices[k], cell );
+				this->EraseEntries( m_VertexCells, this->ComputeCellKey( cell ), pathId );
+				this->AddToCellBounds( cell, false );
+
+				const VertexType & next = stored.Vertices[ k + 1 < numberOfVertices ? k + 1 : k ];
+				CellIndexType first, last;
+				this->ComputeCellRange( stored.Vertices[k], next, 0.0, first, last );
+				cell = first;
+				do
+				{
+					this->EraseEntries( m_SegmentCells, this->ComputeCellKey( cell ), pathId );
+				}
+				while( this->NextCell( cell, first, last ) );
+			}
+		}
+
+		static void EraseEntries(CellMapType & cells, CellKeyType key, PathIdentifierType pathId)
+		{
+			typename CellMapType::iterator it = cells.find( key );
+			if( it == cells.end() )
+			{
+				return;
+			}
+			std::vector<CellEntry> & entries = it->second;
+			SizeValueType kept = 0;
+			for(SizeValueType e = 0; e < entries.size(); e++)
+			{
+				if( entries[e].PathId != pathId )
+				{
+					entries[kept++] = entries[e];
+				}
+			}
+			entries.resize( kept );
+			if( entries.empty() )
+			{
+				cells.erase( it );
+			}
+		}
+
+		static SizeValueType GetNumberOfEntries(const CellMapType & cells)
+		{
+			SizeValueType numberOfEntries = 0;
+			for(typename CellMapType::const_iterator it = cells.begin(); it != cells.end(); ++it)
+			{
+				numberOfEntries += it->second.size();
+			}
+			return numberOfEntries;
+		}
+
+		double															m_CellSize;
+		double															m_Spacing[SpatialDimension];
+		PathMapType													m_Paths;
+		CellMapType													m_VertexCells;
+		CellMapType													m_SegmentCells;
+		PathIdentifierType									m_NextPathId;
+		SizeValueType												m_NumberOfVertices;
+		/** Bounds of the cells holding a vertex, maintained from the number
+		 * of vertices at each cell coordinate so that they shrink when paths
+		 * are removed. */
+		long																m_MinimumCell[SpatialDimension];
+		long																m_MaximumCell[SpatialDimension];
+		std::map<long, SizeValueType>				m_CellCoordinateCounts[SpatialDimension];
+	};
+
+} // end namespace itk
+
+#endif
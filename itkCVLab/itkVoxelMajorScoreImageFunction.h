@@ -0,0 +1,178 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+#ifndef __itkVoxelMajorScoreImageFunction_h
+#define __itkVoxelMajorScoreImageFunction_h
+
+#include <vector>
+
+#include <itkFunctionBase.h>
+#include <itkObjectFactory.h>
+#include <itkImageRegion.h>
+#include <itkContinuousIndex.h>
+#include <itkNumericTraits.h>
+
+namespace itk
+{
+
+	/** \class VoxelMajorScoreImageFunction
+	 * \brief Scale-space score with the scales of a voxel next to each other
+	 * in memory.
+	 *
+	 * An Image<float, N+1> puts the scale on the slowest axis: the scales of
+	 * a voxel are a whole volume apart, and reading all of them, or the
+	 * neighbours of an index along the scale axis, costs one cache miss per
+	 * scale. SetScore() copies a score into bricks of BrickSize^N voxels,
+	 * within which the scales of each voxel are contiguous:
+	 * offset = (brick * BrickSize^N + voxel in brick) * scales + scale.
+	 * With a BrickSize of 1 (the default) this is the voxel-major layout;
+	 * larger bricks, e.g. 4, also keep the spatial neighbours of a voxel on
+	 * few cache lines.
+	 *
+	 * Evaluate() reads the score at an index of the original image, so
+	 * that the function replaces the score as the speed of
+	 * FastMarchingImageFilter2 (see SetSpeedFunction()), and
+	 * EvaluateAtContinuousIndex() interpolates it linearly along all the
+	 * axes, as LinearInterpolateImageFunction does on the image.
+	 *
+	 * \author : Fethallah Benmansour
+	 */
+	template <class TScoreImage>
+	class ITK_EXPORT VoxelMajorScoreImageFunction:
+	public FunctionBase<typename TScoreImage::IndexType, double>
+	{
+	public:
+		/** Standard class typedefs. */
+		typedef VoxelMajorScoreImageFunction																Self;
+		typedef FunctionBase<typename TScoreImage::IndexType, double>				Superclass;
+		typedef SmartPointer<Self>																					Pointer;
+		typedef SmartPointer<const Self>																		ConstPointer;
+
+		/** Method for creation through the object factory. */
+		itkNewMacro(Self);
+
+		/** Run-time type information (and related methods). */
+		itkTypeMacro(VoxelMajorScoreImageFunction, FunctionBase);
+
+		/** Dimension of the score, the last axis being the scale. */
+		itkStaticConstMacro(ImageDimension, unsigned int, TScoreImage::ImageDimension);
+		itkStaticConstMacro(SpatialDimension, unsigned int, TScoreImage::ImageDimension - 1);
+
+		typedef TScoreImage																									ScoreImageType;
+		typedef typename ScoreImageType::PixelType													ScorePixelType;
+		typedef typename ScoreImageType::IndexType													IndexType;
+		typedef typename ScoreImageType::IndexValueType											IndexValueType;
+		typedef typename ScoreImageType::SizeType														SizeType;
+		typedef typename ScoreImageType::RegionType													RegionType;
+		typedef typename ScoreImageType::SpacingType												SpacingType;
+		typedef typename ScoreImageType::PointType													PointType;
+		typedef typename ScoreImageType::DirectionType											DirectionType;
+		typedef ContinuousIndex<double, ImageDimension>											ContinuousIndexType;
+
+		/** Edge, in voxels, of the spatial bricks. It is used by the next
+		 * call to SetScore(). */
+		itkSetClampMacro(BrickSize, unsigned int, 1, NumericTraits<unsigned int>::max());
+		itkGetConstMacro(BrickSize, unsigned int);
+
+		/** Copy the buffered region of a score image. The image can be
+		 * released afterwards. */
+		void SetScore(const ScoreImageType * score);
+
+		/** Score at an index of the score image. The index must be inside
+		 * the region of the score. */
+		double Evaluate(const IndexType & index) const
+		{
+			return static_cast<double>( m_Buffer[ this->ComputeOffset( index ) ] );
+		}
+
+		/** Score interpolated linearly at a continuous index inside the
+		 * region of the score. */
+		double EvaluateAtContinuousIndex(const ContinuousIndexType & index) const;
+
+		/** Index of the scale of strongest response at a spatial location;
+		 * the scale coordinate of the given index is ignored. */
+		IndexValueType GetBestScaleIndex(const IndexType & index) const;
+
+		/** The scales of a spatial location, contiguous in memory. */
+		const ScorePixelType * GetScales(const IndexType & index) const
+		{
+			IndexType spatialIndex = index;
+			spatialIndex[ImageDimension-1] = m_Region.GetIndex()[ImageDimension-1];
+			return &m_Buffer[ this->ComputeOffset( spatialIndex ) ];
+		}
+
+		/** Size in bytes of the buffer, padding of the bricks included. */
+		SizeValueType GetMemorySize() const
+		{
+			return static_cast<SizeValueType>( m_Buffer.size() * sizeof(ScorePixelType) );
+		}
+
+		/** Geometry of the score. */
+		itkGetConstReferenceMacro(Region, RegionType);
+		itkGetConstReferenceMacro(Spacing, SpacingType);
+		itkGetConstReferenceMacro(Origin, PointType);
+		itkGetConstReferenceMacro(Direction, DirectionType);
+
+		/** An image with the geometry of the score and no pixel buffer, to
+		 * stand for the score where only its geometry is used (e.g. as the
+		 * input of TubularMetricToPathFilter). */
+		typename ScoreImageType::Pointer GetScoreInformation() const;
+
+	protected:
+		VoxelMajorScoreImageFunction();
+		virtual ~VoxelMajorScoreImageFunction() {}
+		void PrintSelf(std::ostream& os, Indent indent) const;
+
+	private:
+		VoxelMajorScoreImageFunction(const Self&); //purposely not implemented
+		void operator=(const Self&); //purposely not implemented
+
+		/** Offset of an index in m_Buffer. */
+		SizeValueType ComputeOffset(const IndexType & index) const
+		{
+			SizeValueType brick = 0;
+			SizeValueType voxel = 0;
+			for(unsigned int i = 0; i < SpatialDimension; i++)
+			{
+				SizeValueType position = static_cast<SizeValueType>( index[i] - m_Region.GetIndex()[i] );
+				SizeValueType brickCoordinate = position / m_BrickSize;
+				brick += brickCoordinate * m_BrickStride[i];
+				voxel += (position - brickCoordinate * m_BrickSize) * m_VoxelStride[i];
+			}
+			return (brick * m_NumberOfVoxelsPerBrick + voxel) * m_NumberOfScales +
+				static_cast<SizeValueType>( index[ImageDimension-1] - m_Region.GetIndex()[ImageDimension-1] );
+		}
+
+		unsigned int											m_BrickSize;
+		RegionType												m_Region;
+		SpacingType												m_Spacing;
+		PointType													m_Origin;
+		DirectionType											m_Direction;
+
+		std::vector<ScorePixelType>				m_Buffer;
+		SizeValueType											m_NumberOfScales;
+		SizeValueType											m_NumberOfVoxelsPerBrick;
+		SizeValueType											m_BrickStride[SpatialDimension];
+		SizeValueType											m_VoxelStride[SpatialDimension];
+	};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkVoxelMajorScoreImageFunction.txx"
+#endif
+
+#endif
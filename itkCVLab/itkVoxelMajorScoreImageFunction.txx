@@ -0,0 +1,221 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+
+#ifndef __itkVoxelMajorScoreImageFunction_txx
+#define __itkVoxelMajorScoreImageFunction_txx
+
+#include "itkVoxelMajorScoreImageFunction.h"
+#include <vcl_cmath.h>
+#include "vnl/vnl_math.h"
+#include <omp.h>
+
+namespace itk
+{
+
+	/**
+	 * Constructor
+	 */
+	template <class TScoreImage>
+	VoxelMajorScoreImageFunction<TScoreImage>
+	::VoxelMajorScoreImageFunction()
+	{
+		m_BrickSize = 1;
+		m_Spacing.Fill( 1.0 );
+		m_Origin.Fill( 0.0 );
+		m_Direction.SetIdentity();
+		m_NumberOfScales = 0;
+		m_NumberOfVoxelsPerBrick = 0;
+		for(unsigned int i = 0; i < SpatialDimension; i++)
+		{
+			m_BrickStride[i] = 0;
+			m_VoxelStride[i] = 0;
+		}
+	}
+
+	/**
+	 * Copy the score in the voxel-major layout
+	 */
+	template <class TScoreImage>
+	void
+	VoxelMajorScoreImageFunction<TScoreImage>
+	::SetScore(const ScoreImageType * score)
+	{
+		if( !score )
+		{
+			itkExceptionMacro( << "No score image given" );
+		}
+		m_Region		= score->GetBufferedRegion();
+		m_Spacing		= score->GetSpacing();
+		m_Origin		= score->GetOrigin();
+		m_Direction	= score->GetDirection();
+		m_NumberOfScales = m_Region.GetSize()[ImageDimension-1];
+
+		SizeValueType numberOfBricks = 1;
+		SizeValueType voxelStride = 1;
+		SizeValueType numberOfBricksPerAxis[SpatialDimension];
+		for(unsigned int i = 0; i < SpatialDimension; i++)
+		{
+			numberOfBricksPerAxis[i] = (m_Region.GetSize()[i] + m_BrickSize - 1) / m_BrickSize;
+			m_BrickStride[i] = numberOfBricks;
+			m_VoxelStride[i] = voxelStride;
+			numberOfBricks *= numberOfBricksPerAxis[i];
+			voxelStride *= m_BrickSize;
+		}
+		m_NumberOfVoxelsPerBrick = voxelStride;
+		// The voxels of the bricks cut by the border are padding.
+		m_Buffer.assign( numberOfBricks * m_NumberOfVoxelsPerBrick * m_NumberOfScales, NumericTraits<ScorePixelType>::Zero );
+
+		// Destination of the first scale of each spatial voxel, the voxels
+		// being in the order of the score buffer.
+		const SizeValueType numberOfVoxels = m_NumberOfScales > 0 ? m_Region.GetNumberOfPixels() / m_NumberOfScales : 0;
+		const long numberOfVoxelsLong = static_cast<long>( numberOfVoxels );
+		std::vector<SizeValueType> destination( numberOfVoxels );
+#pragma omp parallel for schedule(static)
+		for(long v = 0; v < numberOfVoxelsLong; v++)
+		{
+			IndexType index;
+			SizeValueType remainder = static_cast<SizeValueType>( v );
+			for(unsigned int i = 0; i < SpatialDimension; i++)
+			{
+				index[i] = m_Region.GetIndex()[i] + static_cast<IndexValueType>( remainder % m_Region.GetSize()[i] );
+				remainder /= m_Region.GetSize()[i];
+			}
+			index[ImageDimension-1] = m_Region.GetIndex()[ImageDimension-1];
+			destination[v] = this->ComputeOffset( index );
+		}
+
+		// Read each scale of the score sequentially
+		const ScorePixelType * buffer = score->GetBufferPointer();
+		for(SizeValueType k = 0; k < m_NumberOfScales; k++)
+		{
+			const ScorePixelType * scale = buffer + k * numberOfVoxels;
+#pragma omp parallel for schedule(static)
+			for(long v = 0; v < numberOfVoxelsLong; v++)
+			{
+				m_Buffer[ destination[v] + k ] = scale[v];
+			}
+		}
+		this->Modified();
+	}
+
+	/**
+	 * Linear interpolation
+	 */
+	template <class TScoreImage>
+	double
+	VoxelMajorScoreImageFunction<TScoreImage>
+	::EvaluateAtContinuousIndex(const ContinuousIndexType & index) const
+	{
+		IndexType baseIndex;
+		double distance[ImageDimension];
+		for(unsigned int i = 0; i < ImageDimension; i++)
+		{
+			IndexValueType first = m_Region.GetIndex()[i];
+			IndexValueType last = first + static_cast<IndexValueType>( m_Region.GetSize()[i] ) - 1;
+			IndexValueType base = static_cast<IndexValueType>( vcl_floor( index[i] ) );
+			base = vnl_math_max( first, vnl_math_min( last, base ) );
+			baseIndex[i] = base;
+			distance[i] = vnl_math_max( 0.0, vnl_math_min( 1.0, index[i] - static_cast<double>( base ) ) );
+			if( base == last )
+			{
+				distance[i] = 0.0;
+			}
+		}
+
+		double value = 0.0;
+		const unsigned int numberOfCorners = 1 << ImageDimension;
+		for(unsigned int corner = 0; corner < numberOfCorners; corner++)
+		{
+			IndexType cornerIndex = baseIndex;
+			double weight = 1.0;
+			for(unsigned int i = 0; i < ImageDimension; i++)
+			{
+				if( corner & (1 << i) )
+				{
+					weight *= distance[i];
+					cornerIndex[i]++;
+				}
+				else
+				{
+					weight *= 1.0 - distance[i];
+				}
+			}
+			if( weight > 0.0 )
+			{
+				value += weight * this->Evaluate( cornerIndex );
+			}
+		}
+		return value;
+	}
+
+	/**
+	 * Scale of strongest response
+	 */
+	template <class TScoreImage>
+	typename VoxelMajorScoreImageFunction<TScoreImage>::IndexValueType
+	VoxelMajorScoreImageFunction<TScoreImage>
+	::GetBestScaleIndex(const IndexType & index) const
+	{
+		const ScorePixelType * scales = this->GetScales( index );
+		SizeValueType bestScale = 0;
+		for(SizeValueType k = 1; k < m_NumberOfScales; k++)
+		{
+			if( scales[k] > scales[bestScale] )
+			{
+				bestScale = k;
+			}
+		}
+		return m_Region.GetIndex()[ImageDimension-1] + static_cast<IndexValueType>( bestScale );
+	}
+
+	/**
+	 * Geometry-only image
+	 */
+	template <class TScoreImage>
+	typename TScoreImage::Pointer
+	VoxelMajorScoreImageFunction<TScoreImage>
+	::GetScoreInformation() const
+	{
+		typename ScoreImageType::Pointer information = ScoreImageType::New();
+		information->SetLargestPossibleRegion( m_Region );
+		information->SetRequestedRegion( m_Region );
+		information->SetSpacing( m_Spacing );
+		information->SetOrigin( m_Origin );
+		information->SetDirection( m_Direction );
+		return information;
+	}
+
+	/**
+	 * PrintSelf
+	 */
+	template <class TScoreImage>
+	void
+	VoxelMajorScoreImageFunction<TScoreImage>
+	::PrintSelf(std::ostream& os, Indent indent) const
+	{
+		Superclass::PrintSelf(os, indent);
+		os << indent << "BrickSize: " << m_BrickSize << std::endl;
+		os << indent << "Region: " << m_Region << std::endl;
+		os << indent << "Spacing: " << m_Spacing << std::endl;
+		os << indent << "Origin: " << m_Origin << std::endl;
+		os << indent << "Direction: " << m_Direction << std::endl;
+		os << indent << "MemorySize: " << this->GetMemorySize() << std::endl;
+	}
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,201 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+#ifndef __itkWaypointTubularMetricToPathFilter_h
+#define __itkWaypointTubularMetricToPathFilter_h
+
+#include <vector>
+
+#include "itkImageToPathFilter.h"
+#include "itkPolyLineParametricTubularPath.h"
+#include "itkTubularMetricToPathFilter.h"
+#include "itkCancellationToken.h"
+
+namespace itk
+{
+	/** \class WaypointTubularMetricToPathFilter
+	 *
+	 * This filter takes as input a tubularity measure and an ordered list of
+	 * waypoints, e.g. the points clicked along a long neurite, and produces the
+	 * minimal path going through all of them in order.
+	 *
+	 * The path is split into the segments linking consecutive waypoints, each of
+	 * which is solved by a TubularMetricToPathFilter on its own region: the bounding
+	 * box of its two waypoints padded by RegionPadding voxels in the spatial
+	 * dimensions, with all the scales. The segments are independent and are solved
+	 * concurrently, by NumberOfParallelSegments threads, then stitched in order.
+	 * A segment ends exactly at the waypoint the next one starts from, scale
+	 * included, so that the stitched path and its scale coordinate are continuous
+	 * at the joints; the waypoint is kept once.
+	 *
+	 * A cancelled segment aborts the whole path with a ProcessAborted exception,
+	 * and a failed segment with an exception telling which one failed. The
+	 * progress events give the fraction of the segments solved; they are
+	 * all sent from the thread calling Update().
+	 *
+	 * \author Fethallah Benmansour, fethallah[at]gmail.com
+	 *
+	 * \ingroup ImageToPathFilters
+	 */
+	template <class TInputImage,
+	class TOutputPath = PolyLineParametricTubularPath<TInputImage::ImageDimension> >
+	class ITK_EXPORT WaypointTubularMetricToPathFilter :
+	public ImageToPathFilter< TInputImage, TOutputPath >
+	{
+	public:
+		/** Standard class typedefs. */
+		typedef WaypointTubularMetricToPathFilter										Self;
+		typedef ImageToPathFilter<TInputImage,TOutputPath>					Superclass;
+		typedef SmartPointer<Self>																	Pointer;
+		typedef SmartPointer<const Self>														ConstPointer;
+
+		/** Run-time type information (and related methods). */
+		itkTypeMacro( WaypointTubularMetricToPathFilter, ImageToPathFilter );
+
+		/** Method for creation through the object factory. */
+		itkNewMacro(Self);
+
+		/** ImageDimension constants */
+		itkStaticConstMacro(SetDimension, unsigned int, TInputImage::ImageDimension);
+
+		/** Some image typedefs. */
+		typedef TInputImage																					InputImageType;
+		typedef typename InputImageType::ConstPointer								InputImagePointer;
+
+		/** Some path typedefs. */
+		typedef TOutputPath																					PathType;
+		typedef typename PathType::VertexType												VertexType;
+		typedef typename PathType::Pointer													PathPointer;
+
+		/** Some convenient typedefs. */
+		typedef Index< SetDimension >																IndexType;
+		typedef ImageRegion< SetDimension >													RegionType;
+		typedef Size< SetDimension >																SizeType;
+
+		/** Declare the filter solving each segment */
+		typedef TubularMetricToPathFilter< InputImageType, PathType >	SegmentFilterType;
+		typedef typename SegmentFilterType::Pointer									SegmentFilterPointer;
+		typedef typename SegmentFilterType::SpeedFunctionType				SpeedFunctionType;
+
+		/** Sets the waypoints, in the order in which the path goes through them. */
+		void SetWaypoints( const std::vector<IndexType>& waypoints )
+		{
+			m_Waypoints = waypoints;
+			this->Modified();
+		}
+		const std::vector<IndexType>& GetWaypoints() const
+		{
+			return m_Waypoints;
+		}
+
+		/** Adds a waypoint at the end of the list. */
+		void AddWaypoint( const IndexType & waypoint )
+		{
+			m_Waypoints.push_back( waypoint );
+			this->Modified();
+		}
+
+		/** Clear the list of waypoints. */
+		void ClearWaypoints()
+		{
+			if( m_Waypoints.size() > 0 )
+			{
+				m_Waypoints.clear();
+				this->Modified();
+			}
+		}
+
+		/** Get the stitched path. */
+		PathType * GetPath()
+		{
+			return this->GetOutput();
+		}
+
+		/** Number of voxels added around the bounding box of the waypoints of
+		 * a segment in the spatial dimensions. Defaults to 20. */
+		itkSetMacro(RegionPadding, unsigned int);
+		itkGetConstMacro(RegionPadding, unsigned int);
+
+		/** Maximum number of segments solved concurrently. Defaults to 0, that
+		 * is one per OpenMP thread. */
+		itkSetMacro(NumberOfParallelSegments, unsigned int);
+		itkGetConstMacro(NumberOfParallelSegments, unsigned int);
+
+		/** Settings of the segment filters (see TubularMetricToPathFilter). */
+		itkSetObjectMacro(CancellationToken, CancellationToken);
+		itkGetObjectMacro(CancellationToken, CancellationToken);
+		itkSetConstObjectMacro(SpeedFunction, SpeedFunctionType);
+		itkGetConstObjectMacro(SpeedFunction, SpeedFunctionType);
+		itkSetMacro(PathExtractionMode, int);
+		itkGetConstMacro(PathExtractionMode, int);
+		itkSetMacro(GeodesicSolver, int);
+		itkGetConstMacro(GeodesicSolver, int);
+		itkSetClampMacro(DijkstraConnectivity, unsigned int, 1, SetDimension);
+		itkGetConstMacro(DijkstraConnectivity, unsigned int);
+		itkSetMacro(UseBrickedStorage, bool);
+		itkGetConstMacro(UseBrickedStorage, bool);
+		itkBooleanMacro(UseBrickedStorage);
+
+		/** Geodesic distances of the segments of the last update, and their sum. */
+		const std::vector<double>& GetSegmentDistances() const
+		{
+			return m_SegmentDistances;
+		}
+		itkGetConstMacro(TotalDistance, double);
+
+		/** Wall-clock time of the last update, segments and stitching. */
+		itkGetConstMacro(ElapsedTime, double);
+
+	protected:
+		WaypointTubularMetricToPathFilter();
+		~WaypointTubularMetricToPathFilter() {}
+		virtual void PrintSelf(std::ostream& os, Indent indent) const;
+
+		/** Override since the filter needs all the data for the algorithm */
+		void GenerateInputRequestedRegion();
+
+		/** Implemention of algorithm */
+		void GenerateData(void);
+
+	private:
+		WaypointTubularMetricToPathFilter(const Self&); //purposely not implemented
+		void operator=(const Self&); //purposely not implemented
+
+		/** The bounding box of two waypoints, padded and cropped to the given region. */
+		RegionType ComputeSegmentRegion(const IndexType & start, const IndexType & end,
+																		const RegionType & largestRegion) const;
+
+		std::vector<IndexType>										m_Waypoints;
+		unsigned int															m_RegionPadding;
+		unsigned int															m_NumberOfParallelSegments;
+
+		CancellationToken::Pointer								m_CancellationToken;
+		typename SpeedFunctionType::ConstPointer	m_SpeedFunction;
+		int																				m_PathExtractionMode;
+		int																				m_GeodesicSolver;
+		unsigned int															m_DijkstraConnectivity;
+		bool																			m_UseBrickedStorage;
+
+		std::vector<double>												m_SegmentDistances;
+		double																		m_TotalDistance;
+		double																		m_ElapsedTime;
+	};
+
+}
+
+#include "itkWaypointTubularMetricToPathFilter.txx"
+
+#endif
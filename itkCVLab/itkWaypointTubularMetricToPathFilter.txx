@@ -0,0 +1,261 @@
+//**********************************************************
+//Copyright 2012 Fethallah Benmansour
+//
+//Licensed under the Apache License, Version 2.0 (the "License");
+//you may not use this file except in compliance with the License.
+//You may obtain a copy of the License at
+//
+//http://www.apache.org/licenses/LICENSE-2.0
+//
+//Unless required by applicable law or agreed to in writing, software
+//distributed under the License is distributed on an "AS IS" BASIS,
+//WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//See the License for the specific language governing permissions and
+//limitations under the License.
+//**********************************************************
+
+#ifndef __itkWaypointTubularMetricToPathFilter_txx
+#define __itkWaypointTubularMetricToPathFilter_txx
+
+#include <string>
+
+#include "itkWaypointTubularMetricToPathFilter.h"
+#include "itkMetricsRegistry.h"
+#include "itkTraceEventRecorder.h"
+#include "vnl/vnl_math.h"
+#include <omp.h>
+
+namespace itk
+{
+
+	template <class TInputImage, class TOutputPath>
+	WaypointTubularMetricToPathFilter<TInputImage,TOutputPath>
+	::WaypointTubularMetricToPathFilter()
+	{
+		m_RegionPadding							= 20;
+		m_NumberOfParallelSegments	= 0;
+		m_PathExtractionMode				= SegmentFilterType::CharacteristicDescent;
+		m_GeodesicSolver						= SegmentFilterType::FastMarchingSolver;
+		m_DijkstraConnectivity			= SetDimension;
+		m_UseBrickedStorage					= false;
+		m_TotalDistance							= 0.0;
+		m_ElapsedTime								= 0.0;
+	}
+
+	/**
+	 *
+	 */
+	template<class TInputImage, class TOutputPath>
+	void
+	WaypointTubularMetricToPathFilter<TInputImage,TOutputPath>
+	::PrintSelf(std::ostream& os, Indent indent) const
+	{
+		Superclass::PrintSelf(os, indent);
+		os << indent << "Waypoints:  "								<< m_Waypoints.size() << std::endl;
+		os << indent << "RegionPadding:  "						<< m_RegionPadding << std::endl;
+		os << indent << "NumberOfParallelSegments:  "	<< m_NumberOfParallelSegments << std::endl;
+		os << indent << "SpeedFunction:  "						<< m_SpeedFunction.GetPointer() << std::endl;
+		os << indent << "PathExtractionMode:  "				<< m_PathExtractionMode << std::endl;
+		os << indent << "GeodesicSolver:  "						<< m_GeodesicSolver << std::endl;
+		os << indent << "DijkstraConnectivity:  "			<< m_DijkstraConnectivity << std::endl;
+		os << indent << "UseBrickedStorage:  "				<< m_UseBrickedStorage << std::endl;
+		os << indent << "TotalDistance:  "						<< m_TotalDistance << std::endl;
+		os << indent << "ElapsedTime:  "							<< m_ElapsedTime << std::endl;
+	}
+
+	/**
+	 *
+	 */
+	template <class TInputImage, class TOutputPath>
+	void
+	WaypointTubularMetricToPathFilter<TInputImage,TOutputPath>
+	::GenerateInputRequestedRegion()
+	{
+		Superclass::GenerateInputRequestedRegion();
+		if ( this->GetInput() )
+		{
+			typename InputImageType::Pointer image =
+			const_cast< InputImageType * >( this->GetInput() );
+			image->SetRequestedRegionToLargestPossibleRegion();
+		}
+	}
+
+	/**
+	 *
+	 */
+	template <class TInputImage, class TOutputPath>
+	typename WaypointTubularMetricToPathFilter<TInputImage,TOutputPath>::RegionType
+	WaypointTubularMetricToPathFilter<TInputImage,TOutputPath>
+	::ComputeSegmentRegion(const IndexType & start, const IndexType & end,
+												 const RegionType & largestRegion) const
+	{
+		// No padding or sub-selection on the scale dimension
+		const unsigned int scaleAxis = SetDimension - 1;
+		IndexType regionStart = largestRegion.GetIndex();
+		SizeType regionSize = largestRegion.GetSize();
+		const IndexValueType padding = static_cast<IndexValueType>( m_RegionPadding );
+		for(unsigned int i = 0; i < scaleAxis; i++)
+		{
+			const IndexValueType firstIndex = largestRegion.GetIndex()[i];
+			const IndexValueType lastIndex = firstIndex + static_cast<IndexValueType>( largestRegion.GetSize()[i] ) - 1;
+			const IndexValueType minIndex = vnl_math_max( vnl_math_min( start[i], end[i] ) - padding, firstIndex );
+			const IndexValueType maxIndex = vnl_math_min( vnl_math_max( start[i], end[i] ) + padding, lastIndex );
+			regionStart[i] = minIndex;
+			regionSize[i] = static_cast<SizeValueType>( maxIndex - minIndex + 1 );
+		}
+		RegionType region;
+		region.SetIndex( regionStart );
+		region.SetSize( regionSize );
+		return region;
+	}
+
+	/**
+	 *
+	 */
+	template <class TInputImage, class TOutputPath>
+	void
+	WaypointTubularMetricToPathFilter<TInputImage,TOutputPath>
+	::GenerateData( void )
+	{
+		InputImagePointer input = static_cast<const InputImageType *>( this->GetInput() );
+
+		if ( input.IsNull() )
+		{
+			itkExceptionMacro( "Input image must be provided" );
+		}
+
+		if( m_Waypoints.size() < 2 )
+		{
+			itkExceptionMacro( "At least two waypoints must be provided" );
+		}
+
+		const RegionType largestRegion = m_SpeedFunction ? input->GetLargestPossibleRegion() : input->GetBufferedRegion();
+		for(unsigned int w = 0; w < m_Waypoints.size(); w++)
+		{
+			if( !largestRegion.IsInside( m_Waypoints[w] ) )
+			{
+				itkExceptionMacro( "The waypoint " << m_Waypoints[w] << " is outside of the input" );
+			}
+		}
+
+		TraceTimeProbe elapsedTime("waypoints", "tracing");
+		elapsedTime.Start();
+
+		// Set up the segment filters here, the threads only update them. Each
+		// one works on its own image object sharing the pixel buffer of the
+		// input, so that the pipelines do not step on each other's regions.
+		const int numberOfSegments = static_cast<int>( m_Waypoints.size() ) - 1;
+		std::vector<SegmentFilterPointer> segmentFilters( numberOfSegments );
+		for(int s = 0; s < numberOfSegments; s++)
+		{
+			typename InputImageType::Pointer segmentInput = InputImageType::New();
+			segmentInput->Graft( input );
+
+			SegmentFilterPointer segmentFilter = SegmentFilterType::New();
+			segmentFilter->SetInput( segmentInput );
+			segmentFilter->SetSpeedFunction( m_SpeedFunction );
+			segmentFilter->SetCancellationToken( m_CancellationToken );
+			segmentFilter->SetPathExtractionMode( m_PathExtractionMode );
+			segmentFilter->SetGeodesicSolver( m_GeodesicSolver );
+			segmentFilter->SetDijkstraConnectivity( m_DijkstraConnectivity );
+			segmentFilter->SetUseBrickedStorage( m_UseBrickedStorage );
+			segmentFilter->SetStartPoint( m_Waypoints[s] );
+			segmentFilter->SetPathEndPoint( m_Waypoints[s + 1] );
+			segmentFilter->SetRegionToProcess( this->ComputeSegmentRegion( m_Waypoints[s], m_Waypoints[s + 1], largestRegion ) );
+			segmentFilters[s] = segmentFilter;
+		}
+
+		int numberOfParallelSegments = omp_get_max_threads();
+		if( m_NumberOfParallelSegments > 0 )
+		{
+			numberOfParallelSegments = vnl_math_min( numberOfParallelSegments, (int)m_NumberOfParallelSegments );
+		}
+		numberOfParallelSegments = vnl_math_max( 1, vnl_math_min( numberOfParallelSegments, numberOfSegments ) );
+
+		// The exceptions can not leave the parallel loop, they are reported
+		// after it. The progress is the fraction of the segments done, sent
+		// by the calling thread only, as the observers may not be thread safe
+		// (e.g. the JNI ones).
+		std::vector<char> aborted( numberOfSegments, 0 );
+		std::vector<std::string> errors( numberOfSegments );
+		int numberOfSegmentsDone = 0;
+		this->UpdateProgress( 0.0 );
+#pragma omp parallel for schedule(dynamic) num_threads(numberOfParallelSegments)
+		for(int s = 0; s < numberOfSegments; s++)
+		{
+			TraceEventRecorder::GetInstance()->SetCurrentThreadName("Waypoint segment thread");
+			try
+			{
+				segmentFilters[s]->Update();
+			}
+			catch( ProcessAborted & )
+			{
+				aborted[s] = 1;
+			}
+			catch( ExceptionObject & e )
+			{
+				errors[s] = e.GetDescription();
+				if( errors[s].empty() )
+				{
+					errors[s] = "unknown error";
+				}
+			}
+#pragma omp atomic
+			numberOfSegmentsDone++;
+			if( omp_get_thread_num() == 0 )
+			{
+				int done;
+#pragma omp atomic read
+				done = numberOfSegmentsDone;
+				this->UpdateProgress( static_cast<float>( done ) / numberOfSegments );
+			}
+		}
+
+		for(int s = 0; s < numberOfSegments; s++)
+		{
+			if( aborted[s] )
+			{
+				ProcessAborted e(__FILE__, __LINE__);
+				e.SetDescription("Process aborted.");
+				e.SetLocation(ITK_LOCATION);
+				throw e;
+			}
+		}
+		for(int s = 0; s < numberOfSegments; s++)
+		{
+			if( !errors[s].empty() )
+			{
+				itkExceptionMacro( "The segment from " << m_Waypoints[s] << " to " << m_Waypoints[s + 1]
+													 << " failed: " << errors[s] );
+			}
+		}
+
+		// Stitch the segments. Each of them ends at the waypoint the next one
+		// starts from, which is kept once.
+		PathPointer path = PathType::New();
+		m_SegmentDistances.resize( numberOfSegments );
+		m_TotalDistance = 0.0;
+		for(int s = 0; s < numberOfSegments; s++)
+		{
+			PathPointer segmentPath = segmentFilters[s]->GetPath( 0 );
+			const typename PathType::VertexListType * vertices = segmentPath->GetVertexList();
+			for(unsigned int k = ( s == 0 ? 0 : 1 ); k < vertices->Size(); k++)
+			{
+				path->AddVertex( vertices->ElementAt( k ), segmentPath->GetVertexRadius( k ) );
+			}
+			m_SegmentDistances[s] = segmentFilters[s]->GetEndPointDistance( 0 );
+			m_TotalDistance += m_SegmentDistances[s];
+		}
+		this->ProcessObject::SetNthOutput( 0, path.GetPointer() );
+		this->UpdateProgress( 1.0 );
+
+		elapsedTime.Stop();
+		m_ElapsedTime = elapsedTime.GetTotal();
+		MetricsRegistry * metrics = MetricsRegistry::GetInstance();
+		metrics->AddTime("tracing.waypoints", m_ElapsedTime);
+		metrics->Increment("tracing.waypointSegments", numberOfSegments);
+	}
+
+}
+
+#endif